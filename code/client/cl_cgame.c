@@ -955,6 +955,8 @@ Should only by called by CL_StartHunkUsers
 void CL_InitCGame( void ) {
 	const char          *info;
 	const char          *mapname;
+	const char          *label;
+	char                hunkReportName[MAX_QPATH];
 	int t1, t2;
 	vmInterpret_t interpret;
 
@@ -968,6 +970,11 @@ void CL_InitCGame( void ) {
 	mapname = Info_ValueForKey( info, "mapname" );
 	Com_sprintf( cl.mapname, sizeof( cl.mapname ), "maps/%s.bsp", mapname );
 
+	// keeps going if the local server started the trace
+	Com_BeginLoadTrace( mapname );
+
+	label = Hunk_SetLabel( "cgame" );
+
 	// load the dll or bytecode
 	interpret = Cvar_VariableValue("vm_cgame");
 	if(cl_connectedToPureServer)
@@ -1014,6 +1021,17 @@ void CL_InitCGame( void ) {
 
 	// Ridah, update the memory usage file
 	CL_UpdateLevelHunkUsage();
+
+	// write out what the load read for the next prefetch
+	FS_EndLevelLoad();
+
+	Com_EndLoadTrace( "CL_InitCGame" );
+
+	Hunk_SetLabel( label );
+
+	// the info string buffers have been reused since
+	COM_StripExtension( COM_SkipPath( cl.mapname ), hunkReportName, sizeof( hunkReportName ) );
+	Hunk_WriteReport( hunkReportName );
 }
 
 
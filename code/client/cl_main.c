@@ -3345,6 +3345,19 @@ int CL_ScaledMilliseconds( void ) {
 	return Sys_Milliseconds() * com_timescale->value;
 }
 
+/*
+============
+CL_RefMalloc
+
+Renderer blocks are tagged for zonelog
+============
+*/
+static void *CL_RefMalloc( int size ) {
+	void *buf = Z_TagMalloc( size, TAG_RENDERER );
+	Com_Memset( buf, 0, size );
+	return buf;
+}
+
 /*
 ============
 CL_InitRef
@@ -3396,7 +3409,7 @@ void CL_InitRef( void ) {
 	ri.Error = Com_Error;
 	ri.Milliseconds = CL_ScaledMilliseconds;
 
-	ri.Z_Malloc = Z_Malloc;
+	ri.Z_Malloc = CL_RefMalloc;
 	ri.Free = Z_Free;
 	ri.Hunk_Clear = Hunk_ClearToMark;
 #ifdef HUNK_DEBUG
@@ -3405,6 +3418,7 @@ void CL_InitRef( void ) {
 	ri.Hunk_Alloc = Hunk_Alloc;
 #endif
 	ri.Hunk_AllocateTempMemory = Hunk_AllocateTempMemory;
+	ri.Hunk_SetLabel = Hunk_SetLabel;
 	ri.Hunk_FreeTempMemory = Hunk_FreeTempMemory;
 
 	ri.CM_ClusterPVS = CM_ClusterPVS;
@@ -3415,6 +3429,7 @@ void CL_InitRef( void ) {
 	ri.FS_FreeFileList = FS_FreeFileList;
 	ri.FS_ListFiles = FS_ListFiles;
 	ri.FS_FileIsInPAK = FS_FileIsInPAK;
+	ri.FS_FilePakChecksum = FS_FilePakChecksum;
 	ri.FS_FileExists = FS_FileExists;
 	ri.Cvar_Get = Cvar_Get;
 	ri.Cvar_Set = Cvar_Set;
@@ -3441,6 +3456,14 @@ void CL_InitRef( void ) {
 	ri.Sys_GLimpInit = Sys_GLimpInit;
 	ri.Sys_LowPhysicalMemory = Sys_LowPhysicalMemory;
 
+	ri.AddJob = Com_AddJob;
+	ri.WaitJobs = Com_WaitJobs;
+	ri.JobThreads = Com_JobThreads;
+	ri.TraceStart = Com_TraceStart;
+	ri.TraceEvent = Com_TraceEvent;
+	ri.BenchArgs = Com_BenchArgs;
+	ri.Benchmark = Com_Benchmark;
+
 	ret = GetRefAPI( REF_API_VERSION, &ri );
 
 	if ( !ret ) {
@@ -1154,8 +1154,11 @@ CL_InitUI
 */
 
 void CL_InitUI( void ) {
+	const char *label;
 	int v;
 
+	label = Hunk_SetLabel( "ui" );
+
 	// load the dll or bytecode
 	uivm = VM_Create( "ui", CL_UISystemCalls, Cvar_VariableValue("vm_ui") );
 	if ( !uivm ) {
@@ -1171,6 +1174,8 @@ void CL_InitUI( void ) {
 
 	// init for this gamestate
 	VM_Call( uivm, UI_INIT, ( clc.state >= CA_AUTHORIZING && clc.state < CA_ACTIVE ) );
+
+	Hunk_SetLabel( label );
 }
 
 
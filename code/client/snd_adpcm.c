@@ -292,7 +292,7 @@ void S_AdpcmEncodeSound( sfx_t *sfx, short *samples ) {
 	int				inOffset;
 	int				count;
 	int				n;
-	sndBuffer		*newchunk, *chunk;
+	sndBuffer		*chunk;
 	byte			*out;
 
 	inOffset = 0;
@@ -307,13 +307,8 @@ void S_AdpcmEncodeSound( sfx_t *sfx, short *samples ) {
 			n = SND_CHUNK_SIZE_BYTE*2;
 		}
 
-		newchunk = SND_malloc();
-		if (sfx->soundData == NULL) {
-			sfx->soundData = newchunk;
-		} else if (chunk != NULL) {
-			chunk->next = newchunk;
-		}
-		chunk = newchunk;
+		// the chunks were taken by S_AllocSound
+		chunk = chunk ? chunk->next : sfx->soundData;
 
 		// output the header
 		chunk->adpcm.index  = state.index;
@@ -26,6 +26,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 
 static snd_codec_t *codecs;
 
+// streams read pak data in blocks this big, so the codecs' small reads
+// don't each go through the zip layer
+#define CODEC_READAHEAD_SIZE	0x10000
+
 /*
 =================
 S_CodecGetSound
@@ -221,6 +225,10 @@ snd_stream_t *S_CodecUtilOpen(const char *filename, snd_codec_t *codec)
 	stream->codec = codec;
 	stream->file = hnd;
 	stream->length = length;
+
+	stream->readAheadSize = (length < CODEC_READAHEAD_SIZE) ? length : CODEC_READAHEAD_SIZE;
+	if(stream->readAheadSize > 0)
+		stream->readAhead = Z_Malloc(stream->readAheadSize);
 	return stream;
 }
 
@@ -232,6 +240,114 @@ S_CodecUtilClose
 void S_CodecUtilClose(snd_stream_t **stream)
 {
 	FS_FCloseFile((*stream)->file);
+	if((*stream)->readAhead)
+		Z_Free((*stream)->readAhead);
 	Z_Free(*stream);
 	*stream = NULL;
 }
+
+/*
+=================
+S_CodecUtilRead
+
+Reads through the read-ahead block, requests bigger than the block go
+straight to the file
+=================
+*/
+int S_CodecUtilRead(snd_stream_t *stream, void *buffer, int bytes)
+{
+	byte *out = buffer;
+	int total = 0;
+	int n;
+
+	if(!stream->readAhead)
+		return FS_Read(buffer, bytes, stream->file);
+
+	while(bytes > 0)
+	{
+		if(stream->readAheadPos >= stream->readAheadLen)
+		{
+			if(bytes >= stream->readAheadSize)
+			{
+				// the block no longer ends at the file position
+				stream->readAheadPos = stream->readAheadLen = 0;
+				n = FS_Read(out, bytes, stream->file);
+				if(n > 0)
+					total += n;
+				break;
+			}
+
+			stream->readAheadPos = 0;
+			stream->readAheadLen = FS_Read(stream->readAhead, stream->readAheadSize, stream->file);
+			if(stream->readAheadLen <= 0)
+			{
+				stream->readAheadLen = 0;
+				break;
+			}
+		}
+
+		n = stream->readAheadLen - stream->readAheadPos;
+		if(n > bytes)
+			n = bytes;
+		Com_Memcpy(out, stream->readAhead + stream->readAheadPos, n);
+		stream->readAheadPos += n;
+		out += n;
+		bytes -= n;
+		total += n;
+	}
+
+	return total;
+}
+
+/*
+=================
+S_CodecUtilTell
+=================
+*/
+int S_CodecUtilTell(snd_stream_t *stream)
+{
+	return FS_FTell(stream->file) - (stream->readAheadLen - stream->readAheadPos);
+}
+
+/*
+=================
+S_CodecUtilSeek
+
+Seeks inside the read-ahead block when possible, and never seeks the
+file backwards to move forwards, which would re-inflate a pak file
+from its start
+=================
+*/
+int S_CodecUtilSeek(snd_stream_t *stream, long offset, int origin)
+{
+	int target, fileOfs;
+
+	if(!stream->readAhead)
+		return FS_Seek(stream->file, offset, origin);
+
+	switch(origin)
+	{
+		case FS_SEEK_CUR:
+			target = S_CodecUtilTell(stream) + offset;
+			break;
+		case FS_SEEK_END:
+			target = stream->length + offset;
+			break;
+		case FS_SEEK_SET:
+		default:
+			target = offset;
+			break;
+	}
+
+	fileOfs = FS_FTell(stream->file);
+	if(target >= fileOfs - stream->readAheadLen && target <= fileOfs)
+	{
+		stream->readAheadPos = stream->readAheadLen - (fileOfs - target);
+		return 0;
+	}
+
+	stream->readAheadPos = stream->readAheadLen = 0;
+	if(target > fileOfs)
+		return FS_Seek(stream->file, target - fileOfs, FS_SEEK_CUR);
+	return FS_Seek(stream->file, target, FS_SEEK_SET);
+}
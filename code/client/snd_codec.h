@@ -47,6 +47,10 @@ typedef struct snd_stream_s
 	int length;
 	int pos;
 	void *ptr;
+	byte *readAhead;		// file data read in large blocks, see S_CodecUtilRead
+	int readAheadSize;
+	int readAheadPos;
+	int readAheadLen;
 } snd_stream_t;
 
 // Codec functions
@@ -78,6 +82,22 @@ int S_CodecReadStream(snd_stream_t *stream, int bytes, void *buffer);
 // Util functions (used by codecs)
 snd_stream_t *S_CodecUtilOpen(const char *filename, snd_codec_t *codec);
 void S_CodecUtilClose(snd_stream_t **stream);
+int S_CodecUtilRead(snd_stream_t *stream, void *buffer, int bytes);
+int S_CodecUtilSeek(snd_stream_t *stream, long offset, int origin);
+int S_CodecUtilTell(snd_stream_t *stream);
+
+// Decode-ahead streams (snd_stream.c), one per raw stream, 0 is the music
+void S_StreamInit( void );
+void S_StreamShutdown( void );
+qboolean S_StreamOpen( int slot, const char *filename, const char *loop, snd_info_t *info );
+void S_StreamClose( int slot );
+qboolean S_StreamActive( int slot );
+qboolean S_StreamFinished( int slot );
+int S_StreamAvailable( int slot, snd_info_t *info );
+int S_StreamRead( int slot, void *buffer, int bytes );
+void S_StreamUnderrun( int slot );
+void S_StreamUpdate( void );
+void S_StreamInfo_f( void );
 
 // WAV Codec
 extern snd_codec_t wav_codec;
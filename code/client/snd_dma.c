@@ -33,11 +33,15 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #include "snd_codec.h"
 #include "client.h"
 
+#ifdef __vita__
+#include <vitasdk.h>
+#endif
+
 void S_Update_( void );
 void S_Base_StopAllSounds(void);
 void S_Base_StopBackgroundTrack( void );
+static void S_UpdateStreamingSounds( void );
 
-snd_stream_t	*s_backgroundStream = NULL;
 static char		s_backgroundLoop[MAX_QPATH];
 //static char		s_backgroundMusic[MAX_QPATH]; //TTimo: unused
 
@@ -89,6 +93,12 @@ cvar_t		*s_mixahead;
 cvar_t		*s_mixPreStep;
 cvar_t      *s_mute;        // (SA) for DM so he can 'toggle' sound on/off without disturbing volume levels
 cvar_t      *s_wavonly;
+cvar_t		*s_maxVoices;
+cvar_t		*s_voiceCullVolume;
+
+// voices painted and left virtual by the last mix
+static int		s_mixedVoices;
+static int		s_virtualVoices;
 
 static loopSound_t		loopSounds[MAX_GENTITIES];
 static	channel_t		*freelist = NULL;
@@ -97,6 +107,124 @@ int	s_rawend[MAX_RAW_STREAMS];
 int	s_rawpainted[MAX_RAW_STREAMS];
 portable_samplepair_t	s_rawsamples[MAX_RAW_STREAMS][MAX_RAW_SAMPLES];
 
+/*
+===============================================================================
+
+MIXER THREAD
+
+With s_mixThread the mixing runs on its own thread, paced by the device
+through SNDDMA_Wait instead of by Com_Frame, so sound keeps going through
+hitches and level loads.  The mixer owns the channels, loop sounds and the
+listener: the game side calls are turned into commands in a single
+producer, single consumer queue.  Commands of a frame are only published
+in S_Update, so the mixer never sees half of a ClearLoopingSounds /
+AddLoopingSound / Respatialize sequence.  s_mixLock covers what both
+sides really touch, sfx memory and the raw sample streams.
+
+===============================================================================
+*/
+
+typedef enum {
+	SNDCMD_START_SOUND,
+	SNDCMD_ADD_LOOP,
+	SNDCMD_ADD_REAL_LOOP,
+	SNDCMD_STOP_LOOP,
+	SNDCMD_CLEAR_LOOPS,
+	SNDCMD_RESPATIALIZE,
+	SNDCMD_ENTITY_POSITION,
+	SNDCMD_CLEAR_BUFFER
+} sndCommandType_t;
+
+typedef struct {
+	sndCommandType_t type;
+	int entityNum;
+	int entchannel;             // killall for CLEAR_LOOPS, inwater for RESPATIALIZE
+	sfxHandle_t sfx;
+	int flags;
+	int range;
+	int volume;
+	int framecount;             // cls.framecount the loop was added in
+	qboolean localSound;
+	qboolean hasOrigin;
+	vec3_t origin;
+	vec3_t vec[3];              // velocity, or the listener axis
+} sndCommand_t;
+
+#define MAX_SND_COMMANDS    2048    // must be a power of two
+
+static sndCommand_t s_commands[MAX_SND_COMMANDS];
+static int s_commandWrite;                  // game side only
+static volatile int s_commandPublished;     // written by the game side
+static volatile int s_commandRead;          // written by the mixer
+
+static qboolean s_mixCommands;              // calls go through the queue
+static qboolean s_mixThreadRunning;
+
+cvar_t		*s_mixThread;
+
+#ifdef __vita__
+static SceKernelLwMutexWork s_mixLock;
+static SceUID s_mixThreadId;
+static volatile qboolean s_mixThreadQuit;
+
+#define S_MixLock()     sceKernelLockLwMutex( &s_mixLock, 1, NULL )
+#define S_MixUnlock()   sceKernelUnlockLwMutex( &s_mixLock, 1 )
+#else
+#define S_MixLock()
+#define S_MixUnlock()
+#endif
+
+void S_LockMixer( void ) {
+	S_MixLock();
+}
+
+void S_UnlockMixer( void ) {
+	S_MixUnlock();
+}
+
+/*
+=================
+S_PublishCommands
+
+Makes everything queued so far visible to the mixer
+=================
+*/
+static void S_PublishCommands( void ) {
+	__sync_synchronize();
+	s_commandPublished = s_commandWrite;
+}
+
+/*
+=================
+S_AllocCommand
+
+Returns the next free command slot, the command is queued
+once the caller filled it in and the frame is published
+=================
+*/
+static void S_MixFrame( void );
+
+static sndCommand_t *S_AllocCommand( sndCommandType_t type ) {
+	sndCommand_t *cmd;
+
+	if ( s_commandWrite - s_commandRead >= MAX_SND_COMMANDS ) {
+		// the mixer fell behind, hand it what we have and wait
+		S_PublishCommands();
+		while ( s_commandWrite - s_commandRead >= MAX_SND_COMMANDS ) {
+			if ( s_mixThreadRunning ) {
+				Sys_Sleep( 1 );
+			} else {
+				S_MixFrame();
+			}
+		}
+	}
+
+	cmd = &s_commands[s_commandWrite & ( MAX_SND_COMMANDS - 1 )];
+	cmd->type = type;
+	s_commandWrite++;
+	return cmd;
+}
+
 
 // ====================================================================
 // User-setable variables
@@ -114,7 +242,12 @@ void S_Base_SoundInfo(void) {
 		Com_Printf("%5d submission_chunk\n", dma.submission_chunk);
 		Com_Printf("%5d speed\n", dma.speed);
 		Com_Printf("%p dma buffer\n", dma.buffer);
-		if ( s_backgroundStream ) {
+		Com_Printf("mixing %s\n", s_mixThreadRunning ? "on the mixer thread" : "in the main loop");
+		if ( s_mixCommands ) {
+			Com_Printf("%5d commands queued\n", s_commandWrite - s_commandRead);
+		}
+		Com_Printf("%5d voices mixed, %d virtual (s_maxVoices %d)\n", s_mixedVoices, s_virtualVoices, s_maxVoices->integer);
+		if ( S_StreamActive( 0 ) ) {
 			Com_Printf("Background file: %s\n", s_backgroundLoop );
 		} else {
 			Com_Printf("No background file.\n" );
@@ -264,7 +397,7 @@ S_FindName
 Will allocate a new sfx if it isn't found
 ==================
 */
-static sfx_t *S_FindName( const char *name ) {
+sfx_t *S_FindName( const char *name ) {
 	int		i;
 	int		hash;
 
@@ -350,6 +483,8 @@ are no longer valid.
 void S_Base_DisableSounds( void ) {
 	S_Base_StopAllSounds();
 	s_soundMuted = qtrue;
+
+	S_WriteSoundManifest();
 }
 
 /*
@@ -413,6 +548,8 @@ S_BeginRegistration
 */
 void S_Base_BeginRegistration( void ) {
 	sfx_t   *sfx;
+	const char	*info;
+
 	s_soundMuted = qfalse;		// we can play again
 
 	if (s_numSfx == 0) {
@@ -426,15 +563,30 @@ void S_Base_BeginRegistration( void ) {
 		S_DefaultSound( sfx );
 //		S_Base_RegisterSound("sound/misc/menu2.wav", qfalse);		// changed to a sound in main
 	}
+
+	// load what the level used last time before the cgame asks for it,
+	// the gamestate is already there when the hunk users restart
+	info = cl.gameState.stringData + cl.gameState.stringOffsets[ CS_SERVERINFO ];
+	S_PreloadSounds( Info_ValueForKey( info, "mapname" ) );
 }
 
 void S_memoryLoad(sfx_t	*sfx) {
-	// load the sound file
+	const char *label;
+	int traceStart;
+
+	// load the sound file, S_LoadSound only keeps the mixer out
+	// while it takes chunks and publishes the sound
+	traceStart = Com_TraceStart();
+	label = Hunk_SetLabel( "sound" );
 	if ( !S_LoadSound ( sfx ) ) {
 //		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't load sound: %s\n", sfx->soundName );
+		S_MixLock();
 		sfx->defaultSound = qtrue;
+		sfx->inMemory = qtrue;
+		S_MixUnlock();
 	}
-	sfx->inMemory = qtrue;
+	Hunk_SetLabel( label );
+	Com_TraceEvent( traceStart, "decode", sfx->soundName, sfx->soundLength * sizeof( short ), NULL );
 }
 
 //=============================================================================
@@ -504,6 +656,261 @@ void S_SpatializeOrigin (vec3_t origin, int master_vol, int *left_vol, int *righ
 		*left_vol = 0;
 }
 
+/*
+===============================================================================
+
+BATCHED SPATIALIZATION
+
+Respatialize runs S_SpatializeOrigin for every playing channel and every
+active loop sound each frame.  The sounds are gathered into a structure
+of arrays instead and spatialized four at a time, with the reciprocal
+square root and reciprocal estimates in place of the divides.  The
+results match S_SpatializeOrigin to within one volume step, see
+s_spatialbench.
+
+===============================================================================
+*/
+
+#define	SPATIAL_BATCH_SIZE	MAX_GENTITIES		// loop sounds are the most ever gathered
+
+typedef struct {
+	int		count;
+	float	x[SPATIAL_BATCH_SIZE];
+	float	y[SPATIAL_BATCH_SIZE];
+	float	z[SPATIAL_BATCH_SIZE];
+	float	range[SPATIAL_BATCH_SIZE];
+	float	master[SPATIAL_BATCH_SIZE];
+	int		left[SPATIAL_BATCH_SIZE];
+	int		right[SPATIAL_BATCH_SIZE];
+	int		index[SPATIAL_BATCH_SIZE];	// channel or entity the sound came from
+} spatialBatch_t;
+
+static spatialBatch_t	s_spatial;
+
+static void S_SpatialAdd( spatialBatch_t *b, const vec3_t origin, int master_vol, float range, int index ) {
+	int		n;
+
+	n = b->count++;
+	b->x[n] = origin[0];
+	b->y[n] = origin[1];
+	b->z[n] = origin[2];
+	b->range[n] = range;
+	b->master[n] = master_vol;
+	b->index[n] = index;
+}
+
+// pads the batch to a multiple of four with silent sounds
+static void S_SpatialPad( spatialBatch_t *b ) {
+	int		n;
+
+	for ( n = b->count ; n & 3 ; n++ ) {
+		b->x[n] = b->y[n] = b->z[n] = 0;
+		b->range[n] = 1;
+		b->master[n] = 0;
+	}
+}
+
+static void S_SpatializeBatch_scalar( spatialBatch_t *b ) {
+	vec3_t	origin;
+	int		i;
+
+	for ( i = 0 ; i < b->count ; i++ ) {
+		VectorSet( origin, b->x[i], b->y[i], b->z[i] );
+		S_SpatializeOrigin( origin, b->master[i], &b->left[i], &b->right[i], b->range[i] );
+	}
+}
+
+#ifdef __vita__
+#include <arm_neon.h>
+
+static void S_SpatializeBatch_neon( spatialBatch_t *b ) {
+	float32x4_t	ox, oy, oz, ax, ay, az;
+	float32x4_t	dx, dy, dz, lenSq, invLen, invRange, range, dist, dot, atten, lscale, rscale;
+	float32x4_t	zero, half, one;
+	int32x4_t	izero;
+	int			i;
+
+	ox = vdupq_n_f32( listener_origin[0] );
+	oy = vdupq_n_f32( listener_origin[1] );
+	oz = vdupq_n_f32( listener_origin[2] );
+	// the pan is minus the y of the rotated vector, negate the axis once
+	ax = vdupq_n_f32( -listener_axis[1][0] );
+	ay = vdupq_n_f32( -listener_axis[1][1] );
+	az = vdupq_n_f32( -listener_axis[1][2] );
+	zero = vdupq_n_f32( 0 );
+	half = vdupq_n_f32( 0.5f );
+	one = vdupq_n_f32( 1.0f );
+	izero = vdupq_n_s32( 0 );
+
+	for ( i = 0 ; i < b->count ; i += 4 ) {
+		dx = vsubq_f32( vld1q_f32( b->x + i ), ox );
+		dy = vsubq_f32( vld1q_f32( b->y + i ), oy );
+		dz = vsubq_f32( vld1q_f32( b->z + i ), oz );
+
+		// a sound right on the listener has no length and no pan
+		lenSq = vmlaq_f32( vmlaq_f32( vmulq_f32( dx, dx ), dy, dy ), dz, dz );
+		lenSq = vmaxq_f32( lenSq, vdupq_n_f32( 1e-12f ) );
+		invLen = vrsqrteq_f32( lenSq );
+		invLen = vmulq_f32( invLen, vrsqrtsq_f32( vmulq_f32( lenSq, invLen ), invLen ) );
+		invLen = vmulq_f32( invLen, vrsqrtsq_f32( vmulq_f32( lenSq, invLen ), invLen ) );
+
+		range = vld1q_f32( b->range + i );
+		invRange = vrecpeq_f32( range );
+		invRange = vmulq_f32( invRange, vrecpsq_f32( range, invRange ) );
+		invRange = vmulq_f32( invRange, vrecpsq_f32( range, invRange ) );
+
+		dist = vmlsq_n_f32( vmulq_f32( lenSq, invLen ), range, 0.064f );
+		dist = vmulq_f32( vmaxq_f32( dist, zero ), invRange );
+
+		atten = vmulq_f32( vld1q_f32( b->master + i ), vsubq_f32( one, dist ) );
+		if ( dma.channels == 1 ) {
+			lscale = rscale = atten;
+		} else {
+			dot = vmulq_f32( vmlaq_f32( vmlaq_f32( vmulq_f32( dx, ax ), dy, ay ), dz, az ), invLen );
+			rscale = vmulq_f32( atten, vmaxq_f32( vmlaq_f32( half, half, dot ), zero ) );
+			lscale = vmulq_f32( atten, vmaxq_f32( vmlsq_f32( half, half, dot ), zero ) );
+		}
+
+		vst1q_s32( b->left + i, vmaxq_s32( vcvtq_s32_f32( lscale ), izero ) );
+		vst1q_s32( b->right + i, vmaxq_s32( vcvtq_s32_f32( rscale ), izero ) );
+	}
+}
+#define S_SpatializeBatch_simd S_SpatializeBatch_neon
+#else
+// without NEON each GCC vector lane is one sound of the batch, the clamps
+// become compare masks and the inverse length is a per lane sqrt
+typedef float spatialVec4_t __attribute__ ( ( vector_size( 16 ) ) );
+typedef int spatialIVec4_t __attribute__ ( ( vector_size( 16 ) ) );
+
+static void S_SpatializeBatch_vec( spatialBatch_t *b ) {
+	spatialVec4_t	dx, dy, dz, lenSq, invLen, dist, dot, atten, lscale, rscale;
+	spatialIVec4_t	l, r;
+	int				i, j;
+
+	for ( i = 0 ; i < b->count ; i += 4 ) {
+		memcpy( &dx, b->x + i, sizeof( dx ) );
+		memcpy( &dy, b->y + i, sizeof( dy ) );
+		memcpy( &dz, b->z + i, sizeof( dz ) );
+		dx -= listener_origin[0];
+		dy -= listener_origin[1];
+		dz -= listener_origin[2];
+
+		lenSq = dx * dx + dy * dy + dz * dz;
+		for ( j = 0 ; j < 4 ; j++ ) {
+			invLen[j] = lenSq[j] > 1e-12f ? 1.0f / sqrt( lenSq[j] ) : 1e6f;
+		}
+
+		memcpy( &atten, b->range + i, sizeof( atten ) );
+		dist = lenSq * invLen - atten * 0.064f;
+		dist = (spatialVec4_t)( (spatialIVec4_t)dist & ( dist > 0 ) ) / atten;
+
+		memcpy( &atten, b->master + i, sizeof( atten ) );
+		atten *= 1.0f - dist;
+		if ( dma.channels == 1 ) {
+			lscale = rscale = atten;
+		} else {
+			dot = -( dx * listener_axis[1][0] + dy * listener_axis[1][1] + dz * listener_axis[1][2] ) * invLen;
+			rscale = 0.5f + 0.5f * dot;
+			lscale = 0.5f - 0.5f * dot;
+			rscale = atten * (spatialVec4_t)( (spatialIVec4_t)rscale & ( rscale > 0 ) );
+			lscale = atten * (spatialVec4_t)( (spatialIVec4_t)lscale & ( lscale > 0 ) );
+		}
+
+		l = __builtin_convertvector( lscale, spatialIVec4_t );
+		r = __builtin_convertvector( rscale, spatialIVec4_t );
+		l &= l > 0;
+		r &= r > 0;
+		memcpy( b->left + i, &l, sizeof( l ) );
+		memcpy( b->right + i, &r, sizeof( r ) );
+	}
+}
+#define S_SpatializeBatch_simd S_SpatializeBatch_vec
+#endif
+
+static void S_SpatializeBatch( spatialBatch_t *b ) {
+	S_SpatialPad( b );
+	S_SpatializeBatch_simd( b );
+}
+
+static void S_SpatialBenchScalar( benchmark_t *b ) {
+	S_SpatializeBatch_scalar( b->data );
+}
+
+static void S_SpatialBenchSimd( benchmark_t *b ) {
+	S_SpatializeBatch( b->data );
+}
+
+static float S_SpatialBenchCompare( benchmark_t *b ) {
+	spatialBatch_t	*batch = b->data;
+	vec3_t			origin;
+	int				i, left, right, maxError;
+
+	maxError = 0;
+	for ( i = 0; i < batch->count; i++ ) {
+		VectorSet( origin, batch->x[i], batch->y[i], batch->z[i] );
+		S_SpatializeOrigin( origin, batch->master[i], &left, &right, batch->range[i] );
+		maxError = MAX( maxError, abs( batch->left[i] - left ) );
+		maxError = MAX( maxError, abs( batch->right[i] - right ) );
+	}
+	return maxError;
+}
+
+/*
+=================
+S_SpatialBench_f
+
+s_spatialbench [sounds] [msec]
+Spatializes sounds scattered around a turned listener, half of them with
+a custom range and the first one on the listener itself
+=================
+*/
+static void S_SpatialBench_f( void ) {
+	vec3_t		oldOrigin, oldAxis[3], angles, origin;
+	benchmark_t	b;
+	int			numSounds;
+	int			i;
+
+	Com_Memset( &b, 0, sizeof( b ) );
+	if ( !Com_BenchArgs( "sound", 256, SPATIAL_BATCH_SIZE - 4, &numSounds, &b.msec ) ) {
+		return;
+	}
+
+	// the mixer thread spatializes with the same listener and batch
+	S_LockMixer();
+
+	VectorCopy( listener_origin, oldOrigin );
+	AxisCopy( listener_axis, oldAxis );
+	VectorSet( listener_origin, 512, -256, 64 );
+	VectorSet( angles, 10, 35, 0 );
+	AnglesToAxis( angles, listener_axis );
+
+	s_spatial.count = 0;
+	for ( i = 0; i < numSounds; i++ ) {
+		origin[0] = listener_origin[0] + ( rand() % 4001 ) - 2000;
+		origin[1] = listener_origin[1] + ( rand() % 4001 ) - 2000;
+		origin[2] = listener_origin[2] + ( rand() % 1001 ) - 500;
+		if ( i == 0 ) {
+			VectorCopy( listener_origin, origin );
+		}
+		S_SpatialAdd( &s_spatial, origin, rand() & 255, ( i & 1 ) ? SOUND_RANGE_DEFAULT : 400 + ( rand() % 2000 ), i );
+	}
+
+	b.name = va( "%i sounds", numSounds );
+	b.unit = "sound";
+	b.units = numSounds;
+	b.scalar = S_SpatialBenchScalar;
+	b.simd = S_SpatialBenchSimd;
+	b.compare = S_SpatialBenchCompare;
+	b.data = &s_spatial;
+	Com_Benchmark( &b );
+
+	VectorCopy( oldOrigin, listener_origin );
+	AxisCopy( oldAxis, listener_axis );
+	s_spatial.count = 0;
+
+	S_UnlockMixer();
+}
+
 // =======================================================================
 // Start a sound effect
 // =======================================================================
@@ -602,14 +1009,12 @@ void S_Base_StartSoundEx( vec3_t origin, int entityNum, int entchannel, sfxHandl
 
 /*
 ====================
-S_Base_MainStartSound
+S_Base_MixStartSound
 
-Validates the parms and ques the sound up
-if origin is NULL, the sound will be dynamically sourced from the entity
-Entchannel 0 will never override a playing sound
+Picks a channel for an already validated sound, runs on the mixer
 ====================
 */
-static void S_Base_MainStartSound( vec3_t origin, int entityNum, int entchannel, sfxHandle_t sfxHandle, qboolean localSound, int flags ) {
+static void S_Base_MixStartSound( vec3_t origin, int entityNum, int entchannel, sfxHandle_t sfxHandle, qboolean localSound, int flags ) {
 	channel_t	*ch;
 	sfx_t		*sfx;
 	int		i, oldest, chosen, time;
@@ -620,25 +1025,8 @@ static void S_Base_MainStartSound( vec3_t origin, int entityNum, int entchannel,
 		return;
 	}
 
-	if ( !origin && ( entityNum < 0 || entityNum >= MAX_GENTITIES ) ) {
-		Com_Error( ERR_DROP, "S_StartSound: bad entitynum %i", entityNum );
-	}
-
-	if ( sfxHandle < 0 || sfxHandle >= s_numSfx ) {
-		Com_Printf( S_COLOR_YELLOW "S_StartSound: handle %i out of range\n", sfxHandle );
-		return;
-	}
-
 	sfx = &s_knownSfx[ sfxHandle ];
 
-	if (sfx->inMemory == qfalse) {
-		S_memoryLoad(sfx);
-	}
-
-	if ( s_show->integer == 1 ) {
-		Com_Printf( "%i : %s\n", s_paintedtime, sfx->soundName );
-	}
-
 	time = Com_Milliseconds();
 
 //	Com_Printf("playing %s\n", sfx->soundName);
@@ -673,12 +1061,13 @@ static void S_Base_MainStartSound( vec3_t origin, int entityNum, int entchannel,
 	}
 
 	sfx->lastTimeUsed = time;
+	S_TouchSound( sfx );
 
 	// check for a streaming sound that this entity is playing in this channel
 	// kill it if it exists
 	if ( entityNum >= 0 ) {
 		for ( i = 1; i < MAX_RAW_STREAMS; i++ ) {    // track 0 is music/cinematics
-			if ( !streamingSounds[i].file ) {
+			if ( !streamingSounds[i].active ) {
 				continue;
 			}
 			// check to see if this character currently has another sound streaming on the same channel
@@ -816,6 +1205,59 @@ static void S_Base_MainStartSound( vec3_t origin, int entityNum, int entchannel,
 	ch->threadReady = qtrue;
 }
 
+/*
+====================
+S_Base_MainStartSound
+
+Validates the parms and ques the sound up
+if origin is NULL, the sound will be dynamically sourced from the entity
+Entchannel 0 will never override a playing sound
+====================
+*/
+static void S_Base_MainStartSound( vec3_t origin, int entityNum, int entchannel, sfxHandle_t sfxHandle, qboolean localSound, int flags ) {
+	sndCommand_t	*cmd;
+	sfx_t			*sfx;
+
+	if ( !s_soundStarted || s_soundMuted ) {
+		return;
+	}
+
+	if ( !origin && ( entityNum < 0 || entityNum >= MAX_GENTITIES ) ) {
+		Com_Error( ERR_DROP, "S_StartSound: bad entitynum %i", entityNum );
+	}
+
+	if ( sfxHandle < 0 || sfxHandle >= s_numSfx ) {
+		Com_Printf( S_COLOR_YELLOW "S_StartSound: handle %i out of range\n", sfxHandle );
+		return;
+	}
+
+	sfx = &s_knownSfx[ sfxHandle ];
+
+	if (sfx->inMemory == qfalse) {
+		S_memoryLoad(sfx);
+	}
+
+	if ( s_show->integer == 1 ) {
+		Com_Printf( "%i : %s\n", s_paintedtime, sfx->soundName );
+	}
+
+	if ( !s_mixCommands ) {
+		S_Base_MixStartSound( origin, entityNum, entchannel, sfxHandle, localSound, flags );
+		return;
+	}
+
+	cmd = S_AllocCommand( SNDCMD_START_SOUND );
+	cmd->entityNum = entityNum;
+	cmd->entchannel = entchannel;
+	cmd->sfx = sfxHandle;
+	cmd->flags = flags;
+	cmd->localSound = localSound;
+	cmd->hasOrigin = ( origin != NULL );
+	if ( origin ) {
+		VectorCopy( origin, cmd->origin );
+	}
+}
+
 /*
 ====================
 S_StartSound
@@ -848,17 +1290,11 @@ void S_Base_StartLocalSound( sfxHandle_t sfxHandle, int channelNum ) {
 
 /*
 ==================
-S_ClearSoundBuffer
-
-If we are about to perform file access, clear the buffer
-so sound doesn't stutter.
+S_Base_MixClearSoundBuffer
 ==================
 */
-void S_Base_ClearSoundBuffer( void ) {
+static void S_Base_MixClearSoundBuffer( void ) {
 	int		clear;
-		
-	if (!s_soundStarted)
-		return;
 
 	// stop looping sounds
 	Com_Memset(loopSounds, 0, MAX_GENTITIES*sizeof(loopSound_t));
@@ -880,6 +1316,28 @@ void S_Base_ClearSoundBuffer( void ) {
 	SNDDMA_Submit ();
 }
 
+/*
+==================
+S_ClearSoundBuffer
+
+If we are about to perform file access, clear the buffer
+so sound doesn't stutter.
+==================
+*/
+void S_Base_ClearSoundBuffer( void ) {
+	if (!s_soundStarted)
+		return;
+
+	if ( !s_mixCommands ) {
+		S_Base_MixClearSoundBuffer();
+		return;
+	}
+
+	// usually called right before a long stall, don't wait for S_Update
+	S_AllocCommand( SNDCMD_CLEAR_BUFFER );
+	S_PublishCommands();
+}
+
 /*
 ==================
 S_StopAllSounds
@@ -913,12 +1371,34 @@ continuous looping sounds are added each frame
 ==============================================================
 */
 
-void S_Base_StopLoopingSound(int entityNum) {
+static void S_Base_MixStopLoopingSound(int entityNum) {
 	loopSounds[entityNum].active = qfalse;
 //	loopSounds[entityNum].sfx = 0;
 	loopSounds[entityNum].kill = qfalse;
 }
 
+void S_Base_StopLoopingSound(int entityNum) {
+	sndCommand_t *cmd;
+
+	if ( !s_mixCommands ) {
+		S_Base_MixStopLoopingSound( entityNum );
+		return;
+	}
+
+	cmd = S_AllocCommand( SNDCMD_STOP_LOOP );
+	cmd->entityNum = entityNum;
+}
+
+static void S_Base_MixClearLoopingSounds( qboolean killall ) {
+	int i;
+	for ( i = 0 ; i < MAX_GENTITIES ; i++) {
+		if (killall || loopSounds[i].kill == qtrue || (loopSounds[i].sfx && loopSounds[i].sfx->soundLength == 0)) {
+			S_Base_MixStopLoopingSound(i);
+		}
+	}
+	numLoopChannels = 0;
+}
+
 /*
 ==================
 S_ClearLoopingSounds
@@ -926,13 +1406,15 @@ S_ClearLoopingSounds
 ==================
 */
 void S_Base_ClearLoopingSounds( qboolean killall ) {
-	int i;
-	for ( i = 0 ; i < MAX_GENTITIES ; i++) {
-		if (killall || loopSounds[i].kill == qtrue || (loopSounds[i].sfx && loopSounds[i].sfx->soundLength == 0)) {
-			S_Base_StopLoopingSound(i);
-		}
+	sndCommand_t *cmd;
+
+	if ( !s_mixCommands ) {
+		S_Base_MixClearLoopingSounds( killall );
+		return;
 	}
-	numLoopChannels = 0;
+
+	cmd = S_AllocCommand( SNDCMD_CLEAR_LOOPS );
+	cmd->entchannel = killall;
 }
 
 /*
@@ -946,35 +1428,11 @@ Include velocity in case I get around to doing doppler...
 
 #define UNDERWATER_BIT  8
 
-void S_Base_AddLoopingSound( int entityNum, const vec3_t origin, const vec3_t velocity, const int range, sfxHandle_t sfxHandle, int volume ) {
+static void S_Base_MixAddLoopingSound( int entityNum, const vec3_t origin, const vec3_t velocity, const int range, sfxHandle_t sfxHandle, int volume, int framecount ) {
 	sfx_t *sfx;
 
-	if ( !s_soundStarted || s_soundMuted || clc.state != CA_ACTIVE ) {
-		return;
-	}
-
-	if ( !volume ) {
-		return;
-	}
-
-	if ( sfxHandle < 0 || sfxHandle >= s_numSfx ) {
-		Com_Printf( S_COLOR_YELLOW "S_AddLoopingSound: handle %i out of range\n", sfxHandle );
-		return;
-	}
-
-	if ( entityNum < 0 || entityNum >= MAX_GENTITIES )
-		return;
-
 	sfx = &s_knownSfx[ sfxHandle ];
 
-	if (sfx->inMemory == qfalse) {
-		S_memoryLoad(sfx);
-	}
-
-	if ( !sfx->soundLength ) {
-		Com_Error( ERR_DROP, "%s has length 0", sfx->soundName );
-	}
-
 	VectorCopy( origin, loopSounds[entityNum].origin );
 	VectorCopy( velocity, loopSounds[entityNum].velocity );
 	loopSounds[entityNum].active = qtrue;
@@ -1001,7 +1459,7 @@ void S_Base_AddLoopingSound( int entityNum, const vec3_t origin, const vec3_t ve
 		lena = DistanceSquared(loopSounds[listener_number].origin, loopSounds[entityNum].origin);
 		VectorAdd(loopSounds[entityNum].origin, loopSounds[entityNum].velocity, out);
 		lenb = DistanceSquared(loopSounds[listener_number].origin, out);
-		if ((loopSounds[entityNum].framenum+1) != cls.framecount) {
+		if ((loopSounds[entityNum].framenum+1) != framecount) {
 			loopSounds[entityNum].oldDopplerScale = 1.0;
 		} else {
 			loopSounds[entityNum].oldDopplerScale = loopSounds[entityNum].dopplerScale;
@@ -1021,26 +1479,23 @@ void S_Base_AddLoopingSound( int entityNum, const vec3_t origin, const vec3_t ve
 	}
 	loopSounds[entityNum].vol = volume;
 
-	loopSounds[entityNum].framenum = cls.framecount;
+	loopSounds[entityNum].framenum = framecount;
 }
 
-/*
-==================
-S_AddLoopingSound
-
-Called during entity generation for a frame
-Include velocity in case I get around to doing doppler...
-==================
-*/
-void S_Base_AddRealLoopingSound( int entityNum, const vec3_t origin, const vec3_t velocity, const int range, sfxHandle_t sfxHandle ) {
+void S_Base_AddLoopingSound( int entityNum, const vec3_t origin, const vec3_t velocity, const int range, sfxHandle_t sfxHandle, int volume ) {
+	sndCommand_t *cmd;
 	sfx_t *sfx;
 
-	if ( !s_soundStarted || s_soundMuted ) {
+	if ( !s_soundStarted || s_soundMuted || clc.state != CA_ACTIVE ) {
+		return;
+	}
+
+	if ( !volume ) {
 		return;
 	}
 
 	if ( sfxHandle < 0 || sfxHandle >= s_numSfx ) {
-		Com_Printf( S_COLOR_YELLOW "S_AddRealLoopingSound: handle %i out of range\n", sfxHandle );
+		Com_Printf( S_COLOR_YELLOW "S_AddLoopingSound: handle %i out of range\n", sfxHandle );
 		return;
 	}
 
@@ -1056,6 +1511,35 @@ void S_Base_AddRealLoopingSound( int entityNum, const vec3_t origin, const vec3_
 	if ( !sfx->soundLength ) {
 		Com_Error( ERR_DROP, "%s has length 0", sfx->soundName );
 	}
+
+	if ( !s_mixCommands ) {
+		S_Base_MixAddLoopingSound( entityNum, origin, velocity, range, sfxHandle, volume, cls.framecount );
+		return;
+	}
+
+	cmd = S_AllocCommand( SNDCMD_ADD_LOOP );
+	cmd->entityNum = entityNum;
+	cmd->sfx = sfxHandle;
+	cmd->range = range;
+	cmd->volume = volume;
+	cmd->framecount = cls.framecount;
+	VectorCopy( origin, cmd->origin );
+	VectorCopy( velocity, cmd->vec[0] );
+}
+
+/*
+==================
+S_AddLoopingSound
+
+Called during entity generation for a frame
+Include velocity in case I get around to doing doppler...
+==================
+*/
+static void S_Base_MixAddRealLoopingSound( int entityNum, const vec3_t origin, const vec3_t velocity, const int range, sfxHandle_t sfxHandle ) {
+	sfx_t *sfx;
+
+	sfx = &s_knownSfx[ sfxHandle ];
+
 	VectorCopy( origin, loopSounds[entityNum].origin );
 	VectorCopy( velocity, loopSounds[entityNum].velocity );
 	if ( range ) {
@@ -1069,6 +1553,45 @@ void S_Base_AddRealLoopingSound( int entityNum, const vec3_t origin, const vec3_
 	loopSounds[entityNum].doppler = qfalse;
 }
 
+void S_Base_AddRealLoopingSound( int entityNum, const vec3_t origin, const vec3_t velocity, const int range, sfxHandle_t sfxHandle ) {
+	sndCommand_t *cmd;
+	sfx_t *sfx;
+
+	if ( !s_soundStarted || s_soundMuted ) {
+		return;
+	}
+
+	if ( sfxHandle < 0 || sfxHandle >= s_numSfx ) {
+		Com_Printf( S_COLOR_YELLOW "S_AddRealLoopingSound: handle %i out of range\n", sfxHandle );
+		return;
+	}
+
+	if ( entityNum < 0 || entityNum >= MAX_GENTITIES )
+		return;
+
+	sfx = &s_knownSfx[ sfxHandle ];
+
+	if (sfx->inMemory == qfalse) {
+		S_memoryLoad(sfx);
+	}
+
+	if ( !sfx->soundLength ) {
+		Com_Error( ERR_DROP, "%s has length 0", sfx->soundName );
+	}
+
+	if ( !s_mixCommands ) {
+		S_Base_MixAddRealLoopingSound( entityNum, origin, velocity, range, sfxHandle );
+		return;
+	}
+
+	cmd = S_AllocCommand( SNDCMD_ADD_REAL_LOOP );
+	cmd->entityNum = entityNum;
+	cmd->sfx = sfxHandle;
+	cmd->range = range;
+	VectorCopy( origin, cmd->origin );
+	VectorCopy( velocity, cmd->vec[0] );
+}
+
 
 
 /*
@@ -1086,12 +1609,26 @@ void S_AddLoopSounds (void) {
 	channel_t	*ch;
 	loopSound_t	*loop, *loop2;
 	static int	loopFrame;
+	static int	loopLeft[MAX_GENTITIES], loopRight[MAX_GENTITIES];
 
 
 	numLoopChannels = 0;
 
 	time = Com_Milliseconds();
 
+	// spatialize every active loop at once, the merging below only sums
+	s_spatial.count = 0;
+	for ( i = 0 ; i < MAX_GENTITIES ; i++ ) {
+		if ( loopSounds[i].active ) {
+			S_SpatialAdd( &s_spatial, loopSounds[i].origin, 90, loopSounds[i].range, i );		// sphere
+		}
+	}
+	S_SpatializeBatch( &s_spatial );
+	for ( i = 0 ; i < s_spatial.count ; i++ ) {
+		loopLeft[ s_spatial.index[i] ] = s_spatial.left[i];
+		loopRight[ s_spatial.index[i] ] = s_spatial.right[i];
+	}
+
 	loopFrame++;
 	for ( i = 0 ; i < MAX_GENTITIES ; i++) {
 		loop = &loopSounds[i];
@@ -1099,17 +1636,15 @@ void S_AddLoopSounds (void) {
 			continue;	// already merged into an earlier sound
 		}
 
-		//if (loop->kill) {
-		//	S_SpatializeOrigin( loop->origin, 127, &left_total, &right_total, loop->range );			// 3d
-		//} else {
-			S_SpatializeOrigin( loop->origin, 90,  &left_total, &right_total, loop->range );			// sphere
-		//}
+		left_total = loopLeft[i];
+		right_total = loopRight[i];
 
 		// adjust according to volume
 		left_total = (int)( (float)loop->vol * (float)left_total / 256.0 );
 		right_total = (int)( (float)loop->vol * (float)right_total / 256.0 );
 
 		loop->sfx->lastTimeUsed = time;
+		S_TouchSound( loop->sfx );
 
 		for (j=(i+1); j< MAX_GENTITIES ; j++) {
 			loop2 = &loopSounds[j];
@@ -1118,11 +1653,8 @@ void S_AddLoopSounds (void) {
 			}
 			loop2->mergeFrame = loopFrame;
 
-			//if (loop2->kill) {
-			//	S_SpatializeOrigin( loop2->origin, 127, &left, &right, loop2->range );				// 3d
-			//} else {
-				S_SpatializeOrigin( loop2->origin, 90,  &left, &right, loop2->range );				// sphere
-			//}
+			left = loopLeft[j];
+			right = loopRight[j];
 
 			// adjust according to volume
 			left = (int)( (float)loop2->vol * (float)left / 256.0 );
@@ -1212,6 +1744,8 @@ void S_Base_RawSamples( int stream, int samples, int rate, int width, int s_chan
 		return;
 	}
 	
+	S_MixLock();
+
 	rawsamples = s_rawsamples[stream];
 
 	if ( s_muted->integer ) {
@@ -1313,6 +1847,8 @@ void S_Base_RawSamples( int stream, int samples, int rate, int width, int s_chan
 	if ( s_rawend[stream] > s_soundtime + MAX_RAW_SAMPLES ) {
 		Com_DPrintf( "S_Base_RawSamples: overflowed %i > %i\n", s_rawend[stream], s_soundtime );
 	}
+
+	S_MixUnlock();
 }
 
 //=============================================================================
@@ -1325,10 +1861,20 @@ let the sound system know where an entity currently is
 ======================
 */
 void S_Base_UpdateEntityPosition( int entityNum, const vec3_t origin ) {
+	sndCommand_t *cmd;
+
 	if ( entityNum < 0 || entityNum >= MAX_GENTITIES ) {
 		Com_Error( ERR_DROP, "S_UpdateEntityPosition: bad entitynum %i", entityNum );
 	}
-	VectorCopy( origin, loopSounds[entityNum].origin );
+
+	if ( !s_mixCommands ) {
+		VectorCopy( origin, loopSounds[entityNum].origin );
+		return;
+	}
+
+	cmd = S_AllocCommand( SNDCMD_ENTITY_POSITION );
+	cmd->entityNum = entityNum;
+	VectorCopy( origin, cmd->origin );
 }
 
 
@@ -1339,15 +1885,11 @@ S_Respatialize
 Change the volumes of all the playing sounds for changes in their positions
 ============
 */
-void S_Base_Respatialize( int entityNum, const vec3_t head, vec3_t axis[3], int inwater ) {
+static void S_Base_MixRespatialize( int entityNum, const vec3_t head, vec3_t axis[3], int inwater ) {
 	int			i;
 	channel_t	*ch;
 	vec3_t		origin;
 
-	if ( !s_soundStarted || s_soundMuted ) {
-		return;
-	}
-
 	listener_number = entityNum;
 	VectorCopy(head, listener_origin);
 	VectorCopy(axis[0], listener_axis[0]);
@@ -1355,6 +1897,7 @@ void S_Base_Respatialize( int entityNum, const vec3_t head, vec3_t axis[3], int
 	VectorCopy(axis[2], listener_axis[2]);
 
 	// update spatialization for dynamic sounds	
+	s_spatial.count = 0;
 	ch = s_channels;
 	for ( i = 0 ; i < MAX_CHANNELS ; i++, ch++ ) {
 		if ( !ch->thesfx ) {
@@ -1371,14 +1914,42 @@ void S_Base_Respatialize( int entityNum, const vec3_t head, vec3_t axis[3], int
 				VectorCopy( loopSounds[ ch->entnum ].origin, origin );
 			}
 
-			S_SpatializeOrigin (origin, ch->master_vol, &ch->leftvol, &ch->rightvol, SOUND_RANGE_DEFAULT );
+			S_SpatialAdd( &s_spatial, origin, ch->master_vol, SOUND_RANGE_DEFAULT, i );
 		}
 	}
 
+	S_SpatializeBatch( &s_spatial );
+	for ( i = 0 ; i < s_spatial.count ; i++ ) {
+		ch = &s_channels[ s_spatial.index[i] ];
+		ch->leftvol = s_spatial.left[i];
+		ch->rightvol = s_spatial.right[i];
+	}
+
 	// add loopsounds
 	S_AddLoopSounds ();
 }
 
+void S_Base_Respatialize( int entityNum, const vec3_t head, vec3_t axis[3], int inwater ) {
+	sndCommand_t *cmd;
+
+	if ( !s_soundStarted || s_soundMuted ) {
+		return;
+	}
+
+	if ( !s_mixCommands ) {
+		S_Base_MixRespatialize( entityNum, head, axis, inwater );
+		return;
+	}
+
+	cmd = S_AllocCommand( SNDCMD_RESPATIALIZE );
+	cmd->entityNum = entityNum;
+	cmd->entchannel = inwater;
+	VectorCopy( head, cmd->origin );
+	VectorCopy( axis[0], cmd->vec[0] );
+	VectorCopy( axis[1], cmd->vec[1] );
+	VectorCopy( axis[2], cmd->vec[2] );
+}
+
 
 /*
 ========================
@@ -1417,6 +1988,233 @@ qboolean S_ScanChannelStarts( void ) {
 	return newSamples;
 }
 
+/*
+========================
+S_CullVoices
+
+Picks the voices that get painted.  Voices quieter than s_voiceCullVolume
+and the quietest ones past s_maxVoices are virtual: the paint position
+comes from s_paintedtime, so they stay in time and come back where they
+would have been, but cost nothing to mix.  Full volume voices are never
+virtual, they take their places of s_maxVoices before the others.
+========================
+*/
+#define	VOICE_HYSTERESIS	4		// keeps voices at the cutoff from flipping every mix
+#define	VOICE_SCORES		( 256 + VOICE_HYSTERESIS )
+
+static void S_CullVoices( void ) {
+	channel_t	*voices[MAX_CHANNELS * 2];
+	short		scores[MAX_CHANNELS * 2];
+	int			count[VOICE_SCORES];
+	channel_t	*ch;
+	int			numVoices, numFull, numMixed, numVirtual, limit, minVolume;
+	int			i, score, cutoff, remaining;
+
+	limit = s_maxVoices->integer;
+	minVolume = s_voiceCullVolume->integer;
+
+	Com_Memset( count, 0, sizeof( count ) );
+	numVoices = 0;
+	numFull = 0;
+	numVirtual = 0;
+
+	for ( i = 0; i < MAX_CHANNELS + numLoopChannels; i++ ) {
+		ch = ( i < MAX_CHANNELS ) ? &s_channels[i] : &loop_channels[i - MAX_CHANNELS];
+
+		if ( !ch->thesfx || ( !ch->leftvol && !ch->rightvol ) ) {
+			ch->isVirtual = qfalse;
+			continue;		// not painted anyway
+		}
+
+		score = ( ch->leftvol > ch->rightvol ) ? ch->leftvol : ch->rightvol;
+		if ( score > 255 ) {
+			score = 255;
+		}
+
+		if ( ch->fullVolume ) {
+			ch->isVirtual = qfalse;
+			numFull++;
+			continue;
+		}
+
+		if ( score < minVolume ) {
+			ch->isVirtual = qtrue;
+			numVirtual++;
+			continue;
+		} else if ( !ch->isVirtual ) {
+			score += VOICE_HYSTERESIS;
+		}
+
+		voices[numVoices] = ch;
+		scores[numVoices] = score;
+		count[score]++;
+		numVoices++;
+	}
+
+	numMixed = numFull;
+	if ( limit <= 0 || numFull + numVoices <= limit ) {
+		for ( i = 0; i < numVoices; i++ ) {
+			voices[i]->isVirtual = qfalse;
+		}
+		numMixed += numVoices;
+	} else {
+		// find the score of the quietest voice that still gets painted,
+		// and how many voices with exactly that score fit, nothing fits
+		// once the full volume voices took all places
+		remaining = limit - numFull;
+		for ( cutoff = VOICE_SCORES - 1; cutoff > 0; cutoff-- ) {
+			if ( count[cutoff] >= remaining ) {
+				break;
+			}
+			remaining -= count[cutoff];
+		}
+
+		for ( i = 0; i < numVoices; i++ ) {
+			if ( scores[i] > cutoff ) {
+				voices[i]->isVirtual = qfalse;
+				numMixed++;
+			} else if ( scores[i] == cutoff && remaining > 0 ) {
+				voices[i]->isVirtual = qfalse;
+				numMixed++;
+				remaining--;
+			} else {
+				voices[i]->isVirtual = qtrue;
+				numVirtual++;
+			}
+		}
+	}
+
+	s_mixedVoices = numMixed;
+	s_virtualVoices = numVirtual;
+}
+
+/*
+=================
+S_RunCommands
+
+Applies everything the game side published since the last mix
+=================
+*/
+static void S_RunCommands( void ) {
+	sndCommand_t *cmd;
+	int published;
+
+	published = s_commandPublished;
+	__sync_synchronize();
+
+	while ( s_commandRead != published ) {
+		cmd = &s_commands[s_commandRead & ( MAX_SND_COMMANDS - 1 )];
+
+		switch ( cmd->type ) {
+		case SNDCMD_START_SOUND:
+			S_Base_MixStartSound( cmd->hasOrigin ? cmd->origin : NULL, cmd->entityNum, cmd->entchannel,
+								  cmd->sfx, cmd->localSound, cmd->flags );
+			break;
+		case SNDCMD_ADD_LOOP:
+			S_Base_MixAddLoopingSound( cmd->entityNum, cmd->origin, cmd->vec[0], cmd->range, cmd->sfx,
+									   cmd->volume, cmd->framecount );
+			break;
+		case SNDCMD_ADD_REAL_LOOP:
+			S_Base_MixAddRealLoopingSound( cmd->entityNum, cmd->origin, cmd->vec[0], cmd->range, cmd->sfx );
+			break;
+		case SNDCMD_STOP_LOOP:
+			S_Base_MixStopLoopingSound( cmd->entityNum );
+			break;
+		case SNDCMD_CLEAR_LOOPS:
+			S_Base_MixClearLoopingSounds( cmd->entchannel );
+			break;
+		case SNDCMD_RESPATIALIZE:
+			S_Base_MixRespatialize( cmd->entityNum, cmd->origin, cmd->vec, cmd->entchannel );
+			break;
+		case SNDCMD_ENTITY_POSITION:
+			VectorCopy( cmd->origin, loopSounds[cmd->entityNum].origin );
+			break;
+		case SNDCMD_CLEAR_BUFFER:
+			S_Base_MixClearSoundBuffer();
+			break;
+		}
+
+		__sync_synchronize();
+		s_commandRead++;
+	}
+}
+
+/*
+=================
+S_MixFrame
+=================
+*/
+static void S_MixFrame( void ) {
+	S_MixLock();
+
+	S_RunCommands();
+
+	// default to ZERO amplitude, overwrite if sound is playing
+	memset( s_entityTalkAmplitude, 0, sizeof( s_entityTalkAmplitude ) );
+
+	S_Update_();
+
+	S_MixUnlock();
+}
+
+#ifdef __vita__
+static int S_MixerThread( SceSize args, void *argp ) {
+	while ( !s_mixThreadQuit ) {
+		SNDDMA_Wait( 50 );
+		if ( !CL_VideoRecording() ) {
+			S_MixFrame();
+		}
+	}
+
+	return sceKernelExitThread( 0 );
+}
+#endif
+
+/*
+=================
+S_StartMixer
+=================
+*/
+static void S_StartMixer( void ) {
+	s_commandWrite = s_commandPublished = s_commandRead = 0;
+
+	if ( !s_mixThread->integer ) {
+		return;
+	}
+
+	s_mixCommands = qtrue;
+
+#ifdef __vita__
+	s_mixThreadQuit = qfalse;
+	s_mixThreadId = sceKernelCreateThread( "Sound Mixer", S_MixerThread, 0x10000100, 0x10000, 0, 0, NULL );
+	if ( s_mixThreadId < 0 || sceKernelStartThread( s_mixThreadId, 0, NULL ) < 0 ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't start the mixer thread, mixing in the main loop\n" );
+		return;
+	}
+	s_mixThreadRunning = qtrue;
+#endif
+}
+
+/*
+=================
+S_StopMixer
+
+Returns once the mixer is done with the channels and the dma buffer
+=================
+*/
+static void S_StopMixer( void ) {
+#ifdef __vita__
+	if ( s_mixThreadRunning ) {
+		s_mixThreadQuit = qtrue;
+		sceKernelWaitThreadEnd( s_mixThreadId, NULL, NULL );
+		sceKernelDeleteThread( s_mixThreadId );
+		s_mixThreadRunning = qfalse;
+	}
+#endif
+
+	s_mixCommands = qfalse;
+}
+
 /*
 ============
 S_Update
@@ -1429,14 +2227,15 @@ void S_Base_Update( void ) {
 	int			total;
 	channel_t	*ch;
 
+	if ( s_mixCommands ) {
+		S_PublishCommands();
+	}
+
 	if ( !s_soundStarted || s_soundMuted ) {
 //		Com_DPrintf ("not started or muted\n");
 		return;
 	}
 
-	// default to ZERO amplitude, overwrite if sound is playing
-	memset( s_entityTalkAmplitude, 0, sizeof( s_entityTalkAmplitude ) );
-
 	//
 	// debugging output
 	//
@@ -1450,14 +2249,19 @@ void S_Base_Update( void ) {
 			}
 		}
 		
-		Com_Printf ("----(%i)---- painted: %i\n", total, s_paintedtime);
+		Com_Printf ("----(%i)---- painted: %i, %i voices mixed, %i virtual\n", total, s_paintedtime, s_mixedVoices, s_virtualVoices);
 	}
 
 	// add raw data from streamed samples
+	S_StreamUpdate();
 	S_UpdateBackgroundTrack();
+	S_UpdateStreamingSounds();
 
-	// mix some sound
-	S_Update_();
+	// mix some sound, the mixer thread leaves video recording to the
+	// main loop so the audio stays in step with the captured frames
+	if ( !s_mixThreadRunning || CL_VideoRecording() ) {
+		S_MixFrame();
+	}
 }
 
 void S_GetSoundtime(void)
@@ -1489,7 +2293,7 @@ void S_GetSoundtime(void)
 		{	// time to chop things off to avoid 32 bit limits
 			buffers = 0;
 			s_paintedtime = dma.fullsamples;
-			S_Base_StopAllSounds ();
+			S_Base_MixClearSoundBuffer ();
 		}
 	}
 	oldsamplepos = samplepos;
@@ -1505,7 +2309,13 @@ void S_GetSoundtime(void)
 	}
 #endif
 
-	if ( dma.submission_chunk < 256 ) {
+	if ( s_mixThreadRunning ) {
+		// the mixer is woken for every chunk the device takes, so keep
+		// going from where the last mix stopped instead of remixing
+		if ( s_paintedtime < s_soundtime + dma.submission_chunk ) {
+			s_paintedtime = s_soundtime + dma.submission_chunk;
+		}
+	} else if ( dma.submission_chunk < 256 ) {
 		s_paintedtime = s_soundtime + s_mixPreStep->value * dma.speed;
 	} else {
 		s_paintedtime = s_soundtime + dma.submission_chunk;
@@ -1567,15 +2377,21 @@ void S_Update_(void) {
 
 	// mix ahead of current position
 	endtime = s_soundtime + ma;
+	if ( s_mixThreadRunning ) {
+		endtime = s_soundtime + 2 * dma.submission_chunk;
+	}
 
 	// mix to an even submission block size
 	endtime = (endtime + dma.submission_chunk-1)
 		& ~(dma.submission_chunk-1);
 
-	// never mix more than the complete buffer
-	if (endtime - s_soundtime > dma.fullsamples)
-		endtime = s_soundtime + dma.fullsamples;
+	// never mix more than the complete buffer, minus the chunk the
+	// device is still playing from
+	if (endtime - s_soundtime > dma.fullsamples - dma.submission_chunk)
+		endtime = s_soundtime + dma.fullsamples - dma.submission_chunk;
 	
+	S_CullVoices();
+
 	SNDDMA_BeginPainting ();
 
 	S_PaintChannels (endtime);
@@ -1595,17 +2411,79 @@ background music functions
 ===============================================================================
 */
 
+/*
+======================
+S_FeedStream
+
+Moves decoded pcm of a stream into its raw samples, returns qfalse once
+the stream played out
+======================
+*/
+static qboolean S_FeedStream( int stream, float volume, int entityNum ) {
+	snd_info_t	info;
+	int		bufferSamples;
+	int		fileSamples;
+	byte	raw[30000];		// just enough to fit in a mac stack frame
+	int		fileBytes;
+	int		frame;
+	int		avail;
+
+	// see how many samples should be copied into the raw buffer
+	if ( s_rawend[stream] < s_soundtime ) {
+		if ( !S_StreamAvailable( stream, NULL ) ) {
+			S_StreamUnderrun( stream );
+		}
+		s_rawend[stream] = s_soundtime;
+	}
+
+	while ( s_rawend[stream] < s_soundtime + MAX_RAW_SAMPLES ) {
+		avail = S_StreamAvailable( stream, &info );
+		if ( !avail ) {
+			break;
+		}
+
+		bufferSamples = MAX_RAW_SAMPLES - (s_rawend[stream] - s_soundtime);
+
+		// decide how much data needs to be read from the stream
+		fileSamples = bufferSamples * info.rate / dma.speed;
+		if ( !fileSamples ) {
+			break;
+		}
+
+		frame = info.width * info.channels;
+		fileBytes = fileSamples * frame;
+		if ( fileBytes > avail ) {
+			fileBytes = avail;
+		}
+		if ( fileBytes > sizeof(raw) ) {
+			fileBytes = sizeof(raw);
+		}
+		fileBytes -= fileBytes % frame;
+		if ( fileBytes <= 0 ) {
+			break;
+		}
+
+		fileBytes = S_StreamRead( stream, raw, fileBytes );
+
+		// add to raw buffer
+		S_Base_RawSamples( stream, fileBytes / frame, info.rate, info.width, info.channels, raw, volume, entityNum );
+	}
+
+	return !S_StreamFinished( stream );
+}
+
 /*
 ======================
 S_StopBackgroundTrack
 ======================
 */
 void S_Base_StopBackgroundTrack( void ) {
-	if(!s_backgroundStream)
+	if ( !S_StreamActive( 0 ) )
 		return;
-	S_CodecCloseStream(s_backgroundStream);
-	s_backgroundStream = NULL;
+	S_StreamClose( 0 );
+	S_MixLock();
 	s_rawend[0] = 0;
+	S_MixUnlock();
 }
 
 /*
@@ -1614,24 +2492,18 @@ S_OpenBackgroundStream
 ======================
 */
 static void S_OpenBackgroundStream( const char *filename ) {
-	// close the background track, but DON'T reset s_rawend
-	// if restarting the same back ground track
-	if(s_backgroundStream)
-	{
-		S_CodecCloseStream(s_backgroundStream);
-		s_backgroundStream = NULL;
-	}
+	snd_info_t	info;
 
 	Cvar_Set( "s_currentMusic", "" ); //----(SA)	so the savegame will have the right music
 
-	// Open stream
-	s_backgroundStream = S_CodecOpenStream(filename);
-	if(!s_backgroundStream) {
+	// Open stream, this closes the background track, but DON'T reset
+	// s_rawend if restarting the same back ground track
+	if ( !S_StreamOpen( 0, filename, s_backgroundLoop, &info ) ) {
 		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't open music file %s\n", filename );
 		return;
 	}
 
-	if(s_backgroundStream->info.channels != 2 || s_backgroundStream->info.rate != 22050) {
+	if ( info.channels != 2 || info.rate != 22050 ) {
 		Com_Printf(S_COLOR_YELLOW "WARNING: music file %s is not 22k stereo\n", filename );
 	}
 
@@ -1666,16 +2538,12 @@ void S_Base_StartBackgroundTrack( const char *intro, const char *loop ){
 /*
 ======================
 S_UpdateBackgroundTrack
+
+The loop file is queued by the stream itself, see S_StreamUpdate
 ======================
 */
 void S_UpdateBackgroundTrack( void ) {
-	int		bufferSamples;
-	int		fileSamples;
-	byte	raw[30000];		// just enough to fit in a mac stack frame
-	int		fileBytes;
-	int		r;
-
-	if(!s_backgroundStream) {
+	if ( !S_StreamActive( 0 ) ) {
 		return;
 	}
 
@@ -1684,58 +2552,8 @@ void S_UpdateBackgroundTrack( void ) {
 		return;
 	}
 
-	// see how many samples should be copied into the raw buffer
-	if ( s_rawend[0] < s_soundtime ) {
-		s_rawend[0] = s_soundtime;
-	}
-
-	while ( s_rawend[0] < s_soundtime + MAX_RAW_SAMPLES ) {
-		bufferSamples = MAX_RAW_SAMPLES - (s_rawend[0] - s_soundtime);
-
-		// decide how much data needs to be read from the file
-		fileSamples = bufferSamples * s_backgroundStream->info.rate / dma.speed;
-
-		if (!fileSamples)
-			return;
-
-		// our max buffer size
-		fileBytes = fileSamples * (s_backgroundStream->info.width * s_backgroundStream->info.channels);
-		if ( fileBytes > sizeof(raw) ) {
-			fileBytes = sizeof(raw);
-			fileSamples = fileBytes / (s_backgroundStream->info.width * s_backgroundStream->info.channels);
-		}
-
-		// Read
-		r = S_CodecReadStream(s_backgroundStream, fileBytes, raw);
-		if(r < fileBytes)
-		{
-			fileSamples = r / (s_backgroundStream->info.width * s_backgroundStream->info.channels);
-		}
-
-		if(r > 0)
-		{
-			// add to raw buffer
-			S_Base_RawSamples(0, fileSamples, s_backgroundStream->info.rate,
-				s_backgroundStream->info.width, s_backgroundStream->info.channels, raw, s_musicVolume->value, -1);
-		}
-		else
-		{
-			// loop
-			if(s_backgroundLoop[0])
-			{
-				S_CodecCloseStream(s_backgroundStream);
-				s_backgroundStream = NULL;
-				S_Base_StartBackgroundTrack( s_backgroundLoop, s_backgroundLoop );
-				if(!s_backgroundStream)
-					return;
-			}
-			else
-			{
-				S_Base_StopBackgroundTrack();
-				return;
-			}
-		}
-
+	if ( !S_FeedStream( 0, s_musicVolume->value, -1 ) ) {
+		S_Base_StopBackgroundTrack();
 	}
 }
 
@@ -1759,70 +2577,131 @@ void S_Base_FadeAllSounds( float targetvol, int time ) {
 
 /*
 ======================
-S_StartStreamingSound
+S_StopStreamingSound
+
+Stops a streaming sound, and what it already put into the raw samples
+if killed
 ======================
 */
-void S_Base_StartStreamingSound( const char *intro, const char *loop, int entnum, int channel, int attenuation ) {
-	// FIXME: Stub
+static void S_StopStreamingSound( int stream, qboolean kill ) {
+	streamingSounds[stream].active = qfalse;
+	streamingSounds[stream].kill = qfalse;
+	S_StreamClose( stream );
+
+	if ( kill ) {
+		S_MixLock();
+		s_rawend[stream] = 0;
+		S_MixUnlock();
+	}
 }
 
 /*
 ======================
-S_StopEntStreamingSound
+S_StartStreamingSound
 ======================
 */
-void S_Base_StopEntStreamingSound( int entnum ) {
-	// FIXME: Stub
+void S_Base_StartStreamingSound( const char *intro, const char *loop, int entnum, int channel, int attenuation ) {
+	streamingSound_t	*ss;
+	int					i, stream;
+
+	if ( !s_soundStarted || s_soundMuted || !intro || !intro[0] ) {
+		return;
+	}
+
+	// an entity streaming on the same channel again replaces the old sound
+	stream = 0;
+	for ( i = 1; i < MAX_RAW_STREAMS; i++ ) {    // track 0 is music/cinematics
+		ss = &streamingSounds[i];
+		if ( !ss->active ) {
+			if ( !stream ) {
+				stream = i;
+			}
+			continue;
+		}
+		if ( entnum >= 0 && channel != CHAN_AUTO && ss->entnum == entnum && ss->channel == channel ) {
+			stream = i;
+			break;
+		}
+	}
+
+	if ( !stream ) {
+		Com_DPrintf( "S_StartStreamingSound: no free streams for %s\n", intro );
+		return;
+	}
+
+	if ( streamingSounds[stream].active ) {
+		S_StopStreamingSound( stream, qtrue );
+	}
+
+	if ( !S_StreamOpen( stream, intro, loop, NULL ) ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't open streaming sound %s\n", intro );
+		return;
+	}
+
+	ss = &streamingSounds[stream];
+	ss->active = qtrue;
+	ss->kill = qfalse;
+	Q_strncpyz( ss->loop, loop ? loop : "", sizeof( ss->loop ) );
+	ss->entnum = entnum;
+	ss->channel = channel;
+	ss->attenuation = attenuation;
 }
 
 /*
 ======================
-S_GetVoiceAmplitude
+S_StopEntStreamingSound
 ======================
 */
-int S_Base_GetVoiceAmplitude( int entityNum ) {
-	if ( entityNum >= MAX_CLIENTS ) {
-		Com_Printf( "Error: S_GetVoiceAmplitude() called for a non-client\n" );
-		return 0;
-	}
+void S_Base_StopEntStreamingSound( int entnum ) {
+	int i;
 
-	return (int)s_entityTalkAmplitude[entityNum] * 2;
+	for ( i = 1; i < MAX_RAW_STREAMS; i++ ) {
+		if ( !streamingSounds[i].active ) {
+			continue;
+		}
+		// -1 stops all of them
+		if ( entnum != -1 && streamingSounds[i].entnum != entnum ) {
+			continue;
+		}
+		streamingSounds[i].kill = qtrue;
+	}
 }
 
 /*
 ======================
-S_FreeOldestSound
+S_UpdateStreamingSounds
 ======================
 */
+static void S_UpdateStreamingSounds( void ) {
+	streamingSound_t	*ss;
+	int					i;
 
-void S_FreeOldestSound( void ) {
-	int	i, oldest, used;
-	sfx_t	*sfx;
-	sndBuffer	*buffer, *nbuffer;
-
-	oldest = Com_Milliseconds();
-	used = 0;
+	for ( i = 1; i < MAX_RAW_STREAMS; i++ ) {
+		ss = &streamingSounds[i];
+		if ( !ss->active ) {
+			continue;
+		}
 
-	for (i=1 ; i < s_numSfx ; i++) {
-		sfx = &s_knownSfx[i];
-		if (sfx->inMemory && sfx->lastTimeUsed<oldest) {
-			used = i;
-			oldest = sfx->lastTimeUsed;
+		if ( ss->kill ) {
+			S_StopStreamingSound( i, qtrue );
+		} else if ( !S_FeedStream( i, 1.0f, ( ss->attenuation && ss->entnum >= 0 ) ? ss->entnum : -1 ) ) {
+			S_StopStreamingSound( i, qfalse );
 		}
 	}
+}
 
-	sfx = &s_knownSfx[used];
-
-	Com_DPrintf("S_FreeOldestSound: freeing sound %s\n", sfx->soundName);
-
-	buffer = sfx->soundData;
-	while(buffer != NULL) {
-		nbuffer = buffer->next;
-		SND_free(buffer);
-		buffer = nbuffer;
+/*
+======================
+S_GetVoiceAmplitude
+======================
+*/
+int S_Base_GetVoiceAmplitude( int entityNum ) {
+	if ( entityNum >= MAX_CLIENTS ) {
+		Com_Printf( "Error: S_GetVoiceAmplitude() called for a non-client\n" );
+		return 0;
 	}
-	sfx->inMemory = qfalse;
-	sfx->soundData = NULL;
+
+	return (int)s_entityTalkAmplitude[entityNum] * 2;
 }
 
 // =======================================================================
@@ -1834,13 +2713,24 @@ void S_Base_Shutdown( void ) {
 		return;
 	}
 
+	S_StopMixer();
+	S_StreamShutdown();
+	Com_Memset( streamingSounds, 0, sizeof( streamingSounds ) );
+
 	SNDDMA_Shutdown();
 	SND_shutdown();
 
+#ifdef __vita__
+	sceKernelDeleteLwMutex( &s_mixLock );
+#endif
+
 	s_soundStarted = 0;
 	s_numSfx = 0;
 
 	Cmd_RemoveCommand("s_info");
+	Cmd_RemoveCommand("s_mixbench");
+	Cmd_RemoveCommand("s_spatialbench");
+	Cmd_RemoveCommand("s_streaminfo");
 }
 
 /*
@@ -1859,6 +2749,9 @@ qboolean S_Base_Init( soundInterface_t *si ) {
 	s_mixPreStep = Cvar_Get ("s_mixPreStep", "0.05", CVAR_ARCHIVE);
 	s_show = Cvar_Get ("s_show", "0", CVAR_CHEAT);
 	s_testsound = Cvar_Get ("s_testsound", "0", CVAR_CHEAT);
+	s_mixThread = Cvar_Get ("s_mixThread", "1", CVAR_ARCHIVE | CVAR_LATCH);
+	s_maxVoices = Cvar_Get ("s_maxVoices", "32", CVAR_ARCHIVE);
+	s_voiceCullVolume = Cvar_Get ("s_voiceCullVolume", "2", CVAR_ARCHIVE);
 
 	r = SNDDMA_Init();
 
@@ -1872,7 +2765,19 @@ qboolean S_Base_Init( soundInterface_t *si ) {
 		s_soundtime = 0;
 		s_paintedtime = 0;
 
+#ifdef __vita__
+		sceKernelCreateLwMutex( &s_mixLock, "Sound Mixer", 0, 0, NULL );
+#endif
+
+		S_StreamInit();
+
 		S_Base_StopAllSounds( );
+
+		S_StartMixer();
+
+		Cmd_AddCommand( "s_mixbench", S_MixBench_f );
+		Cmd_AddCommand( "s_spatialbench", S_SpatialBench_f );
+		Cmd_AddCommand( "s_streaminfo", S_StreamInfo_f );
 	} else {
 		return qfalse;
 	}
@@ -60,6 +60,10 @@ typedef struct sfx_s {
 	char 			soundName[MAX_QPATH];
 	int				lastTimeUsed;
 	struct sfx_s	*next;
+	struct sfx_s	*lruPrev;				// resident sounds, most recently used first
+	struct sfx_s	*lruNext;
+	int				chunks;					// sndBuffers holding the sound, 0 if not cached
+	qboolean		levelUsed;				// goes into the level's preload manifest
 } sfx_t;
 
 typedef struct {
@@ -115,6 +119,7 @@ typedef struct
 	int flags;                  //----(SA)	added
 	qboolean threadReady;
 	qboolean	fullVolume;
+	qboolean	isVirtual;		// only keeps its place in time, see S_CullVoices
 } channel_t;
 
 
@@ -190,6 +195,10 @@ void	SNDDMA_BeginPainting (void);
 
 void	SNDDMA_Submit(void);
 
+// blocks until the device consumed another submission_chunk of the
+// buffer or msec have passed, paces the mixer thread
+void	SNDDMA_Wait( int msec );
+
 #ifdef USE_VOIP
 void SNDDMA_StartCapture(void);
 int SNDDMA_AvailableCaptureSamples(void);
@@ -215,9 +224,7 @@ extern	dma_t	dma;
 
 // Ridah, streaming sounds
 typedef struct {
-	fileHandle_t file;
-	wavinfo_t info;
-	int samples;
+	qboolean active;		// decoded on the raw stream of the same index, see snd_stream.c
 	char loop[MAX_QPATH];
 	int entnum;
 	int channel;
@@ -238,7 +245,11 @@ extern cvar_t *s_doppler;
 
 extern cvar_t *s_testsound;
 
+extern	sfx_t	s_knownSfx[];
+extern	int		s_numSfx;
+
 qboolean S_LoadSound( sfx_t *sfx );
+sfx_t *S_FindName( const char *name );
 
 void		SND_free(sndBuffer *v);
 sndBuffer*	SND_malloc( void );
@@ -246,6 +257,11 @@ void		SND_setup( void );
 void		SND_shutdown(void);
 
 void S_PaintChannels(int endtime);
+void S_MixBench_f( void );
+
+// keeps the mixer thread out while the paint buffer or sfx memory is used
+void S_LockMixer( void );
+void S_UnlockMixer( void );
 
 void S_memoryLoad(sfx_t *sfx);
 
@@ -263,6 +279,11 @@ void S_AdpcmGetSamples(sndBuffer *chunk, short *to);
 #define SENTINEL_MULAW_FOUR_BIT_RUN 126
 
 void S_FreeOldestSound( void );
+void S_TouchSound( sfx_t *sfx );
+
+// sound preload manifests, see snd_mem.c
+void S_PreloadSounds( const char *mapname );
+void S_WriteSoundManifest( void );
 
 #define	NXStream byte
 
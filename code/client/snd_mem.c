@@ -46,27 +46,59 @@ static	sndBuffer	*buffer = NULL;
 static	sndBuffer	*freelist = NULL;
 static	int inUse = 0;
 static	int totalInUse = 0;
+static	int numChunks = 0;
+static	int chunksInUse = 0;
+
+static	cvar_t		*s_soundCacheMegs;
+static	cvar_t		*s_soundPreload;
+
+// least and most recently used resident sounds
+static	sfx_t		*lruFirst = NULL;
+static	sfx_t		*lruLast = NULL;
+
+static	int c_soundLoads, c_soundEvictions;
 
 short *sfxScratchBuffer = NULL;
 sfx_t *sfxScratchPointer = NULL;
 int	   sfxScratchIndex = 0;
 
+/*
+================
+S_CacheBudget
+
+Number of sndBuffers the cached sounds may use
+================
+*/
+static int S_CacheBudget( void ) {
+	int budget;
+
+	budget = s_soundCacheMegs->value * 1024 * 1024 / sizeof(sndBuffer);
+	if ( budget <= 0 || budget > numChunks ) {
+		budget = numChunks;
+	}
+	return budget;
+}
+
 void	SND_free(sndBuffer *v) {
 	*(sndBuffer **)v = freelist;
 	freelist = (sndBuffer*)v;
 	inUse += sizeof(sndBuffer);
+	chunksInUse--;
 }
 
 sndBuffer*	SND_malloc(void) {
 	sndBuffer *v;
 redo:
-	if (freelist == NULL) {
+	// a sound bigger than the budget still gets loaded once nothing
+	// else is left to page out
+	if (freelist == NULL || (chunksInUse >= S_CacheBudget() && lruLast)) {
 		S_FreeOldestSound();
 		goto redo;
 	}
 
 	inUse -= sizeof(sndBuffer);
 	totalInUse += sizeof(sndBuffer);
+	chunksInUse++;
 
 	v = freelist;
 	freelist = *(sndBuffer **)freelist;
@@ -80,6 +112,8 @@ void SND_setup(void) {
 	int scs;
 
 	cv = Cvar_Get( "com_soundMegs", DEF_COMSOUNDMEGS, CVAR_LATCH | CVAR_ARCHIVE );
+	s_soundCacheMegs = Cvar_Get( "s_soundCacheMegs", "0", CVAR_ARCHIVE );
+	s_soundPreload = Cvar_Get( "s_soundPreload", "1", CVAR_ARCHIVE );
 
 	scs = (cv->integer*1536);
 
@@ -89,6 +123,9 @@ void SND_setup(void) {
 	sfxScratchPointer = NULL;
 
 	inUse = scs*sizeof(sndBuffer);
+	numChunks = scs;
+	chunksInUse = 0;
+	lruFirst = lruLast = NULL;
 	p = buffer;;
 	q = p + scs;
 	while (--q > p)
@@ -106,60 +143,238 @@ void SND_shutdown(void)
 		free(buffer);
 }
 
+/*
+===============================================================================
+
+sample cache
+
+The resident sounds are kept in a list ordered by their last use, so
+the sound to page out is always at hand
+
+===============================================================================
+*/
+
 /*
 ================
-ResampleSfx
+S_CacheUnlink
+================
+*/
+static void S_CacheUnlink( sfx_t *sfx ) {
+	if ( sfx->lruPrev ) {
+		sfx->lruPrev->lruNext = sfx->lruNext;
+	} else {
+		lruFirst = sfx->lruNext;
+	}
+	if ( sfx->lruNext ) {
+		sfx->lruNext->lruPrev = sfx->lruPrev;
+	} else {
+		lruLast = sfx->lruPrev;
+	}
+	sfx->lruPrev = sfx->lruNext = NULL;
+}
 
-resample / decimate to the current source rate
+/*
+================
+S_CacheLinkFirst
 ================
 */
-static int ResampleSfx( sfx_t *sfx, int channels, int inrate, int inwidth, int samples, byte *data, qboolean compressed ) {
-	int		outcount;
-	int		srcsample;
-	float	stepscale;
-	int		i, j;
-	int		sample, samplefrac, fracstep;
-	int			part;
-	sndBuffer	*chunk;
-	
-	stepscale = (float)inrate / dma.speed;	// this is usually 0.5, 1, or 2
+static void S_CacheLinkFirst( sfx_t *sfx ) {
+	sfx->lruPrev = NULL;
+	sfx->lruNext = lruFirst;
+	if ( lruFirst ) {
+		lruFirst->lruPrev = sfx;
+	} else {
+		lruLast = sfx;
+	}
+	lruFirst = sfx;
+}
 
-	outcount = samples / stepscale;
+/*
+================
+S_CacheSound
 
-	srcsample = 0;
-	samplefrac = 0;
-	fracstep = stepscale * 256 * channels;
-	chunk = sfx->soundData;
+Puts a freshly loaded sound at the front of the cache
+================
+*/
+static void S_CacheSound( sfx_t *sfx ) {
+	sndBuffer *chunk;
 
-	for (i=0 ; i<outcount ; i++)
-	{
-		srcsample += samplefrac >> 8;
-		samplefrac &= 255;
-		samplefrac += fracstep;
-		for (j=0 ; j<channels ; j++)
-		{
-			if( inwidth == 2 ) {
-				sample = ( ((short *)data)[srcsample+j] );
-			} else {
-				sample = (unsigned int)( (unsigned char)(data[srcsample+j]) - 128) << 8;
-			}
-			part = (i*channels+j)&(SND_CHUNK_SIZE-1);
-			if (part == 0) {
-				sndBuffer	*newchunk;
-				newchunk = SND_malloc();
-				if (chunk == NULL) {
-					sfx->soundData = newchunk;
-				} else {
-					chunk->next = newchunk;
-				}
-				chunk = newchunk;
+	sfx->chunks = 0;
+	for ( chunk = sfx->soundData; chunk; chunk = chunk->next ) {
+		sfx->chunks++;
+	}
+
+	if ( sfx->chunks ) {
+		S_CacheLinkFirst( sfx );
+	}
+}
+
+/*
+================
+S_TouchSound
+
+Marks a sound as just used, called by the mixer when it starts playing
+================
+*/
+void S_TouchSound( sfx_t *sfx ) {
+	sfx->levelUsed = qtrue;
+
+	if ( !sfx->chunks || sfx == lruFirst ) {
+		return;
+	}
+	S_CacheUnlink( sfx );
+	S_CacheLinkFirst( sfx );
+}
+
+/*
+================
+S_FreeOldestSound
+
+Pages out the least recently used sound
+================
+*/
+void S_FreeOldestSound( void ) {
+	sfx_t		*sfx;
+	sndBuffer	*chunk, *next;
+
+	sfx = lruLast;
+	if ( !sfx ) {
+		Com_Error( ERR_FATAL, "S_FreeOldestSound: sound memory exhausted, raise com_soundMegs" );
+	}
+
+	Com_DPrintf("S_FreeOldestSound: freeing sound %s\n", sfx->soundName);
+
+	S_CacheUnlink( sfx );
+
+	for ( chunk = sfx->soundData; chunk; chunk = next ) {
+		next = chunk->next;
+		SND_free( chunk );
+	}
+	sfx->inMemory = qfalse;
+	sfx->soundData = NULL;
+	sfx->chunks = 0;
+
+	c_soundEvictions++;
+}
+
+/*
+================
+S_AllocSound
+
+Chains up the sndBuffers for a sound.  They only go on the lru list with
+S_PublishSound, so nothing pages them out while they are filled without
+the mixer lock.  Returns qfalse when even paging out every other sound
+doesn't make room; S_FreeOldestSound can't be left to error out, the
+mixer thread would block on the lock the error path joins it with
+================
+*/
+static qboolean S_AllocSound( sfx_t *sfx, int count ) {
+	sndBuffer	*chunk, *newchunk, *next;
+	int			i;
+
+	// making room pages out sounds the mixer may be playing
+	S_LockMixer();
+	sfx->soundData = NULL;
+	chunk = NULL;
+	for ( i = 0; i < count; i++ ) {
+		if ( !freelist && !lruLast ) {
+			for ( chunk = sfx->soundData; chunk; chunk = next ) {
+				next = chunk->next;
+				SND_free( chunk );
 			}
+			sfx->soundData = NULL;
+			S_UnlockMixer();
+
+			Com_Printf( S_COLOR_YELLOW "WARNING: no sound memory left for %s, raise com_soundMegs\n", sfx->soundName );
+			return qfalse;
+		}
 
-			chunk->sndChunk[part] = sample;
+		newchunk = SND_malloc();
+		if ( chunk == NULL ) {
+			sfx->soundData = newchunk;
+		} else {
+			chunk->next = newchunk;
 		}
+		chunk = newchunk;
 	}
+	S_UnlockMixer();
 
-	return outcount;
+	return qtrue;
+}
+
+/*
+================
+S_PublishSound
+
+Hands a filled sound to the mixer
+================
+*/
+static void S_PublishSound( sfx_t *sfx ) {
+	S_LockMixer();
+	S_CacheSound( sfx );
+	sfx->inMemory = qtrue;
+	S_UnlockMixer();
+}
+
+/*
+================
+S_SoundChunks
+
+sndBuffers a sound of length samples takes once stored
+================
+*/
+static int S_SoundChunks( sfx_t *sfx, int length, int channels ) {
+	if ( channels == 1 && sfx->soundCompressed == qtrue ) {
+		return ( length + SND_CHUNK_SIZE_BYTE*2 - 1 ) / ( SND_CHUNK_SIZE_BYTE*2 );
+	}
+	return ( length * channels + SND_CHUNK_SIZE - 1 ) / SND_CHUNK_SIZE;
+}
+
+/*
+================
+S_StoreSound
+
+Puts converted samples into sndBuffers, either adpcm or SND_CHUNK_SIZE
+interleaved samples each.  Loading on demand and preloading both go
+through here, so a sound is stored the same way either way.
+================
+*/
+static qboolean S_StoreSound( sfx_t *sfx, short *samples, int length, int channels ) {
+	sndBuffer	*chunk;
+	int			total, i, n;
+
+	sfx->soundLength = length;
+	sfx->soundChannels = channels;
+	sfx->lastTimeUsed = Com_Milliseconds()+1;
+
+	if ( !S_AllocSound( sfx, S_SoundChunks( sfx, length, channels ) ) ) {
+		sfx->soundLength = 0;
+		return qfalse;
+	}
+
+	// each of these compression schemes works just fine
+	// but the 16bit quality is much nicer and with a local
+	// install assured we can rely upon the sound memory
+	// manager to do the right thing for us and page
+	// sound in as needed
+	if ( channels == 1 && sfx->soundCompressed == qtrue ) {
+		sfx->soundCompressionMethod = 1;
+		S_AdpcmEncodeSound( sfx, samples );
+	} else {
+		sfx->soundCompressionMethod = 0;
+		total = length * channels;
+		for ( i = 0, chunk = sfx->soundData; i < total; i += SND_CHUNK_SIZE, chunk = chunk->next ) {
+			n = total - i;
+			if ( n > SND_CHUNK_SIZE ) {
+				n = SND_CHUNK_SIZE;
+			}
+			Com_Memcpy( chunk->sndChunk, samples + i, n * sizeof( short ) );
+		}
+	}
+
+	S_PublishSound( sfx );
+
+	return qtrue;
 }
 
 /*
@@ -217,6 +432,7 @@ qboolean S_LoadSound( sfx_t *sfx )
 	byte	*data;
 	short	*samples;
 	snd_info_t	info;
+	int		length;
 //	int		size;
 
 	// player specific sounds are never directly loaded
@@ -239,45 +455,248 @@ qboolean S_LoadSound( sfx_t *sfx )
 
 	samples = Hunk_AllocateTempMemory(info.channels * info.samples * sizeof(short) * 2);
 
-	sfx->lastTimeUsed = Com_Milliseconds()+1;
-
-	// each of these compression schemes works just fine
-	// but the 16bit quality is much nicer and with a local
-	// install assured we can rely upon the sound memory
-	// manager to do the right thing for us and page
-	// sound in as needed
-
-	if( info.channels == 1 && sfx->soundCompressed == qtrue) {
-		sfx->soundCompressionMethod = 1;
-		sfx->soundData = NULL;
-		sfx->soundLength = ResampleSfxRaw( samples, info.channels, info.rate, info.width, info.samples, data + info.dataofs );
-		S_AdpcmEncodeSound(sfx, samples);
-#if 0
-	} else if (info.channels == 1 && info.samples>(SND_CHUNK_SIZE*16) && info.width >1) {
-		sfx->soundCompressionMethod = 3;
-		sfx->soundData = NULL;
-		sfx->soundLength = ResampleSfxRaw( samples, info.channels, info.rate, info.width, info.samples, (data + info.dataofs) );
-		encodeMuLaw( sfx, samples);
-	} else if (info.channels == 1 && info.samples>(SND_CHUNK_SIZE*6400) && info.width >1) {
-		sfx->soundCompressionMethod = 2;
-		sfx->soundData = NULL;
-		sfx->soundLength = ResampleSfxRaw( samples, info.channels, info.rate, info.width, info.samples, (data + info.dataofs) );
-		encodeWavelet( sfx, samples);
-#endif
-	} else {
-		sfx->soundCompressionMethod = 0;
-		sfx->soundData = NULL;
-		sfx->soundLength = ResampleSfx( sfx, info.channels, info.rate, info.width, info.samples, data + info.dataofs, qfalse );
+	// decoding keeps off the mixer lock, the mixer thread would underrun
+	length = ResampleSfxRaw( samples, info.channels, info.rate, info.width, info.samples, data + info.dataofs );
+	if ( !S_StoreSound( sfx, samples, length, info.channels ) ) {
+		Hunk_FreeTempMemory(samples);
+		Hunk_FreeTempMemory(data);
+		return qfalse;
 	}
 
-	sfx->soundChannels = info.channels;
-	
 	Hunk_FreeTempMemory(samples);
 	Hunk_FreeTempMemory(data);
 
+	c_soundLoads++;
+
 	return qtrue;
 }
 
+/*
+===============================================================================
+
+preload manifests
+
+soundcache/<mapname>.txt lists the sounds a level used the last times it
+was played.  They are loaded with the level, converted on the job
+threads, instead of on first use in the middle of a fight.
+
+===============================================================================
+*/
+
+#define	MAX_PRELOAD_BATCH		32
+#define	PRELOAD_BATCH_BYTES		0x400000
+
+typedef struct {
+	sfx_t		*sfx;
+	snd_info_t	info;
+	byte		*data;
+	short		*samples;
+	int			length;
+} sfxPreload_t;
+
+static char		s_levelName[MAX_QPATH];
+static int		c_soundsPreloaded, c_preloadMsec;
+
+/*
+================
+S_PreloadJob
+================
+*/
+static void S_PreloadJob( void *data, int thread ) {
+	sfxPreload_t *p = data;
+
+	p->length = ResampleSfxRaw( p->samples, p->info.channels, p->info.rate, p->info.width,
+		p->info.samples, p->data + p->info.dataofs );
+}
+
+/*
+================
+S_PreloadBatch
+
+Temp memory has to be freed in the reverse order it was taken in
+================
+*/
+static void S_PreloadBatch( sfxPreload_t *batch, int count ) {
+	sfxPreload_t	*p;
+	int				i;
+
+	for ( i = 0; i < count; i++ ) {
+		Com_AddJob( S_PreloadJob, &batch[i] );
+	}
+	Com_WaitJobs();
+
+	for ( i = count - 1; i >= 0; i-- ) {
+		p = &batch[i];
+
+		S_StoreSound( p->sfx, p->samples, p->length, p->info.channels );
+
+		Hunk_FreeTempMemory( p->samples );
+		Hunk_FreeTempMemory( p->data );
+	}
+}
+
+/*
+================
+S_PreloadSounds
+
+Loads the sounds of the map's manifest that aren't resident yet, as long
+as they fit into the cache without paging out each other
+================
+*/
+void S_PreloadSounds( const char *mapname ) {
+	sfxPreload_t	batch[MAX_PRELOAD_BATCH];
+	snd_info_t		info;
+	sfx_t			*sfx;
+	char			*text, *text_p, *token;
+	byte			*data;
+	float			stepscale;
+	int				count, batchBytes, length, chunks, preloadChunks, budget, start;
+	const char		*label;
+
+	Q_strncpyz( s_levelName, mapname, sizeof( s_levelName ) );
+	c_soundsPreloaded = 0;
+	c_preloadMsec = 0;
+
+	if ( !s_levelName[0] || !s_soundPreload->integer ) {
+		return;
+	}
+
+	if ( FS_ReadFile( va( "soundcache/%s.txt", s_levelName ), (void **)&text ) <= 0 ) {
+		return;
+	}
+
+	start = Sys_Milliseconds();
+	label = Hunk_SetLabel( "sound" );
+	budget = S_CacheBudget();
+	preloadChunks = 0;
+	count = 0;
+	batchBytes = 0;
+
+	text_p = text;
+	while ( 1 ) {
+		token = COM_ParseExt( &text_p, qtrue );
+		if ( !token[0] ) {
+			break;
+		}
+
+		sfx = S_FindName( token );
+		if ( !sfx || sfx->defaultSound ) {
+			continue;
+		}
+
+		// keeps the sound in the next manifest even if it doesn't fit now
+		sfx->levelUsed = qtrue;
+
+		if ( sfx->inMemory ) {
+			// the mixer thread touches sounds as well
+			S_LockMixer();
+			S_TouchSound( sfx );
+			S_UnlockMixer();
+			preloadChunks += sfx->chunks;
+			continue;
+		}
+
+		if ( sfx->soundName[0] == '*' ) {
+			continue;
+		}
+
+		data = S_CodecLoad( sfx->soundName, &info );
+		if ( !data ) {
+			sfx->levelUsed = qfalse;
+			continue;
+		}
+
+		stepscale = (float)info.rate / dma.speed;
+		length = info.samples / stepscale;
+		chunks = S_SoundChunks( sfx, length, info.channels );
+		if ( preloadChunks + chunks > budget ) {
+			Hunk_FreeTempMemory( data );
+			continue;
+		}
+		preloadChunks += chunks;
+
+		batch[count].sfx = sfx;
+		batch[count].info = info;
+		batch[count].data = data;
+		batch[count].samples = Hunk_AllocateTempMemory( length * info.channels * sizeof( short ) );
+		batchBytes += info.size + length * info.channels * sizeof( short );
+		count++;
+
+		if ( count == MAX_PRELOAD_BATCH || batchBytes >= PRELOAD_BATCH_BYTES ) {
+			S_PreloadBatch( batch, count );
+			c_soundsPreloaded += count;
+			count = 0;
+			batchBytes = 0;
+		}
+	}
+
+	S_PreloadBatch( batch, count );
+	c_soundsPreloaded += count;
+
+	FS_FreeFile( text );
+	Hunk_SetLabel( label );
+
+	c_preloadMsec = Sys_Milliseconds() - start;
+	Com_DPrintf( "S_PreloadSounds: %i sounds for %s in %i msec\n", c_soundsPreloaded, s_levelName, c_preloadMsec );
+}
+
+/*
+================
+S_WriteSoundManifest
+
+Writes the sounds the level used into its manifest, called when the
+level's sounds are disabled
+================
+*/
+void S_WriteSoundManifest( void ) {
+	sfx_t	*sfx;
+	char	*text;
+	int		i, size, len;
+
+	if ( !s_levelName[0] ) {
+		return;
+	}
+
+	size = 0;
+	for ( i = 0, sfx = s_knownSfx; i < s_numSfx; i++, sfx++ ) {
+		if ( sfx->levelUsed && !sfx->defaultSound && sfx->soundName[0] && sfx->soundName[0] != '*' ) {
+			size += strlen( sfx->soundName ) + 1;
+		}
+	}
+
+	if ( size ) {
+		text = Z_Malloc( size + 1 );
+		len = 0;
+		for ( i = 0, sfx = s_knownSfx; i < s_numSfx; i++, sfx++ ) {
+			if ( sfx->levelUsed && !sfx->defaultSound && sfx->soundName[0] && sfx->soundName[0] != '*' ) {
+				len += Com_sprintf( text + len, size + 1 - len, "%s\n", sfx->soundName );
+			}
+		}
+
+		FS_WriteFile( va( "soundcache/%s.txt", s_levelName ), text, len );
+		Z_Free( text );
+	}
+
+	for ( i = 0, sfx = s_knownSfx; i < s_numSfx; i++, sfx++ ) {
+		sfx->levelUsed = qfalse;
+	}
+	s_levelName[0] = '\0';
+}
+
 void S_DisplayFreeMemory(void) {
+	int		resident;
+	sfx_t	*sfx;
+
+	resident = 0;
+	for ( sfx = lruFirst; sfx; sfx = sfx->lruNext ) {
+		resident++;
+	}
+
 	Com_Printf("%d bytes free sound buffer memory, %d total used\n", inUse, totalInUse);
+	Com_Printf("%i sounds cached in %i of %i KB, %i loads, %i paged out\n", resident,
+		chunksInUse * (int)sizeof(sndBuffer) / 1024, S_CacheBudget() * (int)sizeof(sndBuffer) / 1024,
+		c_soundLoads, c_soundEvictions);
+	if ( s_levelName[0] ) {
+		Com_Printf("%i sounds preloaded for %s in %i msec\n", c_soundsPreloaded, s_levelName, c_preloadMsec);
+	}
 }
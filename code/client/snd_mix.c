@@ -111,6 +111,131 @@ LClampDone2:
 
 #endif
 
+/*
+===============================================================================
+
+MIXING KERNELS
+
+Whatever the source format, mixing ends up as runs of 16 bit samples,
+mono or interleaved stereo, scaled by the channel volumes and added to the
+paint buffer.  The clip kernel narrows the paint buffer back down to 16
+bit for the device.  The NEON versions do four samples at a time and give
+the same result as the scalar loops, bit for bit.
+
+===============================================================================
+*/
+
+static void S_MixMono16_scalar( portable_samplepair_t *samp, const short *samples, int count, int leftvol, int rightvol ) {
+	int		i, data;
+
+	for ( i = 0 ; i < count ; i++ ) {
+		data = samples[i];
+		samp[i].left += ( data * leftvol ) >> 8;
+		samp[i].right += ( data * rightvol ) >> 8;
+	}
+}
+
+static void S_MixStereo16_scalar( portable_samplepair_t *samp, const short *samples, int count, int leftvol, int rightvol ) {
+	int		i;
+
+	for ( i = 0 ; i < count ; i++ ) {
+		samp[i].left += ( samples[i*2] * leftvol ) >> 8;
+		samp[i].right += ( samples[i*2+1] * rightvol ) >> 8;
+	}
+}
+
+#ifdef __vita__
+#include <arm_neon.h>
+
+static void S_MixMono16_neon( portable_samplepair_t *samp, const short *samples, int count, int leftvol, int rightvol ) {
+	int32x4x2_t	d;
+	int32x4_t	s;
+	int			i;
+
+	for ( i = 0 ; i + 4 <= count ; i += 4 ) {
+		s = vmovl_s16( vld1_s16( samples + i ) );
+		d = vld2q_s32( &samp[i].left );
+		d.val[0] = vaddq_s32( d.val[0], vshrq_n_s32( vmulq_n_s32( s, leftvol ), 8 ) );
+		d.val[1] = vaddq_s32( d.val[1], vshrq_n_s32( vmulq_n_s32( s, rightvol ), 8 ) );
+		vst2q_s32( &samp[i].left, d );
+	}
+
+	S_MixMono16_scalar( samp + i, samples + i, count - i, leftvol, rightvol );
+}
+
+static void S_MixStereo16_neon( portable_samplepair_t *samp, const short *samples, int count, int leftvol, int rightvol ) {
+	int32x4x2_t	d;
+	int16x4x2_t	s;
+	int			i;
+
+	for ( i = 0 ; i + 4 <= count ; i += 4 ) {
+		s = vld2_s16( samples + i * 2 );
+		d = vld2q_s32( &samp[i].left );
+		d.val[0] = vaddq_s32( d.val[0], vshrq_n_s32( vmulq_n_s32( vmovl_s16( s.val[0] ), leftvol ), 8 ) );
+		d.val[1] = vaddq_s32( d.val[1], vshrq_n_s32( vmulq_n_s32( vmovl_s16( s.val[1] ), rightvol ), 8 ) );
+		vst2q_s32( &samp[i].left, d );
+	}
+
+	S_MixStereo16_scalar( samp + i, samples + i * 2, count - i, leftvol, rightvol );
+}
+
+// the saturating narrowing shift is exactly the >>8 and clamp of the C version
+static void S_WriteLinearBlastStereo16_neon( void ) {
+	int		i, val;
+
+	for ( i = 0 ; i + 8 <= snd_linear_count ; i += 8 ) {
+		vst1q_s16( snd_out + i, vcombine_s16( vqshrn_n_s32( vld1q_s32( snd_p + i ), 8 ),
+											  vqshrn_n_s32( vld1q_s32( snd_p + i + 4 ), 8 ) ) );
+	}
+
+	for ( ; i < snd_linear_count ; i++ ) {
+		val = snd_p[i] >> 8;
+		snd_out[i] = val > 0x7fff ? 0x7fff : val < -32768 ? -32768 : val;
+	}
+}
+#define S_MixMono16_simd S_MixMono16_neon
+#define S_MixStereo16_simd S_MixStereo16_neon
+#define S_WriteLinearBlastStereo16_simd S_WriteLinearBlastStereo16_neon
+#else
+// without NEON the two mix loops use GCC vector types, four mono samples or
+// two stereo pairs per add, and the clip keeps the C loop
+typedef int mixVec4_t __attribute__ ( ( vector_size( 16 ) ) );
+
+static void S_MixMono16_vec( portable_samplepair_t *samp, const short *samples, int count, int leftvol, int rightvol ) {
+	mixVec4_t	s, l, r, d[2];
+	int			i;
+
+	for ( i = 0 ; i + 4 <= count ; i += 4 ) {
+		s = (mixVec4_t){ samples[i], samples[i+1], samples[i+2], samples[i+3] };
+		l = ( s * leftvol ) >> 8;
+		r = ( s * rightvol ) >> 8;
+		memcpy( d, &samp[i], sizeof( d ) );
+		d[0] += (mixVec4_t){ l[0], r[0], l[1], r[1] };
+		d[1] += (mixVec4_t){ l[2], r[2], l[3], r[3] };
+		memcpy( &samp[i], d, sizeof( d ) );
+	}
+
+	S_MixMono16_scalar( samp + i, samples + i, count - i, leftvol, rightvol );
+}
+
+static void S_MixStereo16_vec( portable_samplepair_t *samp, const short *samples, int count, int leftvol, int rightvol ) {
+	mixVec4_t	vol, d;
+	int			i;
+
+	vol = (mixVec4_t){ leftvol, rightvol, leftvol, rightvol };
+	for ( i = 0 ; i + 2 <= count ; i += 2 ) {
+		memcpy( &d, &samp[i], sizeof( d ) );
+		d += ( (mixVec4_t){ samples[i*2], samples[i*2+1], samples[i*2+2], samples[i*2+3] } * vol ) >> 8;
+		memcpy( &samp[i], &d, sizeof( d ) );
+	}
+
+	S_MixStereo16_scalar( samp + i, samples + i * 2, count - i, leftvol, rightvol );
+}
+#define S_MixMono16_simd S_MixMono16_vec
+#define S_MixStereo16_simd S_MixStereo16_vec
+#define S_WriteLinearBlastStereo16_simd S_WriteLinearBlastStereo16
+#endif
+
 void S_TransferStereo16 (unsigned long *pbuf, int endtime)
 {
 	int		lpos;
@@ -133,7 +258,7 @@ void S_TransferStereo16 (unsigned long *pbuf, int endtime)
 		snd_linear_count <<= 1; // snd_linear_count *= dma.channels
 
 	// write a linear blast of samples
-		S_WriteLinearBlastStereo16 ();
+		S_WriteLinearBlastStereo16_simd ();
 
 		snd_p += snd_linear_count;
 		ls_paintedtime += (snd_linear_count>>1); // snd_linear_count / dma.channels
@@ -766,6 +891,70 @@ static void S_PaintChannelFrom16_scalar( channel_t *ch, const sfx_t *sc, int cou
 	}
 }
 
+static void S_PaintChannelFrom16_simd( channel_t *ch, const sfx_t *sc, int count, int sampleOffset, int bufferOffset ) {
+	int						leftvol, rightvol;
+	int						run;
+	portable_samplepair_t	*samp;
+	sndBuffer				*chunk;
+
+	if (sc->soundChannels <= 0) {
+		return;
+	}
+
+	if (ch->doppler && ch->dopplerScale!=1.0f) {
+		// resampling doesn't vectorize
+		S_PaintChannelFrom16_scalar( ch, sc, count, sampleOffset, bufferOffset );
+		return;
+	}
+
+	samp = &paintbuffer[ bufferOffset ];
+
+	if (ch->doppler) {
+		sampleOffset = sampleOffset*ch->oldDopplerScale;
+	}
+
+	if ( sc->soundChannels == 2 ) {
+		sampleOffset *= sc->soundChannels;
+
+		if ( sampleOffset & 1 ) {
+			sampleOffset &= ~1;
+		}
+	}
+
+	chunk = sc->soundData;
+	while (sampleOffset>=SND_CHUNK_SIZE) {
+		chunk = chunk->next;
+		sampleOffset -= SND_CHUNK_SIZE;
+		if (!chunk) {
+			chunk = sc->soundData;
+		}
+	}
+
+	leftvol = ch->leftvol*snd_vol;
+	rightvol = ch->rightvol*snd_vol;
+
+	// mix a run at a time, up to the end of each chunk
+	while ( count > 0 ) {
+		if (sampleOffset == SND_CHUNK_SIZE) {
+			chunk = chunk->next;
+			sampleOffset = 0;
+		}
+
+		if ( sc->soundChannels == 2 ) {
+			run = MIN( count, ( SND_CHUNK_SIZE - sampleOffset ) / 2 );
+			S_MixStereo16_simd( samp, chunk->sndChunk + sampleOffset, run, leftvol, rightvol );
+			sampleOffset += run * 2;
+		} else {
+			run = MIN( count, SND_CHUNK_SIZE - sampleOffset );
+			S_MixMono16_simd( samp, chunk->sndChunk + sampleOffset, run, leftvol, rightvol );
+			sampleOffset += run;
+		}
+
+		samp += run;
+		count -= run;
+	}
+}
+
 static void S_PaintChannelFrom16( channel_t *ch, const sfx_t *sc, int count, int sampleOffset, int bufferOffset ) {
 #if idppc_altivec
 	if (com_altivec->integer) {
@@ -774,16 +963,14 @@ static void S_PaintChannelFrom16( channel_t *ch, const sfx_t *sc, int count, int
 		return;
 	}
 #endif
-	S_PaintChannelFrom16_scalar( ch, sc, count, sampleOffset, bufferOffset );
+	S_PaintChannelFrom16_simd( ch, sc, count, sampleOffset, bufferOffset );
 }
 
 void S_PaintChannelFromWavelet( channel_t *ch, sfx_t *sc, int count, int sampleOffset, int bufferOffset ) {
-	int						data;
 	int						leftvol, rightvol;
-	int						i;
+	int						i, run;
 	portable_samplepair_t	*samp;
 	sndBuffer				*chunk;
-	short					*samples;
 
 	leftvol = ch->leftvol*snd_vol;
 	rightvol = ch->rightvol*snd_vol;
@@ -798,34 +985,32 @@ void S_PaintChannelFromWavelet( channel_t *ch, sfx_t *sc, int count, int sampleO
 	}
 
 	if (i!=sfxScratchIndex || sfxScratchPointer != sc) {
-		S_AdpcmGetSamples( chunk, sfxScratchBuffer );
+		decodeWavelet( chunk, sfxScratchBuffer );
 		sfxScratchIndex = i;
 		sfxScratchPointer = sc;
 	}
 
-	samples = sfxScratchBuffer;
-
-	for ( i=0 ; i<count ; i++ ) {
-		data  = samples[sampleOffset++];
-		samp[i].left += (data * leftvol)>>8;
-		samp[i].right += (data * rightvol)>>8;
-
+	while ( count > 0 ) {
 		if (sampleOffset == SND_CHUNK_SIZE*2) {
 			chunk = chunk->next;
 			decodeWavelet(chunk, sfxScratchBuffer);
 			sfxScratchIndex++;
 			sampleOffset = 0;
 		}
+
+		run = MIN( count, SND_CHUNK_SIZE*2 - sampleOffset );
+		S_MixMono16_simd( samp, sfxScratchBuffer + sampleOffset, run, leftvol, rightvol );
+		sampleOffset += run;
+		samp += run;
+		count -= run;
 	}
 }
 
 void S_PaintChannelFromADPCM( channel_t *ch, sfx_t *sc, int count, int sampleOffset, int bufferOffset ) {
-	int						data;
 	int						leftvol, rightvol;
-	int						i;
+	int						i, run;
 	portable_samplepair_t	*samp;
 	sndBuffer				*chunk;
-	short					*samples;
 
 	leftvol = ch->leftvol*snd_vol;
 	rightvol = ch->rightvol*snd_vol;
@@ -850,19 +1035,21 @@ void S_PaintChannelFromADPCM( channel_t *ch, sfx_t *sc, int count, int sampleOff
 		sfxScratchPointer = sc;
 	}
 
-	samples = sfxScratchBuffer;
-
-	for ( i=0 ; i<count ; i++ ) {
-		data  = samples[sampleOffset++];
-		samp[i].left += (data * leftvol)>>8;
-		samp[i].right += (data * rightvol)>>8;
-
+	// the decode is a serial predictor, only the mixing of the
+	// decoded chunk is vectorized
+	while ( count > 0 ) {
 		if (sampleOffset == SND_CHUNK_SIZE*4) {
 			chunk = chunk->next;
 			S_AdpcmGetSamples( chunk, sfxScratchBuffer);
 			sampleOffset = 0;
 			sfxScratchIndex++;
 		}
+
+		run = MIN( count, SND_CHUNK_SIZE*4 - sampleOffset );
+		S_MixMono16_simd( samp, sfxScratchBuffer + sampleOffset, run, leftvol, rightvol );
+		sampleOffset += run;
+		samp += run;
+		count -= run;
 	}
 }
 
@@ -874,6 +1061,8 @@ void S_PaintChannelFromMuLaw( channel_t *ch, sfx_t *sc, int count, int sampleOff
 	sndBuffer				*chunk;
 	byte					*samples;
 	float					ooff;
+	short					decoded[256];
+	int						run;
 
 	leftvol = ch->leftvol*snd_vol;
 	rightvol = ch->rightvol*snd_vol;
@@ -889,16 +1078,23 @@ void S_PaintChannelFromMuLaw( channel_t *ch, sfx_t *sc, int count, int sampleOff
 	}
 
 	if (!ch->doppler) {
-		samples = (byte *)chunk->sndChunk + sampleOffset;
-		for ( i=0 ; i<count ; i++ ) {
-			data  = mulawToShort[*samples];
-			samp[i].left += (data * leftvol)>>8;
-			samp[i].right += (data * rightvol)>>8;
-			samples++;
-			if (chunk != NULL && samples == (byte *)chunk->sndChunk+(SND_CHUNK_SIZE*2)) {
+		// table decode a block at a time, then mix it like 16 bit
+		while ( count > 0 ) {
+			if (sampleOffset == SND_CHUNK_SIZE*2) {
 				chunk = chunk->next;
-				samples = (byte *)chunk->sndChunk;
+				sampleOffset = 0;
 			}
+
+			samples = (byte *)chunk->sndChunk + sampleOffset;
+			run = MIN( count, MIN( SND_CHUNK_SIZE*2 - sampleOffset, (int)ARRAY_LEN( decoded ) ) );
+			for ( i=0 ; i<run ; i++ ) {
+				decoded[i] = mulawToShort[samples[i]];
+			}
+			S_MixMono16_simd( samp, decoded, run, leftvol, rightvol );
+
+			sampleOffset += run;
+			samp += run;
+			count -= run;
 		}
 	} else {
 		ooff = sampleOffset;
@@ -1008,9 +1204,10 @@ void S_PaintChannels( int endtime ) {
 			ltime = s_paintedtime;
 			sc = ch->thesfx;
 
-			// (SA) hmm, why was this commented out?
+			// paged out while playing, loading from here would stall
+			// the mix (and can't be done from the mixer thread)
 			if ( !sc->inMemory ) {
-				S_memoryLoad( sc );
+				continue;
 			}
 
 			if (sc->soundData==NULL || sc->soundLength==0) {
@@ -1045,6 +1242,9 @@ void S_PaintChannels( int endtime ) {
 						}
 					}
 				}
+				if ( ch->isVirtual ) {
+					continue;	// the talk amplitude above still follows it
+				}
 				if( sc->soundCompressionMethod == 1) {
 					S_PaintChannelFromADPCM		(ch, sc, count, sampleOffset, ltime - s_paintedtime);
 				} else if( sc->soundCompressionMethod == 2) {
@@ -1060,7 +1260,7 @@ void S_PaintChannels( int endtime ) {
 		// paint in the looped channels.
 		ch = loop_channels;
 		for ( i = 0; i < numLoopChannels ; i++, ch++ ) {		
-			if ( !ch->thesfx || (!ch->leftvol && !ch->rightvol )) {
+			if ( !ch->thesfx || (!ch->leftvol && !ch->rightvol ) || ch->isVirtual ) {
 				continue;
 			}
 
@@ -1123,3 +1323,187 @@ void S_PaintChannels( int endtime ) {
 		firstPass = qfalse;
 	}
 }
+
+typedef struct {
+	channel_t	*channels;
+	int			numChannels;
+	sfx_t		*sfx;
+	int			format;
+	short		*out[2];		// scalar and simd clip output
+} mixBench_t;
+
+static void S_MixBenchPaint( mixBench_t *m, qboolean scalar ) {
+	channel_t	*ch;
+	int			i, offset;
+
+	Com_Memset( paintbuffer, 0, sizeof( paintbuffer ) );
+	for ( i = 0, ch = m->channels; i < m->numChannels; i++, ch++ ) {
+		// spread the channels over the sound so they don't share decodes
+		offset = i * 1543 & ( SND_CHUNK_SIZE - 1 );
+		if ( m->format == 2 ) {
+			S_PaintChannelFromADPCM( ch, m->sfx, PAINTBUFFER_SIZE, offset, 0 );
+		} else if ( m->format == 3 ) {
+			S_PaintChannelFromWavelet( ch, m->sfx, PAINTBUFFER_SIZE, offset, 0 );
+		} else if ( m->format == 4 ) {
+			S_PaintChannelFromMuLaw( ch, m->sfx, PAINTBUFFER_SIZE, offset, 0 );
+		} else if ( scalar ) {
+			S_PaintChannelFrom16_scalar( ch, m->sfx, PAINTBUFFER_SIZE, offset, 0 );
+		} else {
+			S_PaintChannelFrom16_simd( ch, m->sfx, PAINTBUFFER_SIZE, offset, 0 );
+		}
+	}
+}
+
+static void S_MixBenchPaintScalar( benchmark_t *b ) {
+	S_MixBenchPaint( b->data, qtrue );
+}
+
+static void S_MixBenchPaintSimd( benchmark_t *b ) {
+	S_MixBenchPaint( b->data, qfalse );
+}
+
+static float S_MixBenchComparePaint( benchmark_t *b ) {
+	static portable_samplepair_t reference[PAINTBUFFER_SIZE];
+	int		i, maxError;
+
+	// the simd paint ran last, paint once more with the scalar loop
+	Com_Memcpy( reference, paintbuffer, sizeof( reference ) );
+	S_MixBenchPaint( b->data, qtrue );
+
+	maxError = 0;
+	for ( i = 0; i < PAINTBUFFER_SIZE; i++ ) {
+		maxError = MAX( maxError, abs( reference[i].left - paintbuffer[i].left ) );
+		maxError = MAX( maxError, abs( reference[i].right - paintbuffer[i].right ) );
+	}
+	return maxError;
+}
+
+// what the mono device used to take
+static void S_MixBenchClipMono( benchmark_t *b ) {
+	mixBench_t	*m = b->data;
+	int			i, val;
+
+	for ( i = 0; i < PAINTBUFFER_SIZE; i++ ) {
+		val = paintbuffer[i].left >> 8;
+		m->out[1][i] = val > 0x7fff ? 0x7fff : val < -32768 ? -32768 : val;
+	}
+}
+
+static void S_MixBenchClipScalar( benchmark_t *b ) {
+	mixBench_t	*m = b->data;
+
+	snd_p = (int *)paintbuffer;
+	snd_out = m->out[0];
+	snd_linear_count = PAINTBUFFER_SIZE * 2;
+	S_WriteLinearBlastStereo16();
+}
+
+static void S_MixBenchClipSimd( benchmark_t *b ) {
+	mixBench_t	*m = b->data;
+
+	snd_p = (int *)paintbuffer;
+	snd_out = m->out[1];
+	snd_linear_count = PAINTBUFFER_SIZE * 2;
+	S_WriteLinearBlastStereo16_simd();
+}
+
+static float S_MixBenchCompareClip( benchmark_t *b ) {
+	mixBench_t	*m = b->data;
+	int			i, maxError;
+
+	maxError = 0;
+	for ( i = 0; i < PAINTBUFFER_SIZE * 2; i++ ) {
+		maxError = MAX( maxError, abs( m->out[0][i] - m->out[1][i] ) );
+	}
+	return maxError;
+}
+
+/*
+=================
+S_MixBench_f
+
+s_mixbench [channels] [msec]
+Paints looping noise in every source format, only the 16 bit formats
+have a scalar loop to compare against, then clips the last paint for
+the old mono and the stereo device
+=================
+*/
+void S_MixBench_f( void ) {
+	static const char *formats[] = { "16bit mono", "16bit stereo", "adpcm", "daub4", "mulaw" };
+	static const int methods[] = { 0, 0, 1, 2, 3 };
+	mixBench_t	m;
+	benchmark_t	b;
+	sndBuffer	*chunks;
+	sfx_t		sfx;
+	int			i, j;
+
+	Com_Memset( &b, 0, sizeof( b ) );
+	if ( !Com_BenchArgs( "channel", 32, MAX_CHANNELS, &m.numChannels, &b.msec ) ) {
+		return;
+	}
+
+	// a looping sound made of four chunks of noise
+	chunks = Z_Malloc( 4 * sizeof( *chunks ) );
+	for ( i = 0; i < 4; i++ ) {
+		for ( j = 0; j < SND_CHUNK_SIZE; j++ ) {
+			chunks[i].sndChunk[j] = ( rand() & 0xffff ) - 0x8000;
+		}
+		chunks[i].next = &chunks[( i + 1 ) & 3];
+		chunks[i].size = SND_CHUNK_SIZE * 2;
+	}
+
+	m.channels = Z_Malloc( m.numChannels * sizeof( *m.channels ) );
+	for ( i = 0; i < m.numChannels; i++ ) {
+		m.channels[i].leftvol = rand() & 127;
+		m.channels[i].rightvol = rand() & 127;
+		m.channels[i].master_vol = 127;
+	}
+
+	m.out[0] = Z_Malloc( PAINTBUFFER_SIZE * 2 * 2 * sizeof( short ) );
+	m.out[1] = m.out[0] + PAINTBUFFER_SIZE * 2;
+
+	Com_Memset( &sfx, 0, sizeof( sfx ) );
+	sfx.soundData = chunks;
+	sfx.soundLength = 1 << 20;
+	sfx.inMemory = qtrue;
+	m.sfx = &sfx;
+
+	b.unit = "sample";
+	b.data = &m;
+
+	// the mixer thread shares the paint buffer and the decode scratch
+	S_LockMixer();
+	snd_vol = 255;
+
+	b.units = m.numChannels * PAINTBUFFER_SIZE;
+	for ( m.format = 0; m.format < (int)ARRAY_LEN( formats ); m.format++ ) {
+		sfx.soundChannels = ( m.format == 1 ) ? 2 : 1;
+		sfx.soundCompressionMethod = methods[m.format];
+
+		b.name = va( "%-12s x %i", formats[m.format], m.numChannels );
+		b.scalar = methods[m.format] ? NULL : S_MixBenchPaintScalar;
+		b.simd = S_MixBenchPaintSimd;
+		b.compare = S_MixBenchComparePaint;
+		Com_Benchmark( &b );
+	}
+
+	b.units = PAINTBUFFER_SIZE;
+	b.name = "mono out";
+	b.scalar = NULL;
+	b.simd = S_MixBenchClipMono;
+	Com_Benchmark( &b );
+
+	b.name = "stereo out";
+	b.scalar = S_MixBenchClipScalar;
+	b.simd = S_MixBenchClipSimd;
+	b.compare = S_MixBenchCompareClip;
+	Com_Benchmark( &b );
+
+	// the scratch buffer now holds noise, make the next mix decode again
+	sfxScratchPointer = NULL;
+	S_UnlockMixer();
+
+	Z_Free( m.out[0] );
+	Z_Free( m.channels );
+	Z_Free( chunks );
+}
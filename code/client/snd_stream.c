@@ -0,0 +1,629 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+
+
+// snd_stream.c -- music and streaming sounds decoded ahead of the mixer
+//
+// Every raw stream gets a ring of decoded pcm that a decoder thread keeps
+// topped up, so ogg and wav decoding never runs on the main thread.  The
+// main thread only opens and closes the codec streams, which needs the
+// zone, and copies the decoded data into the raw samples.  Without the
+// thread the rings are filled from S_Update instead.
+
+#include "snd_local.h"
+#include "snd_codec.h"
+
+#ifdef __vita__
+#include <vitasdk.h>
+#endif
+
+#define STREAM_RING_SIZE		0x20000		// bytes of pcm per stream, power of two
+#define STREAM_DECODE_BLOCK		0x4000		// bytes decoded per codec call
+
+typedef struct {
+	snd_stream_t	*stream;		// being decoded
+	snd_stream_t	*next;			// opened by the main thread, decoded once stream ends
+	snd_stream_t	*done;			// ended, closed by the main thread
+	snd_stream_t	*orphan;		// closed while a block of it was decoded, closed by the main thread
+	qboolean		decoding;		// the decoder reads stream without the lock
+	snd_info_t		info;			// format of the pcm in the ring
+	char			name[MAX_QPATH];
+	char			loop[MAX_QPATH];
+
+	byte			*ring;
+	volatile unsigned	written;	// bytes the decoder put into the ring
+	volatile unsigned	read;		// bytes the main thread took out of it
+	volatile qboolean	eof;		// nothing left to decode
+
+	qboolean		started;		// underruns only count once playback started
+	int				underruns;
+	int				blocks;
+	int				decodedBytes;
+	int				decodeMaxUsec;
+	int64_t			decodeUsec;
+} streamDecoder_t;
+
+static streamDecoder_t	s_streams[MAX_RAW_STREAMS];
+static byte				s_decodeBlock[STREAM_DECODE_BLOCK];
+
+static cvar_t			*s_streamThread;
+static qboolean			s_streamThreadRunning;
+
+#ifdef __vita__
+static SceKernelLwMutexWork	s_streamLock;
+static SceUID				s_streamSema;
+static SceUID				s_streamThreadId;
+static volatile qboolean	s_streamThreadQuit;
+
+#define S_StreamLock()		sceKernelLockLwMutex( &s_streamLock, 1, NULL )
+#define S_StreamUnlock()	sceKernelUnlockLwMutex( &s_streamLock, 1 )
+#else
+#define S_StreamLock()
+#define S_StreamUnlock()
+#endif
+
+/*
+=================
+S_StreamClock
+
+Microseconds, for the decode time stats
+=================
+*/
+static int64_t S_StreamClock( void ) {
+#ifdef __vita__
+	return sceKernelGetProcessTimeWide();
+#else
+	return (int64_t)Sys_Milliseconds() * 1000;
+#endif
+}
+
+/*
+=================
+S_StreamOpenFile
+
+Opens a codec stream the raw samples can take
+=================
+*/
+static snd_stream_t *S_StreamOpenFile( const char *filename ) {
+	snd_stream_t *stream;
+
+	stream = S_CodecOpenStream( filename );
+	if ( !stream ) {
+		return NULL;
+	}
+
+	if ( stream->info.width < 1 || stream->info.width > 2 || stream->info.channels < 1 || stream->info.channels > 2 ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: %s is not 8 or 16 bit mono or stereo\n", filename );
+		S_CodecCloseStream( stream );
+		return NULL;
+	}
+
+	return stream;
+}
+
+/*
+=================
+S_StreamNextFile
+
+Called when the codec stream ran out.  A queued file with a different
+format has to wait until the ring is drained, the ring holds one format.
+Returns qtrue if decoding can go on.
+=================
+*/
+static qboolean S_StreamNextFile( streamDecoder_t *d ) {
+	snd_info_t *info;
+
+	if ( !d->next ) {
+		// S_StreamUpdate queues the loop file, unless there is none
+		if ( !d->loop[0] ) {
+			d->eof = qtrue;
+		}
+		return qfalse;
+	}
+
+	if ( d->done ) {
+		return qfalse;
+	}
+
+	info = &d->next->info;
+	if ( ( info->rate != d->info.rate || info->width != d->info.width || info->channels != d->info.channels )
+		&& d->written != d->read ) {
+		return qfalse;
+	}
+
+	d->done = d->stream;
+	d->stream = d->next;
+	d->next = NULL;
+	d->info = d->stream->info;
+	return qtrue;
+}
+
+/*
+=================
+S_StreamDecode
+
+Decodes one block into the ring, returns qtrue if there may be more to do.
+The codec runs without the stream lock, so the main thread doesn't wait
+for the card or the decoder in S_StreamUpdate.
+=================
+*/
+static qboolean S_StreamDecode( streamDecoder_t *d ) {
+	snd_stream_t	*stream;
+	int		frame, bytes, r, ofs, n;
+	int64_t	start, usec;
+	qboolean	more;
+
+	S_StreamLock();
+	stream = d->stream;
+	if ( !stream || d->eof ) {
+		S_StreamUnlock();
+		return qfalse;
+	}
+
+	frame = d->info.width * d->info.channels;
+	bytes = STREAM_RING_SIZE - ( d->written - d->read );
+	if ( bytes > STREAM_DECODE_BLOCK ) {
+		bytes = STREAM_DECODE_BLOCK;
+	}
+	bytes -= bytes % frame;
+
+	// nearly full, wait for the mixer to take some
+	if ( bytes < STREAM_DECODE_BLOCK / 4 ) {
+		S_StreamUnlock();
+		return qfalse;
+	}
+
+	// S_StreamClose leaves the stream to us until the block is done
+	d->decoding = qtrue;
+	S_StreamUnlock();
+
+	start = S_StreamClock();
+	r = S_CodecReadStream( stream, bytes, s_decodeBlock );
+	usec = S_StreamClock() - start;
+
+	S_StreamLock();
+	d->decoding = qfalse;
+
+	if ( d->stream != stream ) {
+		// closed meanwhile, the ring may be gone as well
+		d->orphan = stream;
+		S_StreamUnlock();
+		return qfalse;
+	}
+
+	d->decodeUsec += usec;
+	if ( usec > d->decodeMaxUsec ) {
+		d->decodeMaxUsec = usec;
+	}
+
+	r -= r % frame;
+	if ( r <= 0 ) {
+		more = S_StreamNextFile( d );
+		S_StreamUnlock();
+		return more;
+	}
+
+	ofs = d->written & ( STREAM_RING_SIZE - 1 );
+	n = STREAM_RING_SIZE - ofs;
+	if ( n > r ) {
+		n = r;
+	}
+	Com_Memcpy( d->ring + ofs, s_decodeBlock, n );
+	Com_Memcpy( d->ring, s_decodeBlock + n, r - n );
+
+	// the data has to be there before the reader sees it
+	__sync_synchronize();
+	d->written += r;
+
+	d->blocks++;
+	d->decodedBytes += r;
+	S_StreamUnlock();
+	return qtrue;
+}
+
+/*
+=================
+S_StreamFill
+=================
+*/
+static void S_StreamFill( streamDecoder_t *d ) {
+	while ( S_StreamDecode( d ) ) {
+	}
+}
+
+/*
+=================
+S_StreamFillAll
+=================
+*/
+static void S_StreamFillAll( void ) {
+	int i;
+
+	for ( i = 0; i < MAX_RAW_STREAMS; i++ ) {
+		if ( s_streams[i].stream ) {
+			S_StreamFill( &s_streams[i] );
+		}
+	}
+}
+
+#ifdef __vita__
+/*
+=================
+S_StreamThread
+
+Woken whenever the main thread took data out of a ring
+=================
+*/
+static int S_StreamThread( SceSize args, void *argp ) {
+	SceUInt timeout;
+
+	while ( !s_streamThreadQuit ) {
+		timeout = 20000;
+		sceKernelWaitSema( s_streamSema, 1, &timeout );
+		S_StreamFillAll();
+	}
+
+	return sceKernelExitThread( 0 );
+}
+#endif
+
+/*
+=================
+S_StreamWake
+=================
+*/
+static void S_StreamWake( void ) {
+#ifdef __vita__
+	if ( s_streamThreadRunning ) {
+		sceKernelSignalSema( s_streamSema, 1 );
+	}
+#endif
+}
+
+/*
+=================
+S_StreamOpen
+
+Starts decoding filename on a raw stream, then loop over and over if
+given.  The stream keeps its raw samples.
+=================
+*/
+qboolean S_StreamOpen( int slot, const char *filename, const char *loop, snd_info_t *info ) {
+	streamDecoder_t	*d;
+	snd_stream_t	*stream;
+
+	if ( slot < 0 || slot >= MAX_RAW_STREAMS ) {
+		return qfalse;
+	}
+
+	S_StreamClose( slot );
+
+	stream = S_StreamOpenFile( filename );
+	if ( !stream ) {
+		return qfalse;
+	}
+
+	d = &s_streams[slot];
+	Q_strncpyz( d->name, filename, sizeof( d->name ) );
+	Q_strncpyz( d->loop, loop ? loop : "", sizeof( d->loop ) );
+	d->info = stream->info;
+	d->ring = Z_Malloc( STREAM_RING_SIZE );
+	d->written = d->read = 0;
+	d->eof = qfalse;
+	d->started = qfalse;
+	d->underruns = 0;
+	d->blocks = 0;
+	d->decodedBytes = 0;
+	d->decodeMaxUsec = 0;
+	d->decodeUsec = 0;
+
+	if ( info ) {
+		*info = stream->info;
+	}
+
+	S_StreamLock();
+	d->stream = stream;
+	S_StreamUnlock();
+
+	S_StreamWake();
+	return qtrue;
+}
+
+/*
+=================
+S_StreamClose
+=================
+*/
+void S_StreamClose( int slot ) {
+	streamDecoder_t	*d;
+	snd_stream_t	*stream, *next, *done, *orphan;
+
+	if ( slot < 0 || slot >= MAX_RAW_STREAMS ) {
+		return;
+	}
+
+	d = &s_streams[slot];
+
+	// once the pointers are gone the decoder leaves the stream alone,
+	// a stream it is decoding right now comes back as the orphan
+	S_StreamLock();
+	stream = d->decoding ? NULL : d->stream;
+	next = d->next;
+	done = d->done;
+	orphan = d->orphan;
+	d->stream = d->next = d->done = d->orphan = NULL;
+	S_StreamUnlock();
+
+	if ( stream ) {
+		S_CodecCloseStream( stream );
+	}
+	if ( next ) {
+		S_CodecCloseStream( next );
+	}
+	if ( done ) {
+		S_CodecCloseStream( done );
+	}
+	if ( orphan ) {
+		S_CodecCloseStream( orphan );
+	}
+	if ( d->ring ) {
+		Z_Free( d->ring );
+		d->ring = NULL;
+	}
+}
+
+/*
+=================
+S_StreamActive
+=================
+*/
+qboolean S_StreamActive( int slot ) {
+	return s_streams[slot].stream != NULL;
+}
+
+/*
+=================
+S_StreamFinished
+
+The file and its loops were decoded and everything was read
+=================
+*/
+qboolean S_StreamFinished( int slot ) {
+	streamDecoder_t *d = &s_streams[slot];
+
+	return !d->stream || ( d->eof && d->written == d->read );
+}
+
+/*
+=================
+S_StreamAvailable
+
+Bytes of decoded pcm ready for S_StreamRead, and their format
+=================
+*/
+int S_StreamAvailable( int slot, snd_info_t *info ) {
+	streamDecoder_t	*d = &s_streams[slot];
+	int				avail;
+
+	avail = d->written - d->read;
+	if ( avail && info ) {
+		// the format only changes while the ring is empty
+		__sync_synchronize();
+		*info = d->info;
+	}
+
+	return avail;
+}
+
+/*
+=================
+S_StreamRead
+=================
+*/
+int S_StreamRead( int slot, void *buffer, int bytes ) {
+	streamDecoder_t	*d = &s_streams[slot];
+	int				avail, ofs, n;
+
+	avail = d->written - d->read;
+	if ( bytes > avail ) {
+		bytes = avail;
+	}
+	if ( bytes <= 0 ) {
+		return 0;
+	}
+
+	__sync_synchronize();
+
+	ofs = d->read & ( STREAM_RING_SIZE - 1 );
+	n = STREAM_RING_SIZE - ofs;
+	if ( n > bytes ) {
+		n = bytes;
+	}
+	Com_Memcpy( buffer, d->ring + ofs, n );
+	Com_Memcpy( (byte *)buffer + n, d->ring, bytes - n );
+
+	// done with the data before the decoder may overwrite it
+	__sync_synchronize();
+	d->read += bytes;
+	d->started = qtrue;
+
+	S_StreamWake();
+	return bytes;
+}
+
+/*
+=================
+S_StreamUnderrun
+
+The raw samples of the stream ran dry while it had nothing decoded
+=================
+*/
+void S_StreamUnderrun( int slot ) {
+	streamDecoder_t *d = &s_streams[slot];
+
+	if ( d->started && !d->eof ) {
+		d->underruns++;
+	}
+}
+
+/*
+=================
+S_StreamUpdate
+
+Closes the files the decoder is done with and opens the loop files, as
+the zone can't be used from the decoder thread
+=================
+*/
+void S_StreamUpdate( void ) {
+	streamDecoder_t	*d;
+	snd_stream_t	*done, *next, *orphan;
+	qboolean		needNext;
+	int				i;
+
+	for ( i = 0; i < MAX_RAW_STREAMS; i++ ) {
+		d = &s_streams[i];
+		if ( !d->stream && !d->orphan ) {
+			continue;
+		}
+
+		S_StreamLock();
+		done = d->done;
+		orphan = d->orphan;
+		d->done = d->orphan = NULL;
+		needNext = d->stream && !d->next && d->loop[0] && !d->eof;
+		S_StreamUnlock();
+
+		if ( done ) {
+			S_CodecCloseStream( done );
+		}
+		if ( orphan ) {
+			S_CodecCloseStream( orphan );
+		}
+
+		if ( needNext ) {
+			next = S_StreamOpenFile( d->loop );
+			if ( !next ) {
+				Com_Printf( S_COLOR_YELLOW "WARNING: couldn't open %s\n", d->loop );
+			}
+
+			S_StreamLock();
+			if ( next ) {
+				d->next = next;
+			} else {
+				d->loop[0] = '\0';
+			}
+			S_StreamUnlock();
+		}
+	}
+
+	if ( s_streamThreadRunning ) {
+		S_StreamWake();
+	} else {
+		S_StreamFillAll();
+	}
+}
+
+/*
+=================
+S_StreamInfo_f
+=================
+*/
+void S_StreamInfo_f( void ) {
+	streamDecoder_t	*d;
+	int				i, frame, msec, count;
+
+	Com_Printf( "streams are decoded on the %s\n", s_streamThreadRunning ? "decoder thread" : "main thread" );
+
+	count = 0;
+	for ( i = 0; i < MAX_RAW_STREAMS; i++ ) {
+		d = &s_streams[i];
+		if ( !d->stream ) {
+			continue;
+		}
+
+		frame = d->info.width * d->info.channels;
+		msec = (int)( ( d->written - d->read ) / frame ) * 1000 / d->info.rate;
+
+		Com_Printf( "%3i: %5i ms buffered %4i underruns %6i blocks %5i/%5i usec avg/max %7i KB %s%s\n",
+			i, msec, d->underruns, d->blocks,
+			d->blocks ? (int)( d->decodeUsec / d->blocks ) : 0, d->decodeMaxUsec,
+			d->decodedBytes / 1024, d->name, d->eof ? " (eof)" : "" );
+		count++;
+	}
+
+	Com_Printf( "%i active streams\n", count );
+}
+
+/*
+=================
+S_StreamInit
+=================
+*/
+void S_StreamInit( void ) {
+	s_streamThread = Cvar_Get( "s_streamThread", "1", CVAR_ARCHIVE | CVAR_LATCH );
+
+#ifdef __vita__
+	sceKernelCreateLwMutex( &s_streamLock, "Sound Streams", 0, 0, NULL );
+
+	if ( !s_streamThread->integer ) {
+		return;
+	}
+
+	s_streamSema = sceKernelCreateSema( "Sound Streams", 0, 0, 1, NULL );
+	s_streamThreadQuit = qfalse;
+	s_streamThreadId = sceKernelCreateThread( "Sound Streams", S_StreamThread, 0x10000100, 0x20000, 0, 0, NULL );
+	if ( s_streamThreadId < 0 || sceKernelStartThread( s_streamThreadId, 0, NULL ) < 0 ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't start the stream decoder thread, decoding in the main loop\n" );
+		sceKernelDeleteSema( s_streamSema );
+		return;
+	}
+	s_streamThreadRunning = qtrue;
+#endif
+}
+
+/*
+=================
+S_StreamShutdown
+=================
+*/
+void S_StreamShutdown( void ) {
+	int i;
+
+#ifdef __vita__
+	if ( s_streamThreadRunning ) {
+		s_streamThreadQuit = qtrue;
+		sceKernelSignalSema( s_streamSema, 1 );
+		sceKernelWaitThreadEnd( s_streamThreadId, NULL, NULL );
+		sceKernelDeleteThread( s_streamThreadId );
+		sceKernelDeleteSema( s_streamSema );
+		s_streamThreadRunning = qfalse;
+	}
+#endif
+
+	for ( i = 0; i < MAX_RAW_STREAMS; i++ ) {
+		S_StreamClose( i );
+	}
+
+#ifdef __vita__
+	sceKernelDeleteLwMutex( &s_streamLock );
+#endif
+}
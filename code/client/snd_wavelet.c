@@ -27,9 +27,43 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 #define C2 0.2241438680420134
 #define C3 -0.1294095225512604
 
+#ifdef __vita__
+#include <arm_neon.h>
+
+/*
+Four steps of the inverse transform at once, writing the even and odd
+outputs interleaved.  The scalar loop works in double because of the
+constants, so the result can be off by a rounding step
+*/
+static unsigned long daub4_inverse_neon(float b[], float wksp[], unsigned long nh)
+{
+	float32x4_t p, q, p1, q1;
+	float32x4x2_t w;
+	unsigned long i;
+
+	for (i=1 ; i+4<=nh ; i+=4) {
+		p = vld1q_f32(b+i-1);
+		q = vld1q_f32(b+i-1+nh);
+		p1 = vld1q_f32(b+i);
+		q1 = vld1q_f32(b+i+nh);
+		w.val[0] = vmulq_n_f32(p, C2);
+		w.val[0] = vmlaq_n_f32(w.val[0], q, C1);
+		w.val[0] = vmlaq_n_f32(w.val[0], p1, C0);
+		w.val[0] = vmlaq_n_f32(w.val[0], q1, C3);
+		w.val[1] = vmulq_n_f32(p, C3);
+		w.val[1] = vmlsq_n_f32(w.val[1], q, C0);
+		w.val[1] = vmlaq_n_f32(w.val[1], p1, C1);
+		w.val[1] = vmlsq_n_f32(w.val[1], q1, C2);
+		vst2q_f32(wksp+2*i+1, w);
+	}
+
+	return i;
+}
+#endif
+
 void daub4(float b[], unsigned long n, int isign)
 {
-	float wksp[4097] = { 0.0f };
+	float wksp[4097];	// only [1..n] is used, and all of it is written first
 #define a(x) b[(x)-1]					// numerical recipies so a[1] = b[0]
 
 	unsigned long nh,nh1,i,j;
@@ -47,7 +81,14 @@ void daub4(float b[], unsigned long n, int isign)
 	} else {
 		wksp[1] = C2*a(nh)+C1*a(n)+C0*a(1)+C3*a(nh1);
 		wksp[2] = C3*a(nh)-C0*a(n)+C1*a(1)-C2*a(nh1);
-		for (i=1,j=3;i<nh;i++) {
+#ifdef __vita__
+		i = daub4_inverse_neon(b, wksp, nh);
+		j = 2*i+1;
+#else
+		i = 1;
+		j = 3;
+#endif
+		for (;i<nh;i++) {
 			wksp[j++] = C2*a(i)+C1*a(i+nh)+C0*a(i+1)+C3*a(i+nh1);
 			wksp[j++] = C3*a(i)-C0*a(i+nh)+C1*a(i+1)-C2*a(i+nh1);
 		}
@@ -170,7 +211,7 @@ void encodeWavelet( sfx_t *sfx, short *packets) {
 }
 
 void decodeWavelet(sndBuffer *chunk, short *to) {
-	float			wksp[4097] = { 0.0f };
+	float			wksp[4097];
 	int				i;
 	byte			*out;
 
@@ -30,30 +30,44 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
 qboolean snd_inited = qfalse;
 
 #define SAMPLE_RATE   48000
-#define AUDIOSIZE 16384
+#define AUDIOSIZE 32768
+#define CHANNELS  2
+
+// the dma buffer is a ring of grains, the output thread hands them to the
+// hardware one at a time and SNDDMA_GetDMAPos reports the first sample
+// that hasn't been handed over yet, so everything before it up to one
+// grain back is off limits to the mixer
+#define GRAIN_SAMPLES 1024
+#define GRAIN_BYTES   ( GRAIN_SAMPLES * CHANNELS * 2 )
+#define NUM_GRAINS    ( AUDIOSIZE / GRAIN_BYTES )
 
-SceRtcTick initial_tick;
-float tickRate;
 int chn = -1;
-qboolean stop_audio = qfalse;
+volatile qboolean stop_audio = qfalse;
 uint8_t *audiobuffer;
 
+static volatile int grainsPlayed;
+static SceUID grainSema;
+static SceUID audiothread;
+
 static int audio_thread(int args, void *argp)
 {
-	chn = sceAudioOutOpenPort(SCE_AUDIO_OUT_PORT_TYPE_MAIN, AUDIOSIZE / 2, SAMPLE_RATE, SCE_AUDIO_OUT_MODE_MONO);
+	chn = sceAudioOutOpenPort(SCE_AUDIO_OUT_PORT_TYPE_MAIN, GRAIN_SAMPLES, SAMPLE_RATE, SCE_AUDIO_OUT_MODE_STEREO);
 	sceAudioOutSetConfig(chn, -1, -1, -1);
 	int vol[] = {32767, 32767};
 	sceAudioOutSetVolume(chn, SCE_AUDIO_VOLUME_FLAG_L_CH | SCE_AUDIO_VOLUME_FLAG_R_CH, vol);
 	
 	while (!stop_audio)
 	{
-		sceAudioOutOutput(chn, audiobuffer);
+		// blocks until the previous grain is done playing
+		sceAudioOutOutput(chn, audiobuffer + (grainsPlayed % NUM_GRAINS) * GRAIN_BYTES);
+		__sync_fetch_and_add(&grainsPlayed, 1);
+		sceKernelSignalSema(grainSema, 1);
 	}
 	 
+	sceAudioOutOutput(chn, NULL);
 	sceAudioOutReleasePort(chn);
-	free(audiobuffer);
 
-	sceKernelExitDeleteThread(0);
+	sceKernelExitThread(0);
 	return 0;
 }
 
@@ -67,23 +81,26 @@ qboolean SNDDMA_Init(void)
 	Com_Printf("Initializing audio device.\n");
 	dma.samplebits = 16;
 	dma.speed = SAMPLE_RATE;
-	dma.channels = 1;
+	dma.channels = CHANNELS;
 	dma.samples = AUDIOSIZE / 2;
 	dma.fullsamples = dma.samples / dma.channels;
-	dma.submission_chunk = 1;
-	dma.buffer = audiobuffer = malloc(AUDIOSIZE);
+	dma.submission_chunk = GRAIN_SAMPLES;
+	dma.buffer = audiobuffer = calloc(1, AUDIOSIZE);
 	dma.isfloat = 0;
+
+	stop_audio = qfalse;
+	grainsPlayed = 0;
+	grainSema = sceKernelCreateSema("Audio Grain", 0, 0, 1, NULL);
 	
-	tickRate = 1.0f / sceRtcGetTickResolution();
-	
-	SceUID audiothread = sceKernelCreateThread("Audio Thread", (void*)&audio_thread, 0x10000100, 0x10000, 0, 0, NULL);
+	audiothread = sceKernelCreateThread("Audio Thread", (void*)&audio_thread, 0x10000100, 0x10000, 0, 0, NULL);
 	int res = sceKernelStartThread(audiothread, sizeof(audiothread), &audiothread);
 	if (res != 0){
 		Com_Printf("Failed to init audio thread (0x%x)\n", res);
+		sceKernelDeleteSema(grainSema);
+		free(audiobuffer);
 		return qfalse;
 	}
 
-	sceRtcGetCurrentTick(&initial_tick);
 	snd_inited = qtrue;
 	
 	return qtrue;
@@ -97,13 +114,25 @@ SNDDMA_GetDMAPos
 int SNDDMA_GetDMAPos(void)
 {
 	if (!snd_inited) return 0;
-	
-	SceRtcTick tick;
-	sceRtcGetCurrentTick(&tick);
-	const unsigned int deltaTick  = tick.tick - initial_tick.tick;
-	const float deltaSecond = deltaTick * tickRate;
-	uint64_t samplepos = deltaSecond * SAMPLE_RATE;
-	return samplepos;
+
+	return ((grainsPlayed + 1) % NUM_GRAINS) * GRAIN_SAMPLES * CHANNELS;
+}
+
+/*
+===============
+SNDDMA_Wait
+===============
+*/
+void SNDDMA_Wait(int msec)
+{
+	SceUInt timeout = msec * 1000;
+
+	if (!snd_inited) {
+		sceKernelDelayThread(timeout);
+		return;
+	}
+
+	sceKernelWaitSema(grainSema, 1, &timeout);
 }
 
 /*
@@ -116,7 +145,12 @@ void SNDDMA_Shutdown(void)
 	Com_Printf("Closing audio device...\n");
 	if(snd_inited){
 		stop_audio = qtrue;
-		chn = -1;
+		sceKernelWaitThreadEnd(audiothread, NULL, NULL);
+		sceKernelDeleteThread(audiothread);
+		sceKernelDeleteSema(grainSema);
+		free(audiobuffer);
+		dma.buffer = audiobuffer = NULL;
+		snd_inited = qfalse;
 	}
 }
 
@@ -277,6 +277,25 @@ int Sys_FileTime( char *path )
 	return buf.st_mtime;
 }
 
+/*
+============
+Sys_FileStat
+
+returns qfalse if not present
+============
+*/
+qboolean Sys_FileStat( const char *path, int *size, int *mtime )
+{
+	struct stat buf;
+
+	if (stat (path,&buf) == -1)
+		return qfalse;
+
+	*size = buf.st_size;
+	*mtime = buf.st_mtime;
+	return qtrue;
+}
+
 /*
 =================
 Sys_UnloadDll
@@ -0,0 +1,98 @@
+/*
+===========================================================================
+
+Return to Castle Wolfenstein single player GPL Source Code
+Copyright (C) 1999-2010 id Software LLC, a ZeniMax Media company. 
+
+This file is part of the Return to Castle Wolfenstein single player GPL Source Code (RTCW SP Source Code).  
+
+RTCW SP Source Code is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RTCW SP Source Code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RTCW SP Source Code.  If not, see <http://www.gnu.org/licenses/>.
+
+In addition, the RTCW SP Source Code is also subject to certain additional terms. You should have received a copy of these additional terms immediately following the terms and conditions of the GNU General Public License which accompanied the RTCW SP Source Code.  If not, please request a copy in writing from id Software at the address below.
+
+If you have questions concerning this license or the applicable additional terms, you may contact in writing id Software LLC, c/o ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
+
+===========================================================================
+*/
+
+// bench.c -- kernel benchmarks
+//
+// The console benchmarks time a scalar loop against its vectorized
+// version on the same synthetic input.  The command fills in the input
+// and a benchmark_t, this keeps each kernel running for the requested
+// time, reports the cost per element and asks the command how far the
+// two outputs are apart.
+
+#include "../qcommon/q_shared.h"
+#include "qcommon.h"
+
+/*
+=================
+Com_BenchArgs
+
+Reads the "[count] [msec]" arguments shared by the benchmark commands,
+prints the usage and returns qfalse when they are out of range
+=================
+*/
+qboolean Com_BenchArgs( const char *unit, int defaultCount, int maxCount, int *count, int *msec ) {
+	*count = ( Cmd_Argc() > 1 ) ? atoi( Cmd_Argv( 1 ) ) : defaultCount;
+	*msec = ( Cmd_Argc() > 2 ) ? atoi( Cmd_Argv( 2 ) ) : 500;
+	if ( *count < 1 || *count > maxCount || *msec < 1 ) {
+		Com_Printf( "usage: %s [1-%i %ss] [msec]\n", Cmd_Argv( 0 ), maxCount, unit );
+		return qfalse;
+	}
+	return qtrue;
+}
+
+/*
+=================
+Com_BenchKernel
+
+Calls the kernel until msec have passed, returns nanoseconds per element
+=================
+*/
+static double Com_BenchKernel( benchmark_t *b, void ( *kernel )( benchmark_t *b ) ) {
+	double	units;
+	int		start, elapsed;
+
+	units = 0;
+	start = Sys_Milliseconds();
+	do {
+		kernel( b );
+		units += b->units;
+		elapsed = Sys_Milliseconds() - start;
+	} while ( elapsed < b->msec );
+
+	return elapsed * 1000000.0 / units;
+}
+
+/*
+=================
+Com_Benchmark
+=================
+*/
+void Com_Benchmark( benchmark_t *b ) {
+	double	scalar, simd;
+
+	if ( !b->scalar ) {
+		simd = Com_BenchKernel( b, b->simd );
+		Com_Printf( "%s: %.2f ns/%s\n", b->name, simd, b->unit );
+		return;
+	}
+
+	scalar = Com_BenchKernel( b, b->scalar );
+	simd = Com_BenchKernel( b, b->simd );
+	Com_Printf( "%s: scalar %.2f ns/%s, simd %.2f ns/%s, max error %g\n",
+				b->name, scalar, b->unit, simd, b->unit, b->compare( b ) );
+}
@@ -31,6 +31,9 @@ If you have questions concerning this license or the applicable additional terms
 #include "q_shared.h"
 #include "qcommon.h"
 #include <setjmp.h>
+#ifdef __vita__
+#include <vitasdk.h>
+#endif
 #ifndef _WIN32
 #include <netinet/in.h>
 #include <sys/stat.h> // umask
@@ -800,10 +803,248 @@ int Com_RealTime( qtime_t *qtime ) {
 
 ==============================================================================
 
-  The old zone is gone, mallocs replaced it. To keep the widespread code changes down to a bare minimum
-  Z_Malloc and Z_Free still work.
+  The old zone is gone, mallocs replaced it, but the small blocks that most
+  of the zone traffic is made of (CopyString, cvar strings, events) don't go
+  to malloc one by one anymore.  Blocks up to ZONE_SMALL_MAX bytes come from
+  pages of same sized blocks, so level changes don't fragment the system
+  heap with them, bigger ones are malloced with a header and kept in a list.
+
+  Every block is tagged, zonelog prints the bytes and blocks of each tag.
+  Z_Malloc returns 0 filled memory, Z_TagMalloc doesn't fill for the callers
+  that overwrite all of it anyway.
+*/
+
+#define ZONEID              0x1d4a
+#define ZONE_FREEID         0x1d4b
+
+#define ZONE_SMALL_MAX      256
+#define ZONE_PAGE_SIZE      0x4000
+#define ZONE_NUM_CLASSES    10
+#define ZONE_LARGE          0xff
+#define ZONE_NUM_TAGS       ( TAG_STATIC + 1 )
+
+static const int zoneClassSizes[ZONE_NUM_CLASSES] = { 8, 16, 24, 32, 48, 64, 96, 128, 192, ZONE_SMALL_MAX };
+
+static const char *zoneTagNames[ZONE_NUM_TAGS] = { "free", "general", "botlib", "renderer", "small", "static" };
+
+typedef struct {
+	unsigned short  id;
+	byte            tag;
+	byte            sizeClass;      // ZONE_LARGE if not from a page
+	unsigned short  pageOfs;        // back to the zonePage_t in 8 byte units
+	unsigned short  size;           // size asked for, small blocks only
+} zoneHeader_t;
+
+typedef struct zonePage_s {
+	struct zonePage_s   *next, *prev;       // pages of the class with free blocks
+	struct zonePage_s   *allNext, *allPrev;
+	zoneHeader_t        *free;              // the next pointer is in the block
+	int                 used;
+	int                 sizeClass;
+} zonePage_t;
+
+typedef struct zoneLarge_s {
+	struct zoneLarge_s  *next, *prev;
+	int                 size;
+	int                 pad;
+	zoneHeader_t        header;             // right in front of the block
+} zoneLarge_t;
+
+typedef struct {
+	zonePage_t      *pages;             // with free blocks
+	zonePage_t      *allPages;
+	int             numPages;
+	int             emptyPages;
+	int             used;
+} zoneClass_t;
+
+typedef struct {
+	int             blocks;
+	int             bytes;
+	int             peakBytes;
+} zoneTagStats_t;
+
+static zoneClass_t zoneClasses[ZONE_NUM_CLASSES];
+static zoneLarge_t *zoneLargeBlocks;
+static zoneTagStats_t zoneTags[ZONE_NUM_TAGS];
+static int zoneSystemBytes;             // pages and large blocks held from malloc
+
+#define ZONE_PAGE_START     (int)( ( sizeof( zonePage_t ) + 7 ) & ~7 )
+
+#ifdef __vita__
+static SceKernelLwMutexWork zoneLock;
+static qboolean zoneLockCreated;        // no other threads before Com_InitZoneMemory
+
+#define Z_Lock()    if ( zoneLockCreated ) sceKernelLockLwMutex( &zoneLock, 1, NULL )
+#define Z_Unlock()  if ( zoneLockCreated ) sceKernelUnlockLwMutex( &zoneLock, 1 )
+#else
+#define Z_Lock()
+#define Z_Unlock()
+#endif
+
+/*
+================
+Z_SizeClass
+================
+*/
+static int Z_SizeClass( int size ) {
+	int i;
+
+	for ( i = 0 ; zoneClassSizes[i] < size ; i++ ) {
+	}
+	return i;
+}
+
+/*
+================
+Z_NewPage
+================
 */
+static zonePage_t *Z_NewPage( int sizeClass ) {
+	zoneClass_t     *c;
+	zonePage_t      *page;
+	zoneHeader_t    *block;
+	int             stride, ofs;
+
+	page = malloc( ZONE_PAGE_SIZE );
+	if ( !page ) {
+		return NULL;
+	}
+	zoneSystemBytes += ZONE_PAGE_SIZE;
+
+	c = &zoneClasses[sizeClass];
+	page->used = 0;
+	page->sizeClass = sizeClass;
+	page->free = NULL;
 
+	// carve it from the end so the free list starts at the front
+	stride = sizeof( zoneHeader_t ) + zoneClassSizes[sizeClass];
+	for ( ofs = ZONE_PAGE_START + ( ( ZONE_PAGE_SIZE - ZONE_PAGE_START ) / stride - 1 ) * stride ; ofs >= ZONE_PAGE_START ; ofs -= stride ) {
+		block = (zoneHeader_t *)( (byte *)page + ofs );
+		block->id = ZONE_FREEID;
+		block->sizeClass = sizeClass;
+		block->pageOfs = ofs >> 3;
+		*(zoneHeader_t **)( block + 1 ) = page->free;
+		page->free = block;
+	}
+
+	page->prev = NULL;
+	page->next = c->pages;
+	if ( c->pages ) {
+		c->pages->prev = page;
+	}
+	c->pages = page;
+
+	page->allPrev = NULL;
+	page->allNext = c->allPages;
+	if ( c->allPages ) {
+		c->allPages->allPrev = page;
+	}
+	c->allPages = page;
+
+	c->numPages++;
+	c->emptyPages++;
+
+	return page;
+}
+
+/*
+================
+Z_ReleasePage
+================
+*/
+static void Z_ReleasePage( zonePage_t *page ) {
+	zoneClass_t *c;
+
+	c = &zoneClasses[page->sizeClass];
+
+	if ( page->prev ) {
+		page->prev->next = page->next;
+	} else {
+		c->pages = page->next;
+	}
+	if ( page->next ) {
+		page->next->prev = page->prev;
+	}
+
+	if ( page->allPrev ) {
+		page->allPrev->allNext = page->allNext;
+	} else {
+		c->allPages = page->allNext;
+	}
+	if ( page->allNext ) {
+		page->allNext->allPrev = page->allPrev;
+	}
+
+	c->numPages--;
+	c->emptyPages--;
+	zoneSystemBytes -= ZONE_PAGE_SIZE;
+	free( page );
+}
+
+/*
+================
+Z_FreeBlock
+
+Needs the zone locked
+================
+*/
+static void Z_FreeBlock( zoneHeader_t *block ) {
+	zoneTagStats_t  *stats;
+	zoneLarge_t     *large;
+	zonePage_t      *page;
+	zoneClass_t     *c;
+
+	stats = &zoneTags[block->tag];
+	stats->blocks--;
+
+	if ( block->sizeClass == ZONE_LARGE ) {
+		large = (zoneLarge_t *)( (byte *)block - offsetof( zoneLarge_t, header ) );
+		stats->bytes -= large->size;
+
+		if ( large->prev ) {
+			large->prev->next = large->next;
+		} else {
+			zoneLargeBlocks = large->next;
+		}
+		if ( large->next ) {
+			large->next->prev = large->prev;
+		}
+
+		zoneSystemBytes -= sizeof( *large ) + large->size;
+		free( large );
+		return;
+	}
+
+	stats->bytes -= block->size;
+
+	page = (zonePage_t *)( (byte *)block - ( block->pageOfs << 3 ) );
+	c = &zoneClasses[page->sizeClass];
+
+	block->id = ZONE_FREEID;
+	*(zoneHeader_t **)( block + 1 ) = page->free;
+
+	// it was full, so it wasn't in the list
+	if ( !page->free ) {
+		page->prev = NULL;
+		page->next = c->pages;
+		if ( c->pages ) {
+			c->pages->prev = page;
+		}
+		c->pages = page;
+	}
+	page->free = block;
+
+	c->used--;
+	if ( --page->used == 0 ) {
+		// keep one around so a block going back and forth doesn't
+		// malloc and free a page each time
+		c->emptyPages++;
+		if ( c->emptyPages > 1 ) {
+			Z_ReleasePage( page );
+		}
+	}
+}
 
 /*
 ========================
@@ -811,9 +1052,110 @@ Z_Free
 ========================
 */
 void Z_Free( void *ptr ) {
-	free( ptr );
+	zoneHeader_t *block;
+
+	if ( !ptr ) {
+		return;
+	}
+
+	block = (zoneHeader_t *)ptr - 1;
+	if ( block->id != ZONEID ) {
+		Com_Error( ERR_FATAL, "Z_Free: freed a pointer without ZONEID" );
+	}
+
+	Z_Lock();
+	Z_FreeBlock( block );
+	Z_Unlock();
 }
 
+/*
+================
+Z_TagMalloc
+================
+*/
+void *Z_TagMalloc( int size, int tag ) {
+	zoneTagStats_t  *stats;
+	zoneHeader_t    *block;
+	zoneLarge_t     *large;
+	zonePage_t      *page;
+	zoneClass_t     *c;
+	int             sizeClass;
+
+	if ( tag <= TAG_FREE || tag >= ZONE_NUM_TAGS ) {
+		Com_Error( ERR_FATAL, "Z_TagMalloc: tried to use tag %i", tag );
+	}
+	if ( size < 0 ) {
+		Com_Error( ERR_FATAL, "Z_TagMalloc: negative size %i", size );
+	}
+
+	Z_Lock();
+
+	if ( size > ZONE_SMALL_MAX ) {
+		large = malloc( sizeof( *large ) + size );
+		if ( !large ) {
+			Z_Unlock();
+			Com_Error( ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", size );
+		}
+		zoneSystemBytes += sizeof( *large ) + size;
+
+		large->size = size;
+		large->prev = NULL;
+		large->next = zoneLargeBlocks;
+		if ( zoneLargeBlocks ) {
+			zoneLargeBlocks->prev = large;
+		}
+		zoneLargeBlocks = large;
+
+		block = &large->header;
+		block->sizeClass = ZONE_LARGE;
+		block->pageOfs = 0;
+		block->size = 0;
+	} else {
+		sizeClass = Z_SizeClass( size );
+		c = &zoneClasses[sizeClass];
+
+		page = c->pages;
+		if ( !page ) {
+			page = Z_NewPage( sizeClass );
+			if ( !page ) {
+				Z_Unlock();
+				Com_Error( ERR_FATAL, "Z_Malloc: failed on allocation of %i bytes", size );
+			}
+		}
+
+		block = page->free;
+		page->free = *(zoneHeader_t **)( block + 1 );
+
+		// full pages leave the list until something is freed
+		if ( !page->free ) {
+			c->pages = page->next;
+			if ( c->pages ) {
+				c->pages->prev = NULL;
+			}
+		}
+
+		if ( page->used++ == 0 ) {
+			c->emptyPages--;
+		}
+		c->used++;
+
+		block->size = size;
+	}
+
+	block->id = ZONEID;
+	block->tag = tag;
+
+	stats = &zoneTags[tag];
+	stats->blocks++;
+	stats->bytes += size;
+	if ( stats->bytes > stats->peakBytes ) {
+		stats->peakBytes = stats->bytes;
+	}
+
+	Z_Unlock();
+
+	return block + 1;
+}
 
 /*
 ================
@@ -821,53 +1163,95 @@ Z_Malloc
 ================
 */
 void *Z_Malloc( int size ) {
-	void *buf = malloc( size );
+	void *buf = Z_TagMalloc( size, TAG_GENERAL );
 	Com_Memset( buf, 0, size );
 	return buf;
 }
 
-#if 0
 /*
 ================
-Z_TagMalloc
+Z_FreeTags
+
+Frees every block with the tag, for subsystems that don't keep track
 ================
 */
-void *Z_TagMalloc( int size, int tag ) {
+void Z_FreeTags( int tag ) {
+	zoneLarge_t     *large, *nextLarge;
+	zonePage_t      *page, *nextPage;
+	zoneHeader_t    *block;
+	int             i, ofs, stride;
 
-	if ( tag != TAG_RENDERER ) {
-		assert( 0 );
+	Z_Lock();
+
+	for ( large = zoneLargeBlocks ; large ; large = nextLarge ) {
+		nextLarge = large->next;
+		if ( large->header.tag == tag ) {
+			Z_FreeBlock( &large->header );
+		}
 	}
 
-	if ( g_numTaggedAllocs < MAX_TAG_ALLOCS ) {
-		void *ptr = Z_Malloc( size );
-		g_taggedAllocations[g_numTaggedAllocs++] = ptr;
-		return ptr;
-	} else {
-		Com_Error( ERR_FATAL, "Z_TagMalloc: out of tagged allocation space\n" );
+	for ( i = 0 ; i < ZONE_NUM_CLASSES ; i++ ) {
+		stride = sizeof( zoneHeader_t ) + zoneClassSizes[i];
+		for ( page = zoneClasses[i].allPages ; page ; page = nextPage ) {
+			// freeing the last block may release the page
+			nextPage = page->allNext;
+			for ( ofs = ZONE_PAGE_START ; ofs + stride <= ZONE_PAGE_SIZE && page->used ; ofs += stride ) {
+				block = (zoneHeader_t *)( (byte *)page + ofs );
+				if ( block->id != ZONEID || block->tag != tag ) {
+					continue;
+				}
+				if ( page->used == 1 ) {
+					Z_FreeBlock( block );
+					break;
+				}
+				Z_FreeBlock( block );
+			}
+		}
 	}
-	return NULL;
+
+	Z_Unlock();
 }
 
 /*
 ================
-Z_FreeTags
+Z_LogHeap_f
 ================
 */
-void Z_FreeTags( int tag ) {
-	int i;
+static void Z_LogHeap_f( void ) {
+	zoneTagStats_t  tags[ZONE_NUM_TAGS];
+	zoneClass_t     classes[ZONE_NUM_CLASSES];
+	zoneLarge_t     *large;
+	int             i, numLarge, largeBytes, systemBytes;
 
-	if ( tag != TAG_RENDERER ) {
-		assert( 0 );
+	// Com_Printf may allocate
+	Z_Lock();
+	Com_Memcpy( tags, zoneTags, sizeof( tags ) );
+	Com_Memcpy( classes, zoneClasses, sizeof( classes ) );
+	numLarge = largeBytes = 0;
+	for ( large = zoneLargeBlocks ; large ; large = large->next ) {
+		numLarge++;
+		largeBytes += large->size;
 	}
+	systemBytes = zoneSystemBytes;
+	Z_Unlock();
 
-	for ( i = 0; i < g_numTaggedAllocs; i++ ) {
-		free( g_taggedAllocations[i] );
+	Com_Printf( "tag         blocks      bytes       peak\n" );
+	for ( i = TAG_GENERAL ; i < ZONE_NUM_TAGS ; i++ ) {
+		Com_Printf( "%-8s %9i %10i %10i\n", zoneTagNames[i], tags[i].blocks, tags[i].bytes, tags[i].peakBytes );
 	}
 
-	g_numTaggedAllocs = 0;
-}
+	Com_Printf( "\nsize  pages   used   free\n" );
+	for ( i = 0 ; i < ZONE_NUM_CLASSES ; i++ ) {
+		if ( !classes[i].numPages ) {
+			continue;
+		}
+		Com_Printf( "%4i %6i %6i %6i\n", zoneClassSizes[i], classes[i].numPages, classes[i].used,
+			classes[i].numPages * ( ( ZONE_PAGE_SIZE - ZONE_PAGE_START ) / ( (int)sizeof( zoneHeader_t ) + zoneClassSizes[i] ) ) - classes[i].used );
+	}
 
-#endif
+	Com_Printf( "\n%i large blocks, %i bytes\n", numLarge, largeBytes );
+	Com_Printf( "%i bytes from the system\n", systemBytes );
+}
 
 /*
 ========================
@@ -880,7 +1264,7 @@ CopyString
 char *CopyString( const char *in ) {
 	char    *out;
 
-	out = Z_Malloc( strlen( in ) + 1 );
+	out = Z_TagMalloc( strlen( in ) + 1, TAG_SMALL );
 	strcpy( out, in );
 	return out;
 }
@@ -952,8 +1336,28 @@ static hunkUsed_t  *hunk_permanent, *hunk_temp;
 static byte    *s_hunkData = NULL;
 static int s_hunkTotal;
 
-static int s_zoneTotal;
-//static	int		s_smallZoneTotal; // TTimo: unused
+// every allocation is counted for the subsystem that is loading, so
+// com_hunkMegs can be sized from what the levels really use
+#define MAX_HUNK_LABELS 16
+
+typedef struct {
+	char    name[16];
+	int     blocks;
+	int     bytes;
+	int     markBlocks;
+	int     markBytes;
+	int     tempPeak;               // most temp memory in use while it was loading
+} hunkLabel_t;
+
+static hunkLabel_t hunkLabels[MAX_HUNK_LABELS] = { { "other" } };
+static int numHunkLabels = 1;
+static hunkLabel_t *hunkLabel = &hunkLabels[0];
+
+static int hunkPeak;                // permanent and temp, since Hunk_Clear
+static int hunkTempPeak;
+
+static cvar_t *com_hunkReport;
+
 
 
 /*
@@ -965,7 +1369,7 @@ void Com_Meminfo_f( void ) {
 	int unused;
 
 	Com_Printf( "%8i bytes total hunk\n", s_hunkTotal );
-	Com_Printf( "%8i bytes total zone\n", s_zoneTotal );
+	Com_Printf( "%8i bytes total zone\n", zoneSystemBytes );
 	Com_Printf( "\n" );
 	Com_Printf( "%8i low mark\n", hunk_low.mark );
 	Com_Printf( "%8i low permanent\n", hunk_low.permanent );
@@ -1031,8 +1435,12 @@ void Com_TouchMemory( void ) {
 
 
 void Com_InitZoneMemory( void ) {
-	//memset(g_taggedAllocations, 0, sizeof(g_taggedAllocations));
-	//g_numTaggedAllocs = 0;
+#ifdef __vita__
+	sceKernelCreateLwMutex( &zoneLock, "Zone", 0, 0, NULL );
+	zoneLockCreated = qtrue;
+#endif
+
+	Cmd_AddCommand( "zonelog", Z_LogHeap_f );
 }
 
 /*
@@ -1115,6 +1523,125 @@ void Hunk_SmallLog( void ) {
 	FS_Write( buf, strlen( buf ), logfile );
 }
 
+/*
+=================
+Hunk_SetLabel
+
+Counts the following allocations for label, returns the label to put
+back when done
+=================
+*/
+const char *Hunk_SetLabel( const char *label ) {
+	const char  *previous;
+	int         i;
+
+	previous = hunkLabel->name;
+
+	if ( !label ) {
+		hunkLabel = &hunkLabels[0];
+		return previous;
+	}
+
+	for ( i = 0 ; i < numHunkLabels ; i++ ) {
+		if ( !Q_stricmp( hunkLabels[i].name, label ) ) {
+			hunkLabel = &hunkLabels[i];
+			return previous;
+		}
+	}
+
+	if ( numHunkLabels == MAX_HUNK_LABELS ) {
+		hunkLabel = &hunkLabels[0];
+		return previous;
+	}
+
+	hunkLabel = &hunkLabels[numHunkLabels++];
+	Q_strncpyz( hunkLabel->name, label, sizeof( hunkLabel->name ) );
+	return previous;
+}
+
+/*
+=================
+Hunk_CountPeaks
+=================
+*/
+static void Hunk_CountPeaks( void ) {
+	int temp;
+
+	// the permanent side has temp == permanent
+	if ( hunk_low.temp + hunk_high.temp > hunkPeak ) {
+		hunkPeak = hunk_low.temp + hunk_high.temp;
+	}
+
+	temp = hunk_temp->temp - hunk_temp->permanent;
+	if ( temp > hunkTempPeak ) {
+		hunkTempPeak = temp;
+	}
+	if ( temp > hunkLabel->tempPeak ) {
+		hunkLabel->tempPeak = temp;
+	}
+}
+
+/*
+=================
+Hunk_Report_f
+=================
+*/
+static void Hunk_Report_f( void ) {
+	hunkLabel_t *l;
+	int         i;
+
+	Com_Printf( "label          blocks      bytes  temp peak\n" );
+	for ( i = 0, l = hunkLabels ; i < numHunkLabels ; i++, l++ ) {
+		if ( l->blocks || l->tempPeak ) {
+			Com_Printf( "%-12s %8i %10i %10i\n", l->name, l->blocks, l->bytes, l->tempPeak );
+		}
+	}
+	Com_Printf( "\n%8i bytes in use, %i peak, %i temp peak, %i total\n",
+				hunk_low.permanent + hunk_high.permanent, hunkPeak, hunkTempPeak, s_hunkTotal );
+}
+
+/*
+=================
+Hunk_WriteReport
+
+Writes what the level load took from the hunk, by label, if
+com_hunkReport is set
+=================
+*/
+void Hunk_WriteReport( const char *name ) {
+	char            filename[MAX_QPATH];
+	hunkLabel_t     *l;
+	fileHandle_t    f;
+	int             i;
+
+	if ( !s_hunkData ) {
+		return;
+	}
+
+	Com_Printf( "hunk: %i bytes used, %i peak, %i temp peak of %i\n",
+				hunk_low.permanent + hunk_high.permanent, hunkPeak, hunkTempPeak, s_hunkTotal );
+
+	if ( !com_hunkReport->integer ) {
+		return;
+	}
+
+	Com_sprintf( filename, sizeof( filename ), "hunkreports/%s.json", name );
+	f = FS_FOpenFileWrite( filename );
+	if ( !f ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't write %s\n", filename );
+		return;
+	}
+
+	FS_Printf( f, "{\"map\":\"%s\",\"total\":%i,\"used\":%i,\"peak\":%i,\"tempPeak\":%i,\"labels\":[",
+			   name, s_hunkTotal, hunk_low.permanent + hunk_high.permanent, hunkPeak, hunkTempPeak );
+	for ( i = 0, l = hunkLabels ; i < numHunkLabels ; i++, l++ ) {
+		FS_Printf( f, "%s\n{\"name\":\"%s\",\"blocks\":%i,\"bytes\":%i,\"tempPeak\":%i}",
+				   i ? "," : "", l->name, l->blocks, l->bytes, l->tempPeak );
+	}
+	FS_Printf( f, "\n]}\n" );
+	FS_FCloseFile( f );
+}
+
 /*
 =================
 Com_InitHunkMemory
@@ -1161,7 +1688,10 @@ void Com_InitHunkMemory( void ) {
 	s_hunkData = (byte *) ( ( (intptr_t)s_hunkData + 31 ) & ~31 );
 	Hunk_Clear();
 
+	com_hunkReport = Cvar_Get( "com_hunkReport", "0", CVAR_ARCHIVE );
+
 	Cmd_AddCommand( "meminfo", Com_Meminfo_f );
+	Cmd_AddCommand( "hunkreport", Hunk_Report_f );
 #ifdef HUNK_DEBUG
 	Cmd_AddCommand( "hunklog", Hunk_Log );
 	Cmd_AddCommand( "hunksmalllog", Hunk_SmallLog );
@@ -1190,8 +1720,15 @@ The server calls this after the level and game VM have been loaded
 ===================
 */
 void Hunk_SetMark( void ) {
+	int i;
+
 	hunk_low.mark = hunk_low.permanent;
 	hunk_high.mark = hunk_high.permanent;
+
+	for ( i = 0 ; i < numHunkLabels ; i++ ) {
+		hunkLabels[i].markBlocks = hunkLabels[i].blocks;
+		hunkLabels[i].markBytes = hunkLabels[i].bytes;
+	}
 }
 
 /*
@@ -1202,8 +1739,15 @@ The client calls this before starting a vid_restart or snd_restart
 =================
 */
 void Hunk_ClearToMark( void ) {
+	int i;
+
 	hunk_low.permanent = hunk_low.temp = hunk_low.mark;
 	hunk_high.permanent = hunk_high.temp = hunk_high.mark;
+
+	for ( i = 0 ; i < numHunkLabels ; i++ ) {
+		hunkLabels[i].blocks = hunkLabels[i].markBlocks;
+		hunkLabels[i].bytes = hunkLabels[i].markBytes;
+	}
 }
 
 /*
@@ -1230,6 +1774,7 @@ The server calls this before shutting down or loading a new map
 =================
 */
 void Hunk_Clear( void ) {
+	int i;
 
 #ifndef DEDICATED
 	CL_ShutdownCGame();
@@ -1252,6 +1797,13 @@ void Hunk_Clear( void ) {
 	hunk_permanent = &hunk_low;
 	hunk_temp = &hunk_high;
 
+	for ( i = 0 ; i < numHunkLabels ; i++ ) {
+		Com_Memset( &hunkLabels[i].blocks, 0, sizeof( hunkLabels[i] ) - offsetof( hunkLabel_t, blocks ) );
+	}
+	hunkLabel = &hunkLabels[0];
+	hunkPeak = 0;
+	hunkTempPeak = 0;
+
 	Cvar_Set( "com_hunkused", va( "%i", hunk_low.permanent + hunk_high.permanent ) );
 	Com_Printf( "Hunk_Clear: reset the hunk ok\n" );
 	VM_Clear(); // (SA) FIXME:TODO: was commented out in wolf
@@ -1326,6 +1878,10 @@ void *Hunk_Alloc( int size, ha_pref preference ) {
 
 	hunk_permanent->temp = hunk_permanent->permanent;
 
+	hunkLabel->blocks++;
+	hunkLabel->bytes += size;
+	Hunk_CountPeaks();
+
 	memset( buf, 0, size );
 
 #ifdef HUNK_DEBUG
@@ -1391,6 +1947,8 @@ void *Hunk_AllocateTempMemory( int size ) {
 		hunk_temp->tempHighwater = hunk_temp->temp;
 	}
 
+	Hunk_CountPeaks();
+
 	hdr = (hunkHeader_t *)buf;
 	buf = ( void * )( hdr + 1 );
 
@@ -1600,7 +2158,7 @@ sysEvent_t Com_GetSystemEvent( void )
 		int   len;
 
 		len = strlen( s ) + 1;
-		b = Z_Malloc( len );
+		b = Z_TagMalloc( len, TAG_GENERAL );
 		strcpy( b, s );
 		Com_QueueEvent( 0, SE_CONSOLE, 0, 0, len, b );
 	}
@@ -1635,7 +2193,7 @@ sysEvent_t  Com_GetRealEvent( void ) {
 			Com_Error( ERR_FATAL, "Error reading from journal file" );
 		}
 		if ( ev.evPtrLength ) {
-			ev.evPtr = Z_Malloc( ev.evPtrLength );
+			ev.evPtr = Z_TagMalloc( ev.evPtrLength, TAG_GENERAL );
 			r = FS_Read( ev.evPtr, ev.evPtrLength, com_journalFile );
 			if ( r != ev.evPtrLength ) {
 				Com_Error( ERR_FATAL, "Error reading from journal file" );
@@ -2323,6 +2881,7 @@ void Com_Init( char *commandLine ) {
  	}
 	Cmd_AddCommand ("quit", Com_Quit_f);
 	Cmd_AddCommand ("changeVectors", MSG_ReportChangeVectors_f );
+	Cmd_AddCommand ("huffcheck", MSG_HuffmanCheck_f );
 	Cmd_AddCommand ("writeconfig", Com_WriteConfig_f );
 	Cmd_SetCommandCompletionFunc( "writeconfig", Cmd_CompleteCfgName );
 	Cmd_AddCommand("game_restart", Com_GameRestart_f);
@@ -2343,6 +2902,9 @@ void Com_Init( char *commandLine ) {
 	// allocate the stack based hunk allocator
 	Com_InitHunkMemory();
 
+	Com_InitJobs();
+	Com_InitLoadTrace();
+
 	// if any archived cvars are modified after this, we will trigger a writing
 	// of the config file
 	cvar_modifiedFlags &= ~CVAR_ARCHIVE;
@@ -2776,6 +3338,8 @@ void Com_Frame( void ) {
 	
 	msec = com_frameTime - lastTime;
 
+	FS_RunReadCallbacks();
+
 	Cbuf_Execute();
 
 	if (com_altivec->modified)
@@ -40,6 +40,10 @@ If you have questions concerning this license or the applicable additional terms
 #include "qcommon.h"
 #include "unzip.h"
 
+#ifdef __vita__
+#include <vitasdk.h>
+#endif
+
 /*
 =============================================================================
 
@@ -257,6 +261,10 @@ typedef struct {
 	int hashSize;                               // hash table size (power of 2)
 	fileInPack_t*   *hashTable;                 // hash table
 	fileInPack_t*   buildBuffer;                // buffer with the filenames etc.
+	int pakSize;                                // size and mtime key the directory cache,
+	int pakMtime;                               // 0 size if it can't be cached
+	int numHeaderLongs;                         // checksum feed and file crcs
+	int *headerLongs;
 } pack_t;
 
 typedef struct {
@@ -300,6 +308,7 @@ static int fs_checksumFeed;
 typedef union qfile_gus {
 	FILE*       o;
 	unzFile z;
+	byte        *m;
 } qfile_gut;
 
 typedef struct qfile_us {
@@ -314,6 +323,10 @@ typedef struct {
 	int zipFilePos;
 	int zipFileLen;
 	qboolean zipFile;
+	qboolean memFile;       // prefetched, see FS_OpenPrefetched
+	int memPos;
+	int memLen;
+	const char *pakName;    // for the load trace
 	char name[MAX_ZPATH];
 } fileHandleData_t;
 
@@ -323,6 +336,9 @@ static fileHandleData_t fsh[MAX_FILE_HANDLES];
 // wether we did a reorder on the current search path when joining the server
 static qboolean fs_reordered;
 
+// directory misses are remembered while this doesn't change, see FS_AddDirMiss
+static int fs_dirMissGeneration;
+
 // never load anything from pk3 files that are not present at the server when pure
 static int fs_numServerPaks = 0;
 static int fs_serverPaks[MAX_SEARCH_PATHS];                     // checksums
@@ -448,6 +464,9 @@ static FILE *FS_FileForHandle( fileHandle_t f ) {
 	if ( fsh[f].zipFile == qtrue ) {
 		Com_Error( ERR_DROP, "FS_FileForHandle: can't get FILE on zip file" );
 	}
+	if ( fsh[f].memFile ) {
+		Com_Error( ERR_DROP, "FS_FileForHandle: can't get FILE on prefetched file" );
+	}
 	if ( !fsh[f].handleFiles.file.o ) {
 		Com_Error( ERR_DROP, "FS_FileForHandle: NULL" );
 	}
@@ -494,6 +513,10 @@ long FS_filelength(fileHandle_t f)
 {
 	FILE	*h;
 
+	if ( fsh[f].memFile ) {
+		return fsh[f].memLen;
+	}
+
 	h = FS_FileForHandle( f );
 
 	if(h == NULL)
@@ -571,6 +594,9 @@ qboolean FS_CreatePath (char *OSPath) {
 		return qtrue;
 	}
 
+	// whatever gets written there may have been missed before
+	fs_dirMissGeneration++;
+
 	Q_strncpyz( path, OSPath, sizeof( path ) );
 	FS_ReplaceSeparators( path );
 
@@ -965,6 +991,8 @@ void FS_SV_Rename( const char *from, const char *to, qboolean safe ) {
 		FS_CheckFilenameIsMutable( to_ospath, __func__ );
 	}
 
+	fs_dirMissGeneration++;
+
 	if ( rename( from_ospath, to_ospath ) ) {
 		// Failed, try copying it and deleting the original
 		FS_CopyFile( from_ospath, to_ospath );
@@ -997,6 +1025,8 @@ void FS_Rename( const char *from, const char *to ) {
 
 	FS_CheckFilenameIsMutable( to_ospath, __func__ );
 
+	fs_dirMissGeneration++;
+
 	if ( rename( from_ospath, to_ospath ) ) {
 		// Failed first attempt, try deleting destination, and renaming again
 		FS_Remove( to_ospath );
@@ -1032,6 +1062,12 @@ void FS_FCloseFile( fileHandle_t f ) {
 		return;
 	}
 
+	if ( fsh[f].memFile ) {
+		free( fsh[f].handleFiles.file.m );
+		Com_Memset( &fsh[f], 0, sizeof( fsh[f] ) );
+		return;
+	}
+
 	// we didn't find it as a pak, so close it as a unique file
 	if ( fsh[f].handleFiles.file.o ) {
 		fclose( fsh[f].handleFiles.file.o );
@@ -1334,7 +1370,1182 @@ qboolean FS_IsDemoExt(const char *filename, int namelen)
 		}
 	}
 
-	return qfalse;
+	return qfalse;
+}
+
+/*
+==========================================================================
+
+FILE INDEX
+
+FS_FOpenFileRead used to look every name up in every pak and fopen it in
+every directory until it was found, so a miss, which is common for the
+optional .shader, .skin and _hi files, paid for the whole search path.
+After FS_Startup every file of every pak goes into one hash table, which
+names the paks that have it, and directory misses are remembered until
+something is written.  The search path is still walked in order, but
+only the pak that wins and the directories in front of it that may have
+the file are tried.
+
+==========================================================================
+*/
+
+#define DIR_MISS_SIZE       2048            // power of two
+
+typedef struct {
+	fileInPack_t    *file;
+	searchpath_t    *search;
+	int             order;                  // in the search path, first wins
+	int             next;
+} fileIndexEntry_t;
+
+typedef struct {
+	char            name[MAX_QPATH];
+	int             generation;
+	unsigned        dirs;                   // bits of the directories without it
+} dirMiss_t;
+
+static fileIndexEntry_t *fs_indexEntries;
+static int *fs_indexHash;
+static int fs_indexHashSize;
+static int fs_indexNumEntries;
+static dirMiss_t *fs_dirMisses;
+
+static cvar_t *fs_fileIndex;
+static int fs_indexLookups;
+static int fs_indexHits;
+static int fs_indexMisses;
+static int fs_dirProbes;
+static int fs_dirProbesSkipped;
+
+/*
+=================
+FS_FreeFileIndex
+=================
+*/
+static void FS_FreeFileIndex( void ) {
+	if ( fs_indexEntries ) {
+		Z_Free( fs_indexEntries );
+		fs_indexEntries = NULL;
+		fs_indexHash = NULL;
+	}
+	if ( fs_dirMisses ) {
+		Z_Free( fs_dirMisses );
+		fs_dirMisses = NULL;
+	}
+}
+
+/*
+=================
+FS_BuildFileIndex
+
+Called whenever the search paths changed
+=================
+*/
+static void FS_BuildFileIndex( void ) {
+	searchpath_t        *search;
+	fileIndexEntry_t    *e;
+	int                 numFiles, order, i, hash;
+
+	FS_FreeFileIndex();
+
+	fs_fileIndex = Cvar_Get( "fs_fileIndex", "1", CVAR_ARCHIVE );
+	if ( !fs_fileIndex->integer ) {
+		return;
+	}
+
+	numFiles = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack ) {
+			numFiles += search->pack->numfiles;
+		}
+	}
+
+	for ( fs_indexHashSize = 1024 ; fs_indexHashSize < numFiles && fs_indexHashSize < 0x10000 ; fs_indexHashSize <<= 1 ) {
+	}
+
+	fs_indexEntries = Z_Malloc( numFiles * sizeof( *fs_indexEntries ) + fs_indexHashSize * sizeof( *fs_indexHash ) );
+	fs_indexHash = (int *)( fs_indexEntries + numFiles );
+	for ( i = 0 ; i < fs_indexHashSize ; i++ ) {
+		fs_indexHash[i] = -1;
+	}
+
+	fs_indexNumEntries = 0;
+	for ( search = fs_searchpaths, order = 0 ; search ; search = search->next, order++ ) {
+		if ( !search->pack ) {
+			continue;
+		}
+		for ( i = 0 ; i < search->pack->numfiles ; i++ ) {
+			e = &fs_indexEntries[fs_indexNumEntries];
+			e->file = &search->pack->buildBuffer[i];
+			e->search = search;
+			e->order = order;
+			hash = FS_HashFileName( e->file->name, fs_indexHashSize );
+			e->next = fs_indexHash[hash];
+			fs_indexHash[hash] = fs_indexNumEntries++;
+		}
+	}
+
+	fs_dirMisses = Z_Malloc( DIR_MISS_SIZE * sizeof( *fs_dirMisses ) );
+	fs_dirMissGeneration++;
+
+	fs_indexLookups = fs_indexHits = fs_indexMisses = 0;
+	fs_dirProbes = fs_dirProbesSkipped = 0;
+}
+
+/*
+=================
+FS_IndexLookup
+
+Returns the first pak in the search path with the file, only the pure
+ones if pure is set
+=================
+*/
+static searchpath_t *FS_IndexLookup( const char *filename, qboolean pure ) {
+	fileIndexEntry_t    *e, *best;
+	int                 i;
+
+	if ( filename[0] == '/' || filename[0] == '\\' ) {
+		filename++;
+	}
+
+	best = NULL;
+	for ( i = fs_indexHash[FS_HashFileName( filename, fs_indexHashSize )] ; i != -1 ; i = e->next ) {
+		e = &fs_indexEntries[i];
+		if ( best && best->order < e->order ) {
+			continue;
+		}
+		if ( FS_FilenameCompare( e->file->name, filename ) ) {
+			continue;
+		}
+		if ( pure && !FS_PakIsPure( e->search->pack ) ) {
+			continue;
+		}
+		best = e;
+	}
+
+	return best ? best->search : NULL;
+}
+
+/*
+=================
+FS_DirMissSlot
+
+Unlike FS_HashFileName this hashes the extension too, the loaders try
+the same name with one after the other
+=================
+*/
+static dirMiss_t *FS_DirMissSlot( const char *filename ) {
+	unsigned    hash;
+	int         c;
+
+	hash = 0;
+	for ( ; *filename ; filename++ ) {
+		c = tolower( *filename );
+		if ( c == '\\' ) {
+			c = '/';
+		}
+		hash = hash * 33 + c;
+	}
+
+	return &fs_dirMisses[( hash ^ ( hash >> 11 ) ) & ( DIR_MISS_SIZE - 1 )];
+}
+
+/*
+=================
+FS_DirMissed
+
+qtrue if the directory with dirBit didn't have the file the last time
+=================
+*/
+static qboolean FS_DirMissed( const char *filename, unsigned dirBit ) {
+	dirMiss_t *miss;
+
+	miss = FS_DirMissSlot( filename );
+	return miss->generation == fs_dirMissGeneration && ( miss->dirs & dirBit ) && !FS_FilenameCompare( miss->name, filename );
+}
+
+/*
+=================
+FS_AddDirMiss
+=================
+*/
+static void FS_AddDirMiss( const char *filename, unsigned dirBit ) {
+	dirMiss_t *miss;
+
+	if ( !dirBit || strlen( filename ) >= MAX_QPATH ) {
+		return;
+	}
+
+	miss = FS_DirMissSlot( filename );
+	if ( miss->generation != fs_dirMissGeneration || FS_FilenameCompare( miss->name, filename ) ) {
+		Q_strncpyz( miss->name, filename, sizeof( miss->name ) );
+		miss->generation = fs_dirMissGeneration;
+		miss->dirs = 0;
+	}
+	miss->dirs |= dirBit;
+}
+
+/*
+==========================================================================
+
+ASYNC READS AND PREFETCHING
+
+FS_ReadFileAsync queues a whole file read for the I/O thread, its
+callback runs on the main thread from FS_RunReadCallbacks or
+FS_WaitRead.  The I/O thread looks files up in the search paths
+without touching file handles or the zone, reads pak entries with its
+own FILE and inflates them straight into a malloced buffer.  Anything
+it can't read is left to the normal path on the main thread.
+
+Between FS_BeginLevelLoad and FS_EndLevelLoad every file opened with
+FS_FOpenFileRead goes into prefetch/<mapname>.txt.  The next load of the map
+queues that list up front, so the reads run ahead while the main thread
+decodes images, models and sounds, and FS_FOpenFileRead hands out the
+prefetched files as memory handles.  The search paths only change with
+the I/O thread idle, see FS_FlushReads.
+
+==========================================================================
+*/
+
+#define MAX_ASYNC_READS         2048            // power of two
+#define ASYNC_READ_HASH_SIZE    1024
+#define MAX_PREFETCH_FILES      1536            // leaves room for FS_ReadFileAsync
+#define PREFETCH_LIST_SIZE      0x20000
+
+typedef enum {
+	FSREAD_FREE,
+	FSREAD_QUEUED,
+	FSREAD_READING,
+	FSREAD_DONE
+} fsReadState_t;
+
+typedef struct {
+	volatile fsReadState_t state;
+	int id;
+	char qpath[MAX_QPATH];
+	fsReadCallback_t callback;              // NULL for prefetches
+	void *data;
+	qboolean hashed;                        // prefetch not handed out yet
+	int hashNext;
+
+	byte *buffer;                           // malloced, with a trailing 0
+	long len;                               // -1 if the I/O thread couldn't read it
+	pack_t *pak;                            // it came from, for the references
+} fsRead_t;
+
+typedef struct {
+	FILE *file;                             // last pak read, kept open
+	char path[MAX_OSPATH];
+} fsReader_t;
+
+static fsRead_t fs_reads[MAX_ASYNC_READS];
+static int fs_readQueue[MAX_ASYNC_READS * 2];   // slots, stale ones are skipped
+static int fs_readHead, fs_readTail;
+static int fs_readHash[ASYNC_READ_HASH_SIZE];
+static int fs_readSequence;
+static int fs_nextRead;
+static int fs_numCallbacks;
+static int fs_numPrefetches;
+static volatile int fs_readHeld;               // bytes of finished reads
+static fsReader_t fs_mainReader;
+
+static cvar_t *fs_asyncReads;
+static cvar_t *fs_prefetch;
+static cvar_t *fs_prefetchMegs;
+static qboolean fs_readThreadRunning;
+
+// prefetch list recorded during the level load
+static char fs_prefetchMap[MAX_QPATH];
+static char *fs_prefetchList;
+static int fs_prefetchListLen;
+static int fs_prefetchHashes[MAX_PREFETCH_FILES];
+static int fs_numPrefetchHashes;
+static int fs_prefetchHits;
+
+#ifdef __vita__
+static SceKernelLwMutexWork fs_readLock;
+static SceUID fs_readSema;
+static SceUID fs_readThreadId;
+static volatile qboolean fs_readThreadQuit;
+static fsReader_t fs_threadReader;
+
+#define FS_ReadLock()   sceKernelLockLwMutex( &fs_readLock, 1, NULL )
+#define FS_ReadUnlock() sceKernelUnlockLwMutex( &fs_readLock, 1 )
+#else
+#define FS_ReadLock()
+#define FS_ReadUnlock()
+#endif
+
+/*
+=================
+FS_ReferencePakFile
+
+Marks the pak as referenced the way a file read from it requires
+=================
+*/
+static void FS_ReferencePakFile( pack_t *pak, const char *filename ) {
+	int len;
+
+	// mark the pak as having been referenced and mark specifics on cgame and ui
+	// shaders, txt, arena files  by themselves do not count as a reference as
+	// these are loaded from all pk3s
+	// from every pk3 file..
+	len = strlen(filename);
+
+	if (!(pak->referenced & FS_GENERAL_REF))
+	{
+		if(!FS_IsExt(filename, ".shader", len) &&
+		   !FS_IsExt(filename, ".txt", len) &&
+		   !FS_IsExt(filename, ".cfg", len) &&
+		   !FS_IsExt(filename, ".config", len) &&
+		   !FS_IsExt(filename, ".bot", len) &&
+		   !FS_IsExt(filename, ".arena", len) &&
+		   !FS_IsExt(filename, ".menu", len) &&
+		   !strstr(filename, "levelshots"))
+		{
+			pak->referenced |= FS_GENERAL_REF;
+		}
+	}
+
+	if(strstr(filename, Sys_GetDLLName( "cgame" )))
+		pak->referenced |= FS_CGAME_REF;
+
+	if(strstr(filename, Sys_GetDLLName( "ui" )))
+		pak->referenced |= FS_UI_REF;
+
+	if(strstr(filename, "cgame.sp.qvm"))
+		pak->referenced |= FS_CGAME_REF;
+
+	if(strstr(filename, "ui.sp.qvm"))
+		pak->referenced |= FS_UI_REF;
+}
+
+static int FS_ZipShort( const byte *p ) {
+	return p[0] | ( p[1] << 8 );
+}
+
+static int FS_ZipLong( const byte *p ) {
+	return p[0] | ( p[1] << 8 ) | ( p[2] << 16 ) | ( p[3] << 24 );
+}
+
+/*
+=================
+FS_ReadPakEntry
+
+Reads a stored or deflated file out of a pak without unzip.c, which
+allocates from the zone.  Returns NULL for anything unusual.
+=================
+*/
+static byte *FS_ReadPakEntry( fsReader_t *r, pack_t *pak, fileInPack_t *pakFile ) {
+	byte        header[46];
+	byte        *buffer, *compressed;
+	z_stream    stream;
+	int         method, crc, compressedLen, len, ofs;
+
+	if ( !r->file || strcmp( r->path, pak->pakFilename ) ) {
+		if ( r->file ) {
+			fclose( r->file );
+		}
+		Q_strncpyz( r->path, pak->pakFilename, sizeof( r->path ) );
+		r->file = Sys_FOpen( r->path, "rb" );
+		if ( !r->file ) {
+			return NULL;
+		}
+	}
+
+	// central directory entry
+	if ( fseek( r->file, pakFile->pos, SEEK_SET ) || fread( header, 1, 46, r->file ) != 46
+		 || FS_ZipLong( header ) != 0x02014b50 || ( FS_ZipShort( header + 8 ) & 1 ) ) {
+		return NULL;
+	}
+	method = FS_ZipShort( header + 10 );
+	crc = FS_ZipLong( header + 16 );
+	compressedLen = FS_ZipLong( header + 20 );
+	len = FS_ZipLong( header + 24 );
+	ofs = FS_ZipLong( header + 42 );
+	if ( len != pakFile->len || len < 0 || compressedLen < 0 || ( method != 0 && method != Z_DEFLATED ) ) {
+		return NULL;
+	}
+
+	// local header
+	if ( fseek( r->file, ofs, SEEK_SET ) || fread( header, 1, 30, r->file ) != 30 || FS_ZipLong( header ) != 0x04034b50 ) {
+		return NULL;
+	}
+	ofs += 30 + FS_ZipShort( header + 26 ) + FS_ZipShort( header + 28 );
+	if ( fseek( r->file, ofs, SEEK_SET ) ) {
+		return NULL;
+	}
+
+	buffer = malloc( len + 1 );
+	if ( !buffer ) {
+		return NULL;
+	}
+
+	if ( method == 0 ) {
+		if ( compressedLen != len || fread( buffer, 1, len, r->file ) != len ) {
+			free( buffer );
+			return NULL;
+		}
+	} else {
+		compressed = malloc( compressedLen + 1 );
+		if ( !compressed ) {
+			free( buffer );
+			return NULL;
+		}
+		if ( fread( compressed, 1, compressedLen, r->file ) != compressedLen ) {
+			free( compressed );
+			free( buffer );
+			return NULL;
+		}
+		compressed[compressedLen] = 0;      // inflate may want a byte past a raw stream
+
+		Com_Memset( &stream, 0, sizeof( stream ) );
+		if ( inflateInit2( &stream, -MAX_WBITS ) != Z_OK ) {
+			free( compressed );
+			free( buffer );
+			return NULL;
+		}
+		stream.next_in = compressed;
+		stream.avail_in = compressedLen + 1;
+		stream.next_out = buffer;
+		stream.avail_out = len;
+		inflate( &stream, Z_FINISH );
+		inflateEnd( &stream );
+		free( compressed );
+
+		if ( stream.total_out != len ) {
+			free( buffer );
+			return NULL;
+		}
+	}
+
+	if ( (int)crc32( 0, buffer, len ) != crc ) {
+		free( buffer );
+		return NULL;
+	}
+
+	buffer[len] = 0;
+	return buffer;
+}
+
+/*
+=================
+FS_LoadRead
+
+Finds the file the way FS_FOpenFileRead would and reads it whole.
+Runs on the I/O thread, only reads the search paths.
+=================
+*/
+static void FS_LoadRead( fsReader_t *r, fsRead_t *read ) {
+	searchpath_t    *search, *winner;
+	fileInPack_t    *pakFile;
+	char            netpath[MAX_OSPATH];
+	char            ospath[MAX_OSPATH];
+	FILE            *f;
+	long            hash;
+	int             len;
+	int             traceStart;
+
+	read->buffer = NULL;
+	read->len = -1;
+	read->pak = NULL;
+	traceStart = Com_TraceStart();
+
+	// the directories in front of it are still tried
+	winner = fs_indexHash ? FS_IndexLookup( read->qpath, qtrue ) : NULL;
+
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack ) {
+			if ( fs_indexHash && search != winner ) {
+				continue;
+			}
+			hash = FS_HashFileName( read->qpath, search->pack->hashSize );
+			for ( pakFile = search->pack->hashTable[hash] ; pakFile ; pakFile = pakFile->next ) {
+				if ( !FS_FilenameCompare( pakFile->name, read->qpath ) ) {
+					break;
+				}
+			}
+			if ( !pakFile || !FS_PakIsPure( search->pack ) ) {
+				continue;
+			}
+
+			read->buffer = FS_ReadPakEntry( r, search->pack, pakFile );
+			if ( read->buffer ) {
+				read->len = pakFile->len;
+				read->pak = search->pack;
+			}
+			break;
+		}
+
+		if ( search->dir ) {
+			// same restriction as FS_FOpenFileReadDir on a pure server
+			len = strlen( read->qpath );
+			if ( fs_numServerPaks && !FS_IsExt( read->qpath, ".cfg", len ) && !FS_IsExt( read->qpath, ".svg", len )
+				 && !FS_IsExt( read->qpath, ".game", len ) && !FS_IsExt( read->qpath, ".dat", len )
+				 && !FS_IsDemoExt( read->qpath, len ) ) {
+				continue;
+			}
+
+			// FS_BuildOSPath isn't reentrant
+			Com_sprintf( netpath, sizeof( netpath ), "/%s/%s", search->dir->gamedir, read->qpath );
+			FS_ReplaceSeparators( netpath );
+			Com_sprintf( ospath, sizeof( ospath ), "%s%s", search->dir->path, netpath );
+			f = Sys_FOpen( ospath, "rb" );
+			if ( !f ) {
+				continue;
+			}
+
+			len = FS_fplength( f );
+			read->buffer = malloc( len + 1 );
+			if ( read->buffer && fread( read->buffer, 1, len, f ) == len ) {
+				read->buffer[len] = 0;
+				read->len = len;
+			} else if ( read->buffer ) {
+				free( read->buffer );
+				read->buffer = NULL;
+			}
+			fclose( f );
+			break;
+		}
+	}
+
+	Com_TraceEvent( traceStart, "read", read->qpath, read->len, read->pak ? read->pak->pakBasename : NULL );
+}
+
+/*
+=================
+FS_ReadNext
+
+Takes the next queued read and does it, returns qfalse if there was
+nothing to do.  Prefetches wait while fs_prefetchMegs are held.
+=================
+*/
+static qboolean FS_ReadNext( fsReader_t *r ) {
+	fsRead_t    *read;
+	int         i;
+
+	FS_ReadLock();
+	for ( ; fs_readHead != fs_readTail ; fs_readHead++ ) {
+		i = fs_readQueue[fs_readHead & ( ARRAY_LEN( fs_readQueue ) - 1 )];
+		if ( fs_reads[i].state == FSREAD_QUEUED ) {
+			break;
+		}
+	}
+	if ( fs_readHead == fs_readTail ) {
+		FS_ReadUnlock();
+		return qfalse;
+	}
+	read = &fs_reads[i];
+	if ( !read->callback && fs_readHeld >= fs_prefetchMegs->integer * 1024 * 1024 ) {
+		FS_ReadUnlock();
+		return qfalse;
+	}
+	fs_readHead++;
+	read->state = FSREAD_READING;
+	FS_ReadUnlock();
+
+	FS_LoadRead( r, read );
+
+	FS_ReadLock();
+	if ( read->buffer ) {
+		fs_readHeld += read->len;
+	}
+	read->state = FSREAD_DONE;
+	FS_ReadUnlock();
+
+	return qtrue;
+}
+
+#ifdef __vita__
+/*
+=================
+FS_ReadThread
+=================
+*/
+static int FS_ReadThread( SceSize args, void *argp ) {
+	SceUInt timeout;
+
+	while ( !fs_readThreadQuit ) {
+		if ( !FS_ReadNext( &fs_threadReader ) ) {
+			timeout = 20000;
+			sceKernelWaitSema( fs_readSema, 1, &timeout );
+		}
+	}
+
+	if ( fs_threadReader.file ) {
+		fclose( fs_threadReader.file );
+		fs_threadReader.file = NULL;
+	}
+
+	return sceKernelExitThread( 0 );
+}
+#endif
+
+/*
+=================
+FS_WakeReads
+=================
+*/
+static void FS_WakeReads( void ) {
+#ifdef __vita__
+	if ( fs_readThreadRunning ) {
+		sceKernelSignalSema( fs_readSema, 1 );
+	}
+#endif
+}
+
+/*
+=================
+FS_WaitForReading
+
+Sleeps until the I/O thread finished the read it is doing
+=================
+*/
+static void FS_WaitForReading( fsRead_t *read ) {
+	while ( read->state == FSREAD_READING ) {
+#ifdef __vita__
+		sceKernelDelayThread( 500 );
+#endif
+	}
+}
+
+/*
+=================
+FS_FreeRead
+=================
+*/
+static void FS_FreeRead( fsRead_t *read ) {
+	int *link;
+
+	if ( read->hashed ) {
+		for ( link = &fs_readHash[FS_HashFileName( read->qpath, ASYNC_READ_HASH_SIZE )] ; *link != -1 ; link = &fs_reads[*link].hashNext ) {
+			if ( &fs_reads[*link] == read ) {
+				*link = read->hashNext;
+				break;
+			}
+		}
+		read->hashed = qfalse;
+		fs_numPrefetches--;
+	}
+
+	FS_ReadLock();
+	if ( read->buffer ) {
+		fs_readHeld -= read->len;
+		free( read->buffer );
+		read->buffer = NULL;
+	}
+	read->callback = NULL;
+	read->state = FSREAD_FREE;
+	FS_ReadUnlock();
+}
+
+/*
+=================
+FS_QueueRead
+
+Returns the slot, or NULL if all are taken
+=================
+*/
+static fsRead_t *FS_QueueRead( const char *qpath, fsReadCallback_t callback, void *data ) {
+	fsRead_t    *read;
+	int         i, slot;
+
+	if ( strlen( qpath ) >= MAX_QPATH || strstr( qpath, ".." ) || strstr( qpath, "::" ) || strstr( qpath, "rtcwkey" ) ) {
+		return NULL;
+	}
+
+	for ( i = 0 ; i < MAX_ASYNC_READS ; i++ ) {
+		slot = ( fs_nextRead + i ) & ( MAX_ASYNC_READS - 1 );
+		if ( fs_reads[slot].state == FSREAD_FREE ) {
+			break;
+		}
+	}
+	if ( i == MAX_ASYNC_READS ) {
+		return NULL;
+	}
+	fs_nextRead = slot + 1;
+
+	FS_ReadLock();
+	if ( fs_readTail - fs_readHead >= ARRAY_LEN( fs_readQueue ) ) {
+		FS_ReadUnlock();
+		return NULL;
+	}
+
+	read = &fs_reads[slot];
+	read->id = ( ++fs_readSequence * MAX_ASYNC_READS ) + slot;
+	Q_strncpyz( read->qpath, qpath[0] == '/' || qpath[0] == '\\' ? qpath + 1 : qpath, sizeof( read->qpath ) );
+	read->callback = callback;
+	read->data = data;
+	read->hashed = qfalse;
+	read->buffer = NULL;
+	read->len = -1;
+	read->pak = NULL;
+	read->state = FSREAD_QUEUED;
+
+	if ( callback ) {
+		// asked for by the game, goes before the prefetches
+		fs_readQueue[--fs_readHead & ( ARRAY_LEN( fs_readQueue ) - 1 )] = slot;
+		fs_numCallbacks++;
+	} else {
+		fs_readQueue[fs_readTail++ & ( ARRAY_LEN( fs_readQueue ) - 1 )] = slot;
+	}
+	FS_ReadUnlock();
+
+	FS_WakeReads();
+
+	return read;
+}
+
+/*
+=================
+FS_FinishRead
+
+Runs the callback of a finished read on the main thread, reading it the
+normal way if the I/O thread couldn't
+=================
+*/
+static void FS_FinishRead( fsRead_t *read ) {
+	fsReadCallback_t    callback;
+	void                *buffer;
+	long                len;
+
+	callback = read->callback;
+	fs_numCallbacks--;
+
+	if ( read->buffer ) {
+		if ( read->pak ) {
+			FS_ReferencePakFile( read->pak, read->qpath );
+		}
+		fs_loadCount++;
+		callback( read->qpath, read->buffer, read->len, read->data );
+		FS_FreeRead( read );
+		return;
+	}
+
+	len = FS_ReadFile( read->qpath, &buffer );
+	callback( read->qpath, buffer, len, read->data );
+	if ( buffer ) {
+		FS_FreeFile( buffer );
+	}
+	FS_FreeRead( read );
+}
+
+/*
+=================
+FS_ReadFileAsync
+
+Queues a read of the whole file, callback gets it on the main thread
+with a trailing 0, or a NULL buffer and -1 if there is no such file.
+The buffer is only valid during the callback.  Returns the request.
+=================
+*/
+int FS_ReadFileAsync( const char *qpath, fsReadCallback_t callback, void *data ) {
+	fsRead_t    *read;
+	void        *buffer;
+	long        len;
+
+	if ( !fs_searchpaths ) {
+		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
+	}
+	if ( !qpath || !qpath[0] || !callback ) {
+		Com_Error( ERR_FATAL, "FS_ReadFileAsync with empty name or callback" );
+	}
+
+	read = FS_QueueRead( qpath, callback, data );
+	if ( !read ) {
+		// no room, just do it now
+		len = FS_ReadFile( qpath, &buffer );
+		callback( qpath, buffer, len, data );
+		if ( buffer ) {
+			FS_FreeFile( buffer );
+		}
+		return 0;
+	}
+
+	return read->id;
+}
+
+/*
+=================
+FS_ReadDone
+
+qtrue once the read can be finished without blocking, or its callback ran
+=================
+*/
+qboolean FS_ReadDone( int request ) {
+	fsRead_t *read;
+
+	read = &fs_reads[request & ( MAX_ASYNC_READS - 1 )];
+	return read->id != request || read->state == FSREAD_FREE || read->state == FSREAD_DONE;
+}
+
+/*
+=================
+FS_WaitRead
+
+Finishes the read and runs its callback, does it on the main thread if
+the I/O thread didn't get to it yet
+=================
+*/
+void FS_WaitRead( int request ) {
+	fsRead_t *read;
+
+	read = &fs_reads[request & ( MAX_ASYNC_READS - 1 )];
+	if ( read->id != request || read->state == FSREAD_FREE || !read->callback ) {
+		return;
+	}
+
+	FS_ReadLock();
+	if ( read->state == FSREAD_QUEUED ) {
+		read->state = FSREAD_READING;
+		FS_ReadUnlock();
+		FS_LoadRead( &fs_mainReader, read );
+		FS_ReadLock();
+		if ( read->buffer ) {
+			fs_readHeld += read->len;
+		}
+		read->state = FSREAD_DONE;
+	}
+	FS_ReadUnlock();
+
+	FS_WaitForReading( read );
+	FS_FinishRead( read );
+}
+
+/*
+=================
+FS_RunReadCallbacks
+
+Called every frame, runs the callbacks of the finished reads.  Without
+the I/O thread the queued reads are done here.
+=================
+*/
+void FS_RunReadCallbacks( void ) {
+	int i;
+
+	if ( !fs_numCallbacks ) {
+		return;
+	}
+
+	if ( !fs_readThreadRunning ) {
+		while ( FS_ReadNext( &fs_mainReader ) ) {
+		}
+	}
+
+	for ( i = 0 ; i < MAX_ASYNC_READS && fs_numCallbacks ; i++ ) {
+		if ( fs_reads[i].state == FSREAD_DONE && fs_reads[i].callback ) {
+			FS_FinishRead( &fs_reads[i] );
+		}
+	}
+}
+
+/*
+=================
+FS_DropPrefetches
+
+Cancels the queued prefetches and frees the ones nobody opened
+=================
+*/
+static void FS_DropPrefetches( void ) {
+	fsRead_t    *read;
+	int         i;
+
+	for ( i = 0 ; i < MAX_ASYNC_READS && fs_numPrefetches ; i++ ) {
+		read = &fs_reads[i];
+		if ( !read->hashed ) {
+			continue;
+		}
+
+		FS_ReadLock();
+		if ( read->state == FSREAD_QUEUED ) {
+			read->state = FSREAD_DONE;
+		}
+		FS_ReadUnlock();
+
+		FS_WaitForReading( read );
+		FS_FreeRead( read );
+	}
+}
+
+/*
+=================
+FS_FlushReads
+
+Finishes every read, for when the search paths are about to change
+=================
+*/
+static void FS_FlushReads( void ) {
+	int i;
+
+	FS_DropPrefetches();
+
+	for ( i = 0 ; i < MAX_ASYNC_READS && fs_numCallbacks ; i++ ) {
+		if ( fs_reads[i].state != FSREAD_FREE && fs_reads[i].callback ) {
+			FS_WaitRead( fs_reads[i].id );
+		}
+	}
+
+	if ( fs_mainReader.file ) {
+		fclose( fs_mainReader.file );
+		fs_mainReader.file = NULL;
+	}
+}
+
+/*
+=================
+FS_OpenPrefetched
+
+Hands out a prefetched file as a memory handle, returns -1 if there is
+none and the file has to be opened the normal way
+=================
+*/
+static long FS_OpenPrefetched( const char *filename, fileHandle_t *file ) {
+	fsRead_t    *read;
+	byte        *buffer;
+	pack_t      *pak;
+	long        len;
+	int         i;
+
+	if ( filename[0] == '/' || filename[0] == '\\' ) {
+		filename++;
+	}
+
+	for ( i = fs_readHash[FS_HashFileName( filename, ASYNC_READ_HASH_SIZE )] ; i != -1 ; i = fs_reads[i].hashNext ) {
+		if ( !FS_FilenameCompare( fs_reads[i].qpath, filename ) ) {
+			break;
+		}
+	}
+	if ( i == -1 ) {
+		return -1;
+	}
+	read = &fs_reads[i];
+
+	FS_ReadLock();
+	if ( read->state == FSREAD_QUEUED ) {
+		// not started, reading it right here is no slower
+		read->state = FSREAD_DONE;
+	}
+	FS_ReadUnlock();
+
+	FS_WaitForReading( read );
+
+	if ( !read->buffer ) {
+		FS_FreeRead( read );
+		return -1;
+	}
+
+	// the handle owns the buffer now
+	buffer = read->buffer;
+	len = read->len;
+	pak = read->pak;
+	FS_ReadLock();
+	fs_readHeld -= len;
+	read->buffer = NULL;
+	FS_ReadUnlock();
+	FS_FreeRead( read );
+	FS_WakeReads();
+
+	*file = FS_HandleForFile();
+	fsh[*file].handleFiles.file.m = buffer;
+	fsh[*file].handleFiles.unique = qtrue;
+	fsh[*file].memFile = qtrue;
+	fsh[*file].memLen = len;
+	fsh[*file].memPos = 0;
+	fsh[*file].fileSize = len + 1;      // so FS_Shutdown frees it
+	Q_strncpyz( fsh[*file].name, filename, sizeof( fsh[*file].name ) );
+
+	if ( pak ) {
+		FS_ReferencePakFile( pak, filename );
+		fsh[*file].pakName = pak->pakBasename;
+	}
+
+	fs_prefetchHits++;
+	if ( fs_debug->integer ) {
+		Com_Printf( "FS_FOpenFileRead: %s (prefetched)\n", filename );
+	}
+
+	return len;
+}
+
+/*
+=================
+FS_RecordRead
+
+Notes a file opened during the level load for the prefetch list
+=================
+*/
+static void FS_RecordRead( const char *filename, long len ) {
+	int hash, i, namelen;
+
+	if ( !fs_prefetchList || len <= 0 || len > fs_prefetchMegs->integer * 1024 * 1024 / 4 ) {
+		return;
+	}
+
+	if ( filename[0] == '/' || filename[0] == '\\' ) {
+		filename++;
+	}
+	namelen = strlen( filename );
+	if ( FS_IsExt( filename, ".cfg", namelen ) || strchr( filename, '\n' ) ) {
+		return;
+	}
+
+	hash = FS_HashFileName( filename, 1 << 24 );
+	for ( i = 0 ; i < fs_numPrefetchHashes ; i++ ) {
+		if ( fs_prefetchHashes[i] == hash ) {
+			return;
+		}
+	}
+	if ( fs_numPrefetchHashes == MAX_PREFETCH_FILES || fs_prefetchListLen + namelen + 2 > PREFETCH_LIST_SIZE ) {
+		return;
+	}
+
+	fs_prefetchHashes[fs_numPrefetchHashes++] = hash;
+	Com_sprintf( fs_prefetchList + fs_prefetchListLen, PREFETCH_LIST_SIZE - fs_prefetchListLen, "%s\n", filename );
+	fs_prefetchListLen += namelen + 1;
+}
+
+/*
+=================
+FS_BeginLevelLoad
+
+Queues the files the last load of the map read and starts recording
+the ones this load reads
+=================
+*/
+void FS_BeginLevelLoad( const char *mapname ) {
+	fsRead_t    *read;
+	char        filename[MAX_QPATH];
+	char        *list, *s, *next;
+	int         hash;
+
+	FS_EndLevelLoad();
+
+	if ( !fs_prefetch->integer || !mapname || !mapname[0] ) {
+		return;
+	}
+
+	Q_strncpyz( fs_prefetchMap, mapname, sizeof( fs_prefetchMap ) );
+	fs_prefetchHits = 0;
+
+	// queue the last list, without the I/O thread it's just recorded
+	Com_sprintf( filename, sizeof( filename ), "prefetch/%s.txt", mapname );
+	if ( fs_readThreadRunning && FS_ReadFile( filename, (void **)&list ) > 0 ) {
+		for ( s = list ; *s ; s = next ) {
+			next = strchr( s, '\n' );
+			if ( next ) {
+				*next++ = 0;
+			} else {
+				next = s + strlen( s );
+			}
+			if ( !*s || fs_numPrefetches == MAX_PREFETCH_FILES ) {
+				continue;
+			}
+
+			read = FS_QueueRead( s, NULL, NULL );
+			if ( !read ) {
+				break;
+			}
+			hash = FS_HashFileName( read->qpath, ASYNC_READ_HASH_SIZE );
+			read->hashed = qtrue;
+			read->hashNext = fs_readHash[hash];
+			fs_readHash[hash] = read - fs_reads;
+			fs_numPrefetches++;
+		}
+		FS_FreeFile( list );
+	}
+
+	fs_prefetchList = Z_Malloc( PREFETCH_LIST_SIZE );
+	fs_prefetchListLen = 0;
+	fs_numPrefetchHashes = 0;
+}
+
+/*
+=================
+FS_EndLevelLoad
+
+Writes out what the level load read and drops the prefetches nobody
+opened
+=================
+*/
+void FS_EndLevelLoad( void ) {
+	char filename[MAX_QPATH];
+	int queued;
+
+	if ( !fs_prefetchList ) {
+		return;
+	}
+
+	queued = fs_numPrefetches;
+	FS_DropPrefetches();
+
+	if ( fs_prefetchListLen ) {
+		Com_sprintf( filename, sizeof( filename ), "prefetch/%s.txt", fs_prefetchMap );
+		FS_WriteFile( filename, fs_prefetchList, fs_prefetchListLen );
+	}
+	if ( fs_prefetchHits || queued ) {
+		Com_Printf( "%d files prefetched for %s, %d unused\n", fs_prefetchHits, fs_prefetchMap, queued );
+	}
+
+	Z_Free( fs_prefetchList );
+	fs_prefetchList = NULL;
+}
+
+/*
+=================
+FS_InitReads
+=================
+*/
+static void FS_InitReads( void ) {
+	int i;
+
+	fs_asyncReads = Cvar_Get( "fs_asyncReads", "1", CVAR_ARCHIVE | CVAR_LATCH );
+	fs_prefetch = Cvar_Get( "fs_prefetch", "1", CVAR_ARCHIVE );
+	fs_prefetchMegs = Cvar_Get( "fs_prefetchMegs", "24", CVAR_ARCHIVE );
+
+	for ( i = 0 ; i < ASYNC_READ_HASH_SIZE ; i++ ) {
+		fs_readHash[i] = -1;
+	}
+
+#ifdef __vita__
+	sceKernelCreateLwMutex( &fs_readLock, "FS Reads", 0, 0, NULL );
+
+	if ( !fs_asyncReads->integer ) {
+		return;
+	}
+
+	fs_readSema = sceKernelCreateSema( "FS Reads", 0, 0, 1, NULL );
+	fs_readThreadQuit = qfalse;
+	fs_readThreadId = sceKernelCreateThread( "FS Reads", FS_ReadThread, 0x10000100, 0x10000, 0, 0, NULL );
+	if ( fs_readThreadId < 0 || sceKernelStartThread( fs_readThreadId, 0, NULL ) < 0 ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't start the file read thread, reading on the main thread\n" );
+		sceKernelDeleteSema( fs_readSema );
+		return;
+	}
+	fs_readThreadRunning = qtrue;
+#endif
+}
+
+/*
+=================
+FS_ShutdownReads
+=================
+*/
+static void FS_ShutdownReads( void ) {
+	FS_FlushReads();
+
+#ifdef __vita__
+	if ( fs_readThreadRunning ) {
+		fs_readThreadQuit = qtrue;
+		sceKernelSignalSema( fs_readSema, 1 );
+		sceKernelWaitThreadEnd( fs_readThreadId, NULL, NULL );
+		sceKernelDeleteThread( fs_readThreadId );
+		sceKernelDeleteSema( fs_readSema );
+		fs_readThreadRunning = qfalse;
+	}
+
+	sceKernelDeleteLwMutex( &fs_readLock );
+#endif
 }
 
 /*
@@ -1472,38 +2683,7 @@ long FS_FOpenFileReadDir(const char *filename, searchpath_t *search, fileHandle_
 				{
 					// found it!
 
-					// mark the pak as having been referenced and mark specifics on cgame and ui
-					// shaders, txt, arena files  by themselves do not count as a reference as
-					// these are loaded from all pk3s
-					// from every pk3 file..
-					len = strlen(filename);
-
-					if (!(pak->referenced & FS_GENERAL_REF))
-					{
-						if(!FS_IsExt(filename, ".shader", len) &&
-						   !FS_IsExt(filename, ".txt", len) &&
-						   !FS_IsExt(filename, ".cfg", len) &&
-						   !FS_IsExt(filename, ".config", len) &&
-						   !FS_IsExt(filename, ".bot", len) &&
-						   !FS_IsExt(filename, ".arena", len) &&
-						   !FS_IsExt(filename, ".menu", len) &&
-						   !strstr(filename, "levelshots"))
-						{
-							pak->referenced |= FS_GENERAL_REF;
-						}
-					}
-
-					if(strstr(filename, Sys_GetDLLName( "cgame" )))
-						pak->referenced |= FS_CGAME_REF;
-
-					if(strstr(filename, Sys_GetDLLName( "ui" )))
-						pak->referenced |= FS_UI_REF;
-
-					if(strstr(filename, "cgame.sp.qvm"))
-						pak->referenced |= FS_CGAME_REF;
-
-					if(strstr(filename, "ui.sp.qvm"))
-						pak->referenced |= FS_UI_REF;
+					FS_ReferencePakFile(pak, filename);
 
 					if(uniqueFILE)
 					{
@@ -1518,6 +2698,7 @@ long FS_FOpenFileReadDir(const char *filename, searchpath_t *search, fileHandle_
 
 					Q_strncpyz(fsh[*file].name, filename, sizeof(fsh[*file].name));
 					fsh[*file].zipFile = qtrue;
+					fsh[*file].pakName = pak->pakBasename;
 
 					// set the file position in the zip file (also sets the current file info)
 					unzSetOffset(fsh[*file].handleFiles.file.z, pakFile->pos);
@@ -1596,30 +2777,60 @@ long FS_FOpenFileReadDir(const char *filename, searchpath_t *search, fileHandle_
 
 /*
 ===========
-FS_FOpenFileRead
+FS_FOpenFileReadPath
 
-Finds the file in the search path.
-Returns filesize and an open FILE pointer.
-Used for streaming data out of either a
-separate file or a ZIP file.
+FS_FOpenFileRead without the prefetching
 ===========
 */
-long FS_FOpenFileRead(const char *filename, fileHandle_t *file, qboolean uniqueFILE)
+static long FS_FOpenFileReadPath(const char *filename, fileHandle_t *file, qboolean uniqueFILE, qboolean isLocalConfig)
 {
-	searchpath_t *search;
+	searchpath_t *search, *winner;
+	qboolean passedWinner;
+	unsigned dirBit;
 	long len;
-	qboolean isLocalConfig;
 
-	if(!fs_searchpaths)
-		Com_Error(ERR_FATAL, "Filesystem call made without initialization");
+	winner = NULL;
+	if(fs_indexHash)
+	{
+		fs_indexLookups++;
+		winner = FS_IndexLookup(filename, file != NULL);
+		if(winner)
+			fs_indexHits++;
+		else
+			fs_indexMisses++;
+	}
+
+	passedWinner = qfalse;
+	dirBit = 1;
 
-	isLocalConfig = !strcmp(filename, "autoexec.cfg") || !strcmp(filename, Q3CONFIG_CFG);
 	for(search = fs_searchpaths; search; search = search->next)
 	{
 		// autoexec.cfg and wolfconfig.cfg can only be loaded outside of pk3 files.
 		if (isLocalConfig && search->pack)
 			continue;
 
+		if(fs_indexHash)
+		{
+			if(search->pack)
+			{
+				// the paks in front of the winner don't have it,
+				// the ones behind are only tried if it fails
+				if(!passedWinner && search != winner)
+					continue;
+				passedWinner = qtrue;
+			}
+			else if(search->dir)
+			{
+				if(FS_DirMissed(filename, dirBit))
+				{
+					fs_dirProbesSkipped++;
+					dirBit <<= 1;
+					continue;
+				}
+				fs_dirProbes++;
+			}
+		}
+
 		len = FS_FOpenFileReadDir(filename, search, file, uniqueFILE, qfalse);
 
 		if(file == NULL)
@@ -1633,6 +2844,13 @@ long FS_FOpenFileRead(const char *filename, fileHandle_t *file, qboolean uniqueF
 				return len;
 		}
 
+		if(fs_indexHash && search->dir)
+		{
+			// a pure server refuses most files without looking
+			if(file == NULL || !fs_numServerPaks)
+				FS_AddDirMiss(filename, dirBit);
+			dirBit <<= 1;
+		}
 	}
 	
 #ifdef FS_MISSING
@@ -1653,6 +2871,49 @@ long FS_FOpenFileRead(const char *filename, fileHandle_t *file, qboolean uniqueF
 	}
 }
 
+/*
+===========
+FS_FOpenFileRead
+
+Finds the file in the search path.
+Returns filesize and an open FILE pointer.
+Used for streaming data out of either a
+separate file or a ZIP file.
+===========
+*/
+long FS_FOpenFileRead(const char *filename, fileHandle_t *file, qboolean uniqueFILE)
+{
+	long len;
+	qboolean isLocalConfig;
+	int traceStart;
+
+	if(!fs_searchpaths)
+		Com_Error(ERR_FATAL, "Filesystem call made without initialization");
+
+	isLocalConfig = !strcmp(filename, "autoexec.cfg") || !strcmp(filename, Q3CONFIG_CFG);
+
+	if(!file)
+		return FS_FOpenFileReadPath(filename, file, uniqueFILE, isLocalConfig);
+
+	traceStart = Com_TraceStart();
+	len = -1;
+
+	if(!isLocalConfig && fs_numPrefetches)
+		len = FS_OpenPrefetched(filename, file);
+
+	if(len < 0)
+		len = FS_FOpenFileReadPath(filename, file, uniqueFILE, isLocalConfig);
+
+	// prefetched files go on the next list too
+	if(!isLocalConfig)
+		FS_RecordRead(filename, len);
+
+	if(*file)
+		Com_TraceEvent(traceStart, "open", filename, len, fsh[*file].pakName);
+
+	return len;
+}
+
 /*
 =================
 FS_FindVM
@@ -1809,6 +3070,15 @@ int FS_Read( void *buffer, int len, fileHandle_t f ) {
 	buf = (byte *)buffer;
 	fs_readCount += len;
 
+	if ( fsh[f].memFile ) {
+		if ( len > fsh[f].memLen - fsh[f].memPos ) {
+			len = fsh[f].memLen - fsh[f].memPos;
+		}
+		Com_Memcpy( buf, fsh[f].handleFiles.file.m + fsh[f].memPos, len );
+		fsh[f].memPos += len;
+		return len;
+	}
+
 	if ( fsh[f].zipFile == qfalse ) {
 		remaining = len;
 		tries = 0;
@@ -1919,6 +3189,27 @@ int FS_Seek( fileHandle_t f, long offset, int origin ) {
 		return -1;
 	}
 
+	if ( fsh[f].memFile ) {
+		switch ( origin ) {
+		case FS_SEEK_CUR:
+			offset += fsh[f].memPos;
+			break;
+		case FS_SEEK_END:
+			offset += fsh[f].memLen;
+			break;
+		case FS_SEEK_SET:
+			break;
+		default:
+			Com_Error( ERR_FATAL, "Bad origin in FS_Seek" );
+			return -1;
+		}
+		if ( offset < 0 || offset > fsh[f].memLen ) {
+			return -1;
+		}
+		fsh[f].memPos = offset;
+		return 0;
+	}
+
 	if ( fsh[f].zipFile == qtrue ) {
 		//FIXME: this is really, really crappy
 		//(but better than what was here before)
@@ -2009,7 +3300,14 @@ CONVENIENCE FUNCTIONS FOR ENTIRE FILES
 ======================================================================================
 */
 
-int FS_FileIsInPAK( const char *filename, int *pChecksum ) {
+/*
+================
+FS_PakOfFile
+
+The pure pak a file would be read from, NULL if it is a loose file
+================
+*/
+static pack_t *FS_PakOfFile( const char *filename ) {
 	searchpath_t    *search;
 	pack_t          *pak;
 	fileInPack_t    *pakFile;
@@ -2032,7 +3330,7 @@ int FS_FileIsInPAK( const char *filename, int *pChecksum ) {
 	// The searchpaths do guarantee that something will always
 	// be prepended, so we don't need to worry about "c:" or "//limbo"
 	if ( strstr( filename, ".." ) || strstr( filename, "::" ) ) {
-		return -1;
+		return NULL;
 	}
 
 	//
@@ -2057,16 +3355,48 @@ int FS_FileIsInPAK( const char *filename, int *pChecksum ) {
 			do {
 				// case and separator insensitive comparisons
 				if ( !FS_FilenameCompare( pakFile->name, filename ) ) {
-					if ( pChecksum ) {
-						*pChecksum = pak->pure_checksum;
-					}
-					return 1;
+					return pak;
 				}
 				pakFile = pakFile->next;
 			} while ( pakFile != NULL );
 		}
 	}
-	return -1;
+	return NULL;
+}
+
+int FS_FileIsInPAK( const char *filename, int *pChecksum ) {
+	pack_t *pak;
+
+	pak = FS_PakOfFile( filename );
+	if ( !pak ) {
+		return -1;
+	}
+	if ( pChecksum ) {
+		*pChecksum = pak->pure_checksum;
+	}
+	return 1;
+}
+
+/*
+================
+FS_FilePakChecksum
+
+Like FS_FileIsInPAK, but gives the checksum of the pak contents alone.
+The pure checksum is salted with fs_checksumFeed, which the server picks
+anew for every map, so it can't key anything kept across level loads.
+================
+*/
+int FS_FilePakChecksum( const char *filename, int *pChecksum ) {
+	pack_t *pak;
+
+	pak = FS_PakOfFile( filename );
+	if ( !pak ) {
+		return -1;
+	}
+	if ( pChecksum ) {
+		*pChecksum = pak->checksum;
+	}
+	return 1;
 }
 
 /*
@@ -2085,6 +3415,8 @@ long FS_ReadFileDir(const char *qpath, void *searchPath, qboolean unpure, void *
 	byte*           buf;
 	qboolean isConfig;
 	long len;
+	int traceStart;
+	const char *pakName;
 
 	if ( !fs_searchpaths ) {
 		Com_Error( ERR_FATAL, "Filesystem call made without initialization" );
@@ -2143,6 +3475,7 @@ long FS_ReadFileDir(const char *qpath, void *searchPath, qboolean unpure, void *
 		isConfig = qfalse;
 	}
 
+	traceStart = Com_TraceStart();
 	search = searchPath;
 
 	if(search == NULL)
@@ -2190,8 +3523,11 @@ long FS_ReadFileDir(const char *qpath, void *searchPath, qboolean unpure, void *
 
 	// guarantee that it will have a trailing 0 for string operations
 	buf[len] = 0;
+	pakName = fsh[h].pakName;
 	FS_FCloseFile( h );
 
+	Com_TraceEvent( traceStart, "read", qpath, len, pakName );
+
 	// if we are journalling and it is a config file, write it to the journal file
 	if ( isConfig && com_journal && com_journal->integer == 1 ) {
 		Com_DPrintf( "Writing %s to journal file.\n", qpath );
@@ -2273,9 +3609,261 @@ void FS_WriteFile( const char *qpath, const void *buffer, int size ) {
 
 ZIP FILE LOADING
 
+With fs_pakCache the parsed central directories of the paks, names,
+positions, crcs and hash chains, are kept in pakcache.dat in the home
+path.  A pak is only parsed again when its size or mtime changed, so a
+startup or FS_Restart opens each pak once instead of walking every
+central directory entry with small reads.
+
 ==========================================================================
 */
 
+#define PAKCACHE_FILE       "pakcache.dat"
+#define PAKCACHE_IDENT      ( ( 'X' << 24 ) + ( 'D' << 16 ) + ( 'K' << 8 ) + 'P' )
+#define PAKCACHE_VERSION    1
+#define MAX_PAKCACHE_PAKS   1024
+
+typedef struct {
+	int ident;
+	int version;
+	int numPaks;                    // then the pak records
+} pakCacheHeader_t;
+
+typedef struct {
+	char filename[MAX_OSPATH];
+	int size;
+	int mtime;
+	int numFiles;                   // then the files
+	int numHeaderLongs;             // then the crcs, without the checksum feed
+	int namesSize;                  // then the names, padded to 4 bytes
+} pakCacheRecord_t;
+
+typedef struct {
+	int pos;
+	int len;
+	int name;                       // offset in the names
+	int hash;
+} pakCacheFile_t;
+
+static cvar_t *fs_pakCache;
+static byte *fs_pakCacheData;       // only loaded during FS_Startup
+static pakCacheRecord_t *fs_pakCacheRecords[MAX_PAKCACHE_PAKS];
+static int fs_pakCacheNumRecords;
+static int fs_pakCacheHits;
+static int fs_pakCacheMisses;
+
+static const char *FS_PakCachePath( void ) {
+	static char path[MAX_OSPATH];
+
+	Com_sprintf( path, sizeof( path ), "%s%c%s", fs_homepath->string, PATH_SEP, PAKCACHE_FILE );
+	return path;
+}
+
+static int FS_PakCacheRecordSize( const pakCacheRecord_t *rec ) {
+	return sizeof( *rec ) + rec->numFiles * sizeof( pakCacheFile_t ) + rec->numHeaderLongs * sizeof( int ) + PAD( rec->namesSize, 4 );
+}
+
+/*
+=================
+FS_PakCacheRecordValid
+
+FS_LoadZipFile copies a record straight into buffers sized by its
+counts, so everything it trusts is checked here.  avail is what is
+left of the file from rec on.
+=================
+*/
+static qboolean FS_PakCacheRecordValid( const pakCacheRecord_t *rec, int avail ) {
+	const pakCacheFile_t    *files;
+	const char              *names;
+	int i;
+
+	// bounded one by one first so the record size can't overflow
+	if ( avail < (int)sizeof( *rec ) || rec->numFiles < 0 || rec->numHeaderLongs < 0 || rec->namesSize < 0
+		 || rec->numFiles > avail / (int)sizeof( pakCacheFile_t ) || rec->numHeaderLongs > rec->numFiles
+		 || rec->namesSize > avail || FS_PakCacheRecordSize( rec ) > avail ) {
+		return qfalse;
+	}
+
+	files = (const pakCacheFile_t *)( rec + 1 );
+	names = (const char *)( (const int *)( files + rec->numFiles ) + rec->numHeaderLongs );
+	if ( rec->numFiles && ( !rec->namesSize || names[rec->namesSize - 1] ) ) {
+		return qfalse;
+	}
+	for ( i = 0; i < rec->numFiles; i++ ) {
+		if ( files[i].name < 0 || files[i].name >= rec->namesSize || files[i].pos < 0 || files[i].len < 0 ) {
+			return qfalse;
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+=================
+FS_LoadPakCache
+
+Reads pakcache.dat and keeps the records that pass validation, a
+truncated or corrupt file just means those paks get parsed again
+=================
+*/
+static void FS_LoadPakCache( void ) {
+	pakCacheHeader_t    *header;
+	pakCacheRecord_t    *rec;
+	FILE                *f;
+	int                 len, ofs, i;
+
+	fs_pakCache = Cvar_Get( "fs_pakCache", "1", CVAR_ARCHIVE );
+	fs_pakCacheNumRecords = 0;
+	fs_pakCacheHits = 0;
+	fs_pakCacheMisses = 0;
+
+	if ( !fs_pakCache->integer || !fs_homepath->string[0] ) {
+		return;
+	}
+
+	f = Sys_FOpen( FS_PakCachePath(), "rb" );
+	if ( !f ) {
+		return;
+	}
+
+	fseek( f, 0, SEEK_END );
+	len = ftell( f );
+	fseek( f, 0, SEEK_SET );
+
+	if ( len < (int)sizeof( *header ) ) {
+		fclose( f );
+		return;
+	}
+
+	fs_pakCacheData = Z_Malloc( len );
+	if ( fread( fs_pakCacheData, 1, len, f ) != len ) {
+		len = 0;
+	}
+	fclose( f );
+
+	header = (pakCacheHeader_t *)fs_pakCacheData;
+	if ( len < (int)sizeof( *header ) || header->ident != PAKCACHE_IDENT || header->version != PAKCACHE_VERSION
+		 || header->numPaks < 0 || header->numPaks > MAX_PAKCACHE_PAKS ) {
+		Com_Printf( "%s is out of date, rebuilding\n", PAKCACHE_FILE );
+		Z_Free( fs_pakCacheData );
+		fs_pakCacheData = NULL;
+		return;
+	}
+
+	ofs = sizeof( *header );
+	for ( i = 0; i < header->numPaks; i++ ) {
+		rec = (pakCacheRecord_t *)( fs_pakCacheData + ofs );
+		if ( !FS_PakCacheRecordValid( rec, len - ofs ) ) {
+			// the records after it can't be found any more
+			Com_Printf( "%s is damaged, rebuilding\n", PAKCACHE_FILE );
+			break;
+		}
+		rec->filename[sizeof( rec->filename ) - 1] = 0;
+		fs_pakCacheRecords[fs_pakCacheNumRecords++] = rec;
+		ofs += FS_PakCacheRecordSize( rec );
+	}
+}
+
+/*
+=================
+FS_FindPakCache
+=================
+*/
+static pakCacheRecord_t *FS_FindPakCache( const char *zipfile, int size, int mtime, int numFiles ) {
+	pakCacheRecord_t    *rec;
+	int                 i;
+
+	for ( i = 0; i < fs_pakCacheNumRecords; i++ ) {
+		rec = fs_pakCacheRecords[i];
+		if ( rec->size == size && rec->mtime == mtime && rec->numFiles == numFiles && !strcmp( rec->filename, zipfile ) ) {
+			return rec;
+		}
+	}
+
+	return NULL;
+}
+
+/*
+=================
+FS_WritePakCache
+
+Writes the directories of all loaded paks when any of them was parsed
+or a cached one is gone, and drops the loaded cache
+=================
+*/
+static void FS_WritePakCache( void ) {
+	pakCacheHeader_t    header;
+	pakCacheRecord_t    rec;
+	pakCacheFile_t      file;
+	searchpath_t        *search;
+	pack_t              *pak;
+	FILE                *f;
+	char                *names;
+	int                 i, j, pad;
+
+	if ( fs_pakCacheData ) {
+		Z_Free( fs_pakCacheData );
+		fs_pakCacheData = NULL;
+	}
+
+	if ( !fs_pakCache->integer || !fs_homepath->string[0] ) {
+		return;
+	}
+	if ( !fs_pakCacheMisses && fs_pakCacheHits == fs_pakCacheNumRecords ) {
+		return;
+	}
+
+	f = Sys_FOpen( FS_PakCachePath(), "wb" );
+	if ( !f ) {
+		Com_Printf( "Couldn't write %s\n", PAKCACHE_FILE );
+		return;
+	}
+
+	header.ident = PAKCACHE_IDENT;
+	header.version = PAKCACHE_VERSION;
+	header.numPaks = 0;
+	for ( search = fs_searchpaths ; search ; search = search->next ) {
+		if ( search->pack && search->pack->pakSize && header.numPaks < MAX_PAKCACHE_PAKS ) {
+			header.numPaks++;
+		}
+	}
+	fwrite( &header, sizeof( header ), 1, f );
+
+	pad = 0;
+	i = 0;
+	for ( search = fs_searchpaths ; search && i < header.numPaks ; search = search->next ) {
+		pak = search->pack;
+		if ( !pak || !pak->pakSize ) {
+			continue;
+		}
+		i++;
+
+		Com_Memset( &rec, 0, sizeof( rec ) );
+		Q_strncpyz( rec.filename, pak->pakFilename, sizeof( rec.filename ) );
+		rec.size = pak->pakSize;
+		rec.mtime = pak->pakMtime;
+		rec.numFiles = pak->numfiles;
+		rec.numHeaderLongs = pak->numHeaderLongs - 1;
+		names = (char *)( pak->buildBuffer + pak->numfiles );
+		rec.namesSize = pak->numfiles ? pak->buildBuffer[pak->numfiles - 1].name + strlen( pak->buildBuffer[pak->numfiles - 1].name ) + 1 - names : 0;
+		fwrite( &rec, sizeof( rec ), 1, f );
+
+		for ( j = 0; j < pak->numfiles; j++ ) {
+			file.pos = pak->buildBuffer[j].pos;
+			file.len = pak->buildBuffer[j].len;
+			file.name = pak->buildBuffer[j].name - names;
+			file.hash = FS_HashFileName( pak->buildBuffer[j].name, pak->hashSize );
+			fwrite( &file, sizeof( file ), 1, f );
+		}
+
+		fwrite( pak->headerLongs + 1, sizeof( int ), rec.numHeaderLongs, f );
+		fwrite( names, 1, rec.namesSize, f );
+		fwrite( &pad, 1, PAD( rec.namesSize, 4 ) - rec.namesSize, f );
+	}
+
+	fclose( f );
+}
+
 /*
 =================
 FS_LoadZipFile
@@ -2298,6 +3886,9 @@ static pack_t *FS_LoadZipFile(const char *zipfile, const char *basename)
 	int fs_numHeaderLongs;
 	int             *fs_headerLongs;
 	char            *namePtr;
+	int pakSize, pakMtime;
+	pakCacheRecord_t *rec;
+	pakCacheFile_t  *cacheFiles;
 
 	fs_numHeaderLongs = 0;
 
@@ -2310,16 +3901,29 @@ static pack_t *FS_LoadZipFile(const char *zipfile, const char *basename)
 
 	fs_packFiles += gi.number_entry;
 
+	rec = NULL;
+	if ( !Sys_FileStat( zipfile, &pakSize, &pakMtime ) ) {
+		pakSize = pakMtime = 0;
+	} else if ( fs_pakCacheData ) {
+		rec = FS_FindPakCache( zipfile, pakSize, pakMtime, gi.number_entry );
+	}
+
 	len = 0;
-	unzGoToFirstFile( uf );
-	for ( i = 0; i < gi.number_entry; i++ )
-	{
-		err = unzGetCurrentFileInfo( uf, &file_info, filename_inzip, sizeof( filename_inzip ), NULL, 0, NULL, 0 );
-		if ( err != UNZ_OK ) {
-			break;
+	if ( rec ) {
+		len = rec->namesSize;
+		fs_pakCacheHits++;
+	} else {
+		unzGoToFirstFile( uf );
+		for ( i = 0; i < gi.number_entry; i++ )
+		{
+			err = unzGetCurrentFileInfo( uf, &file_info, filename_inzip, sizeof( filename_inzip ), NULL, 0, NULL, 0 );
+			if ( err != UNZ_OK ) {
+				break;
+			}
+			len += strlen( filename_inzip ) + 1;
+			unzGoToNextFile( uf );
 		}
-		len += strlen( filename_inzip ) + 1;
-		unzGoToNextFile( uf );
+		fs_pakCacheMisses++;
 	}
 
 	buildBuffer = Z_Malloc( ( gi.number_entry * sizeof( fileInPack_t ) ) + len );
@@ -2352,28 +3956,54 @@ static pack_t *FS_LoadZipFile(const char *zipfile, const char *basename)
 
 	pack->handle = uf;
 	pack->numfiles = gi.number_entry;
-	unzGoToFirstFile( uf );
+	pack->pakSize = pakSize;
+	pack->pakMtime = pakMtime;
 
-	for ( i = 0; i < gi.number_entry; i++ )
-	{
-		err = unzGetCurrentFileInfo( uf, &file_info, filename_inzip, sizeof( filename_inzip ), NULL, 0, NULL, 0 );
-		if ( err != UNZ_OK ) {
-			break;
+	if ( rec ) {
+		// everything but the checksum feed comes from the cache
+		cacheFiles = (pakCacheFile_t *)( rec + 1 );
+		Com_Memcpy( fs_headerLongs + 1, cacheFiles + rec->numFiles, rec->numHeaderLongs * sizeof( int ) );
+		fs_numHeaderLongs += rec->numHeaderLongs;
+		Com_Memcpy( namePtr, (int *)( cacheFiles + rec->numFiles ) + rec->numHeaderLongs, len );
+
+		for ( i = 0; i < gi.number_entry; i++ )
+		{
+			hash = cacheFiles[i].hash & ( pack->hashSize - 1 );
+			buildBuffer[i].name = namePtr + cacheFiles[i].name;
+			buildBuffer[i].pos = cacheFiles[i].pos;
+			buildBuffer[i].len = cacheFiles[i].len;
+			buildBuffer[i].next = pack->hashTable[hash];
+			pack->hashTable[hash] = &buildBuffer[i];
+		}
+	} else {
+		unzGoToFirstFile( uf );
+
+		for ( i = 0; i < gi.number_entry; i++ )
+		{
+			err = unzGetCurrentFileInfo( uf, &file_info, filename_inzip, sizeof( filename_inzip ), NULL, 0, NULL, 0 );
+			if ( err != UNZ_OK ) {
+				break;
+			}
+			if ( file_info.uncompressed_size > 0 ) {
+				fs_headerLongs[fs_numHeaderLongs++] = LittleLong( file_info.crc );
+			}
+			Q_strlwr( filename_inzip );
+			hash = FS_HashFileName( filename_inzip, pack->hashSize );
+			buildBuffer[i].name = namePtr;
+			strcpy( buildBuffer[i].name, filename_inzip );
+			namePtr += strlen( filename_inzip ) + 1;
+			// store the file position in the zip
+			buildBuffer[i].pos = unzGetOffset(uf);
+			buildBuffer[i].len = file_info.uncompressed_size;
+			buildBuffer[i].next = pack->hashTable[hash];
+			pack->hashTable[hash] = &buildBuffer[i];
+			unzGoToNextFile( uf );
 		}
-		if ( file_info.uncompressed_size > 0 ) {
-			fs_headerLongs[fs_numHeaderLongs++] = LittleLong( file_info.crc );
+
+		// a pak that couldn't be read to the end is not worth caching
+		if ( i < gi.number_entry ) {
+			pack->pakSize = 0;
 		}
-		Q_strlwr( filename_inzip );
-		hash = FS_HashFileName( filename_inzip, pack->hashSize );
-		buildBuffer[i].name = namePtr;
-		strcpy( buildBuffer[i].name, filename_inzip );
-		namePtr += strlen( filename_inzip ) + 1;
-		// store the file position in the zip
-		buildBuffer[i].pos = unzGetOffset(uf);
-		buildBuffer[i].len = file_info.uncompressed_size;
-		buildBuffer[i].next = pack->hashTable[hash];
-		pack->hashTable[hash] = &buildBuffer[i];
-		unzGoToNextFile( uf );
 	}
 
 	pack->checksum = Com_BlockChecksum( &fs_headerLongs[ 1 ], sizeof(*fs_headerLongs) * ( fs_numHeaderLongs - 1 ) );
@@ -2381,7 +4011,9 @@ static pack_t *FS_LoadZipFile(const char *zipfile, const char *basename)
 	pack->checksum = LittleLong( pack->checksum );
 	pack->pure_checksum = LittleLong( pack->pure_checksum );
 
-	Z_Free( fs_headerLongs );
+	// the crcs are kept for the cache
+	pack->headerLongs = fs_headerLongs;
+	pack->numHeaderLongs = fs_numHeaderLongs;
 
 	pack->buildBuffer = buildBuffer;
 	return pack;
@@ -2398,6 +4030,7 @@ Frees a pak structure and releases all associated resources
 static void FS_FreePak(pack_t *thepak)
 {
 	unzClose(thepak->handle);
+	Z_Free(thepak->headerLongs);
 	Z_Free(thepak->buildBuffer);
 	Z_Free(thepak);
 }
@@ -3091,6 +4724,12 @@ void FS_Path_f( void ) {
 		}
 	}
 
+	if ( fs_indexHash ) {
+		Com_Printf( "\nfile index: %d files, %d lookups, %d hits, %d misses\n",
+			fs_indexNumEntries, fs_indexLookups, fs_indexHits, fs_indexMisses );
+		Com_Printf( "directory probes: %d, %d skipped\n", fs_dirProbes, fs_dirProbesSkipped );
+	}
+
 
 	Com_Printf( "\n" );
 	for ( i = 1 ; i < MAX_FILE_HANDLES ; i++ ) {
@@ -3485,12 +5124,21 @@ void FS_Shutdown( qboolean closemfp ) {
 	searchpath_t    *p, *next;
 	int i;
 
+	// the I/O thread walks the search paths
+	if ( closemfp ) {
+		FS_ShutdownReads();
+	} else {
+		FS_FlushReads();
+	}
+
 	for ( i = 0; i < MAX_FILE_HANDLES; i++ ) {
 		if ( fsh[i].fileSize ) {
 			FS_FCloseFile( i );
 		}
 	}
 
+	FS_FreeFileIndex();
+
 	// free everything
 	for(p = fs_searchpaths; p; p = next)
 	{
@@ -3545,6 +5193,9 @@ static void FS_ReorderPurePaks( void )
 	if ( !fs_numServerPaks )
 		return;
 
+	// the I/O thread walks the search paths
+	FS_FlushReads();
+
 	p_insert_index = &fs_searchpaths; // we insert in order at the beginning of the list
 	for ( i = 0 ; i < fs_numServerPaks ; i++ ) {
 		p_previous = p_insert_index; // track the pointer-to-current-item
@@ -3563,6 +5214,10 @@ static void FS_ReorderPurePaks( void )
 			p_previous = &s->next;
 		}
 	}
+
+	if ( fs_reordered ) {
+		FS_BuildFileIndex();
+	}
 }
 
 /*
@@ -3609,6 +5264,8 @@ static void FS_Startup( const char *gameName )
 		Com_Error( ERR_DROP, "Invalid fs_game '%s'", fs_gamedirvar->string );
 	}
 
+	FS_LoadPakCache();
+
 	// add search path elements in reverse priority order
 #ifndef STANDALONE
 	fs_gogpath = Cvar_Get ("fs_gogpath", Sys_GogPath(), CVAR_INIT|CVAR_PROTECTED );
@@ -3688,6 +5345,9 @@ static void FS_Startup( const char *gameName )
 	}
 #endif
 
+	FS_WritePakCache();
+	FS_BuildFileIndex();
+
 	// add our commands
 	Cmd_AddCommand( "path", FS_Path_f );
 	Cmd_AddCommand( "dir", FS_Dir_f );
@@ -3708,6 +5368,9 @@ static void FS_Startup( const char *gameName )
 	}
 #endif
 	Com_Printf( "%d files in pk3 files\n", fs_packFiles );
+	if ( fs_pakCacheHits ) {
+		Com_Printf( "%d of %d pk3 directories from %s\n", fs_pakCacheHits, fs_pakCacheHits + fs_pakCacheMisses, PAKCACHE_FILE );
+	}
 }
 
 #ifndef STANDALONE
@@ -4191,6 +5854,11 @@ exception of .cfg and .dat files.
 void FS_PureServerSetLoadedPaks( const char *pakSums, const char *pakNames ) {
 	int i, c, d;
 
+	// queued reads looked at the old pure list
+	if ( pakSums[0] || fs_numServerPaks ) {
+		FS_FlushReads();
+	}
+
 	Cmd_TokenizeString( pakSums );
 
 	c = Cmd_Argc();
@@ -4298,6 +5966,8 @@ void FS_InitFilesystem( void ) {
 	if(!FS_FilenameCompare(Cvar_VariableString("fs_game"), com_basegame->string))
 		Cvar_Set("fs_game", "");
 
+	FS_InitReads();
+
 	// try to start up normally
 	FS_Startup(com_basegame->string);
 
@@ -4469,7 +6139,9 @@ int     FS_FOpenFileByMode( const char *qpath, fileHandle_t *f, fsMode_t mode )
 
 int     FS_FTell( fileHandle_t f ) {
 	int pos;
-	if ( fsh[f].zipFile == qtrue ) {
+	if ( fsh[f].memFile ) {
+		pos = fsh[f].memPos;
+	} else if ( fsh[f].zipFile == qtrue ) {
 		pos = unztell( fsh[f].handleFiles.file.z );
 	} else {
 		pos = ftell( fsh[f].handleFiles.file.o );
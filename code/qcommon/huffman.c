@@ -36,14 +36,16 @@ If you have questions concerning this license or the applicable additional terms
 
 static int bloc = 0;
 
+// writes only go through the offset and not bloc,
+// so snapshots can be written on several threads
 void Huff_putBit( int bit, byte *fout, int *offset ) {
-	bloc = *offset;
-	if ( ( bloc & 7 ) == 0 ) {
-		fout[( bloc >> 3 )] = 0;
+	int b = *offset;
+
+	if ( ( b & 7 ) == 0 ) {
+		fout[( b >> 3 )] = 0;
 	}
-	fout[( bloc >> 3 )] |= bit << ( bloc & 7 );
-	bloc++;
-	*offset = bloc;
+	fout[( b >> 3 )] |= bit << ( b & 7 );
+	*offset = b + 1;
 }
 
 int Huff_getBloc( void ) {
@@ -308,19 +310,19 @@ void Huff_offsetReceive( node_t *node, int *ch, byte *fin, int *offset, int maxo
 }
 
 /* Send the prefix code for this node */
-static void send( node_t *node, node_t *child, byte *fout, int maxoffset ) {
+static void send( node_t *node, node_t *child, byte *fout, int *offset, int maxoffset ) {
 	if ( node->parent ) {
-		send( node->parent, node, fout, maxoffset );
+		send( node->parent, node, fout, offset, maxoffset );
 	}
 	if ( child ) {
-		if ( bloc >= maxoffset ) {
-			bloc = maxoffset + 1;
+		if ( *offset >= maxoffset ) {
+			*offset = maxoffset + 1;
 			return;
 		}
 		if ( node->right == child ) {
-			add_bit( 1, fout );
+			Huff_putBit( 1, fout, offset );
 		} else {
-			add_bit( 0, fout );
+			Huff_putBit( 0, fout, offset );
 		}
 	}
 }
@@ -335,14 +337,97 @@ void Huff_transmit( huff_t *huff, int ch, byte *fout, int maxoffset ) {
 			add_bit( (char)( ( ch >> i ) & 0x1 ), fout );
 		}
 	} else {
-		send( huff->loc[ch], NULL, fout, maxoffset );
+		send( huff->loc[ch], NULL, fout, &bloc, maxoffset );
 	}
 }
 
 void Huff_offsetTransmit( huff_t *huff, int ch, byte *fout, int *offset, int maxoffset ) {
-	bloc = *offset;
-	send( huff->loc[ch], NULL, fout, maxoffset );
-	*offset = bloc;
+	send( huff->loc[ch], NULL, fout, offset, maxoffset );
+}
+
+/* Collect the codes below this node into the table */
+static void Huff_TableCodes( huffTable_t *table, node_t *node, unsigned int code, int length ) {
+	int i;
+
+	if ( !node ) {
+		return;
+	}
+	if ( node->symbol == INTERNAL_NODE ) {
+		if ( length < 32 ) {
+			Huff_TableCodes( table, node->left, code, length + 1 );
+			Huff_TableCodes( table, node->right, code | ( 1u << length ), length + 1 );
+		}
+		return;
+	}
+	if ( node->symbol < HMAX ) {
+		table->code[node->symbol] = code;
+		table->length[node->symbol] = length;
+	}
+	if ( length && length <= HUFF_LOOKUP_BITS ) {
+		// every index that starts with this code decodes to it
+		for ( i = code; i < ( 1 << HUFF_LOOKUP_BITS ); i += ( 1 << length ) ) {
+			table->lookup[i] = node->symbol | ( length << 9 );
+		}
+	}
+}
+
+/* The tree must not get any more references after this */
+void Huff_BuildTable( huff_t *huff, huffTable_t *table ) {
+	Com_Memset( table, 0, sizeof( *table ) );
+	table->huff = huff;
+	Huff_TableCodes( table, huff->tree, 0, 0 );
+}
+
+/* Same as Huff_offsetReceive, one lookup for codes up to HUFF_LOOKUP_BITS */
+void Huff_tableReceive( const huffTable_t *table, int *ch, byte *fin, int *offset, int maxoffset ) {
+	int b = *offset;
+	int entry;
+	unsigned int bits;
+	const byte *p;
+
+	// don't look past the end of the message, the tree walk handles the tail
+	if ( b + HUFF_LOOKUP_BITS <= maxoffset ) {
+		p = &fin[b >> 3];
+		bits = p[0] | ( p[1] << 8 );
+		if ( ( b & 7 ) + HUFF_LOOKUP_BITS > 16 ) {
+			bits |= p[2] << 16;
+		}
+		entry = table->lookup[( bits >> ( b & 7 ) ) & ( ( 1 << HUFF_LOOKUP_BITS ) - 1 )];
+		if ( entry ) {
+			*ch = entry & 511;
+			*offset = b + ( entry >> 9 );
+			return;
+		}
+	}
+	Huff_offsetReceive( table->huff->tree, ch, fin, offset, maxoffset );
+}
+
+/* Same as Huff_offsetTransmit, the code goes out a byte at a time */
+void Huff_tableTransmit( const huffTable_t *table, int ch, byte *fout, int *offset, int maxoffset ) {
+	int b = *offset;
+	int end = b + table->length[ch];
+	unsigned long long bits;
+	byte *p;
+
+	// codes that run over the end keep the bit by bit overflow handling
+	if ( end == b || end > maxoffset ) {
+		Huff_offsetTransmit( table->huff, ch, fout, offset, maxoffset );
+		return;
+	}
+
+	bits = (unsigned long long)table->code[ch] << ( b & 7 );
+	p = &fout[b >> 3];
+	if ( b & 7 ) {
+		*p++ |= (byte)bits;
+	} else {
+		*p++ = (byte)bits;
+	}
+	// the following bytes are started fresh, like Huff_putBit does
+	for ( b = ( b | 7 ) + 1; b < end; b += 8 ) {
+		bits >>= 8;
+		*p++ = (byte)bits;
+	}
+	*offset = end;
 }
 
 void Huff_Decompress( msg_t *mbuf, int offset ) {
@@ -0,0 +1,285 @@
+/*
+===========================================================================
+
+Return to Castle Wolfenstein single player GPL Source Code
+Copyright (C) 1999-2010 id Software LLC, a ZeniMax Media company. 
+
+This file is part of the Return to Castle Wolfenstein single player GPL Source Code (RTCW SP Source Code).  
+
+RTCW SP Source Code is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RTCW SP Source Code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RTCW SP Source Code.  If not, see <http://www.gnu.org/licenses/>.
+
+In addition, the RTCW SP Source Code is also subject to certain additional terms. You should have received a copy of these additional terms immediately following the terms and conditions of the GNU General Public License which accompanied the RTCW SP Source Code.  If not, please request a copy in writing from id Software at the address below.
+
+If you have questions concerning this license or the applicable additional terms, you may contact in writing id Software LLC, c/o ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
+
+===========================================================================
+*/
+
+// jobs.c -- small work stealing job system
+//
+// Jobs are queued from the main thread and run by a pool of worker threads.
+// Every thread owns a queue it pops from the back, and steals from the front
+// of the other queues once its own runs dry.  The caller of Com_WaitJobs
+// joins in as thread 0, so everything still works with no workers at all.
+
+#include "../qcommon/q_shared.h"
+#include "qcommon.h"
+
+#ifdef __vita__
+#include <vitasdk.h>
+#endif
+
+#define MAX_QUEUED_JOBS     256     // per thread, must be a power of two
+
+typedef struct {
+	jobFunc_t func;
+	void        *data;
+} job_t;
+
+typedef struct {
+	job_t jobs[MAX_QUEUED_JOBS];
+	int head;                       // next job to steal
+	int tail;                       // next free slot, owner pops from here
+#ifdef __vita__
+	SceKernelLwMutexWork lock;
+#endif
+
+	int c_executed;
+	int c_stolen;
+} jobQueue_t;
+
+static jobQueue_t jobQueues[MAX_JOB_THREADS];
+static int jobNumThreads = 1;
+static int jobNextQueue;
+static volatile int jobsPending;
+
+static cvar_t *com_jobThreads;
+
+#ifdef __vita__
+static SceUID jobWakeSema;
+
+#define Job_Lock( q )   sceKernelLockLwMutex( &( q )->lock, 1, NULL )
+#define Job_Unlock( q ) sceKernelUnlockLwMutex( &( q )->lock, 1 )
+#else
+#define Job_Lock( q )
+#define Job_Unlock( q )
+#endif
+
+/*
+=================
+Job_Pop
+
+Takes the most recently queued job of our own queue
+=================
+*/
+static qboolean Job_Pop( jobQueue_t *q, job_t *job ) {
+	qboolean found = qfalse;
+
+	Job_Lock( q );
+	if ( q->tail != q->head ) {
+		q->tail--;
+		*job = q->jobs[q->tail & ( MAX_QUEUED_JOBS - 1 )];
+		found = qtrue;
+	}
+	Job_Unlock( q );
+
+	return found;
+}
+
+/*
+=================
+Job_Steal
+
+Takes the oldest job of another thread's queue
+=================
+*/
+static qboolean Job_Steal( jobQueue_t *q, job_t *job ) {
+	qboolean found = qfalse;
+
+	Job_Lock( q );
+	if ( q->tail != q->head ) {
+		*job = q->jobs[q->head & ( MAX_QUEUED_JOBS - 1 )];
+		q->head++;
+		found = qtrue;
+	}
+	Job_Unlock( q );
+
+	return found;
+}
+
+/*
+=================
+Job_RunOne
+
+Runs a single job on the given thread, returns qfalse if every queue is empty
+=================
+*/
+static qboolean Job_RunOne( int thread ) {
+	jobQueue_t *q;
+	job_t job;
+	int i;
+
+	q = &jobQueues[thread];
+	if ( !Job_Pop( q, &job ) ) {
+		for ( i = 1; i < jobNumThreads; i++ ) {
+			if ( Job_Steal( &jobQueues[( thread + i ) % jobNumThreads], &job ) ) {
+				break;
+			}
+		}
+		if ( i == jobNumThreads ) {
+			return qfalse;
+		}
+		q->c_stolen++;
+	}
+
+	job.func( job.data, thread );
+	q->c_executed++;
+
+#ifdef __vita__
+	__sync_fetch_and_sub( &jobsPending, 1 );
+#else
+	jobsPending--;
+#endif
+	return qtrue;
+}
+
+#ifdef __vita__
+static int Job_WorkerThread( SceSize args, void *argp ) {
+	int thread = *(int *)argp;
+
+	for ( ;; ) {
+		sceKernelWaitSema( jobWakeSema, 1, NULL );
+		while ( Job_RunOne( thread ) ) {
+		}
+	}
+
+	return sceKernelExitDeleteThread( 0 );
+}
+#endif
+
+/*
+=================
+Com_AddJob
+
+Queues a job, the queues are filled round robin so the
+workers start out with an even share of the batch
+=================
+*/
+void Com_AddJob( jobFunc_t func, void *data ) {
+	jobQueue_t *q;
+
+	q = &jobQueues[jobNextQueue];
+	jobNextQueue = ( jobNextQueue + 1 ) % jobNumThreads;
+
+	Job_Lock( q );
+	if ( q->tail - q->head >= MAX_QUEUED_JOBS ) {
+		// queue is full, just run it right away
+		Job_Unlock( q );
+		func( data, 0 );
+		return;
+	}
+	q->jobs[q->tail & ( MAX_QUEUED_JOBS - 1 )].func = func;
+	q->jobs[q->tail & ( MAX_QUEUED_JOBS - 1 )].data = data;
+	q->tail++;
+#ifdef __vita__
+	__sync_fetch_and_add( &jobsPending, 1 );
+#else
+	jobsPending++;
+#endif
+	Job_Unlock( q );
+
+#ifdef __vita__
+	if ( jobNumThreads > 1 ) {
+		sceKernelSignalSema( jobWakeSema, 1 );
+	}
+#endif
+}
+
+/*
+=================
+Com_WaitJobs
+
+Works on the queued jobs until all of them are finished
+=================
+*/
+void Com_WaitJobs( void ) {
+	while ( jobsPending > 0 ) {
+		if ( !Job_RunOne( 0 ) ) {
+			// the last jobs are still running on the workers
+#ifdef __vita__
+			sceKernelDelayThread( 10 );
+#endif
+		}
+	}
+}
+
+/*
+=================
+Com_JobThreads
+
+Number of threads that can run jobs, including the caller
+=================
+*/
+int Com_JobThreads( void ) {
+	return jobNumThreads;
+}
+
+/*
+=================
+Com_JobInfo_f
+=================
+*/
+static void Com_JobInfo_f( void ) {
+	int i;
+
+	Com_Printf( "%i job threads\n", jobNumThreads );
+	for ( i = 0; i < jobNumThreads; i++ ) {
+		Com_Printf( "%2i: %8i executed %8i stolen\n", i, jobQueues[i].c_executed, jobQueues[i].c_stolen );
+	}
+}
+
+/*
+=================
+Com_InitJobs
+=================
+*/
+void Com_InitJobs( void ) {
+#ifdef __vita__
+	int i;
+#endif
+
+	com_jobThreads = Cvar_Get( "com_jobThreads", "2", CVAR_ARCHIVE | CVAR_LATCH );
+	Cvar_CheckRange( com_jobThreads, 0, MAX_JOB_THREADS - 1, qtrue );
+
+	Com_Memset( jobQueues, 0, sizeof( jobQueues ) );
+	jobNumThreads = 1;
+
+#ifdef __vita__
+	for ( i = 0; i < MAX_JOB_THREADS; i++ ) {
+		sceKernelCreateLwMutex( &jobQueues[i].lock, "job_queue", 0, 0, NULL );
+	}
+
+	jobWakeSema = sceKernelCreateSema( "job_wake", 0, 0, MAX_JOB_THREADS * MAX_QUEUED_JOBS, NULL );
+	for ( i = 1; i <= com_jobThreads->integer; i++ ) {
+		SceUID thid = sceKernelCreateThread( "Job Thread", &Job_WorkerThread, 0x10000100, 0x20000, 0, 0, NULL );
+		if ( thid < 0 ) {
+			break;
+		}
+		sceKernelStartThread( thid, sizeof( i ), &i );
+		jobNumThreads++;
+	}
+#endif
+
+	Cmd_AddCommand( "jobinfo", Com_JobInfo_f );
+}
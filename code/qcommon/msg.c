@@ -30,6 +30,7 @@ If you have questions concerning this license or the applicable additional terms
 #include "qcommon.h"
 
 static huffman_t msgHuff;
+static huffTable_t msgHuffTable;
 static qboolean msgInit = qfalse;
 
 /*
@@ -162,7 +163,7 @@ void MSG_WriteBits( msg_t *msg, int value, int bits ) {
 		}
 		if ( bits ) {
 			for ( i = 0; i < bits; i += 8 ) {
-				Huff_offsetTransmit( &msgHuff.compressor, ( value & 0xff ), msg->data, &msg->bit, msg->maxsize << 3 );
+				Huff_tableTransmit( &msgHuffTable, ( value & 0xff ), msg->data, &msg->bit, msg->maxsize << 3 );
 				value = ( value >> 8 );
 
 				if ( msg->bit > msg->maxsize << 3 ) {
@@ -235,7 +236,7 @@ int MSG_ReadBits( msg_t *msg, int bits ) {
 		if ( bits ) {
 //			fp = fopen("c:\\netchan.bin", "a");
 			for ( i = 0; i < bits; i += 8 ) {
-				Huff_offsetReceive( msgHuff.decompressor.tree, &get, msg->data, &msg->bit, msg->cursize << 3 );
+				Huff_tableReceive( &msgHuffTable, &get, msg->data, &msg->bit, msg->cursize << 3 );
 //				fwrite(&get, 1, 1, fp);
 				value = ( unsigned int )value | ( ( unsigned int )get << ( i + nbits ) );
 
@@ -2189,6 +2190,61 @@ void MSG_initHuffman( void ) {
 			Huff_addRef( &msgHuff.decompressor,  (byte)i );           /* Do update */
 		}
 	}
+	Huff_BuildTable( &msgHuff.decompressor, &msgHuffTable );
+}
+
+/*
+=================
+MSG_HuffmanCheck_f
+
+Feeds random symbols and bits through the table driven and the tree walking
+codec and reports any difference in the output or the offsets
+=================
+*/
+#define HUFF_CHECK_BYTES 64
+
+void MSG_HuffmanCheck_f( void ) {
+	byte tableBuf[HUFF_CHECK_BYTES], treeBuf[HUFF_CHECK_BYTES];
+	int tableOffset, treeOffset, tableCh, treeCh;
+	int i, j, count, maxoffset, ch, errors;
+
+	if ( !msgInit ) {
+		MSG_initHuffman();
+	}
+
+	count = Cmd_Argc() > 1 ? atoi( Cmd_Argv( 1 ) ) : 100000;
+	errors = 0;
+
+	for ( i = 0; i < count; i++ ) {
+		for ( j = 0; j < HUFF_CHECK_BYTES; j++ ) {
+			tableBuf[j] = treeBuf[j] = rand() & 0xff;
+		}
+		// mostly in the middle, sometimes right at the end to hit the overflow handling
+		maxoffset = 1 + rand() % ( HUFF_CHECK_BYTES << 3 );
+		tableOffset = treeOffset = rand() % ( maxoffset + 16 );
+		ch = rand() & 0xff;
+
+		Huff_tableTransmit( &msgHuffTable, ch, tableBuf, &tableOffset, maxoffset );
+		Huff_offsetTransmit( &msgHuff.compressor, ch, treeBuf, &treeOffset, maxoffset );
+		if ( tableOffset != treeOffset || memcmp( tableBuf, treeBuf, sizeof( tableBuf ) ) ) {
+			if ( errors++ < 10 ) {
+				Com_Printf( "transmit %i: offset %i, expected %i\n", ch, tableOffset, treeOffset );
+			}
+			continue;
+		}
+
+		tableOffset = treeOffset = rand() % ( maxoffset + 16 );
+		tableCh = treeCh = -1;
+		Huff_tableReceive( &msgHuffTable, &tableCh, tableBuf, &tableOffset, maxoffset );
+		Huff_offsetReceive( msgHuff.decompressor.tree, &treeCh, treeBuf, &treeOffset, maxoffset );
+		if ( tableOffset != treeOffset || tableCh != treeCh ) {
+			if ( errors++ < 10 ) {
+				Com_Printf( "receive: got %i at %i, expected %i at %i\n", tableCh, tableOffset, treeCh, treeOffset );
+			}
+		}
+	}
+
+	Com_Printf( "%i huffman symbols checked, %i errors\n", count, errors );
 }
 
 /*
@@ -117,6 +117,7 @@ void MSG_ReadDeltaPlayerstate( msg_t *msg, struct playerState_s *from, struct pl
 
 
 void MSG_ReportChangeVectors_f( void );
+void MSG_HuffmanCheck_f( void );
 
 //============================================================================
 
@@ -697,6 +698,9 @@ long		FS_FOpenFileRead( const char *qpath, fileHandle_t *file, qboolean uniqueFI
 int     FS_FileIsInPAK( const char *filename, int *pChecksum );
 // returns 1 if a file is in the PAK file, otherwise -1
 
+int     FS_FilePakChecksum( const char *filename, int *pChecksum );
+// same, but the checksum stays the same across level loads
+
 int     FS_Delete( char *filename );    // only works inside the 'save' directory (for deleting savegames/images)
 
 int     FS_Write( const void *buffer, int len, fileHandle_t f );
@@ -725,6 +729,25 @@ void    FS_FreeFile( void *buffer );
 void    FS_WriteFile( const char *qpath, const void *buffer, int size );
 // writes a complete file, creating any subdirectories needed
 
+typedef void ( *fsReadCallback_t )( const char *qpath, void *buffer, long len, void *data );
+
+int     FS_ReadFileAsync( const char *qpath, fsReadCallback_t callback, void *data );
+// reads the whole file on the I/O thread, the callback gets it on the main
+// thread like FS_ReadFile would return it, the buffer is freed after the
+// callback returns.  Returns a request for FS_ReadDone / FS_WaitRead.
+
+qboolean FS_ReadDone( int request );
+void    FS_WaitRead( int request );
+// runs the callback now, reading the file on this thread if needed
+
+void    FS_RunReadCallbacks( void );
+// called every frame
+
+void    FS_BeginLevelLoad( const char *mapname );
+void    FS_EndLevelLoad( void );
+// prefetches the files the last load of the map read, and records the
+// ones this load reads for the next time
+
 long FS_filelength(fileHandle_t f);
 // doesn't work for files that are opened from a pack file
 
@@ -987,9 +1010,70 @@ void Hunk_FreeTempMemory( void *buf );
 int Hunk_MemoryRemaining( void );
 void Hunk_SmallLog( void );
 void Hunk_Log( void );
+const char *Hunk_SetLabel( const char *label );
+void Hunk_WriteReport( const char *name );
 
 void Com_TouchMemory( void );
 
+/*
+==============================================================
+
+JOBS
+
+==============================================================
+*/
+
+#define MAX_JOB_THREADS     4       // including the thread waiting on the jobs
+
+// thread is the index of the thread running the job, 0 is the caller of Com_WaitJobs
+typedef void ( *jobFunc_t )( void *data, int thread );
+
+void Com_InitJobs( void );
+void Com_AddJob( jobFunc_t func, void *data );
+void Com_WaitJobs( void );
+int Com_JobThreads( void );
+
+/*
+==============================================================
+
+LOAD TRACING
+
+==============================================================
+*/
+
+void Com_InitLoadTrace( void );
+void Com_BeginLoadTrace( const char *name );
+void Com_LoadTraceSummary( const char *label );
+void Com_EndLoadTrace( const char *label );
+
+// returns -1 unless a level load is traced, cat is "open", "read",
+// "decode" or "upload", size and pak can be 0 and NULL
+int Com_TraceStart( void );
+void Com_TraceEvent( int start, const char *cat, const char *name, int size, const char *pak );
+
+/*
+==============================================================
+
+KERNEL BENCHMARKS
+
+==============================================================
+*/
+
+typedef struct benchmark_s {
+	const char  *name;              // printed in front of the timings
+	const char  *unit;              // one element, "vert", "sample"...
+	int units;                      // elements one kernel call processes
+	int msec;                       // how long each kernel is run for
+	void ( *scalar )( struct benchmark_s *b );  // NULL times simd alone
+	void ( *simd )( struct benchmark_s *b );
+	// largest difference between the outputs, called after simd ran last
+	float ( *compare )( struct benchmark_s *b );
+	void        *data;
+} benchmark_t;
+
+qboolean Com_BenchArgs( const char *unit, int defaultCount, int maxCount, int *count, int *msec );
+void Com_Benchmark( benchmark_t *b );
+
 // commandLine should not include the executable name (argv[0])
 void Com_Init( char *commandLine );
 void Com_Frame( void );
@@ -1159,6 +1243,7 @@ qboolean    Sys_IsLANAddress( netadr_t adr );
 void        Sys_ShowIP( void );
 
 FILE	*Sys_FOpen( const char *ospath, const char *mode );
+qboolean Sys_FileStat( const char *path, int *size, int *mtime );
 qboolean Sys_Mkdir( const char *path );
 FILE	*Sys_Mkfifo( const char *ospath );
 char    *Sys_Cwd( void );
@@ -1252,6 +1337,17 @@ typedef struct {
 	huff_t decompressor;
 } huffman_t;
 
+#define HUFF_LOOKUP_BITS 11
+
+// prefix codes of a tree that doesn't change anymore, so a symbol
+// can be sent or received without walking the tree one bit at a time
+typedef struct {
+	huff_t          *huff;
+	unsigned int    code[HMAX];                     // first bit sent in bit 0
+	byte            length[HMAX];                   // 0 if longer than 32 bits
+	unsigned short  lookup[1 << HUFF_LOOKUP_BITS];  // symbol | length << 9, 0 if longer
+} huffTable_t;
+
 void    Huff_Compress( msg_t *buf, int offset );
 void    Huff_Decompress( msg_t *buf, int offset );
 void    Huff_Init( huffman_t *huff );
@@ -1260,6 +1356,9 @@ int     Huff_Receive( node_t *node, int *ch, byte *fin );
 void    Huff_transmit( huff_t *huff, int ch, byte *fout, int maxoffset );
 void    Huff_offsetReceive( node_t *node, int *ch, byte *fin, int *offset, int maxoffset );
 void    Huff_offsetTransmit( huff_t *huff, int ch, byte *fout, int *offset, int maxoffset );
+void    Huff_BuildTable( huff_t *huff, huffTable_t *table );
+void    Huff_tableReceive( const huffTable_t *table, int *ch, byte *fin, int *offset, int maxoffset );
+void    Huff_tableTransmit( const huffTable_t *table, int ch, byte *fout, int *offset, int maxoffset );
 void    Huff_putBit( int bit, byte *fout, int *offset );
 int     Huff_getBit( byte *fout, int *offset );
 
@@ -0,0 +1,479 @@
+/*
+===========================================================================
+
+Return to Castle Wolfenstein single player GPL Source Code
+Copyright (C) 1999-2010 id Software LLC, a ZeniMax Media company.
+
+This file is part of the Return to Castle Wolfenstein single player GPL Source Code (RTCW SP Source Code).
+
+RTCW SP Source Code is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+RTCW SP Source Code is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with RTCW SP Source Code.  If not, see <http://www.gnu.org/licenses/>.
+
+In addition, the RTCW SP Source Code is also subject to certain additional terms. You should have received a copy of these additional terms immediately following the terms and conditions of the GNU General Public License which accompanied the RTCW SP Source Code.  If not, please request a copy in writing from id Software at the address below.
+
+If you have questions concerning this license or the applicable additional terms, you may contact in writing id Software LLC, c/o ZeniMax Media Inc., Suite 120, Rockville, Maryland 20850 USA.
+
+===========================================================================
+*/
+
+// trace.c -- level load tracing
+//
+// With com_loadTrace set every file open and read, decode and texture
+// upload of a level load is recorded with its thread, size and pak.
+// SV_SpawnServer and CL_InitCGame print the slowest assets of their
+// part of the load, and the whole load is written to
+// loadtraces/<mapname>.json in the Chrome trace event format, to be
+// opened with chrome://tracing or Perfetto.
+//
+// Events are timed like this, Com_TraceStart returns -1 when nothing
+// is traced so the untraced cost is one compare:
+//
+//     start = Com_TraceStart();
+//     ...
+//     Com_TraceEvent( start, "decode", name, size, NULL );
+
+#include "../qcommon/q_shared.h"
+#include "qcommon.h"
+
+#ifdef __vita__
+#include <vitasdk.h>
+#endif
+
+#define MAX_TRACE_EVENTS    16384
+
+typedef struct {
+	int ts;                         // usec since the trace started
+	int dur;
+	int self;                       // dur without the events nested in it
+	int tid;
+	int size;
+	const char  *cat;               // one of the string constants passed in
+	char name[MAX_QPATH];
+	char pak[MAX_QPATH];
+} traceEvent_t;
+
+typedef struct {
+	const char  *name;
+	int total;                      // self time of all its events
+	int count;
+	int size;
+	const char  *pak;
+} traceAsset_t;
+
+static traceEvent_t *traceEvents;
+static int traceNumEvents;
+static int traceDropped;
+static int traceMark;               // first event of the next summary
+static int traceMainThread;
+static char traceName[MAX_QPATH];
+static volatile qboolean traceActive;
+
+#ifdef __vita__
+static SceUInt64 traceBase;
+static SceKernelLwMutexWork traceLock;
+
+#define Trace_Lock()    sceKernelLockLwMutex( &traceLock, 1, NULL )
+#define Trace_Unlock()  sceKernelUnlockLwMutex( &traceLock, 1 )
+#else
+static int traceBase;               // msec
+
+#define Trace_Lock()
+#define Trace_Unlock()
+#endif
+
+static cvar_t *com_loadTrace;
+static cvar_t *com_loadTraceTop;
+
+/*
+=================
+Trace_Time
+
+usec since the trace started
+=================
+*/
+static int Trace_Time( void ) {
+#ifdef __vita__
+	return (int)( sceKernelGetProcessTimeWide() - traceBase );
+#else
+	return ( Sys_Milliseconds() - traceBase ) * 1000;
+#endif
+}
+
+/*
+=================
+Trace_ThreadId
+=================
+*/
+static int Trace_ThreadId( void ) {
+#ifdef __vita__
+	return sceKernelGetThreadId();
+#else
+	return 1;
+#endif
+}
+
+/*
+=================
+Com_TraceStart
+=================
+*/
+int Com_TraceStart( void ) {
+	if ( !traceActive ) {
+		return -1;
+	}
+	return Trace_Time();
+}
+
+/*
+=================
+Com_TraceEvent
+
+Records an event that started at start, size and pak are optional.
+Can be called from any thread.
+=================
+*/
+void Com_TraceEvent( int start, const char *cat, const char *name, int size, const char *pak ) {
+	traceEvent_t    *ev;
+	int             now;
+
+	if ( start < 0 || !traceActive ) {
+		return;
+	}
+
+	now = Trace_Time();
+
+	Trace_Lock();
+	if ( !traceActive || start > now ) {
+		// restarted in between
+		Trace_Unlock();
+		return;
+	}
+	if ( traceNumEvents == MAX_TRACE_EVENTS ) {
+		traceDropped++;
+		Trace_Unlock();
+		return;
+	}
+	ev = &traceEvents[traceNumEvents++];
+	ev->ts = start;
+	ev->dur = now - start;
+	ev->self = ev->dur;
+	ev->tid = Trace_ThreadId();
+	ev->size = size;
+	ev->cat = cat;
+	Q_strncpyz( ev->name, name ? name : "", sizeof( ev->name ) );
+	Q_strncpyz( ev->pak, pak ? pak : "", sizeof( ev->pak ) );
+	Trace_Unlock();
+}
+
+/*
+=================
+Trace_WriteString
+
+Writes s as a JSON string
+=================
+*/
+static void Trace_WriteString( fileHandle_t f, const char *s ) {
+	char buffer[MAX_QPATH * 2 + 3];
+	int i;
+
+	i = 0;
+	buffer[i++] = '"';
+	for ( ; *s ; s++ ) {
+		if ( *s == '"' || *s == '\\' ) {
+			buffer[i++] = '\\';
+			buffer[i++] = *s;
+		} else if ( (byte)*s >= ' ' ) {
+			buffer[i++] = *s;
+		}
+	}
+	buffer[i++] = '"';
+	buffer[i] = 0;
+
+	FS_Printf( f, "%s", buffer );
+}
+
+/*
+=================
+Trace_Write
+
+Writes the events in the Chrome trace event format
+=================
+*/
+static void Trace_Write( void ) {
+	char            filename[MAX_QPATH];
+	traceEvent_t    *ev;
+	fileHandle_t    f;
+	int             i;
+
+	Com_sprintf( filename, sizeof( filename ), "loadtraces/%s.json", traceName );
+	f = FS_FOpenFileWrite( filename );
+	if ( !f ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: couldn't write %s\n", filename );
+		return;
+	}
+
+	FS_Printf( f, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n" );
+	FS_Printf( f, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%i,\"args\":{\"name\":\"main\"}}", traceMainThread );
+
+	for ( i = 0, ev = traceEvents ; i < traceNumEvents ; i++, ev++ ) {
+		FS_Printf( f, ",\n{\"name\":" );
+		Trace_WriteString( f, ev->name );
+		FS_Printf( f, ",\"cat\":\"%s\",\"ph\":\"X\",\"ts\":%i,\"dur\":%i,\"pid\":1,\"tid\":%i,\"args\":{\"size\":%i",
+				   ev->cat, ev->ts, ev->dur, ev->tid, ev->size );
+		if ( ev->pak[0] ) {
+			FS_Printf( f, ",\"pak\":" );
+			Trace_WriteString( f, ev->pak );
+		}
+		FS_Printf( f, "}}" );
+	}
+
+	FS_Printf( f, "\n]}\n" );
+	FS_FCloseFile( f );
+
+	Com_Printf( "wrote %i events to %s\n", traceNumEvents, filename );
+}
+
+/*
+=================
+Trace_CompareStart
+
+Orders by thread, then start, with the enclosing events first
+=================
+*/
+static int Trace_CompareStart( const void *a, const void *b ) {
+	const traceEvent_t *ea = *(const traceEvent_t **)a;
+	const traceEvent_t *eb = *(const traceEvent_t **)b;
+
+	if ( ea->tid != eb->tid ) {
+		return ea->tid < eb->tid ? -1 : 1;
+	}
+	if ( ea->ts != eb->ts ) {
+		return ea->ts < eb->ts ? -1 : 1;
+	}
+	return eb->dur - ea->dur;
+}
+
+static int Trace_CompareName( const void *a, const void *b ) {
+	return Q_stricmp( ( *(const traceEvent_t **)a )->name, ( *(const traceEvent_t **)b )->name );
+}
+
+static int Trace_CompareTotal( const void *a, const void *b ) {
+	return ( (const traceAsset_t *)b )->total - ( (const traceAsset_t *)a )->total;
+}
+
+/*
+=================
+Trace_SelfTimes
+
+Takes the time of the events nested in each event off its self time,
+so a world load doesn't count the images it loads and an image decode
+doesn't count its file read
+=================
+*/
+static void Trace_SelfTimes( traceEvent_t **sorted, int count ) {
+	traceEvent_t    *stack[64];
+	traceEvent_t    *ev;
+	int             depth, i;
+
+	qsort( sorted, count, sizeof( *sorted ), Trace_CompareStart );
+
+	depth = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		ev = sorted[i];
+		while ( depth && ( stack[depth - 1]->tid != ev->tid || stack[depth - 1]->ts + stack[depth - 1]->dur < ev->ts + ev->dur ) ) {
+			depth--;
+		}
+		if ( depth ) {
+			stack[depth - 1]->self -= ev->dur;
+		}
+		if ( depth < ARRAY_LEN( stack ) ) {
+			stack[depth++] = ev;
+		}
+	}
+}
+
+/*
+=================
+Trace_Summary
+
+Prints the categories and the assets that took the longest since the
+last summary
+=================
+*/
+static void Trace_Summary( const char *label ) {
+	static const char   *cats[] = { "open", "read", "decode", "upload" };
+	traceEvent_t        **sorted;
+	traceAsset_t        *assets;
+	int                 count, numAssets, top;
+	int                 i, j, time, events, size;
+
+	count = traceNumEvents - traceMark;
+	if ( count <= 0 ) {
+		return;
+	}
+
+	sorted = Z_Malloc( count * sizeof( *sorted ) + count * sizeof( *assets ) );
+	assets = (traceAsset_t *)( sorted + count );
+	for ( i = 0 ; i < count ; i++ ) {
+		sorted[i] = &traceEvents[traceMark + i];
+	}
+
+	Trace_SelfTimes( sorted, count );
+
+	Com_Printf( "----- %s load trace -----\n", label );
+	for ( i = 0 ; i < ARRAY_LEN( cats ) ; i++ ) {
+		time = events = size = 0;
+		for ( j = 0 ; j < count ; j++ ) {
+			if ( !strcmp( sorted[j]->cat, cats[i] ) ) {
+				time += sorted[j]->self;
+				size += sorted[j]->size;
+				events++;
+			}
+		}
+		Com_Printf( "%-7s %5i events %7i msec %8i KB\n", cats[i], events, time / 1000, size / 1024 );
+	}
+
+	// sum up the self times per asset
+	qsort( sorted, count, sizeof( *sorted ), Trace_CompareName );
+	numAssets = 0;
+	for ( i = 0 ; i < count ; i++ ) {
+		if ( !numAssets || Q_stricmp( assets[numAssets - 1].name, sorted[i]->name ) ) {
+			assets[numAssets].name = sorted[i]->name;
+			assets[numAssets].total = 0;
+			assets[numAssets].count = 0;
+			assets[numAssets].size = 0;
+			assets[numAssets].pak = "";
+			numAssets++;
+		}
+		assets[numAssets - 1].total += sorted[i]->self;
+		assets[numAssets - 1].count++;
+		if ( !strcmp( sorted[i]->cat, "read" ) ) {
+			assets[numAssets - 1].size = sorted[i]->size;
+		}
+		if ( sorted[i]->pak[0] ) {
+			assets[numAssets - 1].pak = sorted[i]->pak;
+		}
+	}
+	qsort( assets, numAssets, sizeof( *assets ), Trace_CompareTotal );
+
+	top = com_loadTraceTop->integer;
+	if ( top > numAssets ) {
+		top = numAssets;
+	}
+	Com_Printf( "%i slowest of %i assets:\n", top, numAssets );
+	for ( i = 0 ; i < top ; i++ ) {
+		Com_Printf( "%6.1f msec %2i events %7i KB %s %s\n", assets[i].total / 1000.0f, assets[i].count,
+					assets[i].size / 1024, assets[i].name, assets[i].pak );
+	}
+	if ( traceDropped ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: %i events didn't fit, MAX_TRACE_EVENTS is %i\n", traceDropped, MAX_TRACE_EVENTS );
+	}
+
+	Z_Free( sorted );
+
+	traceMark = traceNumEvents;
+}
+
+/*
+=================
+Com_BeginLoadTrace
+
+Starts tracing a level load if com_loadTrace is set, keeps going if
+the load of name is already traced
+=================
+*/
+void Com_BeginLoadTrace( const char *name ) {
+	if ( traceActive && !Q_stricmp( traceName, name ) ) {
+		return;
+	}
+
+	Com_EndLoadTrace( NULL );
+
+	if ( !com_loadTrace->integer ) {
+		return;
+	}
+
+	traceEvents = malloc( MAX_TRACE_EVENTS * sizeof( *traceEvents ) );
+	if ( !traceEvents ) {
+		Com_Printf( S_COLOR_YELLOW "WARNING: no memory for the load trace\n" );
+		return;
+	}
+
+	Q_strncpyz( traceName, name, sizeof( traceName ) );
+	traceNumEvents = 0;
+	traceDropped = 0;
+	traceMark = 0;
+	traceMainThread = Trace_ThreadId();
+#ifdef __vita__
+	traceBase = sceKernelGetProcessTimeWide();
+#else
+	traceBase = Sys_Milliseconds();
+#endif
+	traceActive = qtrue;
+}
+
+/*
+=================
+Com_LoadTraceSummary
+
+Prints the slowest assets since the last summary
+=================
+*/
+void Com_LoadTraceSummary( const char *label ) {
+	if ( !traceActive ) {
+		return;
+	}
+
+	Trace_Lock();
+	Trace_Summary( label );
+	Trace_Unlock();
+}
+
+/*
+=================
+Com_EndLoadTrace
+
+Prints the summary of the rest of the load and writes the trace
+=================
+*/
+void Com_EndLoadTrace( const char *label ) {
+	if ( !traceActive ) {
+		return;
+	}
+
+	Trace_Lock();
+	traceActive = qfalse;
+	Trace_Unlock();
+
+	if ( label ) {
+		Trace_Summary( label );
+	}
+	Trace_Write();
+
+	free( traceEvents );
+	traceEvents = NULL;
+}
+
+/*
+=================
+Com_InitLoadTrace
+=================
+*/
+void Com_InitLoadTrace( void ) {
+	com_loadTrace = Cvar_Get( "com_loadTrace", "0", 0 );
+	com_loadTraceTop = Cvar_Get( "com_loadTraceTop", "10", CVAR_ARCHIVE );
+
+#ifdef __vita__
+	sceKernelCreateLwMutex( &traceLock, "load_trace", 0, 0, NULL );
+#endif
+}
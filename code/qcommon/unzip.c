@@ -62,6 +62,12 @@ woven in by Terry Thorsen 1/2003.
 #define UNZ_BUFSIZE (16384)
 #endif
 
+/* compressed data is read in blocks of up to this size, so a whole file
+   is inflated in a few calls instead of one per UNZ_BUFSIZE */
+#ifndef UNZ_BLOCKSIZE
+#define UNZ_BLOCKSIZE (0x20000)
+#endif
+
 #ifndef UNZ_MAXFILENAMEINZIP
 #define UNZ_MAXFILENAMEINZIP (256)
 #endif
@@ -94,6 +100,7 @@ typedef struct unz_file_info_internal_s
 typedef struct
 {
     char  *read_buffer;         /* internal buffer for compressed data */
+    uInt  read_buffer_size;     /* UNZ_BUFSIZE up to UNZ_BLOCKSIZE */
     z_stream stream;            /* zLib stream structure for inflate */
 
     uLong pos_in_zipfile;       /* position in byte on the zipfile, for fseek*/
@@ -1094,7 +1101,18 @@ extern int ZEXPORT unzOpenCurrentFile3 (file, method, level, raw, password)
     if (pfile_in_zip_read_info==NULL)
         return UNZ_INTERNALERROR;
 
-    pfile_in_zip_read_info->read_buffer=(char*)ALLOC(UNZ_BUFSIZE);
+    /* stored files are read straight into the caller's buffer when it is
+       large, deflated ones get a buffer big enough for most files */
+    pfile_in_zip_read_info->read_buffer_size = UNZ_BUFSIZE;
+    if ((s->cur_file_info.compression_method!=0) &&
+        (s->cur_file_info.compressed_size>UNZ_BUFSIZE))
+    {
+        pfile_in_zip_read_info->read_buffer_size = UNZ_BLOCKSIZE;
+        if (s->cur_file_info.compressed_size<UNZ_BLOCKSIZE)
+            pfile_in_zip_read_info->read_buffer_size =
+                (uInt)s->cur_file_info.compressed_size;
+    }
+    pfile_in_zip_read_info->read_buffer=(char*)ALLOC(pfile_in_zip_read_info->read_buffer_size);
     pfile_in_zip_read_info->offset_local_extrafield = offset_local_extrafield;
     pfile_in_zip_read_info->size_local_extrafield = size_local_extrafield;
     pfile_in_zip_read_info->pos_local_extrafield=0;
@@ -1273,10 +1291,45 @@ extern int ZEXPORT unzReadCurrentFile  (file, buf, len)
 
     while (pfile_in_zip_read_info->stream.avail_out>0)
     {
+        if ((pfile_in_zip_read_info->stream.avail_in==0) &&
+            (pfile_in_zip_read_info->rest_read_compressed>0) &&
+            (pfile_in_zip_read_info->compression_method==0) &&
+            (!(pfile_in_zip_read_info->raw)) &&
+            (pfile_in_zip_read_info->stream.avail_out>=UNZ_BUFSIZE))
+        {
+            /* large reads of stored files skip the internal buffer */
+            uInt uReadThis = pfile_in_zip_read_info->stream.avail_out;
+            if (pfile_in_zip_read_info->rest_read_compressed<uReadThis)
+                uReadThis = (uInt)pfile_in_zip_read_info->rest_read_compressed;
+            if (ZSEEK(pfile_in_zip_read_info->z_filefunc,
+                      pfile_in_zip_read_info->filestream,
+                      pfile_in_zip_read_info->pos_in_zipfile +
+                         pfile_in_zip_read_info->byte_before_the_zipfile,
+                         ZLIB_FILEFUNC_SEEK_SET)!=0)
+                return UNZ_ERRNO;
+            if (ZREAD(pfile_in_zip_read_info->z_filefunc,
+                      pfile_in_zip_read_info->filestream,
+                      pfile_in_zip_read_info->stream.next_out,
+                      uReadThis)!=uReadThis)
+                return UNZ_ERRNO;
+
+            pfile_in_zip_read_info->crc32 = crc32(pfile_in_zip_read_info->crc32,
+                                pfile_in_zip_read_info->stream.next_out,
+                                uReadThis);
+            pfile_in_zip_read_info->pos_in_zipfile += uReadThis;
+            pfile_in_zip_read_info->rest_read_compressed-=uReadThis;
+            pfile_in_zip_read_info->rest_read_uncompressed-=uReadThis;
+            pfile_in_zip_read_info->stream.avail_out -= uReadThis;
+            pfile_in_zip_read_info->stream.next_out += uReadThis;
+            pfile_in_zip_read_info->stream.total_out += uReadThis;
+            iRead += uReadThis;
+            continue;
+        }
+
         if ((pfile_in_zip_read_info->stream.avail_in==0) &&
             (pfile_in_zip_read_info->rest_read_compressed>0))
         {
-            uInt uReadThis = UNZ_BUFSIZE;
+            uInt uReadThis = pfile_in_zip_read_info->read_buffer_size;
             if (pfile_in_zip_read_info->rest_read_compressed<uReadThis)
                 uReadThis = (uInt)pfile_in_zip_read_info->rest_read_compressed;
             if (uReadThis == 0)
@@ -1317,7 +1370,7 @@ extern int ZEXPORT unzReadCurrentFile  (file, buf, len)
 
         if ((pfile_in_zip_read_info->compression_method==0) || (pfile_in_zip_read_info->raw))
         {
-            uInt uDoCopy,i ;
+            uInt uDoCopy;
 
             if ((pfile_in_zip_read_info->stream.avail_in == 0) &&
                 (pfile_in_zip_read_info->rest_read_compressed == 0))
@@ -1329,9 +1382,8 @@ extern int ZEXPORT unzReadCurrentFile  (file, buf, len)
             else
                 uDoCopy = pfile_in_zip_read_info->stream.avail_in ;
 
-            for (i=0;i<uDoCopy;i++)
-                *(pfile_in_zip_read_info->stream.next_out+i) =
-                        *(pfile_in_zip_read_info->stream.next_in+i);
+            memcpy(pfile_in_zip_read_info->stream.next_out,
+                   pfile_in_zip_read_info->stream.next_in,uDoCopy);
 
             pfile_in_zip_read_info->crc32 = crc32(pfile_in_zip_read_info->crc32,
                                 pfile_in_zip_read_info->stream.next_out,
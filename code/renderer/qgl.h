@@ -106,6 +106,10 @@ extern uint16_t *indices;
 #define qglPolygonOffset glPolygonOffset
 #define qglArrayElement glArrayElement
 #define qglTranslatef glTranslatef
+#define qglGenBuffers glGenBuffers
+#define qglDeleteBuffers glDeleteBuffers
+#define qglBindBuffer glBindBuffer
+#define qglBufferData glBufferData
 #define qglVertex3f glVertex3f
 
 #else
@@ -119,6 +119,46 @@ static int collapse[ MDS_MAX_VERTS ], *pCollapse; // Backend only
 static int p0, p1, p2; // Backend only
 //static  vec4_t m3[4], m4[4], tmp1[4], tmp2[4]; // TTimo: unused
 
+//-----------------------------------------------------------------------------
+// Pose cache, shared by the front end (tags) and the back end (skinning).
+// Final bones are keyed by the pose alone, so the same pose drawn in several
+// views, or by several entities playing the same animation, is only built once.
+
+#define POSE_CACHE_SIZE     32
+
+typedef struct {
+	mdsHeader_t *header;
+	int frame, oldframe;
+	int torsoFrame, oldTorsoFrame;
+	float backlerp, torsoBacklerp;
+	vec3_t torsoAxis[3];
+} poseKey_t;
+
+typedef struct {
+	poseKey_t key;
+	int lastUsed;
+	char validBones[MDS_MAX_BONES];
+	mdsBoneFrame_t bones[MDS_MAX_BONES];
+} poseCacheEntry_t;
+
+static poseCacheEntry_t poseCache[POSE_CACHE_SIZE];
+static int poseCacheSequence;
+
+// the back end and the job threads share the cache; threads of lower
+// priority would starve a holder preempted inside a spin
+#ifdef __vita__
+static SceKernelLwMutexWork poseCacheLock;
+static qboolean poseCacheLockCreated;   // by the first R_ClearPoseCache, from R_Init
+
+#define Pose_Lock()     sceKernelLockLwMutex( &poseCacheLock, 1, NULL )
+#define Pose_Unlock()   sceKernelUnlockLwMutex( &poseCacheLock, 1 )
+#else
+#define Pose_Lock()
+#define Pose_Unlock()
+#endif
+
+poseCacheStats_t poseCacheStats;
+
 //-----------------------------------------------------------------------------
 
 static float RB_ProjectRadius( float r, vec3_t location ) {
@@ -897,6 +937,137 @@ void R_CalcBoneLerp( mdsHeader_t *header, const refEntity_t *refent, int boneNum
 }
 
 
+/*
+==============
+R_PoseCacheKey
+==============
+*/
+static void R_PoseCacheKey( mdsHeader_t *header, const refEntity_t *refent, poseKey_t *key ) {
+	memset( key, 0, sizeof( *key ) );
+	key->header = header;
+	key->frame = refent->frame;
+	key->oldframe = refent->oldframe;
+	key->torsoFrame = refent->torsoFrame;
+	key->oldTorsoFrame = refent->oldTorsoFrame;
+	// same as R_CalcBones, a lerp between identical frames is no lerp at all
+	key->backlerp = ( refent->oldframe == refent->frame ) ? 0 : refent->backlerp;
+	key->torsoBacklerp = ( refent->oldTorsoFrame == refent->torsoFrame ) ? 0 : refent->torsoBacklerp;
+	memcpy( key->torsoAxis, refent->torsoAxis, sizeof( key->torsoAxis ) );
+}
+
+/*
+==============
+R_PoseCacheFind
+
+Must be called with the cache locked
+==============
+*/
+static poseCacheEntry_t *R_PoseCacheFind( const poseKey_t *key ) {
+	int i;
+
+	for ( i = 0; i < POSE_CACHE_SIZE; i++ ) {
+		if ( poseCache[i].key.header == key->header && !memcmp( &poseCache[i].key, key, sizeof( *key ) ) ) {
+			return &poseCache[i];
+		}
+	}
+
+	return NULL;
+}
+
+/*
+==============
+R_PoseCacheLookup
+
+Copies the requested bones out of the cache, returns qfalse
+unless every one of them was there
+==============
+*/
+static qboolean R_PoseCacheLookup( const poseKey_t *key, int *boneList, int numBones, mdsBoneState_t *s ) {
+	poseCacheEntry_t *entry;
+	int i;
+
+	Pose_Lock();
+
+	entry = R_PoseCacheFind( key );
+	if ( entry ) {
+		for ( i = 0; i < numBones; i++ ) {
+			if ( !entry->validBones[boneList[i]] ) {
+				break;
+			}
+		}
+		if ( i == numBones ) {
+			for ( i = 0; i < numBones; i++ ) {
+				s->bones[boneList[i]] = entry->bones[boneList[i]];
+			}
+			entry->lastUsed = ++poseCacheSequence;
+			poseCacheStats.hits++;
+			Pose_Unlock();
+			return qtrue;
+		}
+	}
+
+	poseCacheStats.misses++;
+	Pose_Unlock();
+	return qfalse;
+}
+
+/*
+==============
+R_PoseCacheStore
+
+Adds freshly built bones, replacing the least recently used pose
+==============
+*/
+static void R_PoseCacheStore( const poseKey_t *key, int *boneList, int numBones, mdsBoneState_t *s ) {
+	poseCacheEntry_t *entry;
+	int i;
+
+	Pose_Lock();
+
+	entry = R_PoseCacheFind( key );
+	if ( !entry ) {
+		entry = &poseCache[0];
+		for ( i = 1; i < POSE_CACHE_SIZE; i++ ) {
+			if ( poseCache[i].lastUsed < entry->lastUsed ) {
+				entry = &poseCache[i];
+			}
+		}
+		entry->key = *key;
+		memset( entry->validBones, 0, sizeof( entry->validBones ) );
+	}
+
+	for ( i = 0; i < numBones; i++ ) {
+		entry->bones[boneList[i]] = s->bones[boneList[i]];
+		entry->validBones[boneList[i]] = 1;
+	}
+	entry->lastUsed = ++poseCacheSequence;
+
+	Pose_Unlock();
+}
+
+/*
+==============
+R_ClearPoseCache
+
+Model data is about to go away
+==============
+*/
+void R_ClearPoseCache( void ) {
+#ifdef __vita__
+	if ( !poseCacheLockCreated ) {
+		sceKernelCreateLwMutex( &poseCacheLock, "Pose Cache", 0, 0, NULL );
+		poseCacheLockCreated = qtrue;
+	}
+#endif
+
+	Pose_Lock();
+
+	memset( poseCache, 0, sizeof( poseCache ) );
+	poseCacheSequence = 0;
+
+	Pose_Unlock();
+}
+
 /*
 ==============
 R_CalcBones
@@ -909,6 +1080,20 @@ void R_CalcBones( mdsHeader_t *header, const refEntity_t *refent, int *boneList,
 	int     *boneRefs;
 	float torsoWeight;
 	mdsBoneState_t *s = &boneStates[is_backend];
+	poseKey_t key;
+
+	if ( r_poseCache->integer ) {
+		R_PoseCacheKey( header, refent, &key );
+		if ( R_PoseCacheLookup( &key, boneList, numBones, s ) ) {
+			// callers still expect the frame pointers to be set up
+			s->frameSize = (int) ( sizeof( mdsFrame_t ) + ( header->numBones - 1 ) * sizeof( mdsBoneFrameCompressed_t ) );
+			s->frame = ( mdsFrame_t * )( (byte *)header + header->ofsFrames +
+									  refent->frame * s->frameSize );
+			// bones[] no longer matches the incremental state, force a rebuild next time
+			s->lastBoneEntity.frame = -1;
+			return;
+		}
+	}
 
 	//
 	// if the entity has changed since the last time the bones were built, reset them
@@ -1070,6 +1255,10 @@ void R_CalcBones( mdsHeader_t *header, const refEntity_t *refent, int *boneList,
 
 	// backup the final bones
 	memcpy( s->oldBones, s->bones, sizeof( s->bones[0] ) * header->numBones );
+
+	if ( r_poseCache->integer ) {
+		R_PoseCacheStore( &key, boneList, numBones, s );
+	}
 }
 
 #ifdef DBG_PROFILE_BONES
@@ -1078,13 +1267,259 @@ void R_CalcBones( mdsHeader_t *header, const refEntity_t *refent, int *boneList,
 #define DBG_SHOWTIME    ;
 #endif
 
+/*
+=============================================================
+
+VERTEX SKINNING
+
+The SIMD kernels work on the bones transposed into columns, so a
+weight is three multiply-adds of a whole column plus the translation.
+r_simdSkinning 0 falls back to the scalar reference.
+
+=============================================================
+*/
+
+typedef struct {
+	vec4_t cols[4];             // matrix columns, then the translation
+} QALIGN(16) skinMatrix_t;
+
+static skinMatrix_t skinMatrices[MDS_MAX_BONES]; // Backend only
+
+/*
+==============
+R_BuildSkinMatrices
+==============
+*/
+static void R_BuildSkinMatrices( const mdsBoneFrame_t *bones, const int *boneList, int numBones, skinMatrix_t *out ) {
+	const mdsBoneFrame_t *bone;
+	skinMatrix_t *m;
+	int i, j;
+
+	for ( i = 0; i < numBones; i++ ) {
+		bone = &bones[boneList[i]];
+		m = &out[boneList[i]];
+		for ( j = 0; j < 3; j++ ) {
+			m->cols[j][0] = bone->matrix[0][j];
+			m->cols[j][1] = bone->matrix[1][j];
+			m->cols[j][2] = bone->matrix[2][j];
+			m->cols[j][3] = 0;
+		}
+		VectorCopy( bone->translation, m->cols[3] );
+		m->cols[3][3] = 0;
+	}
+}
+
+/*
+==============
+RB_SkinVertexes_scalar
+
+Reference path, xyz, normal and st are vec4_t strided like tess
+==============
+*/
+static mdsVertex_t *RB_SkinVertexes_scalar( mdsVertex_t *v, int count, mdsBoneFrame_t *bones, const skinMatrix_t *matrices,
+											float *xyz, float *normal, float *st ) {
+	mdsWeight_t *w;
+	int j, k;
+
+	for ( j = 0; j < count; j++, xyz += 4, normal += 4, st += 4 ) {
+		VectorClear( xyz );
+
+		w = v->weights;
+		for ( k = 0 ; k < v->numWeights ; k++, w++ ) {
+			LocalAddScaledMatrixTransformVectorTranslate( w->offset, w->boneWeight, bones[w->boneIndex].matrix, bones[w->boneIndex].translation, xyz );
+		}
+		LocalMatrixTransformVector( v->normal, bones[v->weights[0].boneIndex].matrix, normal );
+
+		st[0] = v->texCoords[0];
+		st[1] = v->texCoords[1];
+
+		v = (mdsVertex_t *)&v->weights[v->numWeights];
+	}
+
+	return v;
+}
+
+#ifdef __vita__
+#include <arm_neon.h>
+static mdsVertex_t *RB_SkinVertexes_neon( mdsVertex_t *v, int count, mdsBoneFrame_t *bones, const skinMatrix_t *matrices,
+										  float *xyz, float *normal, float *st ) {
+	const skinMatrix_t *m;
+	mdsWeight_t *w;
+	float32x4_t acc, p;
+	int j, k;
+
+	for ( j = 0; j < count; j++, xyz += 4, normal += 4, st += 4 ) {
+		acc = vdupq_n_f32( 0.0f );
+
+		w = v->weights;
+		for ( k = 0 ; k < v->numWeights ; k++, w++ ) {
+			m = &matrices[w->boneIndex];
+			p = vmlaq_n_f32( vld1q_f32( m->cols[3] ), vld1q_f32( m->cols[0] ), w->offset[0] );
+			p = vmlaq_n_f32( p, vld1q_f32( m->cols[1] ), w->offset[1] );
+			p = vmlaq_n_f32( p, vld1q_f32( m->cols[2] ), w->offset[2] );
+			acc = vmlaq_n_f32( acc, p, w->boneWeight );
+		}
+		vst1q_f32( xyz, acc );
+
+		m = &matrices[v->weights[0].boneIndex];
+		p = vmulq_n_f32( vld1q_f32( m->cols[0] ), v->normal[0] );
+		p = vmlaq_n_f32( p, vld1q_f32( m->cols[1] ), v->normal[1] );
+		p = vmlaq_n_f32( p, vld1q_f32( m->cols[2] ), v->normal[2] );
+		vst1q_f32( normal, p );
+
+		st[0] = v->texCoords[0];
+		st[1] = v->texCoords[1];
+
+		v = (mdsVertex_t *)&v->weights[v->numWeights];
+	}
+
+	return v;
+}
+#define RB_SkinVertexes_simd RB_SkinVertexes_neon
+#else
+// off the Vita each weight is still a whole column at a time, with GCC
+// vector types standing in for the NEON registers
+typedef float skinVec4_t __attribute__ ( ( vector_size( 16 ) ) );
+
+static mdsVertex_t *RB_SkinVertexes_vec( mdsVertex_t *v, int count, mdsBoneFrame_t *bones, const skinMatrix_t *matrices,
+										 float *xyz, float *normal, float *st ) {
+	const skinVec4_t *m;
+	mdsWeight_t *w;
+	skinVec4_t acc, p;
+	int j, k;
+
+	for ( j = 0; j < count; j++, xyz += 4, normal += 4, st += 4 ) {
+		acc = (skinVec4_t){ 0, 0, 0, 0 };
+
+		w = v->weights;
+		for ( k = 0 ; k < v->numWeights ; k++, w++ ) {
+			m = (const skinVec4_t *)matrices[w->boneIndex].cols;
+			p = m[3] + m[0] * w->offset[0] + m[1] * w->offset[1] + m[2] * w->offset[2];
+			acc += p * w->boneWeight;
+		}
+		memcpy( xyz, &acc, sizeof( acc ) );
+
+		m = (const skinVec4_t *)matrices[v->weights[0].boneIndex].cols;
+		p = m[0] * v->normal[0] + m[1] * v->normal[1] + m[2] * v->normal[2];
+		memcpy( normal, &p, sizeof( p ) );
+
+		st[0] = v->texCoords[0];
+		st[1] = v->texCoords[1];
+
+		v = (mdsVertex_t *)&v->weights[v->numWeights];
+	}
+
+	return v;
+}
+#define RB_SkinVertexes_simd RB_SkinVertexes_vec
+#endif
+
+typedef struct {
+	mdsVertex_t     *verts;
+	mdsBoneFrame_t  *bones;
+	skinMatrix_t    *matrices;
+	float           *out[2];        // scalar and simd xyz, normal and st
+	int numVerts;
+} skinBench_t;
+
+static void R_SkinBenchScalar( benchmark_t *b ) {
+	skinBench_t *s = b->data;
+
+	RB_SkinVertexes_scalar( s->verts, s->numVerts, s->bones, s->matrices, s->out[0], s->out[0] + s->numVerts * 4, s->out[0] + s->numVerts * 8 );
+}
+
+static void R_SkinBenchSimd( benchmark_t *b ) {
+	skinBench_t *s = b->data;
+
+	RB_SkinVertexes_simd( s->verts, s->numVerts, s->bones, s->matrices, s->out[1], s->out[1] + s->numVerts * 4, s->out[1] + s->numVerts * 8 );
+}
+
+static float R_SkinBenchCompare( benchmark_t *b ) {
+	skinBench_t *s = b->data;
+
+	return R_BenchCompareVertexes( s->out[0], s->out[1], s->numVerts );
+}
+
+/*
+==============
+R_SkinBench_f
+
+skinbench [verts] [msec]
+Skins random vertexes with one to four weights against random bones
+==============
+*/
+void R_SkinBench_f( void ) {
+	skinBench_t s;
+	benchmark_t b;
+	mdsVertex_t *v;
+	int boneList[MDS_MAX_BONES];
+	int i, k;
+	byte *buf;
+
+	memset( &b, 0, sizeof( b ) );
+	if ( !ri.BenchArgs( "vert", 2000, SHADER_MAX_VERTEXES, &s.numVerts, &b.msec ) ) {
+		return;
+	}
+
+	buf = ri.Hunk_AllocateTempMemory( sizeof( *s.bones ) * MDS_MAX_BONES + sizeof( *s.matrices ) * ( MDS_MAX_BONES + 1 )
+									  + s.numVerts * ( sizeof( mdsVertex_t ) + 3 * sizeof( mdsWeight_t ) ) + s.numVerts * 12 * sizeof( float ) * 2 + 16 );
+	s.bones = (mdsBoneFrame_t *)buf;
+	s.matrices = (skinMatrix_t *)PADP( s.bones + MDS_MAX_BONES, 16 );
+	s.out[0] = (float *)( s.matrices + MDS_MAX_BONES );
+	s.out[1] = s.out[0] + s.numVerts * 12;
+	s.verts = (mdsVertex_t *)( s.out[1] + s.numVerts * 12 );
+
+	for ( i = 0; i < MDS_MAX_BONES; i++ ) {
+		vec3_t angles;
+
+		angles[0] = random() * 360;
+		angles[1] = random() * 360;
+		angles[2] = random() * 360;
+		AnglesToAxis( angles, s.bones[i].matrix );
+		s.bones[i].translation[0] = crandom() * 32;
+		s.bones[i].translation[1] = crandom() * 32;
+		s.bones[i].translation[2] = crandom() * 32;
+		boneList[i] = i;
+	}
+	R_BuildSkinMatrices( s.bones, boneList, MDS_MAX_BONES, s.matrices );
+
+	for ( i = 0, v = s.verts; i < s.numVerts; i++ ) {
+		v->normal[0] = crandom();
+		v->normal[1] = crandom();
+		v->normal[2] = crandom();
+		VectorNormalize( v->normal );
+		v->texCoords[0] = random();
+		v->texCoords[1] = random();
+		v->numWeights = 1 + ( i & 3 );
+		for ( k = 0; k < v->numWeights; k++ ) {
+			v->weights[k].boneIndex = rand() % MDS_MAX_BONES;
+			v->weights[k].boneWeight = 1.0f / v->numWeights;
+			v->weights[k].offset[0] = crandom() * 16;
+			v->weights[k].offset[1] = crandom() * 16;
+			v->weights[k].offset[2] = crandom() * 16;
+		}
+		v = (mdsVertex_t *)&v->weights[v->numWeights];
+	}
+
+	b.name = va( "skin %i verts", s.numVerts );
+	b.unit = "vert";
+	b.units = s.numVerts;
+	b.scalar = R_SkinBenchScalar;
+	b.simd = R_SkinBenchSimd;
+	b.compare = R_SkinBenchCompare;
+	b.data = &s;
+	ri.Benchmark( &b );
+
+	ri.Hunk_FreeTempMemory( buf );
+}
+
 /*
 ==============
 RB_SurfaceAnim
 ==============
 */
 void RB_SurfaceAnim( mdsSurface_t *surface ) {
-	int j, k;
+	int j;
 	refEntity_t *refent;
 	int             *boneList;
 	mdsHeader_t     *header;
@@ -1211,22 +1646,11 @@ void RB_SurfaceAnim( mdsSurface_t *surface ) {
 	v = ( mdsVertex_t * )( (byte *)surface + surface->ofsVerts );
 	tempVert = ( float * )( tess.xyz + baseVertex );
 	tempNormal = ( float * )( tess.normal + baseVertex );
-	for ( j = 0; j < render_count; j++, tempVert += 4, tempNormal += 4 ) {
-		mdsWeight_t *w;
-
-		VectorClear( tempVert );
-
-		w = v->weights;
-		for ( k = 0 ; k < v->numWeights ; k++, w++ ) {
-			boneStates[1].bone = &boneStates[1].bones[w->boneIndex];
-			LocalAddScaledMatrixTransformVectorTranslate( w->offset, w->boneWeight, boneStates[1].bone->matrix, boneStates[1].bone->translation, tempVert );
-		}
-		LocalMatrixTransformVector( v->normal, boneStates[1].bones[v->weights[0].boneIndex].matrix, tempNormal );
-
-		tess.texCoords[baseVertex + j][0][0] = v->texCoords[0];
-		tess.texCoords[baseVertex + j][0][1] = v->texCoords[1];
-
-		v = (mdsVertex_t *)&v->weights[v->numWeights];
+	if ( r_simdSkinning->integer ) {
+		R_BuildSkinMatrices( boneStates[1].bones, boneList, surface->numBoneReferences, skinMatrices );
+		RB_SkinVertexes_simd( v, render_count, boneStates[1].bones, skinMatrices, tempVert, tempNormal, tess.texCoords[baseVertex][0] );
+	} else {
+		RB_SkinVertexes_scalar( v, render_count, boneStates[1].bones, skinMatrices, tempVert, tempNormal, tess.texCoords[baseVertex][0] );
 	}
 
 	DBG_SHOWTIME
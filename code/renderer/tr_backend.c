@@ -33,6 +33,7 @@ backEndData_t *backEndDataPtr[BACKEND_DATA_NUM];
 backEndData_t *backEndData;
 backEndState_t backEnd;
 int activeBackEnd = 0;
+int backEndSlots = 0;
 
 static float s_flipMatrix[16] = {
 	// convert from our coordinate system (looking down X)
@@ -1094,9 +1095,27 @@ void    RB_SetGL2D( void ) {
 	backEnd.refdef.floatTime = backEnd.refdef.time * 0.001;
 }
 
-#define MAX_CIN_SIZE (512 * 256 * 4)
-static byte rawCins[BACKEND_DATA_NUM][MAX_CIN_SIZE];
-static int cinIdx = 0;
+// copies of the cinematic frames, one per back end slot since the render
+// thread may still upload the previous ones, grown to the largest frame seen
+static byte *rawCins[BACKEND_DATA_NUM];
+static int rawCinSizes[BACKEND_DATA_NUM];
+
+/*
+=============
+R_FreeCinematicFrames
+=============
+*/
+void R_FreeCinematicFrames( void ) {
+	int i;
+
+	for ( i = 0 ; i < BACKEND_DATA_NUM ; i++ ) {
+		if ( rawCins[i] ) {
+			ri.Free( rawCins[i] );
+			rawCins[i] = NULL;
+		}
+		rawCinSizes[i] = 0;
+	}
+}
 
 /*
 =============
@@ -1108,7 +1127,7 @@ Used for cinematics.
 */
 void RE_StretchRaw( int x, int y, int w, int h, int cols, int rows, const byte *data, int client, qboolean dirty ) {
     stretchRawCommand_t *cmd;
-    int i, j;
+    int i, j, size;
 
     if ( !tr.registered ) {
         return;
@@ -1123,7 +1142,16 @@ void RE_StretchRaw( int x, int y, int w, int h, int cols, int rows, const byte *
 		ri.Error( ERR_DROP, "Draw_StretchRaw: size not a power of 2: %i by %i", cols, rows );
 	}
 
-	memcpy( rawCins[cinIdx], data, cols * rows * 4 );
+	// the slot being filled is retired, so its old frame copy is free again
+	size = cols * rows * 4;
+	if ( size > rawCinSizes[activeBackEnd] ) {
+		if ( rawCins[activeBackEnd] ) {
+			ri.Free( rawCins[activeBackEnd] );
+		}
+		rawCins[activeBackEnd] = ri.Z_Malloc( size );
+		rawCinSizes[activeBackEnd] = size;
+	}
+	memcpy( rawCins[activeBackEnd], data, size );
 
     cmd = R_GetCommandBuffer( sizeof( *cmd ) );
     if ( !cmd ) {
@@ -1139,8 +1167,7 @@ void RE_StretchRaw( int x, int y, int w, int h, int cols, int rows, const byte *
     cmd->rows = rows;
     cmd->client = client;
     cmd->dirty = dirty;
-	cmd->data = rawCins[cinIdx];
-	cinIdx = !cinIdx;
+	cmd->data = rawCins[activeBackEnd];
 	
 	R_IssuePendingRenderCommands();
 }
@@ -1581,6 +1608,8 @@ const void  *RB_SwapBuffers( const void *data ) {
 
 	GLimp_EndFrame();
 
+	RB_LerpRecordEndFrame();
+
 	backEnd.projection2D = qfalse;
 
 #ifdef USE_BLOOM
@@ -135,17 +135,26 @@ static void R_ColorShiftLightingBytes( byte in[4], byte out[4] ) {
 ===============
 R_LoadLightmaps
 
+With r_mergeLightmaps the 128x128 lightmaps are packed into a few atlases
+("fat" lightmaps), so lightmapped world shaders stop changing binds between
+surfaces. The lightmap numbers and texcoords of the surfaces are remapped
+onto the atlas by FatLightmap/FatPackU/FatPackV while parsing them.
 ===============
 */
 #define LIGHTMAP_SIZE   128
+#define MAX_LIGHTMAP_ATLAS_SIZE 1024
+
 static void R_LoadLightmaps( lump_t *l ) {
 	byte        *buf, *buf_p;
 	int len;
 	byte image[LIGHTMAP_SIZE * LIGHTMAP_SIZE * 4];
-	int i, j;
+	byte        *atlas;
+	int i, j, numLightmaps, perAtlas, atlasWidth, atlasHeight;
 	float maxIntensity = 0;
 	double sumIntensity = 0;
 
+	tr.fatLightmapCols = tr.fatLightmapRows = 0;
+
 	len = l->filelen;
 	if ( !len ) {
 		return;
@@ -156,20 +165,53 @@ static void R_LoadLightmaps( lump_t *l ) {
 	R_IssuePendingRenderCommands();
 
 	// create all the lightmaps
-	tr.numLightmaps = len / ( LIGHTMAP_SIZE * LIGHTMAP_SIZE * 3 );
-	if ( tr.numLightmaps == 1 ) {
+	numLightmaps = len / ( LIGHTMAP_SIZE * LIGHTMAP_SIZE * 3 );
+	if ( numLightmaps == 1 ) {
 		//FIXME: HACK: maps with only one lightmap turn up fullbright for some reason.
 		//this avoids this, but isn't the correct solution.
-		tr.numLightmaps++;
+		numLightmaps++;
 	}
+	tr.numLightmaps = numLightmaps;
 
 	// if we are in r_vertexLight mode, we don't need the lightmaps at all
 	if ( r_vertexLight->integer || glConfig.hardwareType == GLHW_PERMEDIA2 ) {
 		return;
 	}
 
+	atlas = NULL;
+	atlasWidth = atlasHeight = LIGHTMAP_SIZE;
+	if ( r_mergeLightmaps->integer ) {
+		int maxSize = MAX_LIGHTMAP_ATLAS_SIZE;
+
+		if ( glConfig.maxTextureSize && glConfig.maxTextureSize < maxSize ) {
+			maxSize = glConfig.maxTextureSize;
+		}
+
+		// smallest power of two square that holds them all, or as many as fit
+		for ( atlasWidth = LIGHTMAP_SIZE; atlasWidth < maxSize; atlasWidth <<= 1 ) {
+			if ( ( atlasWidth / LIGHTMAP_SIZE ) * ( atlasWidth / LIGHTMAP_SIZE ) >= numLightmaps ) {
+				break;
+			}
+		}
+		tr.fatLightmapCols = atlasWidth / LIGHTMAP_SIZE;
+
+		// drop rows a single atlas would leave empty
+		for ( atlasHeight = LIGHTMAP_SIZE; atlasHeight < atlasWidth; atlasHeight <<= 1 ) {
+			if ( tr.fatLightmapCols * ( atlasHeight / LIGHTMAP_SIZE ) >= numLightmaps ) {
+				break;
+			}
+		}
+		tr.fatLightmapRows = atlasHeight / LIGHTMAP_SIZE;
+
+		perAtlas = tr.fatLightmapCols * tr.fatLightmapRows;
+		tr.numLightmaps = ( numLightmaps + perAtlas - 1 ) / perAtlas;
+
+		atlas = ri.Hunk_AllocateTempMemory( atlasWidth * atlasHeight * 4 );
+		Com_Memset( atlas, 0, atlasWidth * atlasHeight * 4 );
+	}
+
 	tr.lightmaps = ri.Hunk_Alloc( tr.numLightmaps * sizeof(image_t *), h_low );
-	for ( i = 0 ; i < tr.numLightmaps ; i++ ) {
+	for ( i = 0 ; i < numLightmaps ; i++ ) {
 		// expand the 24 bit on-disk to 32 bit
 		buf_p = buf + i * LIGHTMAP_SIZE * LIGHTMAP_SIZE * 3;
 
@@ -209,9 +251,32 @@ static void R_LoadLightmaps( lump_t *l ) {
 				image[j * 4 + 3] = 255;
 			}
 		}
-		tr.lightmaps[i] = R_CreateImage( va( "*lightmap%d",i ), image,
-			LIGHTMAP_SIZE, LIGHTMAP_SIZE, IMGTYPE_COLORALPHA,
-			IMGFLAG_NOLIGHTSCALE | IMGFLAG_NO_COMPRESSION | IMGFLAG_CLAMPTOEDGE, 0 );
+
+		if ( !atlas ) {
+			tr.lightmaps[i] = R_CreateImage( va( "*lightmap%d",i ), image,
+				LIGHTMAP_SIZE, LIGHTMAP_SIZE, IMGTYPE_COLORALPHA,
+				IMGFLAG_NOLIGHTSCALE | IMGFLAG_NO_COMPRESSION | IMGFLAG_CLAMPTOEDGE, 0 );
+			continue;
+		}
+
+		// copy into its cell of the atlas, and upload the atlas once it is full
+		j = i % perAtlas;
+		buf_p = atlas + ( ( j / tr.fatLightmapCols ) * LIGHTMAP_SIZE * atlasWidth + ( j % tr.fatLightmapCols ) * LIGHTMAP_SIZE ) * 4;
+		for ( j = 0; j < LIGHTMAP_SIZE; j++ ) {
+			Com_Memcpy( buf_p + j * atlasWidth * 4, image + j * LIGHTMAP_SIZE * 4, LIGHTMAP_SIZE * 4 );
+		}
+
+		if ( i % perAtlas == perAtlas - 1 || i == numLightmaps - 1 ) {
+			tr.lightmaps[i / perAtlas] = R_CreateImage( va( "*lightmap%d", i / perAtlas ), atlas,
+				atlasWidth, atlasHeight, IMGTYPE_COLORALPHA,
+				IMGFLAG_NOLIGHTSCALE | IMGFLAG_NO_COMPRESSION | IMGFLAG_CLAMPTOEDGE, 0 );
+		}
+	}
+
+	if ( atlas ) {
+		ri.Hunk_FreeTempMemory( atlas );
+		ri.Printf( PRINT_ALL, "...%i lightmaps merged into %i %ix%i atlases\n",
+				   numLightmaps, tr.numLightmaps, atlasWidth, atlasHeight );
 	}
 
 	if ( r_lightmap->integer == 2 ) {
@@ -219,6 +284,36 @@ static void R_LoadLightmaps( lump_t *l ) {
 	}
 }
 
+/*
+===============
+FatLightmap / FatPackU / FatPackV
+
+Map a BSP lightmap number and lightmap texcoords onto the merged atlases
+===============
+*/
+static int FatLightmap( int lightmapNum ) {
+	if ( lightmapNum < 0 || !tr.fatLightmapCols ) {
+		return lightmapNum;
+	}
+	return lightmapNum / ( tr.fatLightmapCols * tr.fatLightmapRows );
+}
+
+static float FatPackU( float input, int lightmapNum ) {
+	if ( lightmapNum < 0 || !tr.fatLightmapCols ) {
+		return input;
+	}
+	lightmapNum %= ( tr.fatLightmapCols * tr.fatLightmapRows );
+	return ( input + ( lightmapNum % tr.fatLightmapCols ) ) / (float)tr.fatLightmapCols;
+}
+
+static float FatPackV( float input, int lightmapNum ) {
+	if ( lightmapNum < 0 || !tr.fatLightmapCols ) {
+		return input;
+	}
+	lightmapNum %= ( tr.fatLightmapCols * tr.fatLightmapRows );
+	return ( input + ( lightmapNum / tr.fatLightmapCols ) ) / (float)tr.fatLightmapRows;
+}
+
 
 /*
 =================
@@ -363,7 +458,7 @@ static void ParseFace( dsurface_t *ds, drawVert_t *verts, msurface_t *surf, int
 	surf->fogIndex = LittleLong( ds->fogNum ) + 1;
 
 	// get shader value
-	surf->shader = ShaderForShaderNum( ds->shaderNum, lightmapNum );
+	surf->shader = ShaderForShaderNum( ds->shaderNum, FatLightmap( lightmapNum ) );
 	if ( r_singleShader->integer && !surf->shader->isSky ) {
 		surf->shader = tr.defaultShader;
 	}
@@ -389,6 +484,7 @@ static void ParseFace( dsurface_t *ds, drawVert_t *verts, msurface_t *surf, int
 	cv->numPoints = numPoints;
 	cv->numIndices = numIndexes;
 	cv->ofsIndices = ofsIndexes;
+	cv->vboFirstIndex = -1;
 
 	verts += LittleLong( ds->firstVert );
 	for ( i = 0 ; i < numPoints ; i++ ) {
@@ -397,8 +493,9 @@ static void ParseFace( dsurface_t *ds, drawVert_t *verts, msurface_t *surf, int
 		}
 		for ( j = 0 ; j < 2 ; j++ ) {
 			cv->points[i][3 + j] = LittleFloat( verts[i].st[j] );
-			cv->points[i][5 + j] = LittleFloat( verts[i].lightmap[j] );
 		}
+		cv->points[i][5] = FatPackU( LittleFloat( verts[i].lightmap[0] ), lightmapNum );
+		cv->points[i][6] = FatPackV( LittleFloat( verts[i].lightmap[1] ), lightmapNum );
 		R_ColorShiftLightingBytes( verts[i].color, (byte *)&cv->points[i][7] );
 	}
 
@@ -440,7 +537,7 @@ static void ParseMesh( dsurface_t *ds, drawVert_t *verts, msurface_t *surf ) {
 	surf->fogIndex = LittleLong( ds->fogNum ) + 1;
 
 	// get shader value
-	surf->shader = ShaderForShaderNum( ds->shaderNum, lightmapNum );
+	surf->shader = ShaderForShaderNum( ds->shaderNum, FatLightmap( lightmapNum ) );
 	if ( r_singleShader->integer && !surf->shader->isSky ) {
 		surf->shader = tr.defaultShader;
 	}
@@ -464,8 +561,9 @@ static void ParseMesh( dsurface_t *ds, drawVert_t *verts, msurface_t *surf ) {
 		}
 		for ( j = 0 ; j < 2 ; j++ ) {
 			points[i].st[j] = LittleFloat( verts[i].st[j] );
-			points[i].lightmap[j] = LittleFloat( verts[i].lightmap[j] );
 		}
+		points[i].lightmap[0] = FatPackU( LittleFloat( verts[i].lightmap[0] ), lightmapNum );
+		points[i].lightmap[1] = FatPackV( LittleFloat( verts[i].lightmap[1] ), lightmapNum );
 		R_ColorShiftLightingBytes( verts[i].color, points[i].color );
 	}
 
@@ -495,6 +593,7 @@ static void ParseTriSurf( dsurface_t *ds, drawVert_t *verts, msurface_t *surf, i
 	srfTriangles_t  *tri;
 	int i, j;
 	int numVerts, numIndexes;
+	int lightmapNum;
 
 	// get fog volume
 	surf->fogIndex = LittleLong( ds->fogNum ) + 1;
@@ -507,6 +606,7 @@ static void ParseTriSurf( dsurface_t *ds, drawVert_t *verts, msurface_t *surf, i
 
 	numVerts = LittleLong( ds->numVerts );
 	numIndexes = LittleLong( ds->numIndexes );
+	lightmapNum = LittleLong( ds->lightmapNum );
 
 	//tri = ri.Hunk_Alloc( sizeof( *tri ) + numVerts * sizeof( tri->verts[0] )
 	//	+ numIndexes * sizeof( tri->indexes[0] ) );
@@ -518,6 +618,7 @@ static void ParseTriSurf( dsurface_t *ds, drawVert_t *verts, msurface_t *surf, i
 	tri->numIndexes = numIndexes;
 	tri->verts = ( drawVert_t * )( tri + 1 );
 	tri->indexes = ( int * )( tri->verts + tri->numVerts );
+	tri->vboFirstIndex = -1;
 
 	surf->data = (surfaceType_t *)tri;
 
@@ -532,8 +633,9 @@ static void ParseTriSurf( dsurface_t *ds, drawVert_t *verts, msurface_t *surf, i
 		AddPointToBounds( tri->verts[i].xyz, tri->bounds[0], tri->bounds[1] );
 		for ( j = 0 ; j < 2 ; j++ ) {
 			tri->verts[i].st[j] = LittleFloat( verts[i].st[j] );
-			tri->verts[i].lightmap[j] = LittleFloat( verts[i].lightmap[j] );
 		}
+		tri->verts[i].lightmap[0] = FatPackU( LittleFloat( verts[i].lightmap[0] ), lightmapNum );
+		tri->verts[i].lightmap[1] = FatPackV( LittleFloat( verts[i].lightmap[1] ), lightmapNum );
 
 		R_ColorShiftLightingBytes( verts[i].color, tri->verts[i].color );
 	}
@@ -1460,6 +1562,205 @@ void R_MovePatchSurfacesToHunk( void ) {
 	}
 }
 
+/*
+===============
+R_VBOSurfaceSize
+
+Vertex and index counts of a surface that can live in the static world VBOs,
+qfalse if it has to keep going through tess every frame
+===============
+*/
+static qboolean R_VBOSurfaceSize( msurface_t *surf, int *numVerts, int *numIndexes ) {
+	if ( !surf->shader->vboStatic ) {
+		return qfalse;
+	}
+
+	switch ( *surf->data ) {
+	case SF_FACE:
+		*numVerts = ( (srfSurfaceFace_t *)surf->data )->numPoints;
+		*numIndexes = ( (srfSurfaceFace_t *)surf->data )->numIndices;
+		break;
+	case SF_TRIANGLES:
+		*numVerts = ( (srfTriangles_t *)surf->data )->numVerts;
+		*numIndexes = ( (srfTriangles_t *)surf->data )->numIndexes;
+		break;
+	default:
+		// grids change their tesselation with LoD every frame
+		return qfalse;
+	}
+
+	// a surface has to fit a chunk on its own, or the chunking never advances
+	return *numVerts <= MAX_VBO_CHUNK_VERTEXES;
+}
+
+/*
+===============
+R_VBOSurfaceCompare
+
+Keep the surfaces of a shader, and of the shaders batched with it, next to
+each other so the ranges drawn for one batch merge into few draw calls
+===============
+*/
+static int R_VBOSurfaceCompare( const void *a, const void *b ) {
+	msurface_t *sa = *(msurface_t **)a, *sb = *(msurface_t **)b;
+	shader_t *ba, *bb;
+
+	// shaders that get drawn as one batch share their ranges as well
+	ba = sa->shader->batchShader ? sa->shader->batchShader : sa->shader;
+	bb = sb->shader->batchShader ? sb->shader->batchShader : sb->shader;
+	if ( ba->index != bb->index ) {
+		return ba->index - bb->index;
+	}
+	if ( sa->shader->index != sb->shader->index ) {
+		return sa->shader->index - sb->shader->index;
+	}
+	if ( sa->fogIndex != sb->fogIndex ) {
+		return sa->fogIndex - sb->fogIndex;
+	}
+	return sa - sb;
+}
+
+/*
+===============
+R_CreateWorldVBOs
+
+Uploads the planar faces and triangle soups once, so the back end can draw
+them by index range instead of copying their vertexes into tess each frame
+===============
+*/
+static void R_CreateWorldVBOs( void ) {
+	msurface_t  **list;
+	worldVBO_t  *vbo;
+	float       *verts, *v;
+	glIndex_t   *indexes, *idx;
+	int numSurfs, numVerts, numIndexes;
+	int i, j, first, chunk;
+
+	s_worldData.numVBOs = 0;
+	if ( !r_worldVBO->integer ) {
+		return;
+	}
+
+	list = ri.Hunk_AllocateTempMemory( s_worldData.numsurfaces * sizeof( *list ) );
+	for ( i = 0, numSurfs = 0; i < s_worldData.numsurfaces; i++ ) {
+		if ( R_VBOSurfaceSize( &s_worldData.surfaces[i], &numVerts, &numIndexes ) ) {
+			list[numSurfs++] = &s_worldData.surfaces[i];
+		}
+	}
+	if ( !numSurfs ) {
+		ri.Hunk_FreeTempMemory( list );
+		return;
+	}
+	qsort( list, numSurfs, sizeof( *list ), R_VBOSurfaceCompare );
+
+	// count the chunks first so they can go on the hunk in one piece
+	chunk = 1;
+	for ( i = 0, first = 0; i < numSurfs; i++ ) {
+		R_VBOSurfaceSize( list[i], &numVerts, &numIndexes );
+		if ( first + numVerts > MAX_VBO_CHUNK_VERTEXES ) {
+			chunk++;
+			first = 0;
+		}
+		first += numVerts;
+	}
+	s_worldData.vbos = ri.Hunk_Alloc( chunk * sizeof( worldVBO_t ), h_low );
+
+	verts = ri.Hunk_AllocateTempMemory( MAX_VBO_CHUNK_VERTEXES * VERTEXSIZE * sizeof( float ) );
+
+	for ( i = 0; i < numSurfs; ) {
+		vbo = &s_worldData.vbos[s_worldData.numVBOs];
+
+		// gather the surfaces that fit in this chunk
+		numVerts = numIndexes = 0;
+		for ( j = i; j < numSurfs; j++ ) {
+			int nv, ni;
+
+			R_VBOSurfaceSize( list[j], &nv, &ni );
+			if ( numVerts + nv > MAX_VBO_CHUNK_VERTEXES ) {
+				break;
+			}
+			numVerts += nv;
+			numIndexes += ni;
+		}
+
+		indexes = ri.Hunk_AllocateTempMemory( numIndexes * sizeof( *indexes ) );
+		vbo->numVertexes = vbo->numIndexes = 0;
+		for ( ; i < j; i++ ) {
+			v = verts + vbo->numVertexes * VERTEXSIZE;
+			idx = indexes + vbo->numIndexes;
+
+			if ( *list[i]->data == SF_FACE ) {
+				srfSurfaceFace_t *face = (srfSurfaceFace_t *)list[i]->data;
+				int *faceIndexes = ( int * )( (byte *)face + face->ofsIndices );
+
+				Com_Memcpy( v, face->points, face->numPoints * VERTEXSIZE * sizeof( float ) );
+				for ( first = 0; first < face->numIndices; first++ ) {
+					idx[first] = vbo->numVertexes + faceIndexes[first];
+				}
+
+				face->vboChunk = s_worldData.numVBOs;
+				face->vboFirstIndex = vbo->numIndexes;
+				vbo->numVertexes += face->numPoints;
+				vbo->numIndexes += face->numIndices;
+			} else {
+				srfTriangles_t *tri = (srfTriangles_t *)list[i]->data;
+				drawVert_t *dv = tri->verts;
+
+				for ( first = 0; first < tri->numVerts; first++, dv++, v += VERTEXSIZE ) {
+					VectorCopy( dv->xyz, v );
+					v[3] = dv->st[0];
+					v[4] = dv->st[1];
+					v[5] = dv->lightmap[0];
+					v[6] = dv->lightmap[1];
+					*(int *)&v[7] = *(int *)dv->color;
+				}
+				for ( first = 0; first < tri->numIndexes; first++ ) {
+					idx[first] = vbo->numVertexes + tri->indexes[first];
+				}
+
+				tri->vboChunk = s_worldData.numVBOs;
+				tri->vboFirstIndex = vbo->numIndexes;
+				vbo->numVertexes += tri->numVerts;
+				vbo->numIndexes += tri->numIndexes;
+			}
+		}
+
+		qglGenBuffers( 1, &vbo->vertexBuffer );
+		qglBindBuffer( GL_ARRAY_BUFFER, vbo->vertexBuffer );
+		qglBufferData( GL_ARRAY_BUFFER, vbo->numVertexes * VERTEXSIZE * sizeof( float ), verts, GL_STATIC_DRAW );
+
+		qglGenBuffers( 1, &vbo->indexBuffer );
+		qglBindBuffer( GL_ELEMENT_ARRAY_BUFFER, vbo->indexBuffer );
+		qglBufferData( GL_ELEMENT_ARRAY_BUFFER, vbo->numIndexes * sizeof( glIndex_t ), indexes, GL_STATIC_DRAW );
+
+		ri.Hunk_FreeTempMemory( indexes );
+		s_worldData.numVBOs++;
+	}
+
+	qglBindBuffer( GL_ARRAY_BUFFER, 0 );
+	qglBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+
+	ri.Hunk_FreeTempMemory( verts );
+	ri.Hunk_FreeTempMemory( list );
+
+	ri.Printf( PRINT_ALL, "...%i static surfaces in %i world VBOs\n", numSurfs, s_worldData.numVBOs );
+}
+
+/*
+===============
+R_DeleteWorldVBOs
+===============
+*/
+void R_DeleteWorldVBOs( void ) {
+	int i;
+
+	for ( i = 0; i < s_worldData.numVBOs; i++ ) {
+		qglDeleteBuffers( 1, &s_worldData.vbos[i].vertexBuffer );
+		qglDeleteBuffers( 1, &s_worldData.vbos[i].indexBuffer );
+	}
+	s_worldData.numVBOs = 0;
+}
+
 /*
 ===============
 R_LoadSurfaces
@@ -1538,6 +1839,8 @@ static void R_LoadSurfaces( lump_t *surfs, lump_t *verts, lump_t *indexLump ) {
 	R_MovePatchSurfacesToHunk();
 #endif
 
+	R_CreateWorldVBOs();
+
 	ri.Printf( PRINT_ALL, "...loaded %d faces, %i meshes, %i trisurfs, %i flares\n",
 			   numFaces, numMeshes, numTriSurfs, numFlares );
 }
@@ -2157,6 +2460,8 @@ void RE_LoadWorldMap( const char *name ) {
 		void *v;
 	} buffer;
 	byte        *startMarker;
+	int traceStart;
+	const char *label;
 
 	skyboxportal = 0;
 
@@ -2164,6 +2469,9 @@ void RE_LoadWorldMap( const char *name ) {
 		ri.Error( ERR_DROP, "ERROR: attempted to redundantly load world map" );
 	}
 
+	traceStart = ri.TraceStart();
+	label = ri.Hunk_SetLabel( "world" );
+
 	// set default sun direction to be used if it isn't
 	// overridden by a shader
 	tr.sunDirection[0] = 0.45;
@@ -2264,5 +2572,8 @@ void RE_LoadWorldMap( const char *name ) {
 
 //----(SA)	end
 	ri.FS_FreeFile( buffer.v );
+
+	ri.Hunk_SetLabel( label );
+	ri.TraceEvent( traceStart, "decode", name, s_worldData.dataSize, NULL );
 }
 
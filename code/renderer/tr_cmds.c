@@ -39,25 +39,99 @@ extern float *gVertexBuffer;
 extern uint8_t *gColorBuffer;
 extern float *gTexCoordBuffer;
 int renderThread(int argc, void *argv) {
+	backEndData_t *data;
+	int idleStart;
+
 	rendThreadId = sceKernelGetThreadId();
 	vglInitExtended(0, glConfig.vidWidth, glConfig.vidHeight, 0x2000000, SCE_GXM_MULTISAMPLE_4X);
 	vglIndexPointerDefault();
 	glEnableClientState(GL_VERTEX_ARRAY);
-	sceKernelSignalSema(rend_mutex_out, 1);
+	// every slot but the one the front end is filling starts out free
+	sceKernelSignalSema(rend_mutex_out, backEndSlots - 1);
 	gVertexBuffer = (float *)vglAllocFromScratch(1024 * 1024);
 	gColorBuffer = (uint8_t *)vglAllocFromScratch(1024 * 1024);
 	gTexCoordBuffer = (float *)vglAllocFromScratch(1024 * 1024);
 	for (;;) {
+		idleStart = ri.Milliseconds();
 		sceKernelWaitSema(rend_mutex_in, 1, NULL);
-		renderCommandList_t	*cmdList = &backEndDataPtr[rendBackEnd]->commands;
+		backEnd.pc.c_smpIdleMsec += ri.Milliseconds() - idleStart;
+
+		data = backEndDataPtr[rendBackEnd];
 		set_tessPtr(&tessArray[rendBackEnd]);
-		RB_ExecuteRenderCommands( cmdList->cmds );
+		RB_ExecuteRenderCommands( data->commands.cmds );
+
+		// the front end only reads the counters of retired slots
+		data->pc = backEnd.pc;
+		Com_Memset( &backEnd.pc, 0, sizeof( backEnd.pc ) );
+		data->fence = data->frameNum;
+
+		rendBackEnd = ( rendBackEnd + 1 ) % backEndSlots;
 		sceKernelSignalSema(rend_mutex_out, 1);
-		rendBackEnd = !rendBackEnd;
 	}
 	
 	return sceKernelExitDeleteThread(0);
 }
+
+static backEndCounters_t retiredPc;     // render thread counters of the retired slots
+
+/*
+====================
+R_AddBackEndCounters
+====================
+*/
+static void R_AddBackEndCounters( backEndCounters_t *out, const backEndCounters_t *in ) {
+	out->c_surfaces += in->c_surfaces;
+	out->c_shaders += in->c_shaders;
+	out->c_vertexes += in->c_vertexes;
+	out->c_indexes += in->c_indexes;
+	out->c_totalIndexes += in->c_totalIndexes;
+	out->c_overDraw += in->c_overDraw;
+	out->c_dlightVertexes += in->c_dlightVertexes;
+	out->c_dlightIndexes += in->c_dlightIndexes;
+	out->c_flareAdds += in->c_flareAdds;
+	out->c_flareTests += in->c_flareTests;
+	out->c_flareRenders += in->c_flareRenders;
+	out->c_smpIdleMsec += in->c_smpIdleMsec;
+	out->c_vboSurfaces += in->c_vboSurfaces;
+	out->c_vboIndexes += in->c_vboIndexes;
+	out->c_vboDraws += in->c_vboDraws;
+	out->c_drawCalls += in->c_drawCalls;
+	out->msec += in->msec;
+}
+
+/*
+====================
+R_AcquireBackEndSlot
+
+Blocks until the render thread has retired the oldest queued frame
+when every slot of the ring is in flight
+====================
+*/
+static void R_AcquireBackEndSlot( void ) {
+	int stallStart;
+	int i;
+
+	if ( sceKernelPollSema(rend_mutex_out, 1) < 0 ) {
+		stallStart = ri.Milliseconds();
+		sceKernelWaitSema(rend_mutex_out, 1, NULL);
+		tr.pc.c_smpStalls++;
+		tr.pc.c_smpStallMsec += ri.Milliseconds() - stallStart;
+	}
+
+	activeBackEnd = ( activeBackEnd + 1 ) % backEndSlots;
+	backEndData = backEndDataPtr[activeBackEnd];
+	set_tessPtr(&tessArray[activeBackEnd]);
+
+	// the slot is retired, so its counters are complete
+	R_AddBackEndCounters( &retiredPc, &backEndData->pc );
+
+	tr.pc.c_smpFramesInFlight = 0;
+	for ( i = 0; i < backEndSlots; i++ ) {
+		if ( backEndDataPtr[i]->fence != backEndDataPtr[i]->frameNum ) {
+			tr.pc.c_smpFramesInFlight++;
+		}
+	}
+}
 #endif
 
 /*
@@ -66,18 +140,28 @@ R_PerformanceCounters
 =====================
 */
 void R_PerformanceCounters( void ) {
+	backEndCounters_t *pc;
+
+#ifdef __vita__
+	// backEnd.pc belongs to the render thread, which is still running
+	pc = &retiredPc;
+#else
+	pc = &backEnd.pc;
+#endif
+
 	if ( !r_speeds->integer ) {
 		// clear the counters even if we aren't printing
 		memset( &tr.pc, 0, sizeof( tr.pc ) );
-		memset( &backEnd.pc, 0, sizeof( backEnd.pc ) );
+		memset( pc, 0, sizeof( *pc ) );
+		memset( &poseCacheStats, 0, sizeof( poseCacheStats ) );
 		return;
 	}
 
 	if ( r_speeds->integer == 1 ) {
 		ri.Printf( PRINT_ALL, "%i/%i shaders/surfs %i leafs %i verts %i/%i tris %.2f mtex %.2f dc\n",
-				   backEnd.pc.c_shaders, backEnd.pc.c_surfaces, tr.pc.c_leafs, backEnd.pc.c_vertexes,
-				   backEnd.pc.c_indexes / 3, backEnd.pc.c_totalIndexes / 3,
-				   R_SumOfUsedImages() / ( 1000000.0f ), backEnd.pc.c_overDraw / (float)( glConfig.vidWidth * glConfig.vidHeight ) );
+				   pc->c_shaders, pc->c_surfaces, tr.pc.c_leafs, pc->c_vertexes,
+				   pc->c_indexes / 3, pc->c_totalIndexes / 3,
+				   R_SumOfUsedImages() / ( 1000000.0f ), pc->c_overDraw / (float)( glConfig.vidWidth * glConfig.vidHeight ) );
 	} else if ( r_speeds->integer == 2 ) {
 		ri.Printf( PRINT_ALL, "(patch) %i sin %i sclip  %i sout %i bin %i bclip %i bout\n",
 				   tr.pc.c_sphere_cull_patch_in, tr.pc.c_sphere_cull_patch_clip, tr.pc.c_sphere_cull_patch_out,
@@ -88,10 +172,10 @@ void R_PerformanceCounters( void ) {
 	} else if ( r_speeds->integer == 3 ) {
 		ri.Printf( PRINT_ALL, "viewcluster: %i\n", tr.viewCluster );
 	} else if ( r_speeds->integer == 4 ) {
-		if ( backEnd.pc.c_dlightVertexes ) {
+		if ( pc->c_dlightVertexes ) {
 			ri.Printf( PRINT_ALL, "dlight srf:%i  culled:%i  verts:%i  tris:%i\n",
 					   tr.pc.c_dlightSurfaces, tr.pc.c_dlightSurfacesCulled,
-					   backEnd.pc.c_dlightVertexes, backEnd.pc.c_dlightIndexes / 3 );
+					   pc->c_dlightVertexes, pc->c_dlightIndexes / 3 );
 		}
 	}
 //----(SA)	this is unnecessary since it will always show 2048.  I moved this to where it is accurate for the world
@@ -101,11 +185,25 @@ void R_PerformanceCounters( void ) {
 //	}
 	else if ( r_speeds->integer == 6 ) {
 		ri.Printf( PRINT_ALL, "flare adds:%i tests:%i renders:%i\n",
-				   backEnd.pc.c_flareAdds, backEnd.pc.c_flareTests, backEnd.pc.c_flareRenders );
+				   pc->c_flareAdds, pc->c_flareTests, pc->c_flareRenders );
+	} else if ( r_speeds->integer == 7 ) {
+		ri.Printf( PRINT_ALL, "smp slots:%i inflight:%i stalls:%i stallmsec:%i backend idlemsec:%i\n",
+				   backEndSlots, tr.pc.c_smpFramesInFlight, tr.pc.c_smpStalls, tr.pc.c_smpStallMsec,
+				   pc->c_smpIdleMsec );
+	} else if ( r_speeds->integer == 8 ) {
+		ri.Printf( PRINT_ALL, "pose cache hits:%i misses:%i\n",
+				   poseCacheStats.hits, poseCacheStats.misses );
+	} else if ( r_speeds->integer == 9 ) {
+		ri.Printf( PRINT_ALL, "world vbo surfs:%i tris:%i draws:%i\n",
+				   pc->c_vboSurfaces, pc->c_vboIndexes / 3, pc->c_vboDraws );
+	} else if ( r_speeds->integer == 10 ) {
+		ri.Printf( PRINT_ALL, "batches before:%i after:%i draw calls:%i\n",
+				   tr.pc.c_batchesBefore, tr.pc.c_batchesAfter, pc->c_drawCalls );
 	}
 
 	memset( &tr.pc, 0, sizeof( tr.pc ) );
-	memset( &backEnd.pc, 0, sizeof( backEnd.pc ) );
+	memset( pc, 0, sizeof( *pc ) );
+	memset( &poseCacheStats, 0, sizeof( poseCacheStats ) );
 }
 
 /*
@@ -114,6 +212,7 @@ R_IssueRenderCommands
 ====================
 */
 void R_IssueRenderCommands( qboolean runPerformanceCounters ) {
+	static int frameSequence;
 	renderCommandList_t *cmdList;
 
 	cmdList = &backEndData->commands;
@@ -123,23 +222,22 @@ void R_IssueRenderCommands( qboolean runPerformanceCounters ) {
 
 	// clear it out, in case this is a sync and not a buffer flip
 	cmdList->used = 0;
-	
+
 #ifdef __vita__
-	sceKernelWaitSema(rend_mutex_out, 1, NULL);
-#endif
+	// hand the filled slot to the render thread and move on to the next
+	// one, only stalling if the whole ring is still queued
+	backEndData->frameNum = ++frameSequence;
+	sceKernelSignalSema(rend_mutex_in, 1);
+	R_AcquireBackEndSlot();
 
-#ifndef __vita__
 	if ( runPerformanceCounters ) {
 		R_PerformanceCounters();
 	}
-#endif
-
-#ifdef __vita__
-	sceKernelSignalSema(rend_mutex_in, 1);
-	activeBackEnd = !activeBackEnd;
-	backEndData = backEndDataPtr[activeBackEnd];
-	set_tessPtr(&tessArray[activeBackEnd]);
 #else
+	if ( runPerformanceCounters ) {
+		R_PerformanceCounters();
+	}
+
 	// actually start the commands going
 	if ( !r_skipBackEnd->integer ) {
 		// let it start on the new batch
@@ -164,6 +262,26 @@ void R_IssuePendingRenderCommands( void ) {
 	R_IssueRenderCommands( qfalse );
 }
 
+/*
+====================
+R_SyncRenderThread
+
+Waits for the render thread to drain every queued frame,
+needed before freeing resources the back end may still use
+====================
+*/
+void R_SyncRenderThread( void ) {
+#ifdef __vita__
+	int i;
+
+	// once all the other slots are free again the back end is idle
+	for ( i = 0; i < backEndSlots - 1; i++ ) {
+		sceKernelWaitSema(rend_mutex_out, 1, NULL);
+	}
+	sceKernelSignalSema(rend_mutex_out, backEndSlots - 1);
+#endif
+}
+
 /*
 ============
 R_GetCommandBufferReserved
@@ -456,10 +574,17 @@ void RE_EndFrame( int *frontEndMsec, int *backEndMsec ) {
 		*frontEndMsec = tr.frontEndMsec;
 	}
 	tr.frontEndMsec = 0;
+#ifdef __vita__
+	// the last frame the slot just taken ran
+	if ( backEndMsec ) {
+		*backEndMsec = backEndData->pc.msec;
+	}
+#else
 	if ( backEndMsec ) {
 		*backEndMsec = backEnd.pc.msec;
 	}
 	backEnd.pc.msec = 0;
+#endif
 }
 
 /*
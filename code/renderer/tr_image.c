@@ -34,6 +34,7 @@ If you have questions concerning this license or the applicable additional terms
 */
 
 #include "tr_local.h"
+#include <zlib.h>
 
 static byte s_intensitytable[256];
 static unsigned char s_gammatable[256];
@@ -717,6 +718,74 @@ byte * gles_convertLuminanceAlpha(byte * data, int width, int height)
 }
 #endif
 
+/*
+==============================================================================
+
+IMAGE CACHE CAPTURE
+
+While an image is being written to the image cache, every level Upload32
+hands to GL is also copied into the capture buffer. A dry run (the
+buildimagecache command) only captures and never touches GL.
+==============================================================================
+*/
+
+typedef struct {
+	int width, height;              // followed by width * height * 4 bytes
+} imageCacheLevel_t;
+
+typedef struct {
+	qboolean active;
+	qboolean dryRun;
+	qboolean overflow;
+	qboolean generateMipmap;
+	byte        *buffer;
+	int size, used;
+	int numLevels;
+} imageCapture_t;
+
+static imageCapture_t imageCapture;
+
+/*
+================
+R_ImageCacheCancelCapture
+
+An error between begin and end capture leaves the buffer behind in temp
+memory that goes away with the hunk, the next upload mustn't write to it
+================
+*/
+static void R_ImageCacheCancelCapture( void ) {
+	Com_Memset( &imageCapture, 0, sizeof( imageCapture ) );
+}
+
+/*
+================
+R_UploadLevel
+================
+*/
+static void R_UploadLevel( int level, GLenum internalFormat, int width, int height, const void *pixels ) {
+	if ( imageCapture.active ) {
+		int size = width * height * 4;
+
+		if ( level != imageCapture.numLevels || imageCapture.used + (int)sizeof( imageCacheLevel_t ) + size > imageCapture.size ) {
+			imageCapture.overflow = qtrue;
+		} else {
+			imageCacheLevel_t *out = ( imageCacheLevel_t * )( imageCapture.buffer + imageCapture.used );
+
+			out->width = width;
+			out->height = height;
+			Com_Memcpy( out + 1, pixels, size );
+			imageCapture.used += sizeof( *out ) + size;
+			imageCapture.numLevels++;
+		}
+
+		if ( imageCapture.dryRun ) {
+			return;
+		}
+	}
+
+	qglTexImage2D( GL_TEXTURE_2D, level, internalFormat, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, pixels );
+}
+
 /*
 ===============
 Upload32
@@ -950,7 +1019,7 @@ static void Upload32(   unsigned *data,
 	if ( ( scaled_width == width ) &&
 		 ( scaled_height == height ) ) {
 		if ( !mipmap ) {
-			qglTexImage2D( GL_TEXTURE_2D, 0, internalFormat, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, data );
+			R_UploadLevel( 0, internalFormat, scaled_width, scaled_height, data );
 			*pUploadWidth = scaled_width;
 			*pUploadHeight = scaled_height;
 			*format = internalFormat;
@@ -982,7 +1051,7 @@ static void Upload32(   unsigned *data,
 	*pUploadHeight = scaled_height;
 	*format = internalFormat;
 
-	qglTexImage2D( GL_TEXTURE_2D, 0, internalFormat, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, scaledBuffer );
+	R_UploadLevel( 0, internalFormat, scaled_width, scaled_height, scaledBuffer );
 
 	if ( mipmap ) {
 		if (compressed) {
@@ -1005,23 +1074,30 @@ static void Upload32(   unsigned *data,
 				if ( r_colorMipLevels->integer ) {
 					R_BlendOverTexture( (byte *)scaledBuffer, scaled_width * scaled_height, mipBlendColors[miplevel] );
 				}
-				qglTexImage2D( GL_TEXTURE_2D, miplevel, internalFormat, scaled_width, scaled_height, 0, GL_RGBA, GL_UNSIGNED_BYTE, scaledBuffer );
+				R_UploadLevel( miplevel, internalFormat, scaled_width, scaled_height, scaledBuffer );
+			}
+		} else {
+			imageCapture.generateMipmap = qtrue;
+			if ( !imageCapture.dryRun ) {
+				glGenerateMipmap(GL_TEXTURE_2D);
 			}
-		} else glGenerateMipmap(GL_TEXTURE_2D);
+		}
 	}
 done:
 
-	if ( mipmap ) {
-		qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gl_filter_min );
-		qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, gl_filter_max );
-	}
-	else
-	{
-		qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
-		qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
-	}
+	if ( !imageCapture.dryRun ) {
+		if ( mipmap ) {
+			qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gl_filter_min );
+			qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, gl_filter_max );
+		}
+		else
+		{
+			qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+			qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+		}
 
-	GL_CheckErrors();
+		GL_CheckErrors();
+	}
 
 	if ( scaledBuffer != 0 )
 		ri.Hunk_FreeTempMemory( scaledBuffer );
@@ -1031,6 +1107,39 @@ done:
 
 
 
+/*
+================
+R_ImageNoCompress
+
+Images that must never be uploaded with texture compression
+================
+*/
+static qboolean R_ImageNoCompress( const char *name ) {
+	if ( !strncmp( name, "*lightmap", 9 ) ) {
+		return qtrue;
+	}
+	if ( strstr( name, "skies" ) ) {
+		return qtrue;
+	}
+	if ( strstr( name, "weapons" ) ) {    // don't compress view weapon skins
+		return qtrue;
+	}
+	// RF, if the shader hasn't specifically asked for it, don't allow compression
+	if ( r_ext_compressed_textures->integer == 2 && ( tr.allowCompress != qtrue ) ) {
+		return qtrue;
+	} else if ( r_ext_compressed_textures->integer == 1 && ( tr.allowCompress < 0 ) )     {
+		return qtrue;
+	}
+	return qfalse;
+}
+
+typedef struct imageCacheHeader_s imageCacheHeader_t;
+
+// set while R_CreateImageExt should upload a cache entry instead of pic
+static const imageCacheHeader_t *cachedUpload;
+
+static void R_UploadCachedImage( const imageCacheHeader_t *header, image_t *image );
+
 //----(SA)	modified
 
 /*
@@ -1047,31 +1156,25 @@ image_t *R_CreateImageExt( const char *name, byte *pic, int width, int height, i
 	int         glWrapClampMode;
 	long hash;
 	qboolean noCompress = qfalse;
+	int traceStart;
+	const char *label;
 
 	if ( strlen( name ) >= MAX_QPATH ) {
+		R_ImageCacheCancelCapture();
 		ri.Error( ERR_DROP, "R_CreateImage: \"%s\" is too long", name );
 	}
 	if ( !strncmp( name, "*lightmap", 9 ) ) {
 		isLightmap = qtrue;
-		noCompress = qtrue;
-	}
-	if ( !noCompress && strstr( name, "skies" ) ) {
-		noCompress = qtrue;
-	}
-	if ( !noCompress && strstr( name, "weapons" ) ) {    // don't compress view weapon skins
-		noCompress = qtrue;
-	}
-	// RF, if the shader hasn't specifically asked for it, don't allow compression
-	if ( r_ext_compressed_textures->integer == 2 && ( tr.allowCompress != qtrue ) ) {
-		noCompress = qtrue;
-	} else if ( r_ext_compressed_textures->integer == 1 && ( tr.allowCompress < 0 ) )     {
-		noCompress = qtrue;
 	}
+	noCompress = R_ImageNoCompress( name );
 
 	if ( tr.numImages == MAX_DRAWIMAGES ) {
+		R_ImageCacheCancelCapture();
 		ri.Error( ERR_DROP, "R_CreateImage: MAX_DRAWIMAGES hit" );
 	}
 
+	label = ri.Hunk_SetLabel( "images" );
+
 	// Ridah
 	image = tr.images[tr.numImages] = ri.Hunk_Alloc( sizeof( image_t ), h_low );
 	qglGenTextures( 1, &image->texnum );
@@ -1100,16 +1203,22 @@ image_t *R_CreateImageExt( const char *name, byte *pic, int width, int height, i
 	
 	GL_Bind( image );
 
-	Upload32( (unsigned *)pic,
-			  image->width, image->height,
-			  image->flags & IMGFLAG_MIPMAP,
-			  image->flags & IMGFLAG_PICMIP,
-			  characterMip,                     //----(SA)	added
-			  isLightmap,
-			  &image->internalFormat,
-			  &image->uploadWidth,
-			  &image->uploadHeight,
-			  noCompress );
+	traceStart = ri.TraceStart();
+	if ( cachedUpload ) {
+		R_UploadCachedImage( cachedUpload, image );
+	} else {
+		Upload32( (unsigned *)pic,
+				  image->width, image->height,
+				  image->flags & IMGFLAG_MIPMAP,
+				  image->flags & IMGFLAG_PICMIP,
+				  characterMip,                     //----(SA)	added
+				  isLightmap,
+				  &image->internalFormat,
+				  &image->uploadWidth,
+				  &image->uploadHeight,
+				  noCompress );
+	}
+	ri.TraceEvent( traceStart, "upload", name, image->uploadWidth * image->uploadHeight * 4, NULL );
 
 	qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, glWrapClampMode );
 	qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, glWrapClampMode );
@@ -1128,6 +1237,7 @@ image_t *R_CreateImageExt( const char *name, byte *pic, int width, int height, i
 	// Ridah
 	image->hash = hash;
 
+	ri.Hunk_SetLabel( label );
 	return image;
 }
 
@@ -1244,6 +1354,441 @@ void R_LoadImage( const char *name, byte **pic, int *width, int *height )
 }
 
 
+/*
+==============================================================================
+
+IMAGE CACHE
+
+Images that come from pk3 files are stored in imagecache/ exactly as
+Upload32 handed them to GL (resampled, picmipped, light scaled, with the
+CPU built mip levels), deflated. The next load of the same image skips the
+decode and all of that processing. An entry is keyed by the pak checksum,
+image name, flags, picmip and a signature of every setting Upload32 reads,
+so changing any of them just misses the old entries.
+==============================================================================
+*/
+
+#define IMAGECACHE_IDENT        ( ( 'C' << 24 ) + ( 'M' << 16 ) + ( 'I' << 8 ) + 'R' )
+#define IMAGECACHE_VERSION      1
+
+struct imageCacheHeader_s {
+	int ident;
+	int version;
+	char name[MAX_QPATH];
+	int checksum;                   // checksum of the source pak, without the pure feed
+	int flags;
+	int picmip;
+	int noCompress;
+	int signature;
+
+	int width, height;              // size of the source image
+	int uploadWidth, uploadHeight;
+	int internalFormat;
+	int generateMipmap;
+	int numLevels;
+	int dataSize;                   // inflated size of the levels
+	int compressedSize;
+};
+
+typedef struct {
+	char path[MAX_QPATH];
+	char name[MAX_QPATH];
+	int checksum;
+	int flags;
+	int picmip;
+	int noCompress;
+	int signature;
+} imageCacheKey_t;
+
+static const byte *cachedUploadData;
+
+/*
+================
+R_ImageCacheHash
+================
+*/
+static unsigned R_ImageCacheHash( unsigned hash, const void *data, int len ) {
+	const byte *p = data;
+
+	while ( len-- ) {
+		hash ^= *p++;
+		hash *= 16777619u;
+	}
+	return hash;
+}
+
+/*
+================
+R_ImageCacheSignature
+
+Everything besides the key itself that changes what Upload32 produces
+================
+*/
+static int R_ImageCacheSignature( void ) {
+	int settings[6];
+	float values[3];
+	unsigned hash = 2166136261u;
+
+	settings[0] = IMAGECACHE_VERSION;
+	settings[1] = r_roundImagesDown->integer;
+	settings[2] = glConfig.maxTextureSize;
+	settings[3] = r_lowMemTextureSize->integer;
+	settings[4] = r_colorMipLevels->integer;
+	settings[5] = glConfig.deviceSupportsGamma;
+	values[0] = r_lowMemTextureThreshold->value;
+	values[1] = r_rmse->value;
+	values[2] = r_greyscale->value;
+
+	hash = R_ImageCacheHash( hash, settings, sizeof( settings ) );
+	hash = R_ImageCacheHash( hash, values, sizeof( values ) );
+	hash = R_ImageCacheHash( hash, s_gammatable, sizeof( s_gammatable ) );
+	hash = R_ImageCacheHash( hash, s_intensitytable, sizeof( s_intensitytable ) );
+	return (int)hash;
+}
+
+/*
+================
+R_ImageCacheKey
+
+Returns qfalse if the image isn't cacheable, loose files never are
+================
+*/
+static qboolean R_ImageCacheKey( const char *name, imgFlags_t flags, qboolean characterMip, imageCacheKey_t *key ) {
+	char localName[MAX_QPATH];
+	unsigned hash;
+	int i;
+
+	if ( strlen( name ) >= MAX_QPATH ) {
+		return qfalse;
+	}
+
+	// find the pak of the file R_LoadImage is going to pick
+	if ( ri.FS_FilePakChecksum( name, &key->checksum ) == -1 ) {
+		COM_StripExtension( name, localName, MAX_QPATH );
+		for ( i = 0; i < numImageLoaders; i++ ) {
+			if ( ri.FS_FilePakChecksum( va( "%s.%s", localName, imageLoaders[i].ext ), &key->checksum ) != -1 ) {
+				break;
+			}
+		}
+		if ( i == numImageLoaders ) {
+			return qfalse;
+		}
+	}
+
+	Q_strncpyz( key->name, name, sizeof( key->name ) );
+	Q_strlwr( key->name );
+	key->flags = flags;
+	if ( !( flags & IMGFLAG_PICMIP ) ) {
+		key->picmip = 0;
+	} else if ( characterMip ) {
+		key->picmip = r_picmip2->integer;
+	} else {
+		key->picmip = r_picmip->integer;
+	}
+	key->noCompress = R_ImageNoCompress( name );
+	key->signature = R_ImageCacheSignature();
+
+	hash = R_ImageCacheHash( 2166136261u, key->name, strlen( key->name ) );
+	hash = R_ImageCacheHash( hash, &key->checksum, sizeof( key->checksum ) );
+	hash = R_ImageCacheHash( hash, &key->flags, sizeof( key->flags ) );
+	hash = R_ImageCacheHash( hash, &key->picmip, sizeof( key->picmip ) );
+	hash = R_ImageCacheHash( hash, &key->noCompress, sizeof( key->noCompress ) );
+	hash = R_ImageCacheHash( hash, &key->signature, sizeof( key->signature ) );
+	Com_sprintf( key->path, sizeof( key->path ), "imagecache/%08x.img", hash );
+
+	return qtrue;
+}
+
+/*
+================
+R_ImageCacheBeginCapture
+================
+*/
+static void R_ImageCacheBeginCapture( int width, int height, qboolean dryRun ) {
+	int w, h;
+
+	// Upload32 never goes past the next power of two, plus a third for the mips
+	for ( w = 1 ; w < width ; w <<= 1 )
+		;
+	for ( h = 1 ; h < height ; h <<= 1 )
+		;
+
+	Com_Memset( &imageCapture, 0, sizeof( imageCapture ) );
+	imageCapture.size = w * h * 16 / 3 + 32 * sizeof( imageCacheLevel_t );
+	imageCapture.buffer = ri.Hunk_AllocateTempMemory( imageCapture.size );
+	imageCapture.active = qtrue;
+	imageCapture.dryRun = dryRun;
+}
+
+/*
+================
+R_ImageCacheEndCapture
+
+Deflates the captured levels and writes them out
+================
+*/
+static qboolean R_ImageCacheEndCapture( const imageCacheKey_t *key, int width, int height,
+										int internalFormat, int uploadWidth, int uploadHeight ) {
+	imageCacheHeader_t  *header;
+	byte                *out;
+	uLongf compressedSize;
+	qboolean written = qfalse;
+
+	imageCapture.active = qfalse;
+	imageCapture.dryRun = qfalse;
+
+	if ( !imageCapture.overflow && imageCapture.numLevels ) {
+		compressedSize = compressBound( imageCapture.used );
+		out = ri.Hunk_AllocateTempMemory( sizeof( *header ) + compressedSize );
+
+		if ( compress2( out + sizeof( *header ), &compressedSize, imageCapture.buffer, imageCapture.used, Z_BEST_SPEED ) == Z_OK ) {
+			header = (imageCacheHeader_t *)out;
+			Com_Memset( header, 0, sizeof( *header ) );
+			header->ident = IMAGECACHE_IDENT;
+			header->version = IMAGECACHE_VERSION;
+			Q_strncpyz( header->name, key->name, sizeof( header->name ) );
+			header->checksum = key->checksum;
+			header->flags = key->flags;
+			header->picmip = key->picmip;
+			header->noCompress = key->noCompress;
+			header->signature = key->signature;
+			header->width = width;
+			header->height = height;
+			header->uploadWidth = uploadWidth;
+			header->uploadHeight = uploadHeight;
+			header->internalFormat = internalFormat;
+			header->generateMipmap = imageCapture.generateMipmap;
+			header->numLevels = imageCapture.numLevels;
+			header->dataSize = imageCapture.used;
+			header->compressedSize = compressedSize;
+
+			ri.FS_WriteFile( key->path, out, sizeof( *header ) + compressedSize );
+			written = qtrue;
+		}
+
+		ri.Hunk_FreeTempMemory( out );
+	}
+
+	ri.Hunk_FreeTempMemory( imageCapture.buffer );
+	imageCapture.buffer = NULL;
+
+	return written;
+}
+
+/*
+================
+R_UploadCachedImage
+================
+*/
+static void R_UploadCachedImage( const imageCacheHeader_t *header, image_t *image ) {
+	const byte *data = cachedUploadData;
+	int i;
+
+	for ( i = 0 ; i < header->numLevels ; i++ ) {
+		const imageCacheLevel_t *level = (const imageCacheLevel_t *)data;
+
+		qglTexImage2D( GL_TEXTURE_2D, i, header->internalFormat, level->width, level->height, 0, GL_RGBA, GL_UNSIGNED_BYTE, level + 1 );
+		data += sizeof( *level ) + level->width * level->height * 4;
+	}
+	if ( header->generateMipmap ) {
+		glGenerateMipmap( GL_TEXTURE_2D );
+	}
+
+	image->internalFormat = header->internalFormat;
+	image->uploadWidth = header->uploadWidth;
+	image->uploadHeight = header->uploadHeight;
+
+	if ( image->flags & IMGFLAG_MIPMAP ) {
+		qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, gl_filter_min );
+		qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, gl_filter_max );
+	}
+	else
+	{
+		qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+		qglTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+	}
+
+	GL_CheckErrors();
+}
+
+/*
+================
+R_ImageCacheLoad
+
+Creates the image straight from its cache entry, NULL on any mismatch
+================
+*/
+static image_t *R_ImageCacheLoad( const imageCacheKey_t *key, const char *name, imgType_t type, imgFlags_t flags, qboolean characterMip ) {
+	imageCacheHeader_t  *header;
+	byte                *data, *p;
+	uLongf dataSize;
+	image_t             *image = NULL;
+	long len;
+	int i;
+
+	len = ri.FS_ReadFile( key->path, (void **)&header );
+	if ( !header ) {
+		return NULL;
+	}
+
+	if ( len < (long)sizeof( *header )
+		 || header->ident != IMAGECACHE_IDENT
+		 || header->version != IMAGECACHE_VERSION
+		 || strcmp( header->name, key->name )
+		 || header->checksum != key->checksum
+		 || header->flags != key->flags
+		 || header->picmip != key->picmip
+		 || header->noCompress != key->noCompress
+		 || header->signature != key->signature
+		 || header->compressedSize != len - (long)sizeof( *header )
+		 || header->numLevels < 1 || header->dataSize <= 0 ) {
+		ri.FS_FreeFile( header );
+		return NULL;
+	}
+
+	data = ri.Hunk_AllocateTempMemory( header->dataSize );
+	dataSize = header->dataSize;
+
+	if ( uncompress( data, &dataSize, (byte *)( header + 1 ), header->compressedSize ) == Z_OK && dataSize == (uLongf)header->dataSize ) {
+		// make sure the levels stay inside the data before handing them to GL
+		for ( i = 0, p = data ; i < header->numLevels ; i++ ) {
+			const imageCacheLevel_t *level = (const imageCacheLevel_t *)p;
+
+			if ( p + sizeof( *level ) > data + dataSize || level->width < 1 || level->height < 1
+				 || level->width * level->height * 4 > ( data + dataSize ) - ( p + sizeof( *level ) ) ) {
+				break;
+			}
+			p += sizeof( *level ) + level->width * level->height * 4;
+		}
+
+		if ( i == header->numLevels ) {
+			cachedUpload = header;
+			cachedUploadData = data;
+			image = R_CreateImageExt( name, NULL, header->width, header->height, type, flags, 0, characterMip );
+			cachedUpload = NULL;
+			cachedUploadData = NULL;
+		}
+	}
+
+	ri.Hunk_FreeTempMemory( data );
+	ri.FS_FreeFile( header );
+
+	return image;
+}
+
+/*
+================
+R_BuildImageCacheEntry
+
+Writes the cache entry for an image without creating it, used by the
+buildimagecache command. Returns qtrue if a new entry was written.
+================
+*/
+qboolean R_BuildImageCacheEntry( const char *name, imgFlags_t flags, qboolean characterMip ) {
+	imageCacheKey_t key;
+	int width, height;
+	int internalFormat, uploadWidth, uploadHeight;
+	byte    *pic;
+	qboolean written;
+
+	if ( !R_ImageCacheKey( name, flags, characterMip, &key ) || ri.FS_FileExists( key.path ) ) {
+		return qfalse;
+	}
+
+	R_LoadImage( name, &pic, &width, &height );
+	if ( pic == NULL ) {
+		return qfalse;
+	}
+
+	R_ImageCacheBeginCapture( width, height, qtrue );
+	Upload32( (unsigned *)pic, width, height,
+			  flags & IMGFLAG_MIPMAP,
+			  flags & IMGFLAG_PICMIP,
+			  characterMip,
+			  qfalse,
+			  &internalFormat,
+			  &uploadWidth,
+			  &uploadHeight,
+			  key.noCompress );
+	written = R_ImageCacheEndCapture( &key, width, height, internalFormat, uploadWidth, uploadHeight );
+
+	ri.Free( pic );
+	return written;
+}
+
+/*
+================
+R_BuildImageCache_f
+
+buildimagecache [mapname]
+
+Prebuilds the image cache for the world shaders of one or all maps
+================
+*/
+void R_BuildImageCache_f( void ) {
+	char        **maps;
+	char mapName[MAX_QPATH];
+	int numMaps, i, j, numShaders, count, start;
+	dheader_t   *header;
+	dshader_t   *shaders;
+
+	if ( !r_imageCache->integer ) {
+		ri.Printf( PRINT_ALL, "r_imageCache is disabled\n" );
+		return;
+	}
+
+	if ( ri.Cmd_Argc() > 1 ) {
+		maps = NULL;
+		numMaps = 1;
+	} else {
+		maps = ri.FS_ListFiles( "maps", ".bsp", &numMaps );
+	}
+
+	start = ri.Milliseconds();
+	count = 0;
+
+	for ( i = 0 ; i < numMaps ; i++ ) {
+		if ( maps ) {
+			Com_sprintf( mapName, sizeof( mapName ), "maps/%s", maps[i] );
+		} else {
+			Com_sprintf( mapName, sizeof( mapName ), "maps/%s", ri.Cmd_Argv( 1 ) );
+			COM_DefaultExtension( mapName, sizeof( mapName ), ".bsp" );
+		}
+
+		ri.FS_ReadFile( mapName, (void **)&header );
+		if ( !header ) {
+			ri.Printf( PRINT_WARNING, "WARNING: couldn't load %s\n", mapName );
+			continue;
+		}
+
+		if ( LittleLong( header->version ) != BSP_VERSION ) {
+			ri.Printf( PRINT_WARNING, "WARNING: %s has wrong version number\n", mapName );
+			ri.FS_FreeFile( header );
+			continue;
+		}
+
+		shaders = ( dshader_t * )( (byte *)header + LittleLong( header->lumps[LUMP_SHADERS].fileofs ) );
+		numShaders = LittleLong( header->lumps[LUMP_SHADERS].filelen ) / sizeof( *shaders );
+
+		for ( j = 0 ; j < numShaders ; j++ ) {
+			if ( LittleLong( shaders[j].surfaceFlags ) & SURF_NODRAW ) {
+				continue;
+			}
+			count += R_PrecacheShaderImages( shaders[j].shader );
+		}
+
+		ri.FS_FreeFile( header );
+		ri.Printf( PRINT_ALL, "%s: %i shaders\n", mapName, numShaders );
+	}
+
+	if ( maps ) {
+		ri.FS_FreeFileList( maps );
+	}
+
+	ri.Printf( PRINT_ALL, "%i image cache entries written in %i msec\n", count, ri.Milliseconds() - start );
+}
+
+
 //----(SA)	modified
 /*
 ===============
@@ -1260,6 +1805,10 @@ image_t *R_FindImageFileExt( const char *name, imgType_t type, imgFlags_t flags,
 	int width, height;
 	byte    *pic;
 	long hash;
+	imageCacheKey_t key;
+	qboolean cache;
+	int traceStart;
+	const char *label;
 
 	if ( !name ) {
 		return NULL;
@@ -1285,16 +1834,40 @@ image_t *R_FindImageFileExt( const char *name, imgType_t type, imgFlags_t flags,
 		}
 	}
 
+	label = ri.Hunk_SetLabel( "images" );
+
+	//
+	// try the image cache before decoding anything
+	//
+	cache = r_imageCache->integer && R_ImageCacheKey( name, flags, characterMIP, &key );
+	if ( cache ) {
+		image = R_ImageCacheLoad( &key, name, type, flags, characterMIP );
+		if ( image ) {
+			ri.Hunk_SetLabel( label );
+			return image;
+		}
+	}
+
 	//
 	// load the pic from disk
 	//
+	traceStart = ri.TraceStart();
 	R_LoadImage( name, &pic, &width, &height );
+	ri.TraceEvent( traceStart, "decode", name, width * height * 4, NULL );
 	if ( pic == NULL ) {
+		ri.Hunk_SetLabel( label );
 		return NULL;
 	}
 
+	if ( cache ) {
+		R_ImageCacheBeginCapture( width, height, qfalse );
+	}
 	image = R_CreateImageExt( ( char * ) name, pic, width, height, type, flags, 0, characterMIP );
+	if ( cache ) {
+		R_ImageCacheEndCapture( &key, width, height, image->internalFormat, image->uploadWidth, image->uploadHeight );
+	}
 	ri.Free( pic );
+	ri.Hunk_SetLabel( label );
 	return image;
 }
 
@@ -1585,6 +2158,9 @@ R_InitImages
 void    R_InitImages( void ) {
 	memset( hashTable, 0, sizeof( hashTable ) );
 
+	// any other error during a capture ends up here with the next registration
+	R_ImageCacheCancelCapture();
+
 	// build brightness translation tables
 	R_SetColorMappings();
 
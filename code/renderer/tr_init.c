@@ -68,6 +68,7 @@ cvar_t	*r_stereoSeparation;
 cvar_t  *r_zfar;
 
 cvar_t  *r_skipBackEnd;
+cvar_t  *r_backEndSlots;
 
 cvar_t	*r_stereoEnabled;
 cvar_t	*r_anaglyphMode;
@@ -94,6 +95,12 @@ cvar_t  *r_lodscale;
 cvar_t  *r_norefresh;
 cvar_t  *r_drawentities;
 cvar_t  *r_drawworld;
+cvar_t  *r_worldJobs;
+cvar_t  *r_worldVBO;
+cvar_t  *r_batchShaders;
+cvar_t  *r_mergeLightmaps;
+cvar_t  *r_imageCache;
+cvar_t  *r_shaderCache;
 cvar_t  *r_speeds;
 cvar_t  *r_fullbright;
 cvar_t  *r_novis;
@@ -188,6 +195,9 @@ cvar_t  *r_compressModels;
 cvar_t  *r_exportCompressedModels;
 cvar_t  *r_buildScript;
 cvar_t  *r_bonesDebug;
+cvar_t  *r_poseCache;
+cvar_t  *r_simdSkinning;
+cvar_t  *r_simdLerp;
 // done.
 
 // Rafael - wolf fog
@@ -1100,6 +1110,9 @@ void R_Register( void ) {
 	r_exportCompressedModels = ri.Cvar_Get( "r_exportCompressedModels", "0", 0 ); // saves compressed models
 	r_buildScript = ri.Cvar_Get( "com_buildscript", "0", 0 );
 	r_bonesDebug = ri.Cvar_Get( "r_bonesDebug", "0", CVAR_CHEAT );
+	r_poseCache = ri.Cvar_Get( "r_poseCache", "1", CVAR_ARCHIVE );
+	r_simdSkinning = ri.Cvar_Get( "r_simdSkinning", "1", CVAR_ARCHIVE );
+	r_simdLerp = ri.Cvar_Get( "r_simdLerp", "1", CVAR_ARCHIVE );
 
 	// Rafael - wolf fog
 	r_wolffog = ri.Cvar_Get( "r_wolffog", "1", 0 );
@@ -1108,6 +1121,12 @@ void R_Register( void ) {
 	r_framecap = ri.Cvar_Get( "r_framecap", "0", CVAR_ARCHIVE );
 	r_nocurves = ri.Cvar_Get( "r_nocurves", "0", CVAR_CHEAT );
 	r_drawworld = ri.Cvar_Get( "r_drawworld", "1", CVAR_CHEAT );
+	r_worldJobs = ri.Cvar_Get( "r_worldJobs", "1", CVAR_ARCHIVE );
+	r_worldVBO = ri.Cvar_Get( "r_worldVBO", "1", CVAR_ARCHIVE | CVAR_LATCH );
+	r_batchShaders = ri.Cvar_Get( "r_batchShaders", "1", CVAR_ARCHIVE );
+	r_mergeLightmaps = ri.Cvar_Get( "r_mergeLightmaps", "1", CVAR_ARCHIVE | CVAR_LATCH );
+	r_imageCache = ri.Cvar_Get( "r_imageCache", "1", CVAR_ARCHIVE | CVAR_LATCH );
+	r_shaderCache = ri.Cvar_Get( "r_shaderCache", "1", CVAR_ARCHIVE );
 	r_lightmap = ri.Cvar_Get( "r_lightmap", "0", CVAR_CHEAT );
 	r_portalOnly = ri.Cvar_Get( "r_portalOnly", "0", CVAR_CHEAT );
 
@@ -1116,6 +1135,7 @@ void R_Register( void ) {
 	r_flareCoeff = ri.Cvar_Get ("r_flareCoeff", FLARE_STDCOEFF, CVAR_CHEAT);
 
 	r_skipBackEnd = ri.Cvar_Get( "r_skipBackEnd", "0", CVAR_CHEAT );
+	r_backEndSlots = ri.Cvar_Get( "r_backEndSlots", "3", CVAR_ARCHIVE | CVAR_LATCH );
 
 	r_measureOverdraw = ri.Cvar_Get( "r_measureOverdraw", "0", CVAR_CHEAT );
 	r_lodscale = ri.Cvar_Get( "r_lodscale", "5", CVAR_CHEAT );
@@ -1163,6 +1183,9 @@ void R_Register( void ) {
 	ri.Cmd_AddCommand( "gfxinfo", GfxInfo_f );
 	ri.Cmd_AddCommand( "minimize", GLimp_Minimize );
 	ri.Cmd_AddCommand( "taginfo", R_TagInfo_f );
+	ri.Cmd_AddCommand( "skinbench", R_SkinBench_f );
+	ri.Cmd_AddCommand( "lerpbench", R_LerpBench_f );
+	ri.Cmd_AddCommand( "buildimagecache", R_BuildImageCache_f );
 
 	// Ridah
 	ri.Cmd_AddCommand( "cropimages", R_CropImages_f );
@@ -1184,9 +1207,8 @@ void R_Init( void ) {
 	// clear all our internal state
 	memset( &tr, 0, sizeof( tr ) );
 	memset( &backEnd, 0, sizeof( backEnd ) );
-	memset( &tessArray[0], 0, sizeof( tessArray[0] ) );
-	memset( &tessArray[1], 0, sizeof( tessArray[1] ) );
-	set_tessPtr(&tessArray[0]);
+	memset( tessArray, 0, sizeof( tessArray ) );
+	set_tessPtr(&tessArray[activeBackEnd]);
 
 	if(sizeof(glconfig_t) != 7268)
 		ri.Error( ERR_FATAL, "Mod ABI incompatible: sizeof(glconfig_t) == %u != 7268", (unsigned int) sizeof(glconfig_t));
@@ -1244,13 +1266,24 @@ void R_Init( void ) {
 		max_polyverts = MAX_POLYVERTS;
 	}
 
-	for (int i = 0; i < BACKEND_DATA_NUM; i++) {
+	// the render thread semaphores are sized once, so the ring length
+	// can only be picked on the first init
+	if ( !backEndSlots ) {
+		backEndSlots = r_backEndSlots->integer;
+		if ( backEndSlots < 2 ) {
+			backEndSlots = 2;
+		} else if ( backEndSlots > BACKEND_DATA_NUM ) {
+			backEndSlots = BACKEND_DATA_NUM;
+		}
+	}
+
+	for (int i = 0; i < backEndSlots; i++) {
 		ptr = ri.Hunk_Alloc( sizeof( *backEndDataPtr[i] ) + sizeof(srfPoly_t) * max_polys + sizeof(polyVert_t) * max_polyverts, h_low);
 		backEndDataPtr[i] = (backEndData_t *) ptr;
 		backEndDataPtr[i]->polys = (srfPoly_t *) ((char *) ptr + sizeof( *backEndDataPtr[i] ));
 		backEndDataPtr[i]->polyVerts = (polyVert_t *) ((char *) ptr + sizeof( *backEndDataPtr[i] ) + sizeof(srfPoly_t) * max_polys);
 	}
-	backEndData = backEndDataPtr[0];
+	backEndData = backEndDataPtr[activeBackEnd];
 
 	R_InitNextFrame();
 
@@ -1295,6 +1328,9 @@ void RE_Shutdown( qboolean destroyWindow ) {
 	ri.Cmd_RemoveCommand( "gfxinfo" );
 	ri.Cmd_RemoveCommand( "minimize" );
 	ri.Cmd_RemoveCommand( "taginfo" );
+	ri.Cmd_RemoveCommand( "skinbench" );
+	ri.Cmd_RemoveCommand( "lerpbench" );
+	ri.Cmd_RemoveCommand( "buildimagecache" );
 
 	// Ridah
 	ri.Cmd_RemoveCommand( "cropimages" );
@@ -1302,7 +1338,10 @@ void RE_Shutdown( qboolean destroyWindow ) {
 
 	if ( tr.registered ) {
 		R_IssuePendingRenderCommands();
+		R_SyncRenderThread();
 		R_DeleteTextures();
+		R_DeleteWorldVBOs();
+		R_FreeCinematicFrames();
 	}
 
 	R_DoneFreeType();
@@ -32,7 +32,10 @@ If you have questions concerning this license or the applicable additional terms
 
 #include <vitasdk.h>
 
-#define BACKEND_DATA_NUM (2)
+// maximum number of frames that can be queued between the front end and the
+// render thread, the slots actually used are selected by r_backEndSlots
+#define BACKEND_DATA_NUM (4)
+extern int backEndSlots;
 extern int activeBackEnd;
 extern int rendBackEnd;
 extern SceUID rend_mutex_in;
@@ -435,6 +438,10 @@ typedef struct shader_s {
 	shaderStage_t   *stages[MAX_SHADER_STAGES];
 
 	void ( *optimalStageIteratorFunc )( void );
+	qboolean vboStatic;                 // stages only read vertex data, so world surfaces can draw from the static VBOs
+
+	struct shader_s *batchShader;       // first registered shader with identical state, drawn in its place
+	struct shader_s *batchNext;         // batch hash chain
 
 	double clampTime;                                    // time this shader is clamped to
 	double timeOffset;                                   // current time offset for this shader
@@ -677,6 +684,10 @@ typedef struct {
 	int numPoints;
 	int numIndices;
 	int ofsIndices;
+
+	// location in the static world VBOs, vboFirstIndex -1 if not resident
+	int vboChunk;
+	int vboFirstIndex;
 	float points[1][VERTEXSIZE];        // variable sized
 										// there is a variable length list of indices here also
 } srfSurfaceFace_t;
@@ -700,6 +711,10 @@ typedef struct {
 
 	int numVerts;
 	drawVert_t      *verts;
+
+	// location in the static world VBOs, vboFirstIndex -1 if not resident
+	int vboChunk;
+	int vboFirstIndex;
 } srfTriangles_t;
 
 // inter-quake-model
@@ -806,6 +821,17 @@ typedef struct {
 	int numSurfaces;
 } bmodel_t;
 
+// static world geometry, uploaded once at load in the srfSurfaceFace_t
+// point layout (VERTEXSIZE floats); chunked so glIndex_t can address it
+#define MAX_VBO_CHUNK_VERTEXES  65536
+
+typedef struct {
+	GLuint vertexBuffer;
+	GLuint indexBuffer;
+	int numVertexes;
+	int numIndexes;
+} worldVBO_t;
+
 typedef struct {
 	char name[MAX_QPATH];               // ie: maps/tim_dm2.bsp
 	char baseName[MAX_QPATH];           // ie: tim_dm2
@@ -847,6 +873,9 @@ typedef struct {
 
 	char        *entityString;
 	char        *entityParsePoint;
+
+	int numVBOs;
+	worldVBO_t  *vbos;
 } world_t;
 
 //======================================================================
@@ -961,6 +990,13 @@ typedef struct {
 	int c_leafs;
 	int c_dlightSurfaces;
 	int c_dlightSurfacesCulled;
+
+	int c_smpStalls;            // front end found every ring slot in flight
+	int c_smpStallMsec;
+	int c_smpFramesInFlight;
+
+	int c_batchesBefore;        // shader runs in the sorted list before merging equivalent shaders
+	int c_batchesAfter;
 } frontEndCounters_t;
 
 #define FOG_TABLE_SIZE      256
@@ -991,6 +1027,14 @@ typedef struct {
 	int c_flareTests;
 	int c_flareRenders;
 
+	int c_smpIdleMsec;      // render thread waiting on the front end
+
+	int c_vboSurfaces;      // world surfaces drawn straight from the static VBOs
+	int c_vboIndexes;
+	int c_vboDraws;
+
+	int c_drawCalls;        // glDrawElements issued by the stage iterators
+
 	int msec;               // total msec for backend run
 } backEndCounters_t;
 
@@ -1059,6 +1103,7 @@ typedef struct {
 	shader_t                *sunflareShader[6];  //----(SA) for the camera lens flare effect for sun
 
 	int numLightmaps;
+	int fatLightmapCols, fatLightmapRows;         // lightmap cells per atlas, 0 when not merged
 	image_t                 **lightmaps;
 
 	trRefEntity_t           *currentEntity;
@@ -1191,6 +1236,12 @@ extern cvar_t   *r_dlightBacks;         // dlight non-facing surfaces for contin
 extern cvar_t  *r_norefresh;            // bypasses the ref rendering
 extern cvar_t  *r_drawentities;         // disable/enable entity rendering
 extern cvar_t  *r_drawworld;            // disable/enable world rendering
+extern cvar_t  *r_worldJobs;            // split the world BSP walk across the job threads
+extern cvar_t  *r_worldVBO;             // keep static world surfaces in GPU buffers
+extern cvar_t  *r_batchShaders;         // draw opaque shaders with identical state as one batch
+extern cvar_t  *r_mergeLightmaps;       // pack BSP lightmaps into atlases at load time
+extern cvar_t  *r_imageCache;           // keep processed images in imagecache/ across level loads
+extern cvar_t  *r_shaderCache;          // keep the scanned shader scripts in shadercache.dat
 extern cvar_t  *r_speeds;               // various levels of information display
 extern cvar_t  *r_detailTextures;       // enables/disables detail texturing stages
 extern cvar_t  *r_novis;                // disable/enable usage of PVS
@@ -1269,6 +1320,7 @@ extern cvar_t  *r_portalOnly;
 extern cvar_t  *r_subdivisions;
 extern cvar_t  *r_lodCurveError;
 extern cvar_t  *r_skipBackEnd;
+extern cvar_t  *r_backEndSlots;        // number of frames queued for the render thread
 
 extern	cvar_t	*r_stereoEnabled;
 extern	cvar_t	*r_anaglyphMode;
@@ -1293,6 +1345,9 @@ extern cvar_t	*r_marksOnTriangleMeshes;
 
 // Ridah
 extern cvar_t  *r_bonesDebug;
+extern cvar_t  *r_poseCache;            // share built MDS poses between views and entities
+extern cvar_t  *r_simdSkinning;         // vectorized MDS vertex skinning
+extern cvar_t  *r_simdLerp;             // vectorized MD3/MDC vertex interpolation
 // done.
 
 // Rafael - wolf fog
@@ -1316,6 +1371,11 @@ void R_AddRailSurfaces( trRefEntity_t *e, qboolean isUnderwater );
 void R_AddLightningBoltSurfaces( trRefEntity_t *e );
 
 void R_TagInfo_f( void );
+void R_SkinBench_f( void );
+void R_LerpBench_f( void );
+float R_BenchCompareVertexes( const float *a, const float *b, int numVerts );
+void RB_LerpRecordEndFrame( void );
+void R_ClearLerpRecords( void );
 
 void R_AddPolygonSurfaces( void );
 
@@ -1398,6 +1458,8 @@ qhandle_t   RE_RegisterSkin( const char *name );
 void        RE_Shutdown( qboolean destroyWindow );
 
 qboolean    R_GetEntityToken( char *buffer, int size );
+void        R_DeleteWorldVBOs( void );
+void        R_FreeCinematicFrames( void );
 
 //----(SA)
 qboolean    RE_GetSkinModel( qhandle_t skinid, const char *type, char *name );
@@ -1420,6 +1482,8 @@ void        R_SetColorMappings( void );
 void        R_GammaCorrect( byte *buffer, int bufSize );
 
 void    R_ImageList_f( void );
+void    R_BuildImageCache_f( void );
+qboolean R_BuildImageCacheEntry( const char *name, imgFlags_t flags, qboolean characterMip );
 void    R_SkinList_f( void );
 // https://zerowing.idsoftware.com/bugzilla/show_bug.cgi?id=516
 const void *RB_TakeScreenshotCmd( const void *data );
@@ -1451,6 +1515,7 @@ shader_t    *R_GetShaderByState( int index, long *cycleTime );
 shader_t *R_FindShaderByName( const char *name );
 void        R_InitShaders( void );
 void        R_ShaderList_f( void );
+int         R_PrecacheShaderImages( const char *name );
 void    R_RemapShader( const char *oldShader, const char *newShader, const char *timeOffset );
 
 /*
@@ -1488,6 +1553,8 @@ typedef struct stageVars
 	vec2_t texcoords[NUM_TEXTURE_BUNDLES][SHADER_MAX_VERTEXES];
 } stageVars_t;
 
+#define MAX_VBO_RANGES  1024
+
 typedef struct shaderCommands_s
 {
 	glIndex_t	indexes[SHADER_MAX_INDEXES] QALIGN(16);
@@ -1510,6 +1577,11 @@ typedef struct shaderCommands_s
 	int numIndexes;
 	int numVertexes;
 
+	// index ranges of surfaces drawn from the static world VBOs
+	int vboChunk;
+	int numVboRanges;
+	int vboRanges[MAX_VBO_RANGES][2];       // first index, count
+
 	qboolean ATI_tess;
 
 	// info extracted from current shader
@@ -1535,6 +1607,7 @@ void RB_SetGL2D (void);
 void RB_BeginSurface( shader_t *shader, int fogNum );
 void RB_EndSurface( void );
 void RB_CheckOverflow( int verts, int indexes );
+qboolean RB_AddVBORange( int chunk, int firstIndex, int numIndexes, int dlightBits );
 #define RB_CHECKOVERFLOW( v,i ) if ( tess.numVertexes + ( v ) >= SHADER_MAX_VERTEXES || tess.numIndexes + ( i ) >= SHADER_MAX_INDEXES ) {RB_CheckOverflow( v,i );}
 
 void RB_StageIteratorGeneric( void );
@@ -1695,6 +1768,14 @@ ANIMATED MODELS
 
 void R_AddAnimSurfaces( trRefEntity_t *ent );
 void RB_SurfaceAnim( mdsSurface_t *surfType );
+void R_ClearPoseCache( void );
+
+typedef struct {
+	int hits;
+	int misses;
+} poseCacheStats_t;
+
+extern poseCacheStats_t poseCacheStats;
 int R_GetBoneTag( orientation_t *outTag, mdsHeader_t *mds, int startTagIndex, const refEntity_t *refent, const char *tagName );
 void R_MDRAddAnimSurfaces( trRefEntity_t *ent );
 void RB_MDRSurfaceAnim( mdrSurface_t *surface );
@@ -1905,6 +1986,9 @@ typedef struct {
 	srfPoly_t *polys;//[MAX_POLYS];
 	polyVert_t *polyVerts;//[MAX_POLYVERTS];
 	renderCommandList_t commands;
+	int frameNum;                   // sequence number assigned when the slot is submitted
+	volatile int fence;             // set to frameNum by the render thread once executed
+	backEndCounters_t pc;           // what the render thread counted running this slot
 } backEndData_t;
 
 extern int max_polys;
@@ -1917,6 +2001,7 @@ void *R_GetCommandBuffer( int bytes );
 void RB_ExecuteRenderCommands( const void *data );
 
 void R_IssuePendingRenderCommands( void );
+void R_SyncRenderThread( void );
 
 void R_AddDrawSurfCmd( drawSurf_t *drawSurfs, int numDrawSurfs );
 
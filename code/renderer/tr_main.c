@@ -1454,6 +1454,66 @@ void R_DecomposeSort( unsigned sort, int *entityNum, shader_t **shader,
 	*atiTess = ( sort >> QSORT_ATI_TESS_SHIFT ) & 1;
 }
 
+/*
+=================
+R_CountDrawSurfBatches
+
+Number of times the back end will have to flush tess for the sorted list,
+not counting entityMergable shaders or overflows
+=================
+*/
+static int R_CountDrawSurfBatches( drawSurf_t *drawSurfs, int numDrawSurfs ) {
+	int i, batches;
+
+	for ( i = 1, batches = 1; i < numDrawSurfs; i++ ) {
+		if ( drawSurfs[i].sort != drawSurfs[i - 1].sort ) {
+			batches++;
+		}
+	}
+	return batches;
+}
+
+/*
+=================
+R_BatchDrawSurfs
+
+Moves the opaque surfaces of shaders with identical state onto one
+representative shader and sorts again, so they come out of the back end
+as a single index stream instead of one batch per shader
+=================
+*/
+static void R_BatchDrawSurfs( drawSurf_t *drawSurfs, int numDrawSurfs ) {
+	shader_t    *shader, *batch;
+	int i, numOpaque, merged;
+
+	tr.pc.c_batchesBefore += R_CountDrawSurfBatches( drawSurfs, numDrawSurfs );
+
+	merged = 0;
+	for ( i = 0; i < numDrawSurfs; i++ ) {
+		shader = tr.sortedShaders[( drawSurfs[i].sort >> QSORT_SHADERNUM_SHIFT ) & ( MAX_SHADERS - 1 )];
+		if ( shader->sort > SS_OPAQUE ) {
+			break;      // blended surfaces keep their order
+		}
+
+		batch = shader->batchShader;
+		if ( !batch || batch == shader || shader->remappedShader || batch->remappedShader ) {
+			continue;
+		}
+
+		drawSurfs[i].sort = ( drawSurfs[i].sort & ~( (unsigned)( MAX_SHADERS - 1 ) << QSORT_SHADERNUM_SHIFT ) )
+							| ( batch->sortedIndex << QSORT_SHADERNUM_SHIFT );
+		merged++;
+	}
+	numOpaque = i;
+
+	// the representative has the same sort value, so the opaque surfaces stay in front
+	if ( merged ) {
+		R_RadixSort( drawSurfs, numOpaque );
+	}
+
+	tr.pc.c_batchesAfter += R_CountDrawSurfBatches( drawSurfs, numDrawSurfs );
+}
+
 /*
 =================
 R_SortDrawSurfs
@@ -1478,6 +1538,10 @@ void R_SortDrawSurfs( drawSurf_t *drawSurfs, int numDrawSurfs ) {
 	// sort the drawsurfs by sort type, then orientation, then shader
 	R_RadixSort( drawSurfs, numDrawSurfs );
 
+	if ( r_batchShaders->integer ) {
+		R_BatchDrawSurfs( drawSurfs, numDrawSurfs );
+	}
+
 	// check for any pass through drawing, which
 	// may cause another view to be rendered first
 	for ( i = 0 ; i < numDrawSurfs ; i++ ) {
@@ -356,6 +356,8 @@ qhandle_t RE_RegisterModel( const char *name ) {
 	char		localName[ MAX_QPATH ];
 	const char	*ext;
 	char		altName[ MAX_QPATH ];
+	int			traceStart;
+	const char	*label;
 
 	if ( !name || !name[0] ) {
 		// Ridah, disabled this, we can see models that can't be found because they won't be there
@@ -381,10 +383,13 @@ qhandle_t RE_RegisterModel( const char *name ) {
 		}
 	}
 
+	label = ri.Hunk_SetLabel( "models" );
+
 	// allocate a new model_t
 
 	if ( ( mod = R_AllocModel() ) == NULL ) {
 		ri.Printf( PRINT_WARNING, "RE_RegisterModel: R_AllocModel() failed for '%s'\n", name );
+		ri.Hunk_SetLabel( label );
 		return 0;
 	}
 
@@ -404,6 +409,8 @@ qhandle_t RE_RegisterModel( const char *name ) {
 	mod->type = MOD_BAD;
 	mod->numLods = 0;
 
+	traceStart = ri.TraceStart();
+
 	//
 	// load the files
 	//
@@ -436,6 +443,8 @@ qhandle_t RE_RegisterModel( const char *name ) {
 			else
 			{
 				// Something loaded
+				ri.Hunk_SetLabel( label );
+				ri.TraceEvent( traceStart, "decode", name, mod->dataSize, NULL );
 				return mod->index;
 			}
 		}
@@ -464,7 +473,9 @@ qhandle_t RE_RegisterModel( const char *name ) {
 			break;
 		}
 	}
-	
+
+	ri.Hunk_SetLabel( label );
+	ri.TraceEvent( traceStart, "decode", name, mod->dataSize, NULL );
 	return hModel;
 }
 
@@ -1836,6 +1847,10 @@ void R_ModelInit( void ) {
 	// leave a space for NULL model
 	tr.numModels = 0;
 
+	// cached poses and recorded lerps point into model data
+	R_ClearPoseCache();
+	R_ClearLerpRecords();
+
 	mod = R_AllocModel();
 	mod->type = MOD_BAD;
 }
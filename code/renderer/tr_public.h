@@ -141,6 +141,7 @@ typedef struct {
 #endif
 	void    *( *Hunk_AllocateTempMemory )( int size );
 	void ( *Hunk_FreeTempMemory )( void *block );
+	const char *( *Hunk_SetLabel )( const char *label );
 
 	void    *( *Z_Malloc )( int bytes );
 	void ( *Free )( void *buf );
@@ -168,6 +169,7 @@ typedef struct {
 	// a -1 return means the file does not exist
 	// NULL can be passed for buf to just determine existance
 	int ( *FS_FileIsInPAK )( const char *name, int *pChecksum );
+	int ( *FS_FilePakChecksum )( const char *name, int *pChecksum );
 	long ( *FS_ReadFile )( const char *name, void **buf );
 	void ( *FS_FreeFile )( void *buf );
 	char ** ( *FS_ListFiles )( const char *name, const char *extension, int *numfilesfound );
@@ -195,6 +197,19 @@ typedef struct {
 	void	(*Sys_GLimpSafeInit)( void );
 	void	(*Sys_GLimpInit)( void );
 	qboolean (*Sys_LowPhysicalMemory)( void );
+
+	// job system
+	void	(*AddJob)( jobFunc_t func, void *data );
+	void	(*WaitJobs)( void );
+	int		(*JobThreads)( void );
+
+	// load tracing
+	int		(*TraceStart)( void );
+	void	(*TraceEvent)( int start, const char *cat, const char *name, int size, const char *pak );
+
+	// kernel benchmarks
+	qboolean (*BenchArgs)( const char *unit, int defaultCount, int maxCount, int *count, int *msec );
+	void	(*Benchmark)( benchmark_t *b );
 } refimport_t;
 
 
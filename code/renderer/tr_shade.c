@@ -63,7 +63,112 @@ without compiled vertex arrays.
 ==================
 */
 static void R_DrawElements( int numIndexes, const glIndex_t *indexes ) {
+	if ( !numIndexes ) {
+		return;     // the whole batch may be in the static world VBOs
+	}
 	qglDrawElements( GL_TRIANGLES, numIndexes, GL_INDEX_TYPE, indexes );
+	backEnd.pc.c_drawCalls++;
+}
+
+#define VBO_OFFSET( bytes ) ( (void *)(intptr_t)( bytes ) )
+
+/*
+===================
+RB_StaticStageColor
+
+The single color a vboStatic stage without vertex colors resolves to,
+matching what ComputeColors writes for every vertex
+===================
+*/
+static void RB_StaticStageColor( shaderStage_t *pStage, byte *color ) {
+	switch ( pStage->rgbGen ) {
+	case CGEN_IDENTITY:
+		color[0] = color[1] = color[2] = color[3] = 0xff;
+		break;
+	case CGEN_CONST:
+		*(int *)color = *(int *)pStage->constantColor;
+		break;
+	default:
+	case CGEN_IDENTITY_LIGHTING:
+		color[0] = color[1] = color[2] = color[3] = tr.identityLightByte;
+		break;
+	}
+
+	switch ( pStage->alphaGen ) {
+	case AGEN_IDENTITY:
+		color[3] = 0xff;
+		break;
+	case AGEN_CONST:
+		color[3] = pStage->constantColor[3];
+		break;
+	default:
+		break;
+	}
+}
+
+/*
+===================
+RB_DrawVBORanges
+
+Draws the part of the batch that lives in the static world VBOs, using the
+textures and state the stage already set up, then points the arrays back
+at tess for whatever draws next
+===================
+*/
+static void RB_DrawVBORanges( shaderCommands_t *input, shaderStage_t *pStage, qboolean multitexture ) {
+	worldVBO_t *vbo;
+	byte color[4];
+	qboolean vertexColor;
+	int i, stride;
+
+	if ( !input->numVboRanges ) {
+		return;
+	}
+
+	vbo = &tr.world->vbos[input->vboChunk];
+	stride = VERTEXSIZE * sizeof( float );
+
+	qglBindBuffer( GL_ARRAY_BUFFER, vbo->vertexBuffer );
+	qglBindBuffer( GL_ELEMENT_ARRAY_BUFFER, vbo->indexBuffer );
+
+	// points are xyz, st, lightmap st, color bytes
+	qglVertexPointer( 3, GL_FLOAT, stride, VBO_OFFSET( 0 ) );
+	if ( multitexture ) {
+		GL_SelectTexture( 1 );
+		qglTexCoordPointer( 2, GL_FLOAT, stride, VBO_OFFSET( ( pStage->bundle[1].tcGen == TCGEN_LIGHTMAP ? 5 : 3 ) * sizeof( float ) ) );
+		GL_SelectTexture( 0 );
+	}
+	qglTexCoordPointer( 2, GL_FLOAT, stride, VBO_OFFSET( ( pStage->bundle[0].tcGen == TCGEN_LIGHTMAP ? 5 : 3 ) * sizeof( float ) ) );
+
+	vertexColor = ( pStage->rgbGen == CGEN_VERTEX || pStage->rgbGen == CGEN_EXACT_VERTEX );
+	if ( vertexColor ) {
+		qglColorPointer( 4, GL_UNSIGNED_BYTE, stride, VBO_OFFSET( 7 * sizeof( float ) ) );
+	} else {
+		RB_StaticStageColor( pStage, color );
+		qglDisableClientState( GL_COLOR_ARRAY );
+		qglColor4f( color[0] / 255.0f, color[1] / 255.0f, color[2] / 255.0f, color[3] / 255.0f );
+	}
+
+	for ( i = 0; i < input->numVboRanges; i++ ) {
+		qglDrawElements( GL_TRIANGLES, input->vboRanges[i][1], GL_INDEX_TYPE, VBO_OFFSET( input->vboRanges[i][0] * sizeof( glIndex_t ) ) );
+		backEnd.pc.c_vboIndexes += input->vboRanges[i][1];
+	}
+	backEnd.pc.c_vboDraws += input->numVboRanges;
+	backEnd.pc.c_drawCalls += input->numVboRanges;
+
+	qglBindBuffer( GL_ARRAY_BUFFER, 0 );
+	qglBindBuffer( GL_ELEMENT_ARRAY_BUFFER, 0 );
+
+	qglVertexPointer( 3, GL_FLOAT, 16, input->xyz );
+	qglColorPointer( 4, GL_UNSIGNED_BYTE, 0, input->svars.colors );
+	if ( !vertexColor ) {
+		qglEnableClientState( GL_COLOR_ARRAY );
+	}
+	qglTexCoordPointer( 2, GL_FLOAT, 0, input->svars.texcoords[0] );
+	if ( multitexture ) {
+		GL_SelectTexture( 1 );
+		qglTexCoordPointer( 2, GL_FLOAT, 0, input->svars.texcoords[1] );
+	}
 }
 
 
@@ -211,6 +316,7 @@ void RB_BeginSurface( shader_t *shader, int fogNum ) {
 	tess.shader = state;
 	tess.fogNum = fogNum;
 	tess.dlightBits = 0;        // will be OR'd in by surface functions
+	tess.numVboRanges = 0;
 	tess.xstages = state->stages;
 	tess.numPasses = state->numUnfoggedPasses;
 	tess.currentStageIteratorFunc = state->optimalStageIteratorFunc;
@@ -282,6 +388,7 @@ static void DrawMultitextured( shaderCommands_t *input, int stage ) {
 	R_BindAnimatedImage( &pStage->bundle[1] );
 
 	R_DrawElements( input->numIndexes, input->indexes );
+	RB_DrawVBORanges( input, pStage, qtrue );
 
 	//
 	// disable texturing on TEXTURE1, then select TEXTURE0
@@ -1053,6 +1160,7 @@ static void RB_IterateStagesGeneric( shaderCommands_t *input ) {
 			// draw
 			//
 			R_DrawElements( input->numIndexes, input->indexes );
+			RB_DrawVBORanges( input, pStage, qfalse );
 		}
 		// allow skipping out to show just lightmaps during development
 		if ( r_lightmap->integer && ( pStage->bundle[0].isLightmap || pStage->bundle[1].isLightmap ) ) {
@@ -1299,6 +1407,7 @@ void RB_StageIteratorLightmappedMultitexture( void ) {
 	qglTexCoordPointer( 2, GL_FLOAT, 16, tess.texCoords[0][1] );
 
 	R_DrawElements( input->numIndexes, input->indexes );
+	RB_DrawVBORanges( input, tess.xstages[0], qtrue );
 	
 	//
 	// disable texturing on TEXTURE1, then select TEXTURE0
@@ -1336,7 +1445,7 @@ void RB_EndSurface( void ) {
 
 	input = &tess;
 
-	if ( input->numIndexes == 0 ) {
+	if ( input->numIndexes == 0 && input->numVboRanges == 0 ) {
 		return;
 	}
 
@@ -1400,6 +1509,7 @@ void RB_EndSurface( void ) {
 
 	// clear shader so we can tell we don't have any unclosed surfaces
 	tess.numIndexes = 0;
+	tess.numVboRanges = 0;
 
 	GLimp_LogComment( "----------\n" );
 }
@@ -41,18 +41,22 @@ static texModInfo_t texMods[MAX_SHADER_STAGES][TR_MAX_TEXMODS];
 #define FILE_HASH_SIZE      4096
 
 static shader_t*       hashTable[FILE_HASH_SIZE];
+static shader_t*       batchHashTable[FILE_HASH_SIZE];
 
-// Ridah
-// Table containing string indexes for each shader found in the scripts, referenced by their checksum
-// values.
-typedef struct shaderStringPointer_s
-{
-	char *pStr;
-	struct shaderStringPointer_s *next;
-} shaderStringPointer_t;
-//
-shaderStringPointer_t shaderChecksumLookup[FILE_HASH_SIZE];
-// done.
+// index of every shader definition in s_shaderText, built while scanning the scripts
+typedef struct {
+	int nameOffset;                 // of the shader name in s_shaderText
+	int nameLength;
+	int textOffset;                 // just past the name, where ParseShader starts
+	unsigned hash;
+	int next;                       // next entry in the hash chain, -1 ends it
+} shaderTextEntry_t;
+
+#define SHADERTEXT_HASH_SIZE    8192
+
+static int shaderTextHash[SHADERTEXT_HASH_SIZE];
+static shaderTextEntry_t *shaderTextEntries;
+static int numShaderTextEntries;
 
 /*
 ================
@@ -87,6 +91,27 @@ static long generateHashValue( const char *fname ) {
 	return hash;
 }
 
+/*
+================
+ShaderNameHash
+
+Case insensitive like the Q_stricmp name compares
+================
+*/
+static unsigned ShaderNameHash( const char *name, int len ) {
+	unsigned hash = 2166136261u;
+	int i, c;
+
+	for ( i = 0 ; i < len ; i++ ) {
+		c = name[i];
+		if ( c >= 'A' && c <= 'Z' ) {
+			c += 'a' - 'A';
+		}
+		hash = ( hash ^ (byte)c ) * 16777619u;
+	}
+	return hash;
+}
+
 void R_RemapShader( const char *shaderName, const char *newShaderName, const char *timeOffset ) {
 	char strippedName[MAX_QPATH];
 	int hash;
@@ -1838,6 +1863,71 @@ static void ComputeStageIteratorFunc( void ) {
 	}
 }
 
+/*
+===================
+ComputeVBOStatic
+
+A shader can draw world surfaces straight from the static VBOs when none of
+its stages generate vertex data on the CPU: texture and lightmap coordinates
+without tcMods, and colors that are either constant or the raw vertex colors
+===================
+*/
+static qboolean ComputeVBOStatic( void ) {
+	shaderStage_t *pStage;
+	int stage, b;
+
+	if ( shader.optimalStageIteratorFunc != RB_StageIteratorGeneric
+		 && shader.optimalStageIteratorFunc != RB_StageIteratorLightmappedMultitexture ) {
+		return qfalse;
+	}
+	if ( shader.isSky || shader.numDeforms || !shader.numUnfoggedPasses ) {
+		return qfalse;
+	}
+
+	for ( stage = 0; stage < shader.numUnfoggedPasses; stage++ ) {
+		pStage = &stages[stage];
+
+		switch ( pStage->rgbGen ) {
+		case CGEN_IDENTITY:
+		case CGEN_IDENTITY_LIGHTING:
+		case CGEN_CONST:
+			if ( pStage->alphaGen != AGEN_IDENTITY && pStage->alphaGen != AGEN_SKIP && pStage->alphaGen != AGEN_CONST ) {
+				return qfalse;
+			}
+			break;
+		case CGEN_VERTEX:
+			if ( tr.identityLight != 1 ) {
+				return qfalse;
+			}
+			if ( pStage->alphaGen != AGEN_IDENTITY && pStage->alphaGen != AGEN_SKIP && pStage->alphaGen != AGEN_VERTEX ) {
+				return qfalse;
+			}
+			break;
+		case CGEN_EXACT_VERTEX:
+			if ( pStage->alphaGen != AGEN_SKIP && pStage->alphaGen != AGEN_VERTEX ) {
+				return qfalse;
+			}
+			break;
+		default:
+			return qfalse;
+		}
+
+		for ( b = 0; b < NUM_TEXTURE_BUNDLES; b++ ) {
+			if ( !pStage->bundle[b].image[0] ) {
+				continue;
+			}
+			if ( pStage->bundle[b].tcGen != TCGEN_TEXTURE && pStage->bundle[b].tcGen != TCGEN_LIGHTMAP ) {
+				return qfalse;
+			}
+			if ( pStage->bundle[b].numTexMods ) {
+				return qfalse;
+			}
+		}
+	}
+
+	return qtrue;
+}
+
 typedef struct {
 	int blendA;
 	int blendB;
@@ -2091,6 +2181,98 @@ static void SortNewShader( void ) {
 }
 
 
+/*
+====================
+StagesEqual
+====================
+*/
+static qboolean StagesEqual( const shaderStage_t *a, const shaderStage_t *b ) {
+	const textureBundle_t *ba, *bb;
+	int i, j;
+
+	if ( a->stateBits != b->stateBits || a->rgbGen != b->rgbGen || a->alphaGen != b->alphaGen
+		 || *(int *)a->constantColor != *(int *)b->constantColor || a->adjustColorsForFog != b->adjustColorsForFog
+		 || a->isDetail != b->isDetail || a->isFogged != b->isFogged ) {
+		return qfalse;
+	}
+	if ( memcmp( &a->rgbWave, &b->rgbWave, sizeof( a->rgbWave ) ) || memcmp( &a->alphaWave, &b->alphaWave, sizeof( a->alphaWave ) )
+		 || a->zFadeBounds[0] != b->zFadeBounds[0] || a->zFadeBounds[1] != b->zFadeBounds[1] ) {
+		return qfalse;
+	}
+
+	for ( i = 0; i < NUM_TEXTURE_BUNDLES; i++ ) {
+		ba = &a->bundle[i];
+		bb = &b->bundle[i];
+
+		if ( ba->numTexMods || bb->numTexMods ) {
+			return qfalse;
+		}
+		if ( ba->numImageAnimations != bb->numImageAnimations || ba->imageAnimationSpeed != bb->imageAnimationSpeed
+			 || ba->tcGen != bb->tcGen || ba->isLightmap != bb->isLightmap || ba->isVideoMap != bb->isVideoMap
+			 || ba->videoMapHandle != bb->videoMapHandle ) {
+			return qfalse;
+		}
+		if ( memcmp( ba->tcGenVectors, bb->tcGenVectors, sizeof( ba->tcGenVectors ) ) ) {
+			return qfalse;
+		}
+		for ( j = 0; j < MAX( ba->numImageAnimations, 1 ); j++ ) {
+			if ( ba->image[j] != bb->image[j] ) {
+				return qfalse;
+			}
+		}
+	}
+
+	return qtrue;
+}
+
+/*
+====================
+FindBatchShader
+
+Opaque shaders whose state is identical apart from the name or lightmap
+number, e.g. the same texture on surfaces that share a lightmap atlas,
+can be drawn as one batch. Returns the first such shader registered, or
+the shader itself.
+====================
+*/
+static shader_t *FindBatchShader( shader_t *newShader ) {
+	shader_t *sh;
+	int i, hash;
+
+	if ( newShader->isSky || newShader->numDeforms || newShader->defaultShader || !newShader->numUnfoggedPasses
+		 || newShader->sort > SS_OPAQUE || newShader->sort == SS_PORTAL ) {
+		return newShader;
+	}
+
+	hash = ( (intptr_t)newShader->stages[0]->bundle[0].image[0] >> 4 ) ^ newShader->stages[0]->stateBits ^ newShader->numUnfoggedPasses;
+	hash &= FILE_HASH_SIZE - 1;
+
+	for ( sh = batchHashTable[hash]; sh; sh = sh->batchNext ) {
+		if ( sh->sort != newShader->sort || sh->numUnfoggedPasses != newShader->numUnfoggedPasses
+			 || sh->optimalStageIteratorFunc != newShader->optimalStageIteratorFunc || sh->vboStatic != newShader->vboStatic
+			 || sh->cullType != newShader->cullType || sh->polygonOffset != newShader->polygonOffset
+			 || sh->multitextureEnv != newShader->multitextureEnv || sh->fogPass != newShader->fogPass
+			 || sh->noFog != newShader->noFog || sh->entityMergable != newShader->entityMergable
+			 || sh->surfaceFlags != newShader->surfaceFlags || sh->contentFlags != newShader->contentFlags
+			 || sh->needsNormal != newShader->needsNormal || sh->portalRange != newShader->portalRange
+			 || sh->clampTime != newShader->clampTime || sh->timeOffset != newShader->timeOffset ) {
+			continue;
+		}
+		for ( i = 0; i < sh->numUnfoggedPasses; i++ ) {
+			if ( !StagesEqual( sh->stages[i], newShader->stages[i] ) ) {
+				break;
+			}
+		}
+		if ( i == sh->numUnfoggedPasses ) {
+			return sh;
+		}
+	}
+
+	newShader->batchNext = batchHashTable[hash];
+	batchHashTable[hash] = newShader;
+	return newShader;
+}
+
 /*
 ====================
 GeneratePermanentShader
@@ -2100,12 +2282,15 @@ static shader_t *GeneratePermanentShader( void ) {
 	shader_t    *newShader;
 	int i, b;
 	int size, hash;
+	const char *label;
 
 	if ( tr.numShaders == MAX_SHADERS ) {
 		ri.Printf( PRINT_WARNING, "WARNING: GeneratePermanentShader - MAX_SHADERS hit\n" );
 		return tr.defaultShader;
 	}
 
+	label = ri.Hunk_SetLabel( "shaders" );
+
 	newShader = ri.Hunk_Alloc( sizeof( shader_t ), h_low );
 
 	*newShader = shader;
@@ -2151,6 +2336,9 @@ static shader_t *GeneratePermanentShader( void ) {
 	newShader->next = hashTable[hash];
 	hashTable[hash] = newShader;
 
+	newShader->batchShader = FindBatchShader( newShader );
+
+	ri.Hunk_SetLabel( label );
 	return newShader;
 }
 
@@ -2446,6 +2634,7 @@ static shader_t *FinishShader( void ) {
 
 	// determine which stage iterator function is appropriate
 	ComputeStageIteratorFunc();
+	shader.vboStatic = ComputeVBOStatic();
 
 	// RF default back to no compression for next shader
 	if ( r_ext_compressed_textures->integer == 2 ) {
@@ -2461,8 +2650,8 @@ static shader_t *FinishShader( void ) {
 ====================
 FindShaderInShaderText
 
-Scans the combined text description of all the shader files for
-the given shader name.
+Looks the given shader name up in the index built from the combined
+text description of all the shader files.
 
 return NULL if not found
 
@@ -2470,57 +2659,24 @@ If found, it will return a valid shader
 =====================
 */
 static char *FindShaderInShaderText( const char *shadername ) {
-	char *p = s_shaderText;
-	char *token;
+	shaderTextEntry_t *entry;
+	unsigned hash;
+	int len, i;
 
-	if ( !p ) {
+	if ( !s_shaderText ) {
 		return NULL;
 	}
 
-	// Ridah, optimized shader loading
-	{
-		shaderStringPointer_t *pShaderString;
-		unsigned short int checksum;
-
-		checksum = generateHashValue( shadername );
+	len = strlen( shadername );
+	hash = ShaderNameHash( shadername, len );
 
-		// if it's known, skip straight to it's position
-		pShaderString = &shaderChecksumLookup[checksum];
-		while ( pShaderString && pShaderString->pStr ) {
-			p = pShaderString->pStr;
-
-			token = COM_ParseExt( &p, qtrue );
-
-			if ( ( token[0] != 0 ) && !Q_stricmp( token, shadername ) ) {
-				return p;
-			}
-
-			pShaderString = pShaderString->next;
-		}
-	}
-	// done.
-
-	/*
-	// look for label
-	// note that this could get confused if a shader name is used inside
-	// another shader definition
-	while ( 1 ) {
-		token = COM_ParseExt( &p, qtrue );
-		if ( token[0] == 0 ) {
-			break;
-		}
-
-		if ( token[0] == '{' ) {
-			// skip the definition
-			SkipBracedSection( &p, 0 );
-		} else if ( !Q_stricmp( token, shadername ) ) {
-			return p;
-		} else {
-			// skip to end of line
-			SkipRestOfLine( &p );
+	for ( i = shaderTextHash[hash & ( SHADERTEXT_HASH_SIZE - 1 )] ; i >= 0 ; i = entry->next ) {
+		entry = &shaderTextEntries[i];
+		if ( entry->hash == hash && entry->nameLength == len
+			 && !Q_stricmpn( s_shaderText + entry->nameOffset, shadername, len ) ) {
+			return s_shaderText + entry->textOffset;
 		}
 	}
-	*/
 
 	return NULL;
 }
@@ -2746,6 +2902,124 @@ shader_t *R_FindShader( const char *name, int lightmapIndex, qboolean mipRawImag
 	return FinishShader();
 }
 
+/*
+===============
+R_PrecacheShaderImages
+
+Writes the image cache entries for every image the shader would load,
+without creating the shader or any texture. Follows the image flags
+ParseShader and ParseStage would pick, so the entries match the real
+loads later on. Returns the number of entries written.
+===============
+*/
+int R_PrecacheShaderImages( const char *name ) {
+	static char *suf[6] = {"rt", "bk", "lf", "ft", "up", "dn"};
+	char strippedName[MAX_QPATH];
+	char pathname[MAX_QPATH];
+	char        *text, *token;
+	qboolean noMipMaps = qfalse, noPicMip = qfalse, characterMip = qfalse;
+	imgFlags_t flags;
+	int depth, count, i;
+
+	COM_StripExtension( name, strippedName, sizeof( strippedName ) );
+
+	text = FindShaderInShaderText( strippedName );
+	if ( !text ) {
+		// a single image, the way R_FindShader loads world surfaces
+		return R_BuildImageCacheEntry( name, IMGFLAG_MIPMAP | IMGFLAG_PICMIP, qfalse ) ? 1 : 0;
+	}
+
+	count = 0;
+	depth = 0;
+	while ( 1 ) {
+		token = COM_ParseExt( &text, qtrue );
+		if ( !token[0] ) {
+			break;
+		}
+
+		if ( token[0] == '{' ) {
+			depth++;
+			continue;
+		}
+		if ( token[0] == '}' ) {
+			if ( --depth <= 0 ) {
+				break;
+			}
+			continue;
+		}
+
+		flags = IMGFLAG_NONE;
+		if ( !noMipMaps ) {
+			flags |= IMGFLAG_MIPMAP;
+		}
+		if ( !noPicMip ) {
+			flags |= IMGFLAG_PICMIP;
+		}
+
+		if ( depth == 1 ) {
+			if ( !Q_stricmp( token, "nomipmaps" ) ) {
+				noMipMaps = noPicMip = qtrue;
+			} else if ( !Q_stricmp( token, "nopicmip" ) ) {
+				noPicMip = qtrue;
+			} else if ( !Q_stricmp( token, "picmip2" ) ) {
+				characterMip = qtrue;
+			} else if ( !Q_stricmp( token, "allowcompress" ) ) {
+				tr.allowCompress = qtrue;
+			} else if ( !Q_stricmp( token, "nocompress" ) ) {
+				tr.allowCompress = -1;
+			} else if ( !Q_stricmp( token, "skyParms" ) ) {
+				token = COM_ParseExt( &text, qfalse );
+				if ( token[0] && strcmp( token, "-" ) ) {
+					for ( i = 0 ; i < 6 ; i++ ) {
+						Com_sprintf( pathname, sizeof( pathname ), "%s_%s.tga", token, suf[i] );
+						count += R_BuildImageCacheEntry( pathname, IMGFLAG_MIPMAP | IMGFLAG_PICMIP | IMGFLAG_CLAMPTOEDGE, qfalse );
+					}
+				}
+			}
+			SkipRestOfLine( &text );
+			continue;
+		}
+
+		// stage keywords, with the same map16/map32/mapcomp/mapnocomp choices as ParseStage
+		if ( ( !Q_stricmp( token, "map16" ) && glConfig.colorBits <= 16 )
+			 || ( !Q_stricmp( token, "map32" ) && glConfig.colorBits > 16 )
+			 || ( !Q_stricmp( token, "mapcomp" ) && glConfig.textureCompression && r_ext_compressed_textures->integer )
+			 || ( !Q_stricmp( token, "mapnocomp" ) && !glConfig.textureCompression ) ) {
+			token = "map";
+		} else if ( ( !Q_stricmp( token, "animmapcomp" ) && glConfig.textureCompression && r_ext_compressed_textures->integer )
+					|| ( !Q_stricmp( token, "animmapnocomp" ) && !glConfig.textureCompression ) ) {
+			token = "animmap";
+		}
+
+		if ( !Q_stricmp( token, "map" ) || !Q_stricmp( token, "clampmap" ) ) {
+			if ( !Q_stricmp( token, "clampmap" ) ) {
+				flags |= IMGFLAG_CLAMPTOEDGE;
+			}
+			token = COM_ParseExt( &text, qfalse );
+			if ( token[0] && token[0] != '$' && Q_stricmp( token, "*white" ) ) {
+				count += R_BuildImageCacheEntry( token, flags, characterMip );
+			}
+		} else if ( !Q_stricmp( token, "animMap" ) ) {
+			COM_ParseExt( &text, qfalse );      // frequency
+			for ( i = 0 ; i < MAX_IMAGE_ANIMATIONS ; i++ ) {
+				token = COM_ParseExt( &text, qfalse );
+				if ( !token[0] ) {
+					break;
+				}
+				count += R_BuildImageCacheEntry( token, flags, characterMip );
+			}
+		}
+		SkipRestOfLine( &text );
+	}
+
+	// same as FinishShader
+	if ( r_ext_compressed_textures->integer == 2 ) {
+		tr.allowCompress = qfalse;
+	}
+
+	return count;
+}
+
 
 qhandle_t RE_RegisterShaderFromImage( const char *name, int lightmapIndex, image_t *image, qboolean mipRawImage ) {
 	int hash;
@@ -3026,67 +3300,391 @@ void    R_ShaderList_f( void ) {
 	ri.Printf( PRINT_ALL, "------------------\n" );
 }
 
-// Ridah, optimized shader loading
+/*
+==============================================================================
+
+SHADER SCRIPT SCANNING
+
+The scripts are read on the main thread while the job threads check,
+compress and count the shaders of every file as soon as it is loaded.
+A second batch of jobs copies the files into s_shaderText and fills in
+the index, so FindShaderInShaderText is a single hash probe.
 
-#define MAX_SHADER_STRING_POINTERS  100000
-shaderStringPointer_t shaderStringPointerList[MAX_SHADER_STRING_POINTERS];
+With r_shaderCache the text and index are kept in shadercache.dat and
+reused for as long as the same scripts come from the same paks.
+==============================================================================
+*/
+
+#define MAX_SHADER_FILES    4096
+
+typedef struct {
+	char filename[MAX_QPATH];
+	char        *buffer;
+	int length;                     // after COM_Compress
+	qboolean valid;
+	int numEntries;
+
+	// set up before the copy jobs
+	int textOffset;
+	int firstEntry;
+
+	char warning[1024];             // printed by the main thread
+} shaderFileJob_t;
+
+#define SHADERCACHE_FILE        "shadercache.dat"
+#define SHADERCACHE_IDENT       ( ( 'C' << 24 ) + ( 'H' << 16 ) + ( 'S' << 8 ) + 'R' )
+#define SHADERCACHE_VERSION     1
+
+typedef struct {
+	int ident;
+	int version;
+	int key;                        // script names and pak checksums
+	int numFiles;
+	int textLength;                 // text follows, padded to 4 bytes
+	int numEntries;                 // then the index entries
+} shaderCacheHeader_t;
 
 /*
 ====================
-BuildShaderChecksumLookup
+ShaderScanToken
+
+Thread safe version of COM_ParseExt, returns where the token starts and
+its length instead of copying it to com_token. Quotes are not part of
+the token. Returns qfalse at the end of the text.
 ====================
 */
-static void BuildShaderChecksumLookup( void ) {
-	char *p = s_shaderText, *pOld;
-	char *token;
-	unsigned short int checksum;
-	int numShaderStringPointers = 0;
+static qboolean ShaderScanToken( char **data_p, int *line, char **token, int *len ) {
+	char *data = *data_p;
 
-	// initialize the checksums
-	memset( shaderChecksumLookup, 0, sizeof( shaderChecksumLookup ) );
+	while ( 1 ) {
+		// skip whitespace
+		while ( *data && *data <= ' ' ) {
+			if ( *data == '\n' ) {
+				( *line )++;
+			}
+			data++;
+		}
+		if ( !*data ) {
+			*data_p = data;
+			return qfalse;
+		}
 
-	if ( !p ) {
-		return;
+		// skip double slash comments
+		if ( data[0] == '/' && data[1] == '/' ) {
+			while ( *data && *data != '\n' ) {
+				data++;
+			}
+		}
+		// skip /* */ comments
+		else if ( data[0] == '/' && data[1] == '*' ) {
+			data += 2;
+			while ( *data && ( data[0] != '*' || data[1] != '/' ) ) {
+				if ( *data == '\n' ) {
+					( *line )++;
+				}
+				data++;
+			}
+			if ( *data ) {
+				data += 2;
+			}
+		} else {
+			break;
+		}
 	}
 
-	// loop for all labels
-	while ( 1 ) {
+	if ( *data == '\"' ) {
+		*token = ++data;
+		while ( *data && *data != '\"' ) {
+			if ( *data == '\n' ) {
+				( *line )++;
+			}
+			data++;
+		}
+		*len = data - *token;
+		if ( *data ) {
+			data++;
+		}
+	} else {
+		*token = data;
+		while ( *data > 32 ) {
+			data++;
+		}
+		*len = data - *token;
+	}
 
-		pOld = p;
+	*data_p = data;
+	return qtrue;
+}
 
-		token = COM_ParseExt( &p, qtrue );
-		if ( token[0] == 0 ) {
-			break;
+/*
+====================
+ShaderSkipBracedSection
+
+Same as SkipBracedSection with the opening brace already parsed
+====================
+*/
+static qboolean ShaderSkipBracedSection( char **data_p, int *line ) {
+	char *token;
+	int len, depth;
+
+	for ( depth = 1 ; depth && ShaderScanToken( data_p, line, &token, &len ) ; ) {
+		if ( len == 1 && token[0] == '{' ) {
+			depth++;
+		} else if ( len == 1 && token[0] == '}' ) {
+			depth--;
 		}
+	}
 
-		if ( !Q_stricmp( token, "{" ) ) {
-			// skip braced section
-			SkipBracedSection( &p, 0 );
+	return ( depth == 0 );
+}
+
+/*
+====================
+ShaderFileWarning
+====================
+*/
+static void QDECL ShaderFileWarning( shaderFileJob_t *job, const char *fmt, ... ) {
+	va_list argptr;
+	int len = strlen( job->warning );
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( job->warning + len, sizeof( job->warning ) - len, fmt, argptr );
+	va_end( argptr );
+}
+
+/*
+====================
+ShaderFileIndex
+
+Counts the shader definitions of a compressed file, and fills in their
+index entries when given somewhere to put them
+====================
+*/
+static int ShaderFileIndex( shaderFileJob_t *job, shaderTextEntry_t *entries ) {
+	char *p = job->buffer, *token, *name = NULL;
+	int len, nameLength = 0, nameEnd = 0, line = 0, count = 0;
+
+	while ( ShaderScanToken( &p, &line, &token, &len ) ) {
+		if ( len != 1 || token[0] != '{' ) {
+			name = token;
+			nameLength = len;
+			nameEnd = p - job->buffer;
 			continue;
 		}
 
-		// get it's checksum
-		checksum = generateHashValue( token );
+		// the token before an opening brace names the shader
+		if ( name && nameLength ) {
+			if ( entries ) {
+				entries[count].nameOffset = job->textOffset + ( name - job->buffer );
+				entries[count].nameLength = nameLength;
+				entries[count].textOffset = job->textOffset + nameEnd;
+				entries[count].hash = ShaderNameHash( name, nameLength );
+			}
+			count++;
+		}
+		name = NULL;
 
-		// if it's not currently used
-		if ( !shaderChecksumLookup[checksum].pStr ) {
-			shaderChecksumLookup[checksum].pStr = pOld;
-		} else {
-			// create a new list item
-			shaderStringPointer_t *newStrPtr;
+		ShaderSkipBracedSection( &p, &line );
+	}
+
+	return count;
+}
+
+/*
+====================
+ShaderFileCheckJob
+
+Do a simple check on the shader structure in that file to make sure one
+bad shader file cannot fuck up all other shaders, then compress it and
+count its shaders.
+====================
+*/
+static void ShaderFileCheckJob( void *data, int thread ) {
+	shaderFileJob_t *job = data;
+	char *p = job->buffer, *name, *token = NULL;
+	int nameLength, len, line = 1, nameLine;
+
+	job->valid = qtrue;
+	job->numEntries = 0;
+	job->warning[0] = 0;
+
+	while ( ShaderScanToken( &p, &line, &name, &nameLength ) && nameLength ) {
+		nameLine = line;
+
+		if ( !ShaderScanToken( &p, &line, &token, &len ) ) {
+			len = 0;
+		}
+		if ( len == nameLength && !Q_stricmpn( name, token, len ) ) {
+			ShaderFileWarning( job, "WARNING: In shader file %s...Invalid shader name \"%.*s\" on line %d.\n",
+							   job->filename, nameLength, name, nameLine );
+			break;
+		}
+
+		if ( len != 1 || token[0] != '{' ) {
+			ShaderFileWarning( job, "WARNING: In shader file %s...Shader \"%.*s\" on line %d is missing opening brace",
+							   job->filename, nameLength, name, nameLine );
+			if ( len ) {
+				ShaderFileWarning( job, " (found \"%.*s\" on line %d)", len, token, line );
+			}
+			ShaderFileWarning( job, "...Ignored\n" );
+			job->valid = qfalse;
+			break;
+		}
 
-			if ( numShaderStringPointers >= MAX_SHADER_STRING_POINTERS ) {
-				ri.Error( ERR_DROP, "MAX_SHADER_STRING_POINTERS exceeded, too many shaders" );
+		if ( !ShaderSkipBracedSection( &p, &line ) ) {
+			ShaderFileWarning( job, "WARNING: In shader file %s...Shader \"%.*s\" on line %d is missing closing brace",
+							   job->filename, nameLength, name, nameLine );
+			if ( !Q_stricmp( job->filename, "common.shader" ) ) { // HACK...Broken shader in pak0.pk3
+				ShaderFileWarning( job, "...Ignored\n" );
+				job->valid = qfalse;
+				break;
+			} else {
+				ShaderFileWarning( job, ".\n" );
 			}
+		}
+	}
+
+	if ( !job->valid ) {
+		return;
+	}
+
+	job->length = COM_Compress( job->buffer );
+	job->numEntries = ShaderFileIndex( job, NULL );
+}
+
+/*
+====================
+ShaderFileCopyJob
+====================
+*/
+static void ShaderFileCopyJob( void *data, int thread ) {
+	shaderFileJob_t *job = data;
+
+	Com_Memcpy( s_shaderText + job->textOffset, job->buffer, job->length );
+	s_shaderText[job->textOffset + job->length] = '\n';
+
+	ShaderFileIndex( job, shaderTextEntries + job->firstEntry );
+}
+
+/*
+====================
+BuildShaderTextHash
+====================
+*/
+static void BuildShaderTextHash( void ) {
+	shaderTextEntry_t *entry;
+	int i, bucket;
+
+	memset( shaderTextHash, -1, sizeof( shaderTextHash ) );
+
+	// link backwards so the chains run in text order, the first definition wins
+	for ( i = numShaderTextEntries - 1 ; i >= 0 ; i-- ) {
+		entry = &shaderTextEntries[i];
+		bucket = entry->hash & ( SHADERTEXT_HASH_SIZE - 1 );
+		entry->next = shaderTextHash[bucket];
+		shaderTextHash[bucket] = i;
+	}
+}
+
+/*
+====================
+ShaderCacheKey
 
-			newStrPtr = &shaderStringPointerList[numShaderStringPointers++]; //ri.Hunk_Alloc( sizeof( shaderStringPointer_t ), h_low );
-			newStrPtr->pStr = pOld;
-			newStrPtr->next = shaderChecksumLookup[checksum].next;
-			shaderChecksumLookup[checksum].next = newStrPtr;
+Returns qfalse if any script is a loose file, those can change at any time
+====================
+*/
+static qboolean ShaderCacheKey( char **shaderFiles, int numShaderFiles, int *key ) {
+	unsigned hash = 2166136261u;
+	int i, checksum;
+
+	for ( i = 0 ; i < numShaderFiles ; i++ ) {
+		if ( ri.FS_FilePakChecksum( va( "scripts/%s", shaderFiles[i] ), &checksum ) == -1 ) {
+			return qfalse;
 		}
+		hash = ( hash ^ ShaderNameHash( shaderFiles[i], strlen( shaderFiles[i] ) ) ) * 16777619u;
+		hash = ( hash ^ (unsigned)checksum ) * 16777619u;
 	}
+
+	*key = (int)hash;
+	return qtrue;
+}
+
+/*
+====================
+LoadShaderCache
+====================
+*/
+static qboolean LoadShaderCache( int key, int numShaderFiles ) {
+	shaderCacheHeader_t *header;
+	shaderTextEntry_t   *entries;
+	long len;
+	int i;
+
+	len = ri.FS_ReadFile( SHADERCACHE_FILE, (void **)&header );
+	if ( !header ) {
+		return qfalse;
+	}
+
+	if ( len < (long)sizeof( *header )
+		 || header->ident != SHADERCACHE_IDENT
+		 || header->version != SHADERCACHE_VERSION
+		 || header->key != key
+		 || header->numFiles != numShaderFiles
+		 || header->textLength <= 0 || header->numEntries < 0
+		 || len != (long)( sizeof( *header ) + PAD( header->textLength, 4 ) + header->numEntries * sizeof( *entries ) ) ) {
+		ri.FS_FreeFile( header );
+		return qfalse;
+	}
+
+	entries = ( shaderTextEntry_t * )( (byte *)( header + 1 ) + PAD( header->textLength, 4 ) );
+	for ( i = 0 ; i < header->numEntries ; i++ ) {
+		if ( entries[i].nameOffset < 0 || entries[i].nameLength <= 0
+			 || entries[i].nameOffset + entries[i].nameLength > header->textLength
+			 || entries[i].textOffset < 0 || entries[i].textOffset > header->textLength ) {
+			ri.FS_FreeFile( header );
+			return qfalse;
+		}
+	}
+
+	s_shaderText = ri.Hunk_Alloc( header->textLength + 1, h_low );
+	Com_Memcpy( s_shaderText, header + 1, header->textLength );
+	s_shaderText[header->textLength] = 0;
+
+	numShaderTextEntries = header->numEntries;
+	shaderTextEntries = ri.Hunk_Alloc( ( numShaderTextEntries + 1 ) * sizeof( *shaderTextEntries ), h_low );
+	Com_Memcpy( shaderTextEntries, entries, numShaderTextEntries * sizeof( *shaderTextEntries ) );
+
+	ri.FS_FreeFile( header );
+
+	BuildShaderTextHash();
+	return qtrue;
+}
+
+/*
+====================
+WriteShaderCache
+====================
+*/
+static void WriteShaderCache( int key, int numShaderFiles, int textLength ) {
+	shaderCacheHeader_t *header;
+	int size;
+
+	size = sizeof( *header ) + PAD( textLength, 4 ) + numShaderTextEntries * sizeof( *shaderTextEntries );
+	header = ri.Hunk_AllocateTempMemory( size );
+	Com_Memset( header, 0, size );
+
+	header->ident = SHADERCACHE_IDENT;
+	header->version = SHADERCACHE_VERSION;
+	header->key = key;
+	header->numFiles = numShaderFiles;
+	header->textLength = textLength;
+	header->numEntries = numShaderTextEntries;
+	Com_Memcpy( header + 1, s_shaderText, textLength );
+	Com_Memcpy( (byte *)( header + 1 ) + PAD( textLength, 4 ), shaderTextEntries, numShaderTextEntries * sizeof( *shaderTextEntries ) );
+
+	ri.FS_WriteFile( SHADERCACHE_FILE, header, size );
+	ri.Hunk_FreeTempMemory( header );
 }
-// done.
 
 
 /*
@@ -3097,18 +3695,19 @@ Finds and loads all .shader files, combining them into
 a single large text block that can be scanned for shader names
 =====================
 */
-#define MAX_SHADER_FILES    4096
 static void ScanAndLoadShaderFiles( void ) {
 	char **shaderFiles;
-	char *buffers[MAX_SHADER_FILES] = {NULL};
-	char *p;
+	shaderFileJob_t *jobs, *job;
 	int numShaderFiles;
-	int i;
-	char *token, *textEnd;
-	char shaderName[MAX_QPATH];
-	int shaderLine;
+	int i, sum, numEntries, key, start;
+	qboolean useCache;
+
+	start = ri.Milliseconds();
+
+	s_shaderText = NULL;
+	shaderTextEntries = NULL;
+	numShaderTextEntries = 0;
 
-	long sum = 0, summand;
 	// scan for shader files
 	shaderFiles = ri.FS_ListFiles( "scripts", ".shader", &numShaderFiles );
 
@@ -3121,96 +3720,83 @@ static void ScanAndLoadShaderFiles( void ) {
 		numShaderFiles = MAX_SHADER_FILES;
 	}
 
-	// load and parse shader files
-	for ( i = 0; i < numShaderFiles; i++ )
-	{
-		char filename[MAX_QPATH];
+	useCache = r_shaderCache->integer && ShaderCacheKey( shaderFiles, numShaderFiles, &key );
+	if ( useCache && LoadShaderCache( key, numShaderFiles ) ) {
+		ri.FS_FreeFileList( shaderFiles );
+		ri.Printf( PRINT_DEVELOPER, "...%i shaders loaded from %s in %i msec\n",
+				   numShaderTextEntries, SHADERCACHE_FILE, ri.Milliseconds() - start );
+		return;
+	}
 
-		Com_sprintf( filename, sizeof( filename ), "scripts/%s", shaderFiles[i] );
-		ri.Printf( PRINT_DEVELOPER, "...loading '%s'\n", filename );
-		summand = ri.FS_ReadFile( filename, (void **)&buffers[i] );
-		
-		if ( !buffers[i] )
-			ri.Error( ERR_DROP, "Couldn't load %s", filename );
-		
-		// Do a simple check on the shader structure in that file to make sure one bad shader file cannot fuck up all other shaders.
-		p = buffers[i];
-		COM_BeginParseSession(filename);
-		while(1)
-		{
-			token = COM_ParseExt(&p, qtrue);
-			
-			if(!*token)
-				break;
+	jobs = ri.Hunk_AllocateTempMemory( numShaderFiles * sizeof( *jobs ) );
 
-			Q_strncpyz(shaderName, token, sizeof(shaderName));
-			shaderLine = COM_GetCurrentParseLine();
+	// load the shader files, the job threads check each one as soon as it is read
+	for ( i = 0; i < numShaderFiles; i++ )
+	{
+		job = &jobs[i];
+		Com_sprintf( job->filename, sizeof( job->filename ), "scripts/%s", shaderFiles[i] );
+		ri.Printf( PRINT_DEVELOPER, "...loading '%s'\n", job->filename );
+		ri.FS_ReadFile( job->filename, (void **)&job->buffer );
 
-			token = COM_ParseExt(&p, qtrue);
-			if( !Q_stricmp( shaderName, token ) ) {
-				ri.Printf(PRINT_WARNING, "WARNING: In shader file %s...Invalid shader name \"%s\" on line %d.\n",
-							filename, shaderName, shaderLine);
-				break;
-			}
+		if ( !job->buffer ) {
+			ri.WaitJobs();
+			ri.Error( ERR_DROP, "Couldn't load %s", job->filename );
+		}
 
-			if(token[0] != '{' || token[1] != '\0')
-			{
-				ri.Printf(PRINT_WARNING, "WARNING: In shader file %s...Shader \"%s\" on line %d is missing opening brace",
-							filename, shaderName, shaderLine);
-				if (token[0])
-				{
-					ri.Printf(PRINT_WARNING, " (found \"%s\" on line %d)", token, COM_GetCurrentParseLine());
-				}
-				ri.Printf(PRINT_WARNING, "...Ignored\n");
-				ri.FS_FreeFile(buffers[i]);
-				buffers[i] = NULL;
-				break;
-			}
+		ri.AddJob( ShaderFileCheckJob, job );
+	}
+	ri.WaitJobs();
 
-			if(!SkipBracedSection(&p, 1))
-			{
-				ri.Printf(PRINT_WARNING, "WARNING: In shader file %s...Shader \"%s\" on line %d is missing closing brace",
-							filename, shaderName, shaderLine);
-				if( !Q_stricmp( filename, "common.shader" ) ) { // HACK...Broken shader in pak0.pk3
-					ri.Printf(PRINT_WARNING, "...Ignored\n");
-					ri.FS_FreeFile(buffers[i]);
-					buffers[i] = NULL;
-					break;
-				} else {
-					ri.Printf(PRINT_WARNING, ".\n");
-				}
-			}
+	for ( i = 0; i < numShaderFiles; i++ ) {
+		if ( jobs[i].warning[0] ) {
+			ri.Printf( PRINT_WARNING, "%s", jobs[i].warning );
 		}
-		
-		if (buffers[i])
-			sum += summand;		
 	}
 
-	// build single large buffer
-	s_shaderText = ri.Hunk_Alloc( sum + numShaderFiles*2, h_low );
-	s_shaderText[ 0 ] = '\0';
-	textEnd = s_shaderText;
-
-	// free in reverse order, so the temp files are all dumped
+	// lay the files out in reverse order, same as the old single buffer
+	sum = numEntries = 0;
 	for ( i = numShaderFiles - 1; i >= 0 ; i-- )
 	{
-		if ( !buffers[i] )
+		job = &jobs[i];
+		if ( !job->valid ) {
 			continue;
+		}
+		job->textOffset = sum;
+		job->firstEntry = numEntries;
+		sum += job->length + 1;
+		numEntries += job->numEntries;
+	}
+
+	// build single large buffer
+	s_shaderText = ri.Hunk_Alloc( sum + 1, h_low );
+	shaderTextEntries = ri.Hunk_Alloc( ( numEntries + 1 ) * sizeof( *shaderTextEntries ), h_low );
+	numShaderTextEntries = numEntries;
 
-		strcat( textEnd, buffers[i] );
-		strcat( textEnd, "\n" );
-		textEnd += strlen( textEnd );
-		ri.FS_FreeFile( buffers[i] );
+	for ( i = 0; i < numShaderFiles; i++ ) {
+		if ( jobs[i].valid ) {
+			ri.AddJob( ShaderFileCopyJob, &jobs[i] );
+		}
 	}
+	ri.WaitJobs();
+	s_shaderText[sum] = 0;
 
-	COM_Compress( s_shaderText );
+	// free in reverse order, so the temp files are all dumped
+	for ( i = numShaderFiles - 1; i >= 0 ; i-- ) {
+		ri.FS_FreeFile( jobs[i].buffer );
+	}
+	ri.Hunk_FreeTempMemory( jobs );
 
 	// free up memory
 	ri.FS_FreeFileList( shaderFiles );
 
-	// Ridah, optimized shader loading (18ms on a P3-500 for sfm1.bsp)
-	BuildShaderChecksumLookup();
-	// done.
+	BuildShaderTextHash();
+
+	if ( useCache ) {
+		WriteShaderCache( key, numShaderFiles, sum );
+	}
+
+	ri.Printf( PRINT_DEVELOPER, "...%i shaders in %i files scanned in %i msec\n",
+			   numShaderTextEntries, numShaderFiles, ri.Milliseconds() - start );
 }
 
 
@@ -3264,6 +3850,7 @@ R_InitShaders
 ==================
 */
 void R_InitShaders( void ) {
+	const char *label;
 
 	glfogNum = FOG_NONE;
 	ri.Cvar_Set( "r_waterFogColor", "0" );  // clear fog
@@ -3273,10 +3860,15 @@ void R_InitShaders( void ) {
 	ri.Printf( PRINT_ALL, "Initializing Shaders\n" );
 
 	memset( hashTable, 0, sizeof( hashTable ) );
+	memset( batchHashTable, 0, sizeof( batchHashTable ) );
+
+	label = ri.Hunk_SetLabel( "shaders" );
 
 	CreateInternalShaders();
 
 	ScanAndLoadShaderFiles();
 
 	CreateExternalShaders();
+
+	ri.Hunk_SetLabel( label );
 }
@@ -70,6 +70,45 @@ void RB_CheckOverflow( int verts, int indexes ) {
 	RB_BeginSurface( tess.shader, tess.fogNum );
 }
 
+/*
+==============
+RB_AddVBORange
+
+Queues a surface that lives in the static world VBOs as an index range
+instead of copying its vertexes. Anything that needs the vertexes on the CPU
+(dlights, fog, fading, debug tris) makes it fall back to the copy.
+==============
+*/
+qboolean RB_AddVBORange( int chunk, int firstIndex, int numIndexes, int dlightBits ) {
+	int *range;
+
+	if ( !tess.shader->vboStatic || dlightBits || tess.fogNum || r_showtris->integer || r_greyscale->value ) {
+		return qfalse;
+	}
+	if ( backEnd.currentEntity->e.fadeStartTime ) {
+		return qfalse;
+	}
+
+	if ( tess.numVboRanges && ( tess.vboChunk != chunk || tess.numVboRanges == MAX_VBO_RANGES ) ) {
+		RB_EndSurface();
+		RB_BeginSurface( tess.shader, tess.fogNum );
+	}
+	tess.vboChunk = chunk;
+
+	// surfaces were uploaded grouped by shader, so neighbours usually merge
+	range = tess.numVboRanges ? tess.vboRanges[tess.numVboRanges - 1] : NULL;
+	if ( range && range[0] + range[1] == firstIndex ) {
+		range[1] += numIndexes;
+	} else {
+		range = tess.vboRanges[tess.numVboRanges++];
+		range[0] = firstIndex;
+		range[1] = numIndexes;
+	}
+
+	backEnd.pc.c_vboSurfaces++;
+	return qtrue;
+}
+
 /*
 ==============
 RB_AddQuadStampExt
@@ -256,6 +295,11 @@ static void RB_SurfaceTriangles( srfTriangles_t *srf ) {
 	qboolean needsNormal;
 
 	dlightBits = srf->dlightBits;
+
+	if ( srf->vboFirstIndex >= 0 && RB_AddVBORange( srf->vboChunk, srf->vboFirstIndex, srf->numIndexes, dlightBits ) ) {
+		return;
+	}
+
 	tess.dlightBits |= dlightBits;
 
 	RB_CHECKOVERFLOW( srf->numVerts, srf->numIndexes );
@@ -767,21 +811,20 @@ static void LerpMeshVertexes_altivec(md3Surface_t *surf, float backlerp)
 }
 #endif
 
-static void LerpMeshVertexes_scalar(md3Surface_t *surf, float backlerp)
+static void LerpMeshVertexes_scalar(md3Surface_t *surf, int frame, int oldframe, float backlerp, float *outXyz, float *outNormal)
 {
 	short	*oldXyz, *newXyz, *oldNormals, *newNormals;
-	float	*outXyz, *outNormal;
+	float	*normals;
 	float	oldXyzScale, newXyzScale;
 	float	oldNormalScale, newNormalScale;
 	int		vertNum;
 	unsigned lat, lng;
 	int		numVerts;
 
-	outXyz = tess.xyz[tess.numVertexes];
-	outNormal = tess.normal[tess.numVertexes];
+	normals = outNormal;
 
 	newXyz = (short *)((byte *)surf + surf->ofsXyzNormals)
-		+ (backEnd.currentEntity->e.frame * surf->numVerts * 4);
+		+ (frame * surf->numVerts * 4);
 	newNormals = newXyz + 3;
 
 	newXyzScale = MD3_XYZ_SCALE * (1.0 - backlerp);
@@ -820,7 +863,7 @@ static void LerpMeshVertexes_scalar(md3Surface_t *surf, float backlerp)
 		// interpolate and copy the vertex and normal
 		//
 		oldXyz = (short *)((byte *)surf + surf->ofsXyzNormals)
-			+ (backEnd.currentEntity->e.oldframe * surf->numVerts * 4);
+			+ (oldframe * surf->numVerts * 4);
 		oldNormals = oldXyz + 3;
 
 		oldXyzScale = MD3_XYZ_SCALE * backlerp;
@@ -861,12 +904,156 @@ static void LerpMeshVertexes_scalar(md3Surface_t *surf, float backlerp)
 
 //			VectorNormalize (outNormal);
 		}
-    	VectorArrayNormalize((vec4_t *)tess.normal[tess.numVertexes], numVerts);
+    	VectorArrayNormalize((vec4_t *)normals, numVerts);
    	}
 }
 
+/*
+** LerpXyz / VectorArrayNormalize, vectorized
+*
+* The positions are blended four vertexes at a time: the xyz/normal shorts are
+* de-interleaved into lanes so the widen, scale and blend run across vertexes.
+* The lat/long normal decode is a table lookup and stays scalar.
+*/
+#ifdef __vita__
+#include <arm_neon.h>
+
+static void LerpXyz_neon( const short *oldXyz, const short *newXyz, float oldScale, float newScale, float *out, int numVerts ) {
+	int16x4x4_t n, o;
+	float32x4x4_t v;
+	int i;
+
+	v.val[3] = vdupq_n_f32( 0.0f );
+	for ( i = 0; i + 4 <= numVerts; i += 4, newXyz += 16, out += 16 ) {
+		n = vld4_s16( newXyz );
+		v.val[0] = vmulq_n_f32( vcvtq_f32_s32( vmovl_s16( n.val[0] ) ), newScale );
+		v.val[1] = vmulq_n_f32( vcvtq_f32_s32( vmovl_s16( n.val[1] ) ), newScale );
+		v.val[2] = vmulq_n_f32( vcvtq_f32_s32( vmovl_s16( n.val[2] ) ), newScale );
+		if ( oldXyz ) {
+			o = vld4_s16( oldXyz );
+			oldXyz += 16;
+			v.val[0] = vmlaq_n_f32( v.val[0], vcvtq_f32_s32( vmovl_s16( o.val[0] ) ), oldScale );
+			v.val[1] = vmlaq_n_f32( v.val[1], vcvtq_f32_s32( vmovl_s16( o.val[1] ) ), oldScale );
+			v.val[2] = vmlaq_n_f32( v.val[2], vcvtq_f32_s32( vmovl_s16( o.val[2] ) ), oldScale );
+		}
+		vst4q_f32( out, v );
+	}
+
+	for ( ; i < numVerts; i++, newXyz += 4, out += 4 ) {
+		out[0] = newXyz[0] * newScale;
+		out[1] = newXyz[1] * newScale;
+		out[2] = newXyz[2] * newScale;
+		if ( oldXyz ) {
+			out[0] += oldXyz[0] * oldScale;
+			out[1] += oldXyz[1] * oldScale;
+			out[2] += oldXyz[2] * oldScale;
+			oldXyz += 4;
+		}
+	}
+}
+
+// rsqrt estimate plus two Newton-Raphson steps, four normals per iteration
+static void VectorArrayNormalize_neon( vec4_t *normals, int count ) {
+	float32x4x4_t n;
+	float32x4_t len, r;
+	float *f = normals[0];
+
+	for ( ; count >= 4; count -= 4, f += 16 ) {
+		n = vld4q_f32( f );
+		len = vmulq_f32( n.val[0], n.val[0] );
+		len = vmlaq_f32( len, n.val[1], n.val[1] );
+		len = vmlaq_f32( len, n.val[2], n.val[2] );
+		len = vmaxq_f32( len, vdupq_n_f32( 1e-12f ) );  // degenerate blends stay zero instead of NaN
+		r = vrsqrteq_f32( len );
+		r = vmulq_f32( r, vrsqrtsq_f32( vmulq_f32( len, r ), r ) );
+		r = vmulq_f32( r, vrsqrtsq_f32( vmulq_f32( len, r ), r ) );
+		n.val[0] = vmulq_f32( n.val[0], r );
+		n.val[1] = vmulq_f32( n.val[1], r );
+		n.val[2] = vmulq_f32( n.val[2], r );
+		vst4q_f32( f, n );
+	}
+
+	for ( ; count > 0; count--, f += 4 ) {
+		VectorNormalizeFast( f );
+	}
+}
+#define LerpXyz_simd LerpXyz_neon
+#define VectorArrayNormalize_simd VectorArrayNormalize_neon
+#else
+// off the Vita only the position blend has a vector version, one vertex per
+// GCC vector, the normals go through the scalar normalize
+typedef float lerpVec4_t __attribute__ ( ( vector_size( 16 ) ) );
+
+static void LerpXyz_vec( const short *oldXyz, const short *newXyz, float oldScale, float newScale, float *out, int numVerts ) {
+	lerpVec4_t v;
+	int i;
+
+	for ( i = 0; i < numVerts; i++, newXyz += 4, out += 4 ) {
+		v = (lerpVec4_t){ newXyz[0], newXyz[1], newXyz[2], 0 } * newScale;
+		if ( oldXyz ) {
+			v += (lerpVec4_t){ oldXyz[0], oldXyz[1], oldXyz[2], 0 } * oldScale;
+			oldXyz += 4;
+		}
+		memcpy( out, &v, sizeof( v ) );
+	}
+}
+#define LerpXyz_simd LerpXyz_vec
+#define VectorArrayNormalize_simd( normals, count ) VectorArrayNormalize( normals, count )
+#endif
+
+static ID_INLINE void LerpDecodeNormal( short latLong, float *out ) {
+	unsigned lat, lng;
+
+	lat = ( ( latLong >> 8 ) & 0xff ) * ( FUNCTABLE_SIZE / 256 );
+	lng = ( latLong & 0xff ) * ( FUNCTABLE_SIZE / 256 );
+
+	out[0] = tr.sinTable[( lat + ( FUNCTABLE_SIZE / 4 ) ) & FUNCTABLE_MASK] * tr.sinTable[lng];
+	out[1] = tr.sinTable[lat] * tr.sinTable[lng];
+	out[2] = tr.sinTable[( lng + ( FUNCTABLE_SIZE / 4 ) ) & FUNCTABLE_MASK];
+}
+
+static void LerpMeshVertexes_simd( md3Surface_t *surf, int frame, int oldframe, float backlerp, float *outXyz, float *outNormal ) {
+	short   *oldXyz, *newXyz;
+	float   *normals;
+	float oldNormalScale, newNormalScale;
+	vec3_t oldNormal, newNormal;
+	int vertNum, numVerts;
+
+	numVerts = surf->numVerts;
+	normals = outNormal;
+
+	newXyz = (short *)( (byte *)surf + surf->ofsXyzNormals ) + ( frame * numVerts * 4 );
+
+	if ( backlerp == 0 ) {
+		LerpXyz_simd( NULL, newXyz, 0, MD3_XYZ_SCALE, outXyz, numVerts );
+
+		for ( vertNum = 0 ; vertNum < numVerts ; vertNum++, newXyz += 4, outNormal += 4 ) {
+			LerpDecodeNormal( newXyz[3], outNormal );
+		}
+		return;
+	}
+
+	oldXyz = (short *)( (byte *)surf + surf->ofsXyzNormals ) + ( oldframe * numVerts * 4 );
+
+	LerpXyz_simd( oldXyz, newXyz, MD3_XYZ_SCALE * backlerp, MD3_XYZ_SCALE * ( 1.0 - backlerp ), outXyz, numVerts );
+
+	oldNormalScale = backlerp;
+	newNormalScale = 1.0 - backlerp;
+	for ( vertNum = 0 ; vertNum < numVerts ; vertNum++, oldXyz += 4, newXyz += 4, outNormal += 4 ) {
+		LerpDecodeNormal( newXyz[3], newNormal );
+		LerpDecodeNormal( oldXyz[3], oldNormal );
+
+		outNormal[0] = oldNormal[0] * oldNormalScale + newNormal[0] * newNormalScale;
+		outNormal[1] = oldNormal[1] * oldNormalScale + newNormal[1] * newNormalScale;
+		outNormal[2] = oldNormal[2] * oldNormalScale + newNormal[2] * newNormalScale;
+	}
+	VectorArrayNormalize_simd( (vec4_t *)normals, numVerts );
+}
+
 static void LerpMeshVertexes(md3Surface_t *surf, float backlerp)
 {
+	refEntity_t *e = &backEnd.currentEntity->e;
+
 #if idppc_altivec
 	if (com_altivec->integer) {
 		// must be in a seperate function or G3 systems will crash.
@@ -874,9 +1061,86 @@ static void LerpMeshVertexes(md3Surface_t *surf, float backlerp)
 		return;
 	}
 #endif // idppc_altivec
-	LerpMeshVertexes_scalar( surf, backlerp );
+	if ( r_simdLerp->integer ) {
+		LerpMeshVertexes_simd( surf, e->frame, e->oldframe, backlerp, tess.xyz[tess.numVertexes], tess.normal[tess.numVertexes] );
+		return;
+	}
+	LerpMeshVertexes_scalar( surf, e->frame, e->oldframe, backlerp, tess.xyz[tess.numVertexes], tess.normal[tess.numVertexes] );
 }
 
+/*
+=============================================================
+
+LERP RECORDING
+
+"lerpbench record" arms the back end to keep the MD3 and MDC surfaces it
+interpolates, with their frames and backlerp, until the frame is swapped.
+lerpbench then replays that frame through the scalar and vector kernels.
+
+=============================================================
+*/
+
+#define MAX_LERP_RECORDS    1024
+
+enum {
+	LERPREC_IDLE,
+	LERPREC_ARMED,                  // by lerpbench record
+	LERPREC_DONE                    // by the back end, at the swap
+};
+
+typedef struct {
+	void        *surf;              // md3Surface_t or mdcSurface_t
+	qboolean mdc;
+	int frame, oldframe;
+	float backlerp;
+} lerpRecord_t;
+
+static lerpRecord_t lerpRecords[MAX_LERP_RECORDS];
+static int lerpNumRecords;
+static volatile int lerpRecordState;
+
+static void RB_LerpRecord( void *surf, qboolean mdc, float backlerp ) {
+	lerpRecord_t *rec;
+
+	if ( lerpRecordState != LERPREC_ARMED || lerpNumRecords == MAX_LERP_RECORDS ) {
+		return;
+	}
+
+	rec = &lerpRecords[lerpNumRecords++];
+	rec->surf = surf;
+	rec->mdc = mdc;
+	rec->frame = backEnd.currentEntity->e.frame;
+	rec->oldframe = backEnd.currentEntity->e.oldframe;
+	rec->backlerp = backlerp;
+}
+
+/*
+=============
+RB_LerpRecordEndFrame
+
+Closes the recording at the first swap that had models in it
+=============
+*/
+void RB_LerpRecordEndFrame( void ) {
+	if ( lerpRecordState == LERPREC_ARMED && lerpNumRecords ) {
+		__sync_synchronize();
+		lerpRecordState = LERPREC_DONE;
+	}
+}
+
+/*
+=============
+R_ClearLerpRecords
+
+The recorded surfaces point into model data
+=============
+*/
+void R_ClearLerpRecords( void ) {
+	lerpRecordState = LERPREC_IDLE;
+	lerpNumRecords = 0;
+}
+
+
 
 /*
 =============
@@ -907,6 +1171,7 @@ static void RB_SurfaceMesh( md3Surface_t *surface ) {
 
 	RB_CHECKOVERFLOW( surface->numVerts, surface->numTriangles * 3 );
 
+	RB_LerpRecord( surface, qfalse, backlerp );
 	LerpMeshVertexes( surface, backlerp );
 
 	triangles = ( int * )( (byte *)surface + surface->ofsTriangles );
@@ -953,11 +1218,11 @@ void R_LatLongToNormal( vec3_t outNormal, short latLong ) {
 
 // Ridah
 /*
-** LerpCMeshVertexes
+** LerpCMeshVertexesExt
 */
-static void LerpCMeshVertexes( mdcSurface_t *surf, float backlerp ) {
+static void LerpCMeshVertexesExt( mdcSurface_t *surf, int frame, int oldframe, float backlerp, float *outXyz, float *outNormal, qboolean simd ) {
 	short   *oldXyz, *newXyz, *oldNormals, *newNormals;
-	float   *outXyz, *outNormal;
+	float   *normals;
 	float oldXyzScale, newXyzScale;
 	float oldNormalScale, newNormalScale;
 	int vertNum;
@@ -971,17 +1236,16 @@ static void LerpCMeshVertexes( mdcSurface_t *surf, float backlerp ) {
 
 	qboolean hasComp;
 
-	outXyz = tess.xyz[tess.numVertexes];
-	outNormal = tess.normal[tess.numVertexes];
+	normals = outNormal;
 
-	newBase = (int)*( ( short * )( (byte *)surf + surf->ofsFrameBaseFrames ) + backEnd.currentEntity->e.frame );
+	newBase = (int)*( ( short * )( (byte *)surf + surf->ofsFrameBaseFrames ) + frame );
 	newXyz = ( short * )( (byte *)surf + surf->ofsXyzNormals )
 			 + ( newBase * surf->numVerts * 4 );
 	newNormals = newXyz + 3;
 
 	hasComp = ( surf->numCompFrames > 0 );
 	if ( hasComp ) {
-		newComp = ( ( short * )( (byte *)surf + surf->ofsFrameCompFrames ) + backEnd.currentEntity->e.frame );
+		newComp = ( ( short * )( (byte *)surf + surf->ofsFrameCompFrames ) + frame );
 		if ( *newComp >= 0 ) {
 			newXyzComp = ( mdcXyzCompressed_t * )( (byte *)surf + surf->ofsXyzCompressed )
 						 + ( *newComp * surf->numVerts );
@@ -997,14 +1261,18 @@ static void LerpCMeshVertexes( mdcSurface_t *surf, float backlerp ) {
 		//
 		// just copy the vertexes
 		//
+		if ( simd ) {
+			LerpXyz_simd( NULL, newXyz, 0, newXyzScale, outXyz, numVerts );
+		}
 		for ( vertNum = 0 ; vertNum < numVerts ; vertNum++,
 			  newXyz += 4, newNormals += 4,
 			  outXyz += 4, outNormal += 4 )
 		{
-
-			outXyz[0] = newXyz[0] * newXyzScale;
-			outXyz[1] = newXyz[1] * newXyzScale;
-			outXyz[2] = newXyz[2] * newXyzScale;
+			if ( !simd ) {
+				outXyz[0] = newXyz[0] * newXyzScale;
+				outXyz[1] = newXyz[1] * newXyzScale;
+				outXyz[2] = newXyz[2] * newXyzScale;
+			}
 
 			// add the compressed ofsVec
 			if ( hasComp && *newComp >= 0 ) {
@@ -1026,13 +1294,13 @@ static void LerpCMeshVertexes( mdcSurface_t *surf, float backlerp ) {
 		//
 		// interpolate and copy the vertex and normal
 		//
-		oldBase = (int)*( ( short * )( (byte *)surf + surf->ofsFrameBaseFrames ) + backEnd.currentEntity->e.oldframe );
+		oldBase = (int)*( ( short * )( (byte *)surf + surf->ofsFrameBaseFrames ) + oldframe );
 		oldXyz = ( short * )( (byte *)surf + surf->ofsXyzNormals )
 				 + ( oldBase * surf->numVerts * 4 );
 		oldNormals = oldXyz + 3;
 
 		if ( hasComp ) {
-			oldComp = ( ( short * )( (byte *)surf + surf->ofsFrameCompFrames ) + backEnd.currentEntity->e.oldframe );
+			oldComp = ( ( short * )( (byte *)surf + surf->ofsFrameCompFrames ) + oldframe );
 			if ( *oldComp >= 0 ) {
 				oldXyzComp = ( mdcXyzCompressed_t * )( (byte *)surf + surf->ofsXyzCompressed )
 							 + ( *oldComp * surf->numVerts );
@@ -1042,6 +1310,9 @@ static void LerpCMeshVertexes( mdcSurface_t *surf, float backlerp ) {
 		oldXyzScale = MD3_XYZ_SCALE * backlerp;
 		oldNormalScale = backlerp;
 
+		if ( simd ) {
+			LerpXyz_simd( oldXyz, newXyz, oldXyzScale, newXyzScale, outXyz, numVerts );
+		}
 		for ( vertNum = 0 ; vertNum < numVerts ; vertNum++,
 			  oldXyz += 4, newXyz += 4, oldNormals += 4, newNormals += 4,
 			  outXyz += 4, outNormal += 4 )
@@ -1049,9 +1320,11 @@ static void LerpCMeshVertexes( mdcSurface_t *surf, float backlerp ) {
 			vec3_t uncompressedOldNormal, uncompressedNewNormal;
 
 			// interpolate the xyz
-			outXyz[0] = oldXyz[0] * oldXyzScale + newXyz[0] * newXyzScale;
-			outXyz[1] = oldXyz[1] * oldXyzScale + newXyz[1] * newXyzScale;
-			outXyz[2] = oldXyz[2] * oldXyzScale + newXyz[2] * newXyzScale;
+			if ( !simd ) {
+				outXyz[0] = oldXyz[0] * oldXyzScale + newXyz[0] * newXyzScale;
+				outXyz[1] = oldXyz[1] * oldXyzScale + newXyz[1] * newXyzScale;
+				outXyz[2] = oldXyz[2] * oldXyzScale + newXyz[2] * newXyzScale;
+			}
 
 			// add the compressed ofsVec
 			if ( hasComp && *newComp >= 0 ) {
@@ -1088,9 +1361,156 @@ static void LerpCMeshVertexes( mdcSurface_t *surf, float backlerp ) {
 			outNormal[1] = uncompressedOldNormal[1] * oldNormalScale + uncompressedNewNormal[1] * newNormalScale;
 			outNormal[2] = uncompressedOldNormal[2] * oldNormalScale + uncompressedNewNormal[2] * newNormalScale;
 
-			VectorNormalize( outNormal );
+			if ( !simd ) {
+				VectorNormalize( outNormal );
+			}
+		}
+		if ( simd ) {
+			VectorArrayNormalize_simd( (vec4_t *)normals, numVerts );
+		}
+	}
+}
+
+static void LerpCMeshVertexes( mdcSurface_t *surf, float backlerp ) {
+	LerpCMeshVertexesExt( surf, backEnd.currentEntity->e.frame, backEnd.currentEntity->e.oldframe, backlerp,
+						  tess.xyz[tess.numVertexes], tess.normal[tess.numVertexes], r_simdLerp->integer );
+}
+
+/*
+=============
+R_BenchCompareVertexes
+
+Largest difference between two runs of numVerts xyz and normal vectors
+laid out like tess, w is left alone by the scalar paths
+=============
+*/
+float R_BenchCompareVertexes( const float *a, const float *b, int numVerts ) {
+	float maxError, d;
+	int i;
+
+	maxError = 0;
+	for ( i = 0; i < numVerts * 8; i++ ) {
+		if ( ( i & 3 ) == 3 ) {
+			continue;
+		}
+		d = fabs( a[i] - b[i] );
+		if ( d > maxError ) {
+			maxError = d;
+		}
+	}
+
+	return maxError;
+}
+
+typedef struct {
+	qboolean mdc;                   // which of the recorded surfaces are replayed
+	int numVerts;
+	float       *out[2];            // scalar and simd, xyz then normals per surface
+} lerpBench_t;
+
+static void R_LerpBenchReplay( lerpBench_t *l, qboolean simd ) {
+	lerpRecord_t *rec;
+	float *out;
+	int i, n;
+
+	out = l->out[simd];
+	for ( i = 0, rec = lerpRecords; i < lerpNumRecords; i++, rec++ ) {
+		if ( rec->mdc != l->mdc ) {
+			continue;
+		}
+		if ( rec->mdc ) {
+			n = ( (mdcSurface_t *)rec->surf )->numVerts;
+			LerpCMeshVertexesExt( rec->surf, rec->frame, rec->oldframe, rec->backlerp, out, out + n * 4, simd );
+		} else if ( simd ) {
+			n = ( (md3Surface_t *)rec->surf )->numVerts;
+			LerpMeshVertexes_simd( rec->surf, rec->frame, rec->oldframe, rec->backlerp, out, out + n * 4 );
+		} else {
+			n = ( (md3Surface_t *)rec->surf )->numVerts;
+			LerpMeshVertexes_scalar( rec->surf, rec->frame, rec->oldframe, rec->backlerp, out, out + n * 4 );
+		}
+		out += n * 8;
+	}
+}
+
+static void R_LerpBenchScalar( benchmark_t *b ) {
+	R_LerpBenchReplay( b->data, qfalse );
+}
+
+static void R_LerpBenchSimd( benchmark_t *b ) {
+	R_LerpBenchReplay( b->data, qtrue );
+}
+
+static float R_LerpBenchCompare( benchmark_t *b ) {
+	lerpBench_t *l = b->data;
+
+	return R_BenchCompareVertexes( l->out[0], l->out[1], l->numVerts );
+}
+
+/*
+=============
+R_LerpBench_f
+
+lerpbench record
+lerpbench [msec]
+Replays the MD3 and the MDC surfaces of a recorded frame, each with the
+frames and backlerp they were drawn with
+=============
+*/
+void R_LerpBench_f( void ) {
+	static const char *kinds[] = { "md3", "mdc" };
+	lerpBench_t l;
+	benchmark_t b;
+	int numSurfs[2], numVerts[2];
+	int i, n;
+	byte *buf;
+
+	if ( !Q_stricmp( ri.Cmd_Argv( 1 ), "record" ) ) {
+		lerpNumRecords = 0;
+		lerpRecordState = LERPREC_ARMED;
+		ri.Printf( PRINT_ALL, "recording the next frame with models in view\n" );
+		return;
+	}
+
+	memset( &b, 0, sizeof( b ) );
+	b.msec = ( ri.Cmd_Argc() > 1 ) ? atoi( ri.Cmd_Argv( 1 ) ) : 500;
+	if ( lerpRecordState != LERPREC_DONE || b.msec < 1 ) {
+		ri.Printf( PRINT_ALL, "usage: lerpbench record, then lerpbench [msec] to replay the frame\n" );
+		return;
+	}
+	__sync_synchronize();
+
+	numSurfs[0] = numSurfs[1] = 0;
+	numVerts[0] = numVerts[1] = 0;
+	for ( i = 0; i < lerpNumRecords; i++ ) {
+		n = lerpRecords[i].mdc ? ( (mdcSurface_t *)lerpRecords[i].surf )->numVerts : ( (md3Surface_t *)lerpRecords[i].surf )->numVerts;
+		numSurfs[lerpRecords[i].mdc]++;
+		numVerts[lerpRecords[i].mdc] += n;
+	}
+
+	n = MAX( numVerts[0], numVerts[1] );
+	buf = ri.Hunk_AllocateTempMemory( n * 8 * sizeof( float ) * 2 + 16 );
+	l.out[0] = (float *)PADP( buf, 16 );
+	l.out[1] = l.out[0] + n * 8;
+
+	b.unit = "vert";
+	b.scalar = R_LerpBenchScalar;
+	b.simd = R_LerpBenchSimd;
+	b.compare = R_LerpBenchCompare;
+	b.data = &l;
+
+	for ( i = 0; i < 2; i++ ) {
+		if ( !numSurfs[i] ) {
+			ri.Printf( PRINT_ALL, "no %s surfaces recorded\n", kinds[i] );
+			continue;
 		}
+		l.mdc = i;
+		l.numVerts = numVerts[i];
+		b.name = va( "%s %i surfaces", kinds[i], numSurfs[i] );
+		b.units = numVerts[i];
+		ri.Benchmark( &b );
 	}
+
+	ri.Hunk_FreeTempMemory( buf );
 }
 
 /*
@@ -1122,6 +1542,7 @@ void RB_SurfaceCMesh( mdcSurface_t *surface ) {
 
 	RB_CHECKOVERFLOW( surface->numVerts, surface->numTriangles * 3 );
 
+	RB_LerpRecord( surface, qtrue, backlerp );
 	LerpCMeshVertexes( surface, backlerp );
 
 	triangles = ( int * )( (byte *)surface + surface->ofsTriangles );
@@ -1162,6 +1583,10 @@ void RB_SurfaceFace( srfSurfaceFace_t *surf ) {
 	int numPoints;
 	int dlightBits;
 
+	if ( surf->vboFirstIndex >= 0 && RB_AddVBORange( surf->vboChunk, surf->vboFirstIndex, surf->numIndices, surf->dlightBits ) ) {
+		return;
+	}
+
 	RB_CHECKOVERFLOW( surf->numPoints, surf->numIndices );
 
 	dlightBits = surf->dlightBits;
@@ -57,7 +57,7 @@ Returns true if the grid is completely culled away.
 Also sets the clipped hint bit in tess
 =================
 */
-static qboolean R_CullGrid( srfGridMesh_t *cv ) {
+static qboolean R_CullGrid( srfGridMesh_t *cv, frontEndCounters_t *pc ) {
 	int boxCull;
 	int sphereCull;
 
@@ -73,27 +73,27 @@ static qboolean R_CullGrid( srfGridMesh_t *cv ) {
 
 	// check for trivial reject
 	if ( sphereCull == CULL_OUT ) {
-		tr.pc.c_sphere_cull_patch_out++;
+		pc->c_sphere_cull_patch_out++;
 		return qtrue;
 	}
 	// check bounding box if necessary
 	else if ( sphereCull == CULL_CLIP ) {
-		tr.pc.c_sphere_cull_patch_clip++;
+		pc->c_sphere_cull_patch_clip++;
 
 		boxCull = R_CullLocalBox( cv->meshBounds );
 
 		if ( boxCull == CULL_OUT ) {
-			tr.pc.c_box_cull_patch_out++;
+			pc->c_box_cull_patch_out++;
 			return qtrue;
 		} else if ( boxCull == CULL_IN )   {
-			tr.pc.c_box_cull_patch_in++;
+			pc->c_box_cull_patch_in++;
 		} else
 		{
-			tr.pc.c_box_cull_patch_clip++;
+			pc->c_box_cull_patch_clip++;
 		}
 	} else
 	{
-		tr.pc.c_sphere_cull_patch_in++;
+		pc->c_sphere_cull_patch_in++;
 	}
 
 	return qfalse;
@@ -110,7 +110,7 @@ added to the sorting list.
 This will also allow mirrors on both sides of a model without recursion.
 ================
 */
-static qboolean R_CullSurface( surfaceType_t *surface, shader_t *shader ) {
+static qboolean R_CullSurface( surfaceType_t *surface, shader_t *shader, frontEndCounters_t *pc ) {
 	srfSurfaceFace_t *sface;
 	float d;
 
@@ -119,7 +119,7 @@ static qboolean R_CullSurface( surfaceType_t *surface, shader_t *shader ) {
 	}
 
 	if ( *surface == SF_GRID ) {
-		return R_CullGrid( (srfGridMesh_t *)surface );
+		return R_CullGrid( (srfGridMesh_t *)surface, pc );
 	}
 
 	if ( *surface == SF_TRIANGLES ) {
@@ -159,7 +159,7 @@ static qboolean R_CullSurface( surfaceType_t *surface, shader_t *shader ) {
 }
 
 
-static int R_DlightFace( srfSurfaceFace_t *face, int dlightBits ) {
+static int R_DlightFace( srfSurfaceFace_t *face, int dlightBits, frontEndCounters_t *pc ) {
 	float d;
 	int i;
 	dlight_t    *dl;
@@ -177,14 +177,14 @@ static int R_DlightFace( srfSurfaceFace_t *face, int dlightBits ) {
 	}
 
 	if ( !dlightBits ) {
-		tr.pc.c_dlightSurfacesCulled++;
+		pc->c_dlightSurfacesCulled++;
 	}
 
 	face->dlightBits = dlightBits;
 	return dlightBits;
 }
 
-static int R_DlightGrid( srfGridMesh_t *grid, int dlightBits ) {
+static int R_DlightGrid( srfGridMesh_t *grid, int dlightBits, frontEndCounters_t *pc ) {
 	int i;
 	dlight_t    *dl;
 
@@ -205,7 +205,7 @@ static int R_DlightGrid( srfGridMesh_t *grid, int dlightBits ) {
 	}
 
 	if ( !dlightBits ) {
-		tr.pc.c_dlightSurfacesCulled++;
+		pc->c_dlightSurfacesCulled++;
 	}
 
 	grid->dlightBits = dlightBits;
@@ -255,11 +255,11 @@ that is touched by one or more dlights, so try to throw out
 more dlights if possible.
 ====================
 */
-static int R_DlightSurface( msurface_t *surf, int dlightBits ) {
+static int R_DlightSurface( msurface_t *surf, int dlightBits, frontEndCounters_t *pc ) {
 	if ( *surf->data == SF_FACE ) {
-		dlightBits = R_DlightFace( (srfSurfaceFace_t *)surf->data, dlightBits );
+		dlightBits = R_DlightFace( (srfSurfaceFace_t *)surf->data, dlightBits, pc );
 	} else if ( *surf->data == SF_GRID ) {
-		dlightBits = R_DlightGrid( (srfGridMesh_t *)surf->data, dlightBits );
+		dlightBits = R_DlightGrid( (srfGridMesh_t *)surf->data, dlightBits, pc );
 	} else if ( *surf->data == SF_TRIANGLES ) {
 		dlightBits = R_DlightTrisurf( (srfTriangles_t *)surf->data, dlightBits );
 	} else {
@@ -267,7 +267,7 @@ static int R_DlightSurface( msurface_t *surf, int dlightBits ) {
 	}
 
 	if ( dlightBits ) {
-		tr.pc.c_dlightSurfaces++;
+		pc->c_dlightSurfaces++;
 	}
 
 	return dlightBits;
@@ -275,32 +275,121 @@ static int R_DlightSurface( msurface_t *surf, int dlightBits ) {
 
 
 
+/*
+=============================================================
+
+	WORLD JOBS
+
+The BSP walk is split into subtrees that run on the job threads.
+Every thread adds its surfaces to its own bucket, a full bucket is
+flushed into the scene drawsurfs right away and the rest is merged
+before sorting, so the jobs are bound by MAX_DRAWSURFS like the
+serial walk.
+
+=============================================================
+*/
+
+#define WORLD_JOB_DEPTH     5       // up to 32 subtrees
+#define MAX_WORLD_JOBS      ( 1 << WORLD_JOB_DEPTH )
+#define WORLD_BUCKET_SURFS  2048
+
+typedef struct {
+	drawSurf_t drawSurfs[WORLD_BUCKET_SURFS];
+	int numDrawSurfs;
+	vec3_t visBounds[2];
+	frontEndCounters_t pc;
+} worldBucket_t;
+
+typedef struct {
+	mnode_t *node;
+	unsigned int planeBits;
+	unsigned int dlightBits;
+} worldJob_t;
+
+static worldBucket_t worldBuckets[MAX_JOB_THREADS];
+static worldJob_t worldJobs[MAX_WORLD_JOBS];
+static int numWorldJobs;
+
+/*
+======================
+R_FlushWorldBucket
+
+Reserves room in the scene drawsurfs and copies the bucket there,
+masked the same way R_AddDrawSurf does.  The main thread waits for
+the jobs, so only the job threads touch numDrawSurfs meanwhile.
+======================
+*/
+static void R_FlushWorldBucket( worldBucket_t *bucket ) {
+	int i, first;
+
+	first = __sync_fetch_and_add( &tr.refdef.numDrawSurfs, bucket->numDrawSurfs );
+	for ( i = 0 ; i < bucket->numDrawSurfs ; i++ ) {
+		tr.refdef.drawSurfs[( first + i ) & DRAWSURF_MASK] = bucket->drawSurfs[i];
+	}
+	bucket->numDrawSurfs = 0;
+}
+
+/*
+======================
+R_AddWorldBucketSurf
+
+Same as R_AddDrawSurf for the world entity, but thread local
+======================
+*/
+static void R_AddWorldBucketSurf( worldBucket_t *bucket, surfaceType_t *surface, shader_t *shader, int fogIndex, int dlightMap ) {
+	drawSurf_t *drawSurf;
+
+	if ( bucket->numDrawSurfs == WORLD_BUCKET_SURFS ) {
+		R_FlushWorldBucket( bucket );
+	}
+
+	drawSurf = &bucket->drawSurfs[bucket->numDrawSurfs++];
+	drawSurf->sort = ( shader->sortedIndex << QSORT_SHADERNUM_SHIFT )
+					 | ( ATI_TESS_NONE << QSORT_ATI_TESS_SHIFT )
+					 | tr.shiftedEntityNum | ( fogIndex << QSORT_FOGNUM_SHIFT ) | dlightMap;
+	drawSurf->surface = surface;
+}
+
 /*
 ======================
 R_AddWorldSurface
 ======================
 */
-static void R_AddWorldSurface( msurface_t *surf, int dlightBits ) {
-	if ( surf->viewCount == tr.viewCount ) {
+static void R_AddWorldSurface( msurface_t *surf, int dlightBits, worldBucket_t *bucket ) {
+	frontEndCounters_t *pc;
+	int viewCount;
+
+	viewCount = surf->viewCount;
+	if ( viewCount == tr.viewCount ) {
 		return;     // already in this view
 	}
 
-	surf->viewCount = tr.viewCount;
+	// surfaces spanning several leafs can be reached by more than one
+	// world job, only the one that marks it adds it
+	if ( !__sync_bool_compare_and_swap( &surf->viewCount, viewCount, tr.viewCount ) ) {
+		return;
+	}
 	// FIXME: bmodel fog?
 
+	pc = bucket ? &bucket->pc : &tr.pc;
+
 	// try to cull before dlighting or adding
-	if ( R_CullSurface( surf->data, surf->shader ) ) {
+	if ( R_CullSurface( surf->data, surf->shader, pc ) ) {
 		return;
 	}
 
 	// check for dlighting
 	if ( dlightBits ) {
-		dlightBits = R_DlightSurface( surf, dlightBits );
+		dlightBits = R_DlightSurface( surf, dlightBits, pc );
 		dlightBits = ( dlightBits != 0 );
 	}
 
 // GR - not tessellated
-	R_AddDrawSurf( surf->data, surf->shader, surf->fogIndex, dlightBits, ATI_TESS_NONE );
+	if ( bucket ) {
+		R_AddWorldBucketSurf( bucket, surf->data, surf->shader, surf->fogIndex, dlightBits );
+	} else {
+		R_AddDrawSurf( surf->data, surf->shader, surf->fogIndex, dlightBits, ATI_TESS_NONE );
+	}
 }
 
 /*
@@ -387,7 +476,7 @@ void R_AddBrushModelSurfaces( trRefEntity_t *ent ) {
 
 	for ( i = 0 ; i < bmodel->numSurfaces ; i++ ) {
 		( bmodel->firstSurface + i )->fogIndex = fognum;
-		R_AddWorldSurface( bmodel->firstSurface + i, tr.currentEntity->needDlights );
+		R_AddWorldSurface( bmodel->firstSurface + i, tr.currentEntity->needDlights, NULL );
 	}
 //----(SA) end
 }
@@ -407,62 +496,91 @@ void R_AddBrushModelSurfaces( trRefEntity_t *ent ) {
 R_RecursiveWorldNode
 ================
 */
-static void R_RecursiveWorldNode( mnode_t *node, unsigned int planeBits, unsigned int dlightBits ) {
+/*
+================
+R_CullWorldNode
 
-	do {
-		unsigned int newDlights[2];
+Returns qtrue if the node is outside of the frustum, and clears
+the planes the whole node is in front of from planeBits
+================
+*/
+static qboolean R_CullWorldNode( mnode_t *node, unsigned int *planeBits ) {
+	int i, r;
 
-		// if the node wasn't marked as potentially visible, exit
-		if ( node->visframe != tr.visCount ) {
-			return;
+	if ( r_nocull->integer ) {
+		return qfalse;
+	}
+
+	// if the bounding volume is outside the frustum, nothing
+	// inside can be visible OPTIMIZE: don't do this all the way to leafs?
+	for ( i = 0 ; i < 4 ; i++ ) {
+		if ( *planeBits & ( 1 << i ) ) {
+			r = BoxOnPlaneSide( node->mins, node->maxs, &tr.viewParms.frustum[i] );
+			if ( r == 2 ) {
+				return qtrue;                   // culled
+			}
+			if ( r == 1 ) {
+				*planeBits &= ~( 1 << i );      // all descendants will also be in front
+			}
 		}
+	}
 
-		// if the bounding volume is outside the frustum, nothing
-		// inside can be visible OPTIMIZE: don't do this all the way to leafs?
+	return qfalse;
+}
 
-		if ( !r_nocull->integer ) {
-			int r;
+/*
+================
+R_SplitNodeDlights
 
-			if ( planeBits & 1 ) {
-				r = BoxOnPlaneSide( node->mins, node->maxs, &tr.viewParms.frustum[0] );
-				if ( r == 2 ) {
-					return;                     // culled
-				}
-				if ( r == 1 ) {
-					planeBits &= ~1;            // all descendants will also be in front
-				}
-			}
+Determines which dlights are needed on each side of the node
+================
+*/
+static void R_SplitNodeDlights( mnode_t *node, unsigned int dlightBits, unsigned int newDlights[2] ) {
+	int i;
+	dlight_t    *dl;
+	float dist;
 
-			if ( planeBits & 2 ) {
-				r = BoxOnPlaneSide( node->mins, node->maxs, &tr.viewParms.frustum[1] );
-				if ( r == 2 ) {
-					return;                     // culled
-				}
-				if ( r == 1 ) {
-					planeBits &= ~2;            // all descendants will also be in front
-				}
-			}
+	newDlights[0] = 0;
+	newDlights[1] = 0;
 
-			if ( planeBits & 4 ) {
-				r = BoxOnPlaneSide( node->mins, node->maxs, &tr.viewParms.frustum[2] );
-				if ( r == 2 ) {
-					return;                     // culled
-				}
-				if ( r == 1 ) {
-					planeBits &= ~4;            // all descendants will also be in front
-				}
-			}
+	if ( !dlightBits ) {
+		return;
+	}
 
-			if ( planeBits & 8 ) {
-				r = BoxOnPlaneSide( node->mins, node->maxs, &tr.viewParms.frustum[3] );
-				if ( r == 2 ) {
-					return;                     // culled
-				}
-				if ( r == 1 ) {
-					planeBits &= ~8;            // all descendants will also be in front
-				}
+	for ( i = 0 ; i < tr.refdef.num_dlights ; i++ ) {
+		if ( dlightBits & ( 1 << i ) ) {
+			dl = &tr.refdef.dlights[i];
+			dist = DotProduct( dl->origin, node->plane->normal ) - node->plane->dist;
+
+			if ( dist > -dl->radius ) {
+				newDlights[0] |= ( 1 << i );
 			}
+			if ( dist < dl->radius ) {
+				newDlights[1] |= ( 1 << i );
+			}
+		}
+	}
+}
+
+/*
+================
+R_RecursiveWorldNode
 
+A NULL bucket adds straight to the scene from the calling thread
+================
+*/
+static void R_RecursiveWorldNode( mnode_t *node, unsigned int planeBits, unsigned int dlightBits, worldBucket_t *bucket ) {
+
+	do {
+		unsigned int newDlights[2];
+
+		// if the node wasn't marked as potentially visible, exit
+		if ( node->visframe != tr.visCount ) {
+			return;
+		}
+
+		if ( R_CullWorldNode( node, &planeBits ) ) {
+			return;
 		}
 
 		if ( node->contents != -1 ) {
@@ -471,34 +589,10 @@ static void R_RecursiveWorldNode( mnode_t *node, unsigned int planeBits, unsigne
 
 		// node is just a decision point, so go down both sides
 		// since we don't care about sort orders, just go positive to negative
-		// determine which dlights are needed
-		newDlights[0] = 0;
-		newDlights[1] = 0;
-
-		if ( dlightBits )
-		{
-			int	i;
-
-			for ( i = 0 ; i < tr.refdef.num_dlights ; i++ ) {
-				dlight_t	*dl;
-				float		dist;
-
-				if ( dlightBits & ( 1 << i ) ) {
-					dl = &tr.refdef.dlights[i];
-					dist = DotProduct( dl->origin, node->plane->normal ) - node->plane->dist;
-
-					if ( dist > -dl->radius ) {
-						newDlights[0] |= ( 1 << i );
-					}
-					if ( dist < dl->radius ) {
-						newDlights[1] |= ( 1 << i );
-					}
-				}
-			}
-		}
+		R_SplitNodeDlights( node, dlightBits, newDlights );
 
 		// recurse down the children, front side first
-		R_RecursiveWorldNode( node->children[0], planeBits, newDlights[0] );
+		R_RecursiveWorldNode( node->children[0], planeBits, newDlights[0], bucket );
 
 		// tail recurse
 		node = node->children[1];
@@ -509,31 +603,38 @@ static void R_RecursiveWorldNode( mnode_t *node, unsigned int planeBits, unsigne
 		// leaf node, so add mark surfaces
 		int c;
 		msurface_t  *surf, **mark;
+		vec3_t      *visBounds;
 
 		// RF, hack, dlight elimination above is unreliable
 		dlightBits = 0xffffffff;
 
-		tr.pc.c_leafs++;
+		if ( bucket ) {
+			bucket->pc.c_leafs++;
+			visBounds = bucket->visBounds;
+		} else {
+			tr.pc.c_leafs++;
+			visBounds = tr.viewParms.visBounds;
+		}
 
 		// add to z buffer bounds
-		if ( node->mins[0] < tr.viewParms.visBounds[0][0] ) {
-			tr.viewParms.visBounds[0][0] = node->mins[0];
+		if ( node->mins[0] < visBounds[0][0] ) {
+			visBounds[0][0] = node->mins[0];
 		}
-		if ( node->mins[1] < tr.viewParms.visBounds[0][1] ) {
-			tr.viewParms.visBounds[0][1] = node->mins[1];
+		if ( node->mins[1] < visBounds[0][1] ) {
+			visBounds[0][1] = node->mins[1];
 		}
-		if ( node->mins[2] < tr.viewParms.visBounds[0][2] ) {
-			tr.viewParms.visBounds[0][2] = node->mins[2];
+		if ( node->mins[2] < visBounds[0][2] ) {
+			visBounds[0][2] = node->mins[2];
 		}
 
-		if ( node->maxs[0] > tr.viewParms.visBounds[1][0] ) {
-			tr.viewParms.visBounds[1][0] = node->maxs[0];
+		if ( node->maxs[0] > visBounds[1][0] ) {
+			visBounds[1][0] = node->maxs[0];
 		}
-		if ( node->maxs[1] > tr.viewParms.visBounds[1][1] ) {
-			tr.viewParms.visBounds[1][1] = node->maxs[1];
+		if ( node->maxs[1] > visBounds[1][1] ) {
+			visBounds[1][1] = node->maxs[1];
 		}
-		if ( node->maxs[2] > tr.viewParms.visBounds[1][2] ) {
-			tr.viewParms.visBounds[1][2] = node->maxs[2];
+		if ( node->maxs[2] > visBounds[1][2] ) {
+			visBounds[1][2] = node->maxs[2];
 		}
 
 		// add the individual surfaces
@@ -543,13 +644,91 @@ static void R_RecursiveWorldNode( mnode_t *node, unsigned int planeBits, unsigne
 			// the surface may have already been added if it
 			// spans multiple leafs
 			surf = *mark;
-			R_AddWorldSurface( surf, dlightBits );
+			R_AddWorldSurface( surf, dlightBits, bucket );
 			mark++;
 		}
 	}
 
 }
 
+/*
+================
+R_CollectWorldJobs
+
+Walks the top of the tree, turning every visible subtree
+at WORLD_JOB_DEPTH (or leaf above it) into a job
+================
+*/
+static void R_CollectWorldJobs( mnode_t *node, unsigned int planeBits, unsigned int dlightBits, int depth ) {
+	unsigned int newDlights[2];
+	worldJob_t  *job;
+
+	if ( node->visframe != tr.visCount ) {
+		return;
+	}
+
+	if ( R_CullWorldNode( node, &planeBits ) ) {
+		return;
+	}
+
+	if ( node->contents != -1 || depth == WORLD_JOB_DEPTH ) {
+		job = &worldJobs[numWorldJobs++];
+		job->node = node;
+		job->planeBits = planeBits;
+		job->dlightBits = dlightBits;
+		return;
+	}
+
+	R_SplitNodeDlights( node, dlightBits, newDlights );
+
+	R_CollectWorldJobs( node->children[0], planeBits, newDlights[0], depth + 1 );
+	R_CollectWorldJobs( node->children[1], planeBits, newDlights[1], depth + 1 );
+}
+
+/*
+================
+R_WorldJob
+================
+*/
+static void R_WorldJob( void *data, int thread ) {
+	worldJob_t *job = (worldJob_t *)data;
+
+	R_RecursiveWorldNode( job->node, job->planeBits, job->dlightBits, &worldBuckets[thread] );
+}
+
+/*
+================
+R_MergeWorldBuckets
+
+Appends every bucket to the scene drawsurfs and folds
+the per thread bounds and counters back in
+================
+*/
+static void R_MergeWorldBuckets( void ) {
+	worldBucket_t *bucket;
+	int i;
+
+	for ( i = 0 ; i < MAX_JOB_THREADS ; i++ ) {
+		bucket = &worldBuckets[i];
+
+		R_FlushWorldBucket( bucket );
+
+		if ( bucket->pc.c_leafs ) {
+			AddPointToBounds( bucket->visBounds[0], tr.viewParms.visBounds[0], tr.viewParms.visBounds[1] );
+			AddPointToBounds( bucket->visBounds[1], tr.viewParms.visBounds[0], tr.viewParms.visBounds[1] );
+		}
+
+		tr.pc.c_leafs += bucket->pc.c_leafs;
+		tr.pc.c_dlightSurfaces += bucket->pc.c_dlightSurfaces;
+		tr.pc.c_dlightSurfacesCulled += bucket->pc.c_dlightSurfacesCulled;
+		tr.pc.c_sphere_cull_patch_in += bucket->pc.c_sphere_cull_patch_in;
+		tr.pc.c_sphere_cull_patch_clip += bucket->pc.c_sphere_cull_patch_clip;
+		tr.pc.c_sphere_cull_patch_out += bucket->pc.c_sphere_cull_patch_out;
+		tr.pc.c_box_cull_patch_in += bucket->pc.c_box_cull_patch_in;
+		tr.pc.c_box_cull_patch_clip += bucket->pc.c_box_cull_patch_clip;
+		tr.pc.c_box_cull_patch_out += bucket->pc.c_box_cull_patch_out;
+	}
+}
 
 /*
 ===============
@@ -685,6 +864,8 @@ R_AddWorldSurfaces
 =============
 */
 void R_AddWorldSurfaces( void ) {
+	int i;
+
 	if ( !r_drawworld->integer ) {
 		return;
 	}
@@ -706,5 +887,25 @@ void R_AddWorldSurfaces( void ) {
 	if ( tr.refdef.num_dlights > MAX_DLIGHTS ) {
 		tr.refdef.num_dlights = MAX_DLIGHTS ;
 	}
-	R_RecursiveWorldNode( tr.world->nodes, 15, ( 1ULL << tr.refdef.num_dlights ) - 1 );
+
+	if ( !r_worldJobs->integer || ri.JobThreads() < 2 ) {
+		R_RecursiveWorldNode( tr.world->nodes, 15, ( 1ULL << tr.refdef.num_dlights ) - 1, NULL );
+		return;
+	}
+
+	for ( i = 0 ; i < MAX_JOB_THREADS ; i++ ) {
+		worldBuckets[i].numDrawSurfs = 0;
+		ClearBounds( worldBuckets[i].visBounds[0], worldBuckets[i].visBounds[1] );
+		Com_Memset( &worldBuckets[i].pc, 0, sizeof( worldBuckets[i].pc ) );
+	}
+
+	numWorldJobs = 0;
+	R_CollectWorldJobs( tr.world->nodes, 15, ( 1ULL << tr.refdef.num_dlights ) - 1, 0 );
+
+	for ( i = 0 ; i < numWorldJobs ; i++ ) {
+		ri.AddJob( R_WorldJob, &worldJobs[i] );
+	}
+	ri.WaitJobs();
+
+	R_MergeWorldBuckets();
 }
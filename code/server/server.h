@@ -64,7 +64,6 @@ typedef struct svEntity_s {
 	int clusternums[MAX_ENT_CLUSTERS];
 	int lastCluster;                // if all the clusters don't fit in clusternums
 	int areanum, areanum2;
-	int snapshotCounter;            // used to prevent double adding from portal views
 } svEntity_t;
 
 typedef enum {
@@ -79,7 +78,6 @@ typedef struct {
 	int serverId;                       // changes each server start
 	int restartedServerId;              // serverId before a map_restart
 	int checksumFeed;                   //
-	int snapshotCounter;                // incremented for each snapshot built
 	int timeResidual;                   // <= 1000 / sv_frame->value
 	int nextFrameTime;                  // when time > nextFrameTime, process world
 	char            *configstrings[MAX_CONFIGSTRINGS];
@@ -312,6 +310,8 @@ extern cvar_t  *sv_gametype;
 extern cvar_t  *sv_pure;
 extern cvar_t  *sv_floodProtect;
 extern cvar_t  *sv_lanForceRate;
+extern cvar_t  *sv_visCache;
+extern cvar_t  *sv_snapshotJobs;
 extern cvar_t  *sv_allowAnonymous;
 extern cvar_t  *sv_banFile;
 
@@ -429,6 +429,9 @@ void SV_WriteFrameToClient( client_t *client, msg_t *msg );
 void SV_SendMessageToClient( msg_t *msg, client_t *client );
 void SV_SendClientMessages( void );
 void SV_SendClientSnapshot( client_t *client );
+void SV_InitSnapshots( void );
+void SV_VisibilityChanged( int entityNum );
+void SV_ClearVisibility( void );
 
 //
 // sv_game.c
@@ -331,7 +331,8 @@ BotImport_GetMemory
 ==================
 */
 static void *BotImport_GetMemory(int size) {
-	return malloc( size );
+	// botlib clears what it needs itself
+	return Z_TagMalloc( size, TAG_BOTLIB );
 }
 
 /*
@@ -340,7 +341,7 @@ BotImport_FreeMemory
 ==================
 */
 static void BotImport_FreeMemory(void *ptr) {
-	free( ptr );
+	Z_Free( ptr );
 }
 
 /*
@@ -349,10 +350,17 @@ BotImport_HunkAlloc
 =================
 */
 static void *BotImport_HunkAlloc( int size ) {
+	const char *label;
+	void *buf;
+
 	if ( Hunk_CheckMark() ) {
 		Com_Error( ERR_DROP, "SV_Bot_HunkAlloc: Alloc with marks already set" );
 	}
-	return Hunk_Alloc( size, h_high );
+
+	label = Hunk_SetLabel( "botlib" );
+	buf = Hunk_Alloc( size, h_high );
+	Hunk_SetLabel( label );
+	return buf;
 }
 
 /*
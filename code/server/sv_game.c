@@ -214,6 +214,7 @@ void SV_AdjustAreaPortalState( sharedEntity_t *ent, qboolean open ) {
 		return;
 	}
 	CM_AdjustAreaPortalState( svEnt->areanum, svEnt->areanum2, open );
+	SV_ClearVisibility();
 }
 
 
@@ -969,6 +970,7 @@ Called on a normal map change, not on a map_restart
 */
 void SV_InitGameProgs( void ) {
 	cvar_t  *var;
+	const char *label;
 	//FIXME these are temp while I make bots run in vm
 	extern int bot_enable;
 
@@ -979,6 +981,8 @@ void SV_InitGameProgs( void ) {
 		bot_enable = 0;
 	}
 
+	label = Hunk_SetLabel( "game" );
+
 	// load the dll or bytecode
 	gvm = VM_Create( "qagame", SV_GameSystemCalls, Cvar_VariableValue( "vm_game" ) );
 	if ( !gvm ) {
@@ -986,6 +990,8 @@ void SV_InitGameProgs( void ) {
 	}
 
 	SV_InitGameVM( qfalse );
+
+	Hunk_SetLabel( label );
 }
 
 
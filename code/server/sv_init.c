@@ -729,6 +729,8 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	Com_Printf( "------ Server Initialization ------\n" );
 	Com_Printf( "Server: %s\n",server );
 
+	Com_BeginLoadTrace( server );
+
 	// if not running a dedicated server CL_MapLoading will connect the client to the server
 	// also print some status stuff
 	CL_MapLoading();
@@ -756,8 +758,10 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 	FS_ClearPakReferences( 0 );
 
 	// allocate the snapshot entities on the hunk
+	Hunk_SetLabel( "server" );
 	svs.snapshotEntities = Hunk_Alloc( sizeof( entityState_t ) * svs.numSnapshotEntities, h_high );
 	svs.nextSnapshotEntities = 0;
+	Hunk_SetLabel( NULL );
 
 	// toggle the server bit so clients can detect that a
 	// server has changed
@@ -826,7 +830,12 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 
 	FS_Restart( sv.checksumFeed );
 
+	// start reading what the last load of the map read
+	FS_BeginLevelLoad( server );
+
+	Hunk_SetLabel( "clipmap" );
 	CM_LoadMap( va( "maps/%s.bsp", server ), qfalse, &checksum );
+	Hunk_SetLabel( NULL );
 
 	// set serverinfo visible name
 	Cvar_Set( "mapname", server );
@@ -970,6 +979,13 @@ void SV_SpawnServer( char *server, qboolean killBots ) {
 #endif
 */
 
+	Com_LoadTraceSummary( "SV_SpawnServer" );
+
+	// the client writes it when cgame is loaded too
+	if ( com_dedicated->integer ) {
+		Hunk_WriteReport( server );
+	}
+
 	Com_Printf( "-----------------------------------\n" );
 }
 
@@ -1035,6 +1051,8 @@ void SV_Init (void)
 	sv_fps = Cvar_Get( "sv_fps", "20", CVAR_TEMP );
 	sv_timeout = Cvar_Get( "sv_timeout", "120", CVAR_TEMP );
 	sv_zombietime = Cvar_Get( "sv_zombietime", "2", CVAR_TEMP );
+	sv_visCache = Cvar_Get( "sv_visCache", "1", CVAR_TEMP );
+	sv_snapshotJobs = Cvar_Get( "sv_snapshotJobs", "1", CVAR_ARCHIVE );
 	Cvar_Get( "nextmap", "", CVAR_TEMP );
 
 	sv_allowDownload = Cvar_Get( "sv_allowDownload", "1", 0 );
@@ -1057,6 +1075,8 @@ void SV_Init (void)
 
 	sv_banFile = Cvar_Get("sv_banFile", "serverbans.dat", CVAR_ARCHIVE);
 
+	SV_InitSnapshots();
+
 	// initialize bot cvars so they are listed and can be set before loading the botlib
 	SV_BotInitCvars();
 
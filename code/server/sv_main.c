@@ -64,6 +64,8 @@ cvar_t  *sv_gametype;
 cvar_t  *sv_pure;
 cvar_t  *sv_floodProtect;
 cvar_t	*sv_lanForceRate; // dedicated 1 (LAN) server forces local client rates to 99999 (bug #491)
+cvar_t  *sv_visCache;
+cvar_t  *sv_snapshotJobs;
 cvar_t  *sv_allowAnonymous;
 
 cvar_t	*sv_banFile;
@@ -29,6 +29,64 @@ If you have questions concerning this license or the applicable additional terms
 
 #include "server.h"
 
+#ifdef __vita__
+#include <vitasdk.h>
+#endif
+
+// what a client's snapshot is built from, kept until it is written
+typedef struct {
+	int numSnapshotEntities;
+	int snapshotEntities[MAX_SNAPSHOT_ENTITIES];
+	unsigned added[MAX_GENTITIES / 32];         // used to prevent double adding from portal views
+	char log[256];                              // prints held back while the snapshot jobs run
+} snapshotEntityNumbers_t;
+
+#define SV_EntityAdded( eNums, e )  ( ( eNums )->added[( e ) >> 5] & ( 1u << ( ( e ) & 31 ) ) )
+
+static snapshotEntityNumbers_t clientEntityNumbers[MAX_CLIENTS];
+static qboolean snapshotJobsRunning;
+
+/*
+=======================
+SV_SnapshotPrintf
+
+Prints from the job threads are logged per client and
+printed by SV_FlushSnapshotPrints on the main thread
+=======================
+*/
+static void QDECL SV_SnapshotPrintf( snapshotEntityNumbers_t *eNums, const char *fmt, ... ) __attribute__ ((format (printf, 2, 3)));
+static void QDECL SV_SnapshotPrintf( snapshotEntityNumbers_t *eNums, const char *fmt, ... ) {
+	va_list argptr;
+	char msg[MAXPRINTMSG];
+
+	va_start( argptr, fmt );
+	Q_vsnprintf( msg, sizeof( msg ), fmt, argptr );
+	va_end( argptr );
+
+	if ( !snapshotJobsRunning ) {
+		Com_Printf( "%s", msg );
+		return;
+	}
+
+	Q_strcat( eNums->log, sizeof( eNums->log ), msg );
+}
+
+/*
+=======================
+SV_FlushSnapshotPrints
+=======================
+*/
+static void SV_FlushSnapshotPrints( void ) {
+	int i;
+
+	for ( i = 0 ; i < sv_maxclients->integer ; i++ ) {
+		if ( clientEntityNumbers[i].log[0] ) {
+			Com_Printf( "%s", clientEntityNumbers[i].log );
+			clientEntityNumbers[i].log[0] = 0;
+		}
+	}
+}
+
 
 /*
 =============================================================================
@@ -131,6 +189,7 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 	int lastframe;
 	int i;
 	int snapFlags;
+	snapshotEntityNumbers_t *eNums = &clientEntityNumbers[client - svs.clients];
 
 	// this is the snapshot we are creating
 	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
@@ -143,7 +202,9 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 	} else if ( client->netchan.outgoingSequence - client->deltaMessage
 				>= ( PACKET_BACKUP - 3 ) ) {
 		// client hasn't gotten a good message through in a long time
-		Com_DPrintf( "%s: Delta request from out of date packet.\n", client->name );
+		if ( com_developer->integer ) {
+			SV_SnapshotPrintf( eNums, "%s: Delta request from out of date packet.\n", client->name );
+		}
 		oldframe = NULL;
 		lastframe = 0;
 	} else {
@@ -153,7 +214,9 @@ static void SV_WriteSnapshotToClient( client_t *client, msg_t *msg ) {
 
 		// the snapshot's entities may still have rolled off the buffer, though
 		if ( oldframe->first_entity <= svs.nextSnapshotEntities - svs.numSnapshotEntities ) {
-			Com_DPrintf( "%s: Delta request from out of date entities.\n", client->name );
+			if ( com_developer->integer ) {
+				SV_SnapshotPrintf( eNums, "%s: Delta request from out of date entities.\n", client->name );
+			}
 			oldframe = NULL;
 			lastframe = 0;
 		}
@@ -243,10 +306,17 @@ Build a client snapshot structure
 =============================================================================
 */
 
-typedef struct {
-	int numSnapshotEntities;
-	int snapshotEntities[MAX_SNAPSHOT_ENTITIES];
-} snapshotEntityNumbers_t;
+// snapshots are built and written on the job threads, see SV_SendClientMessages
+#ifdef __vita__
+static SceKernelLwMutexWork visLock;
+static SceKernelLwMutexWork sendLock;
+
+#define SV_Lock( l )    sceKernelLockLwMutex( &( l ), 1, NULL )
+#define SV_Unlock( l )  sceKernelUnlockLwMutex( &( l ), 1 )
+#else
+#define SV_Lock( l )
+#define SV_Unlock( l )
+#endif
 
 /*
 =======================
@@ -277,11 +347,13 @@ SV_AddEntToSnapshot
 ===============
 */
 static void SV_AddEntToSnapshot( svEntity_t *svEnt, sharedEntity_t *gEnt, snapshotEntityNumbers_t *eNums ) {
+	int e = svEnt - sv.svEntities;
+
 	// if we have already added this entity to this snapshot, don't add again
-	if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
+	if ( SV_EntityAdded( eNums, e ) ) {
 		return;
 	}
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	eNums->added[e >> 5] |= 1u << ( e & 31 );
 
 	// if we are full, silently discard entities
 	if ( eNums->numSnapshotEntities == MAX_SNAPSHOT_ENTITIES ) {
@@ -292,6 +364,233 @@ static void SV_AddEntToSnapshot( svEntity_t *svEnt, sharedEntity_t *gEnt, snapsh
 	eNums->numSnapshotEntities++;
 }
 
+/*
+=============================================================================
+
+Cached entity visibility
+
+What an entity's clusters and areas let a viewpoint see only changes when
+the entity is linked or unlinked, or when an area portal opens or closes.
+The result is kept per cluster and area of the viewpoint, so clients and
+portal views in the same place share it, and relinked entities are
+logged and replayed into the cached sets when they are used next.
+
+=============================================================================
+*/
+
+#define VIS_CACHE_SLOTS     64          // power of two, searched in sets of VIS_CACHE_WAYS
+#define VIS_CACHE_WAYS      4
+#define VIS_LOG_SIZE        1024        // power of two
+#define VIS_WORDS           ( MAX_GENTITIES / 32 )
+
+typedef struct {
+	int cluster;
+	int area;
+	int epoch;                          // 0 if unused
+	int numEntities;                    // sv.num_entities when it was built
+	unsigned logged;                    // relinks replayed
+	int used;                           // visUses when last used
+	unsigned bits[VIS_WORDS];           // entities visible from the cluster and area
+} visCacheSlot_t;
+
+static visCacheSlot_t visCache[VIS_CACHE_SLOTS];
+static int visEpoch = 1;                // bumped when the world or the area portals change
+static int visUses;
+
+static int visLog[VIS_LOG_SIZE];        // relinked entity numbers
+static unsigned visLogged;
+
+// entities every viewpoint has to look at this frame, whatever their
+// clusters: broadcast and portal entities, and in single player the ones
+// with new events and players
+static unsigned frameBits[VIS_WORDS];
+static qboolean frameBitsValid;
+
+/*
+===============
+SV_VisibilityChanged
+
+Called by SV_LinkEntity and SV_UnlinkEntity
+===============
+*/
+void SV_VisibilityChanged( int entityNum ) {
+	visLog[visLogged & ( VIS_LOG_SIZE - 1 )] = entityNum;
+	visLogged++;
+}
+
+/*
+===============
+SV_ClearVisibility
+
+Called when a new world is loaded and when area portals change state
+===============
+*/
+void SV_ClearVisibility( void ) {
+	visEpoch++;
+}
+
+/*
+===============
+SV_EntityVisibleFromCluster
+
+The PVS and area test, with nothing that depends on entity flags or the client
+===============
+*/
+static qboolean SV_EntityVisibleFromCluster( int e, int area, byte *pvs ) {
+	sharedEntity_t  *ent;
+	svEntity_t      *svEnt;
+	int i, l;
+
+	ent = SV_GentityNum( e );
+	if ( !ent->r.linked ) {
+		return qfalse;
+	}
+
+	svEnt = SV_SvEntityForGentity( ent );
+
+	// check area
+	if ( !CM_AreasConnected( area, svEnt->areanum ) ) {
+		// doors can legally straddle two areas, so
+		// we may need to check another one
+		if ( !CM_AreasConnected( area, svEnt->areanum2 ) ) {
+			return qfalse;  // blocked by a door
+		}
+	}
+
+	// check individual leafs
+	if ( !svEnt->numClusters ) {
+		return qfalse;
+	}
+	l = 0;
+	for ( i = 0 ; i < svEnt->numClusters ; i++ ) {
+		l = svEnt->clusternums[i];
+		if ( pvs[l >> 3] & ( 1 << ( l & 7 ) ) ) {
+			return qtrue;
+		}
+	}
+
+	// if we haven't found it to be visible,
+	// check overflow clusters that coudln't be stored
+	if ( !svEnt->lastCluster ) {
+		return qfalse;
+	}
+	for ( ; l <= svEnt->lastCluster ; l++ ) {
+		if ( pvs[l >> 3] & ( 1 << ( l & 7 ) ) ) {
+			break;
+		}
+	}
+	if ( l == svEnt->lastCluster ) {
+		return qfalse;
+	}
+	return qtrue;
+}
+
+/*
+===============
+SV_CopyVisibility
+
+Copies out the entities visible from cluster and area, brought up to date
+===============
+*/
+static void SV_CopyVisibility( int cluster, int area, unsigned *visible ) {
+	visCacheSlot_t  *slot, *set;
+	byte            *pvs;
+	int i, e;
+
+	SV_Lock( visLock );
+
+	set = &visCache[( (unsigned)( cluster * 31 + area ) * VIS_CACHE_WAYS ) & ( VIS_CACHE_SLOTS - 1 )];
+	slot = set;
+	for ( i = 0 ; i < VIS_CACHE_WAYS ; i++ ) {
+		if ( set[i].epoch && set[i].cluster == cluster && set[i].area == area ) {
+			slot = &set[i];
+			break;
+		}
+		if ( set[i].used < slot->used ) {
+			slot = &set[i];
+		}
+	}
+
+	slot->used = ++visUses;
+	pvs = CM_ClusterPVS( cluster );
+
+	if ( !sv_visCache->integer || slot->epoch != visEpoch || slot->cluster != cluster || slot->area != area
+		 || slot->numEntities != sv.num_entities || visLogged - slot->logged > VIS_LOG_SIZE ) {
+		slot->cluster = cluster;
+		slot->area = area;
+		slot->epoch = visEpoch;
+		slot->numEntities = sv.num_entities;
+		slot->logged = visLogged;
+		memset( slot->bits, 0, sizeof( slot->bits ) );
+		for ( e = 0 ; e < sv.num_entities ; e++ ) {
+			if ( SV_EntityVisibleFromCluster( e, area, pvs ) ) {
+				slot->bits[e >> 5] |= 1u << ( e & 31 );
+			}
+		}
+	} else {
+		// only look at the entities that were linked or unlinked since
+		for ( ; slot->logged != visLogged ; slot->logged++ ) {
+			e = visLog[slot->logged & ( VIS_LOG_SIZE - 1 )];
+			if ( e < sv.num_entities && SV_EntityVisibleFromCluster( e, area, pvs ) ) {
+				slot->bits[e >> 5] |= 1u << ( e & 31 );
+			} else {
+				slot->bits[e >> 5] &= ~( 1u << ( e & 31 ) );
+			}
+		}
+	}
+
+	memcpy( visible, slot->bits, sizeof( slot->bits ) );
+
+	SV_Unlock( visLock );
+}
+
+/*
+===============
+SV_MarkFrameEntities
+
+Finds the entities that go through SV_AddEntitiesVisibleFromPoint whatever
+their visibility, once for all the snapshots built this frame
+===============
+*/
+static void SV_MarkFrameEntities( void ) {
+	sharedEntity_t *ent;
+	int e;
+
+	memset( frameBits, 0, sizeof( frameBits ) );
+
+	for ( e = 0 ; e < sv.num_entities ; e++ ) {
+		ent = SV_GentityNum( e );
+
+		// never send entities that aren't linked in
+		if ( !ent->r.linked ) {
+			continue;
+		}
+
+		if ( ent->s.number != e ) {
+			Com_DPrintf( "FIXING ENT->S.NUMBER!!!\n" );
+			ent->s.number = e;
+		}
+
+		// entities can be flagged to explicitly not be sent to the client
+		if ( ent->r.svFlags & SVF_NOCLIENT ) {
+			continue;
+		}
+
+		if ( ent->r.svFlags & ( SVF_BROADCAST | SVF_PORTAL ) ) {
+			frameBits[e >> 5] |= 1u << ( e & 31 );
+			continue;
+		}
+
+		// events and players are sent to the local client even if they are not visible
+		if ( sv_gametype->integer == GT_SINGLE_PLAYER
+			 && ( ent->r.eventTime == svs.time || ent->s.eType == ET_PLAYER ) ) {
+			frameBits[e >> 5] |= 1u << ( e & 31 );
+		}
+	}
+
+	frameBitsValid = qtrue;
+}
+
 /*
 ===============
 SV_AddEntitiesVisibleFromPoint
@@ -301,14 +600,14 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 //									snapshotEntityNumbers_t *eNums, qboolean portal, clientSnapshot_t *oldframe, qboolean localClient ) {
 //									snapshotEntityNumbers_t *eNums, qboolean portal ) {
 											snapshotEntityNumbers_t *eNums, qboolean portal, qboolean localClient  ) {
-	int e, i;
+	int e;
 	sharedEntity_t *ent, *playerEnt;
 	svEntity_t  *svEnt;
-	int l;
 	int clientarea, clientcluster;
 	int leafnum;
-	byte    *clientpvs;
-	byte    *bitvector;
+	unsigned visible[VIS_WORDS];
+	unsigned bits, bit;
+	qboolean camera;
 
 	// during an error shutdown message we may need to transmit
 	// the shutdown message after the server has shutdown, so
@@ -324,11 +623,33 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 	// calculate the visible areas
 	frame->areabytes = CM_WriteAreaBits( frame->areabits, clientarea );
 
-	clientpvs = CM_ClusterPVS( clientcluster );
+	// copied, portals below and other threads can evict the cache slot
+	SV_CopyVisibility( clientcluster, clientarea, visible );
 
 	playerEnt = SV_GentityNum( frame->ps.clientNum );
 
+	// if this client is viewing from a camera, only add ents visible from portal ents
+	camera = ( playerEnt->s.eFlags & EF_VIEWING_CAMERA ) && !portal;
+
+	bits = 0;
 	for ( e = 0 ; e < sv.num_entities ; e++ ) {
+		// everything else can't be visible, skip it 32 entities at a time
+		if ( !( e & 31 ) ) {
+			bits = frameBits[e >> 5];
+			if ( !camera ) {
+				bits |= visible[e >> 5];
+			}
+			if ( !bits ) {
+				e += 31;
+				continue;
+			}
+		}
+
+		bit = 1u << ( e & 31 );
+		if ( !( bits & bit ) ) {
+			continue;
+		}
+
 		ent = SV_GentityNum( e );
 
 		// never send entities that aren't linked in
@@ -336,11 +657,6 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 			continue;
 		}
 
-		if ( ent->s.number != e ) {
-			Com_DPrintf( "FIXING ENT->S.NUMBER!!!\n" );
-			ent->s.number = e;
-		}
-
 		// entities can be flagged to explicitly not be sent to the client
 		if ( ent->r.svFlags & SVF_NOCLIENT ) {
 			continue;
@@ -362,12 +678,11 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 		svEnt = SV_SvEntityForGentity( ent );
 
 		// don't double add an entity through portals
-		if ( svEnt->snapshotCounter == sv.snapshotCounter ) {
+		if ( SV_EntityAdded( eNums, e ) ) {
 			continue;
 		}
 
-		// if this client is viewing from a camera, only add ents visible from portal ents
-		if ( ( playerEnt->s.eFlags & EF_VIEWING_CAMERA ) && !portal ) {
+		if ( camera ) {
 			if ( ent->r.svFlags & SVF_PORTAL ) {
 				SV_AddEntToSnapshot( svEnt, ent, eNums );
 //				SV_AddEntitiesVisibleFromPoint( ent->s.origin2, frame, eNums, qtrue, oldframe, localClient );
@@ -383,45 +698,9 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 		}
 
 		// ignore if not touching a PV leaf
-		// check area
-		if ( !CM_AreasConnected( clientarea, svEnt->areanum ) ) {
-			// doors can legally straddle two areas, so
-			// we may need to check another one
-			if ( !CM_AreasConnected( clientarea, svEnt->areanum2 ) ) {
-				goto notVisible;    // blocked by a door
-			}
-		}
-
-		bitvector = clientpvs;
-
-		// check individual leafs
-		if ( !svEnt->numClusters ) {
+		if ( !( visible[e >> 5] & bit ) ) {
 			goto notVisible;
 		}
-		l = 0;
-		for ( i = 0 ; i < svEnt->numClusters ; i++ ) {
-			l = svEnt->clusternums[i];
-			if ( bitvector[l >> 3] & ( 1 << ( l & 7 ) ) ) {
-				break;
-			}
-		}
-
-		// if we haven't found it to be visible,
-		// check overflow clusters that coudln't be stored
-		if ( i == svEnt->numClusters ) {
-			if ( svEnt->lastCluster ) {
-				for ( ; l <= svEnt->lastCluster ; l++ ) {
-					if ( bitvector[l >> 3] & ( 1 << ( l & 7 ) ) ) {
-						break;
-					}
-				}
-				if ( l == svEnt->lastCluster ) {
-					goto notVisible;    // not visible
-				}
-			} else {
-				goto notVisible;
-			}
-		}
 
 		//----(SA) added "visibility dummies"
 		if ( ent->r.svFlags & SVF_VISDUMMY ) {
@@ -434,7 +713,7 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 				svEntity_t *master = 0;
 				master = SV_SvEntityForGentity( ment );
 
-				if ( master->snapshotCounter == sv.snapshotCounter || !ment->r.linked ) {
+				if ( SV_EntityAdded( eNums, master - sv.svEntities ) || !ment->r.linked ) {
 					goto notVisible;
 					//continue;
 				}
@@ -470,7 +749,9 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 					}
 
 					if ( ment->s.number != h ) {
-						Com_DPrintf( "FIXING vis dummy multiple ment->S.NUMBER!!!\n" );
+						if ( com_developer->integer ) {
+							SV_SnapshotPrintf( eNums, "FIXING vis dummy multiple ment->S.NUMBER!!!\n" );
+						}
 						ment->s.number = h;
 					}
 
@@ -478,7 +759,7 @@ static void SV_AddEntitiesVisibleFromPoint( vec3_t origin, clientSnapshot_t *fra
 						continue;
 					}
 
-					if ( master->snapshotCounter == sv.snapshotCounter ) {
+					if ( SV_EntityAdded( eNums, h ) ) {
 						continue;
 					}
 
@@ -538,20 +819,15 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	vec3_t org;
 //	clientSnapshot_t			*frame, *oldframe;
 	clientSnapshot_t            *frame;
-	snapshotEntityNumbers_t entityNumbers;
+	snapshotEntityNumbers_t     *eNums;
 	int i;
-	sharedEntity_t              *ent;
-	entityState_t               *state;
-	svEntity_t                  *svEnt;
 	sharedEntity_t              *clent;
 	int clientNum;
 	playerState_t               *ps;
 
-	// bump the counter used to prevent double adding
-	sv.snapshotCounter++;
-
 	// this is the frame we are creating
 	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+	eNums = &clientEntityNumbers[client - svs.clients];
 
 //	// try to use a previous frame as the source for delta compressing the snapshot
 //	if ( client->deltaMessage <= 0 || client->state != CS_ACTIVE ) {
@@ -574,7 +850,8 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 //	}
 
 	// clear everything in this snapshot
-	entityNumbers.numSnapshotEntities = 0;
+	eNums->numSnapshotEntities = 0;
+	memset( eNums->added, 0, sizeof( eNums->added ) );
 	memset( frame->areabits, 0, sizeof( frame->areabits ) );
 
 	clent = client->gentity;
@@ -592,9 +869,11 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 	if ( clientNum < 0 || clientNum >= MAX_GENTITIES ) {
 		Com_Error( ERR_DROP, "SV_SvEntityForGentity: bad gEnt" );
 	}
-	svEnt = &sv.svEntities[ clientNum ];
+	eNums->added[clientNum >> 5] |= 1u << ( clientNum & 31 );
 
-	svEnt->snapshotCounter = sv.snapshotCounter;
+	if ( !frameBitsValid ) {
+		SV_MarkFrameEntities();
+	}
 
 	// find the client's viewpoint
 	VectorCopy( ps->origin, org );
@@ -613,35 +892,64 @@ static void SV_BuildClientSnapshot( client_t *client ) {
 
 	// add all the entities directly visible to the eye, which
 	// may include portal entities that merge other viewpoints
-	SV_AddEntitiesVisibleFromPoint( org, frame, &entityNumbers, qfalse, client->netchan.remoteAddress.type == NA_LOOPBACK );
+	SV_AddEntitiesVisibleFromPoint( org, frame, eNums, qfalse, client->netchan.remoteAddress.type == NA_LOOPBACK );
 //	SV_AddEntitiesVisibleFromPoint( org, frame, &entityNumbers, qfalse, oldframe, client->netchan.remoteAddress.type == NA_LOOPBACK );
 
 	// if there were portals visible, there may be out of order entities
 	// in the list which will need to be resorted for the delta compression
 	// to work correctly.  This also catches the error condition
 	// of an entity being included twice.
-	qsort( entityNumbers.snapshotEntities, entityNumbers.numSnapshotEntities,
-		   sizeof( entityNumbers.snapshotEntities[0] ), SV_QsortEntityNumbers );
+	qsort( eNums->snapshotEntities, eNums->numSnapshotEntities,
+		   sizeof( eNums->snapshotEntities[0] ), SV_QsortEntityNumbers );
 
 	// now that all viewpoint's areabits have been OR'd together, invert
 	// all of them to make it a mask vector, which is what the renderer wants
 	for ( i = 0 ; i < MAX_MAP_AREA_BYTES / 4 ; i++ ) {
 		( (int *)frame->areabits )[i] = ( (int *)frame->areabits )[i] ^ -1;
 	}
+}
+
+/*
+=============
+SV_ReserveSnapshotEntities
+
+Takes the room for the snapshot's entity states, on the main
+thread so every snapshot of the frame gets a range of its own
+=============
+*/
+static void SV_ReserveSnapshotEntities( client_t *client ) {
+	clientSnapshot_t            *frame;
 
-	// copy the entity states out
-	frame->num_entities = 0;
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+
+	frame->num_entities = clientEntityNumbers[client - svs.clients].numSnapshotEntities;
 	frame->first_entity = svs.nextSnapshotEntities;
-	for ( i = 0 ; i < entityNumbers.numSnapshotEntities ; i++ ) {
-		ent = SV_GentityNum( entityNumbers.snapshotEntities[i] );
-		state = &svs.snapshotEntities[svs.nextSnapshotEntities % svs.numSnapshotEntities];
-		*state = ent->s;
-		svs.nextSnapshotEntities++;
-		// this should never hit, map should always be restarted first in SV_Frame
-		if ( svs.nextSnapshotEntities >= 0x7FFFFFFE ) {
-			Com_Error( ERR_FATAL, "svs.nextSnapshotEntities wrapped" );
-		}
-		frame->num_entities++;
+	svs.nextSnapshotEntities += frame->num_entities;
+	// this should never hit, map should always be restarted first in SV_Frame
+	if ( svs.nextSnapshotEntities >= 0x7FFFFFFE ) {
+		Com_Error( ERR_FATAL, "svs.nextSnapshotEntities wrapped" );
+	}
+}
+
+/*
+=============
+SV_StoreSnapshotEntities
+
+Copies the entity states out into the reserved range
+=============
+*/
+static void SV_StoreSnapshotEntities( client_t *client ) {
+	clientSnapshot_t            *frame;
+	snapshotEntityNumbers_t     *eNums;
+	sharedEntity_t              *ent;
+	int i;
+
+	frame = &client->frames[ client->netchan.outgoingSequence & PACKET_MASK ];
+	eNums = &clientEntityNumbers[client - svs.clients];
+
+	for ( i = 0 ; i < frame->num_entities ; i++ ) {
+		ent = SV_GentityNum( eNums->snapshotEntities[i] );
+		svs.snapshotEntities[( frame->first_entity + i ) % svs.numSnapshotEntities] = ent->s;
 	}
 }
 
@@ -713,30 +1021,16 @@ void SV_SendMessageToClient(msg_t *msg, client_t *client)
 
 /*
 =======================
-SV_SendClientSnapshot
-
-Also called by SV_FinalMessage
+SV_WriteClientSnapshot
 
+Writes the built snapshot and sends it, the send is the only part
+that has to wait for the other threads
 =======================
 */
-void SV_SendClientSnapshot( client_t *client ) {
+static void SV_WriteClientSnapshot( client_t *client ) {
 	byte msg_buf[MAX_MSGLEN];
 	msg_t msg;
 
-	//RF, AI don't need snapshots built
-	if ( client->gentity && client->gentity->r.svFlags & SVF_CASTAI ) {
-		return;
-	}
-
-	// build the snapshot
-	SV_BuildClientSnapshot( client );
-
-	// bots need to have their snapshots build, but
-	// the query them directly without needing to be sent
-	if ( client->gentity && client->gentity->r.svFlags & SVF_BOT ) {
-		return;
-	}
-
 	MSG_Init( &msg, msg_buf, sizeof( msg_buf ) );
 	msg.allowoverflow = qtrue;
 
@@ -755,13 +1049,86 @@ void SV_SendClientSnapshot( client_t *client ) {
 	SV_WriteVoipToClient( client, &msg );
 #endif
 
+	SV_Lock( sendLock );
+
 	// check for overflow
 	if ( msg.overflowed ) {
-		Com_Printf( "WARNING: msg overflowed for %s\n", client->name );
+		SV_SnapshotPrintf( &clientEntityNumbers[client - svs.clients], "WARNING: msg overflowed for %s\n", client->name );
 		MSG_Clear( &msg );
 	}
 
 	SV_SendMessageToClient( &msg, client );
+
+	SV_Unlock( sendLock );
+}
+
+/*
+=======================
+SV_SendSnapshot
+=======================
+*/
+static void SV_SendSnapshot( client_t *client ) {
+	//RF, AI don't need snapshots built
+	if ( client->gentity && client->gentity->r.svFlags & SVF_CASTAI ) {
+		return;
+	}
+
+	// build the snapshot
+	SV_BuildClientSnapshot( client );
+	SV_ReserveSnapshotEntities( client );
+	SV_StoreSnapshotEntities( client );
+
+	// bots need to have their snapshots build, but
+	// the query them directly without needing to be sent
+	if ( client->gentity && client->gentity->r.svFlags & SVF_BOT ) {
+		return;
+	}
+
+	SV_WriteClientSnapshot( client );
+}
+
+static void SV_BuildSnapshotJob( void *data, int thread ) {
+	SV_BuildClientSnapshot( (client_t *)data );
+}
+
+static void SV_WriteSnapshotJob( void *data, int thread ) {
+	client_t *client = (client_t *)data;
+
+	SV_StoreSnapshotEntities( client );
+
+	// bots query their snapshots directly
+	if ( client->gentity && client->gentity->r.svFlags & SVF_BOT ) {
+		return;
+	}
+
+	SV_WriteClientSnapshot( client );
+}
+
+/*
+=======================
+SV_SendClientSnapshot
+
+Also called by SV_FinalMessage
+
+=======================
+*/
+void SV_SendClientSnapshot( client_t *client ) {
+	// the game may have changed entities since the last frame
+	frameBitsValid = qfalse;
+
+	SV_SendSnapshot( client );
+}
+
+/*
+=======================
+SV_InitSnapshots
+=======================
+*/
+void SV_InitSnapshots( void ) {
+#ifdef __vita__
+	sceKernelCreateLwMutex( &visLock, "sv_vis", 0, 0, NULL );
+	sceKernelCreateLwMutex( &sendLock, "sv_send", 0, 0, NULL );
+#endif
 }
 
 
@@ -774,6 +1141,14 @@ void SV_SendClientMessages(void)
 {
 	int		i;
 	client_t    *c;
+	client_t	*sendClients[MAX_CLIENTS];
+	int			numSendClients, numBuilds;
+	int			clientNum;
+
+	// entities are marked once, by the first snapshot built
+	frameBitsValid = qfalse;
+	numSendClients = 0;
+	numBuilds = 0;
 
 	// send a message to each connected client
 	for(i=0; i < sv_maxclients->integer; i++)
@@ -807,10 +1182,71 @@ void SV_SendClientMessages(void)
 			}
 		}
 
-		// generate and send a new message
-		SV_SendClientSnapshot(c);
-		c->lastSnapshotTime = svs.time;
-		c->rateDelayed = qfalse;
+		sendClients[numSendClients++] = c;
+		//RF, AI don't need snapshots built
+		if ( !( c->gentity && c->gentity->r.svFlags & SVF_CASTAI ) ) {
+			numBuilds++;
+		}
+	}
+
+	// generate and send the new messages, single player marks entities
+	// for the local client while building, which the others would copy
+	if ( sv_snapshotJobs->integer && Com_JobThreads() > 1 && numBuilds > 1
+		 && sv_gametype->integer != GT_SINGLE_PLAYER ) {
+		// every snapshot is built before any is written, deltas
+		// read the older snapshots of the entity ring, which
+		// can't be overwritten while they are read then
+		SV_MarkFrameEntities();
+
+		// Com_Error can't be raised from the job threads
+		for ( i = 0 ; i < numSendClients ; i++ ) {
+			c = sendClients[i];
+			if ( c->gentity && c->state != CS_ZOMBIE ) {
+				clientNum = SV_GameClientNum( c - svs.clients )->clientNum;
+				if ( clientNum < 0 || clientNum >= MAX_GENTITIES ) {
+					Com_Error( ERR_DROP, "SV_SvEntityForGentity: bad gEnt" );
+				}
+			}
+		}
+
+		snapshotJobsRunning = qtrue;
+		for ( i = 0 ; i < numSendClients ; i++ ) {
+			c = sendClients[i];
+			if ( !( c->gentity && c->gentity->r.svFlags & SVF_CASTAI ) ) {
+				Com_AddJob( SV_BuildSnapshotJob, c );
+			}
+		}
+		Com_WaitJobs();
+		snapshotJobsRunning = qfalse;
+		SV_FlushSnapshotPrints();
+
+		// handed out in client order, the same as the serial path
+		for ( i = 0 ; i < numSendClients ; i++ ) {
+			c = sendClients[i];
+			if ( !( c->gentity && c->gentity->r.svFlags & SVF_CASTAI ) ) {
+				SV_ReserveSnapshotEntities( c );
+			}
+		}
+
+		snapshotJobsRunning = qtrue;
+		for ( i = 0 ; i < numSendClients ; i++ ) {
+			c = sendClients[i];
+			if ( !( c->gentity && c->gentity->r.svFlags & SVF_CASTAI ) ) {
+				Com_AddJob( SV_WriteSnapshotJob, c );
+			}
+		}
+		Com_WaitJobs();
+		snapshotJobsRunning = qfalse;
+		SV_FlushSnapshotPrints();
+	} else {
+		for ( i = 0 ; i < numSendClients ; i++ ) {
+			SV_SendSnapshot( sendClients[i] );
+		}
+	}
+
+	for ( i = 0 ; i < numSendClients ; i++ ) {
+		sendClients[i]->lastSnapshotTime = svs.time;
+		sendClients[i]->rateDelayed = qfalse;
 	}
 }
 
@@ -157,6 +157,7 @@ void SV_ClearWorld( void ) {
 
 	memset( sv_worldSectors, 0, sizeof( sv_worldSectors ) );
 	sv_numworldSectors = 0;
+	SV_ClearVisibility();
 
 	// get world map bounds
 	h = CM_InlineModel( 0 );
@@ -179,6 +180,7 @@ void SV_UnlinkEntity( sharedEntity_t *gEnt ) {
 	ent = SV_SvEntityForGentity( gEnt );
 
 	gEnt->r.linked = qfalse;
+	SV_VisibilityChanged( ent - sv.svEntities );
 
 	ws = ent->worldSector;
 	if ( !ws ) {
@@ -230,6 +232,8 @@ void SV_LinkEntity( sharedEntity_t *gEnt ) {
 
 	if ( ent->worldSector ) {
 		SV_UnlinkEntity( gEnt );    // unlink from old position
+	} else {
+		SV_VisibilityChanged( ent - sv.svEntities );
 	}
 
 	// encode the size into the entityState_t for client prediction
@@ -0,0 +1,193 @@
+/*
+===========================================================================
+Copyright (C) 1999-2005 Id Software, Inc.
+
+This file is part of Quake III Arena source code.
+
+Quake III Arena source code is free software; you can redistribute it
+and/or modify it under the terms of the GNU General Public License as
+published by the Free Software Foundation; either version 2 of the License,
+or (at your option) any later version.
+
+Quake III Arena source code is distributed in the hope that it will be
+useful, but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with Quake III Arena source code; if not, write to the Free Software
+Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+===========================================================================
+*/
+
+
+// snd_null.c -- sound device without any hardware behind it
+//
+// Plays the dma buffer into nowhere at the rate of the wall clock, for
+// dedicated and headless builds.  With s_wavFile set everything the
+// "device" plays is also written to a wav file, which is enough to check
+// the mixer output without speakers.  The Vita uses psp2_snd.c instead.
+
+#ifndef __PSP2__
+
+#include "../qcommon/q_shared.h"
+#include "../qcommon/qcommon.h"
+#include "../client/snd_local.h"
+
+#define NULL_SPEED      48000
+#define NULL_SAMPLES    16384       // must be a power of two
+#define NULL_CHUNK      1024
+
+static cvar_t *s_wavFile;
+
+static short *nullBuffer;
+static int nullStartTime;
+static int nullPlayed;              // samples played since init
+
+static fileHandle_t wavFile;
+static int wavBytes;
+
+/*
+===============
+SNDDMA_WriteWavHeader
+===============
+*/
+static void SNDDMA_WriteWavHeader( void ) {
+	byte header[44];
+	int blockAlign = dma.channels * dma.samplebits / 8;
+
+	Com_Memcpy( header, "RIFF", 4 );
+	*(int *)( header + 4 ) = LittleLong( 36 + wavBytes );
+	Com_Memcpy( header + 8, "WAVEfmt ", 8 );
+	*(int *)( header + 16 ) = LittleLong( 16 );
+	*(short *)( header + 20 ) = LittleShort( 1 );                   // PCM
+	*(short *)( header + 22 ) = LittleShort( dma.channels );
+	*(int *)( header + 24 ) = LittleLong( dma.speed );
+	*(int *)( header + 28 ) = LittleLong( dma.speed * blockAlign );
+	*(short *)( header + 32 ) = LittleShort( blockAlign );
+	*(short *)( header + 34 ) = LittleShort( dma.samplebits );
+	Com_Memcpy( header + 36, "data", 4 );
+	*(int *)( header + 40 ) = LittleLong( wavBytes );
+
+	FS_Seek( wavFile, 0, FS_SEEK_SET );
+	FS_Write( header, sizeof( header ), wavFile );
+}
+
+/*
+===============
+SNDDMA_Init
+===============
+*/
+qboolean SNDDMA_Init( void ) {
+	s_wavFile = Cvar_Get( "s_wavFile", "", CVAR_LATCH );
+
+	dma.samplebits = 16;
+	dma.speed = NULL_SPEED;
+	dma.channels = 2;
+	dma.samples = NULL_SAMPLES;
+	dma.fullsamples = dma.samples / dma.channels;
+	dma.submission_chunk = NULL_CHUNK;
+	dma.isfloat = 0;
+	dma.buffer = (byte *)( nullBuffer = calloc( NULL_SAMPLES, sizeof( short ) ) );
+	if ( !nullBuffer ) {
+		return qfalse;
+	}
+
+	nullStartTime = Sys_Milliseconds();
+	nullPlayed = 0;
+
+	wavBytes = 0;
+	wavFile = 0;
+	if ( s_wavFile->string[0] ) {
+		wavFile = FS_FOpenFileWrite( s_wavFile->string );
+		if ( wavFile ) {
+			SNDDMA_WriteWavHeader();
+			Com_Printf( "Writing sound output to %s\n", s_wavFile->string );
+		} else {
+			Com_Printf( S_COLOR_YELLOW "WARNING: couldn't open %s for writing\n", s_wavFile->string );
+		}
+	}
+
+	Com_Printf( "Using the null sound device.\n" );
+	return qtrue;
+}
+
+/*
+===============
+SNDDMA_GetDMAPos
+
+Everything the clock moved past since the last call counts as played
+===============
+*/
+int SNDDMA_GetDMAPos( void ) {
+	int played, start, count;
+
+	if ( !nullBuffer ) {
+		return 0;
+	}
+
+	played = (int)( (long long)( Sys_Milliseconds() - nullStartTime ) * dma.speed / 1000 ) * dma.channels;
+
+	if ( wavFile ) {
+		// a stall longer than the buffer just loses the overwritten part
+		if ( played - nullPlayed > dma.samples ) {
+			nullPlayed = played - dma.samples;
+		}
+		while ( nullPlayed < played ) {
+			start = nullPlayed & ( dma.samples - 1 );
+			count = MIN( played - nullPlayed, dma.samples - start );
+			FS_Write( nullBuffer + start, count * sizeof( short ), wavFile );
+			wavBytes += count * sizeof( short );
+			nullPlayed += count;
+		}
+	}
+	nullPlayed = played;
+
+	return played & ( dma.samples - 1 );
+}
+
+/*
+===============
+SNDDMA_Wait
+===============
+*/
+void SNDDMA_Wait( int msec ) {
+	int chunkMsec = dma.submission_chunk * 1000 / dma.speed;
+
+	Sys_Sleep( MIN( msec, chunkMsec ) );
+}
+
+/*
+===============
+SNDDMA_Shutdown
+===============
+*/
+void SNDDMA_Shutdown( void ) {
+	if ( wavFile ) {
+		SNDDMA_WriteWavHeader();
+		FS_FCloseFile( wavFile );
+		wavFile = 0;
+	}
+
+	free( nullBuffer );
+	dma.buffer = NULL;
+	nullBuffer = NULL;
+}
+
+/*
+===============
+SNDDMA_BeginPainting
+===============
+*/
+void SNDDMA_BeginPainting( void ) {
+}
+
+/*
+===============
+SNDDMA_Submit
+===============
+*/
+void SNDDMA_Submit( void ) {
+}
+
+#endif